@@ -39,9 +39,9 @@ if [ -n "$USE_ROCKSDB" ]; then
 
     # Install RocksDB
     cd $TRAVIS_BUILD_DIR
-    wget https://github.com/facebook/rocksdb/archive/v5.7.3.tar.gz
-    tar -xzf v5.7.3.tar.gz
-    cd rocksdb-5.7.3
+    wget https://github.com/facebook/rocksdb/archive/v6.4.6.tar.gz
+    tar -xzf v6.4.6.tar.gz
+    cd rocksdb-6.4.6
     make shared_lib
     sudo make install-shared
 fi
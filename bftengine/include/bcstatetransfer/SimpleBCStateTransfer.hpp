@@ -70,14 +70,26 @@ class IAppState {
   // blockSize - the size of the new block
   virtual bool putBlock(uint64_t blockId, char *block, uint32_t blockSize) = 0;
 
-  // returns the maximal block number n such that all blocks 1 <= i <= n exist.
+  // returns the maximal block number n such that all blocks 1 <= i <= n exist,
+  // counting the pruned blocks below getFirstBlockNum().
   // if block 1 does not exist, returns 0.
   virtual uint64_t getLastReachableBlockNum() = 0;
 
+  // returns the first block that is still stored: the blocks below it were
+  // pruned, and can not be fetched from this replica.
+  virtual uint64_t getFirstBlockNum() { return 1; }
+
   // returns the maximum block number that is currently stored in
   // the application/storage layer.
   virtual uint64_t getLastBlockNum() = 0;
 
+  // called when a checkpoint of the state is created, with its last block and
+  // the digest of that block. The application/storage layer may keep a copy
+  // of its storage at that point, to bootstrap other replicas from.
+  virtual void onCheckpointCreated(uint64_t checkpointNumber,
+                                   uint64_t lastBlock,
+                                   const StateTransferDigest &digestOfLastBlock) {}
+
   // When the state is updated by the application, getLastReachableBlockNum()
   // and getLastBlockNum() should always return the same block number.
   // When that state transfer module is updating the state, then these methods
@@ -25,6 +25,11 @@ namespace bftEngine
       Disconnected
    };
 
+   // Returned by ICommunication::sendAsyncMessage when the message was not
+   // queued because the output queue of the destination is full. Nothing was
+   // sent, the caller should slow down and retry later.
+   const int SEND_REJECTED_BACKPRESSURE = -2;
+
    class IReceiver
    {
    public:
@@ -65,7 +70,8 @@ namespace bftEngine
 
       // Sends a message on the underlying communication layer to a given
       // destination node. Asynchronous (non-blocking) method.
-      // Returns 0 on success.
+      // Returns 0 on success, SEND_REJECTED_BACKPRESSURE if the message was
+      // rejected because the destination doesn't keep up.
       virtual int sendAsyncMessage(const NodeNum destNode,
                                    const char *const message,
                                    const size_t messageLength) = 0;
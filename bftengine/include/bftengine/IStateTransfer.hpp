@@ -84,9 +84,12 @@ class IReplicaForStateTransfer {
 
   virtual void freeStateTransferMsg(char *m) = 0;
 
-  virtual void sendStateTransferMessage(char *m,
-                                        uint32_t size,
-                                        uint16_t replicaId) = 0;
+  // Returns the ICommunication::sendAsyncMessage result: 0 on success,
+  // SEND_REJECTED_BACKPRESSURE if the replica should send less to replicaId
+  // for now.
+  virtual int sendStateTransferMessage(char *m,
+                                       uint32_t size,
+                                       uint16_t replicaId) = 0;
 
   // the timer is disabled when timerPeriodMilli==0
   // (notice that the state transfer module can use its own timers and threads)
@@ -31,6 +31,10 @@
 
 typedef struct sockaddr_in Addr;
 
+namespace concordMetrics {
+class Aggregator;
+}
+
 struct NodeInfo {
   std::string ip;
   std::uint16_t port;
@@ -45,7 +49,9 @@ enum CommType {
   SimpleAuthUdp,
   PlainTcp,
   SimpleAuthTcp,
-  TlsTcp
+  TlsTcp,
+  SharedMemory,
+  IoUringTcp
 };
 
 struct BaseCommConfig {
@@ -56,6 +62,8 @@ struct BaseCommConfig {
   NodeMap nodes;
   UPDATE_CONNECTIVITY_FN statusCallback;
   NodeNum selfId;
+  // where transports that have metrics report them, if set
+  std::shared_ptr<concordMetrics::Aggregator> aggregator;
 
   BaseCommConfig(CommType type,
                  std::string ip,
@@ -114,6 +122,102 @@ struct PlainTcpConfig : BaseCommConfig {
   }
 };
 
+// Plain TCP where every frame is authenticated with an HMAC and carries a
+// replay counter. Each connection, and each of its directions, has its own
+// key. Between nodes with RSA key pairs (privateKey of this node, publicKeys
+// of the others, hex encoded DER as in the replica key files), the
+// connecting node chooses the connection secret, encrypts it to the peer
+// and signs it, so a node can't forge the frames of another one.
+// authKey, if not empty, is a secret shared by all the nodes and used with
+// the nodes that have no key pair, e.g. clients. UNSAFE: any node holding it
+// can impersonate any other node on those connections. Construction fails
+// with neither a private key nor an authKey.
+struct SimpleAuthTcpConfig : PlainTcpConfig {
+  std::string privateKey;
+  std::unordered_map<NodeNum, std::string> publicKeys;
+  std::string authKey;
+
+  SimpleAuthTcpConfig(std::string ip,
+                      uint16_t port,
+                      uint32_t bufLength,
+                      NodeMap _nodes,
+                      int32_t _maxServerId,
+                      NodeNum _selfId,
+                      std::string _privateKey,
+                      std::unordered_map<NodeNum, std::string> _publicKeys,
+                      std::string _authKey = "",
+                      UPDATE_CONNECTIVITY_FN _statusCallback = nullptr) :
+      PlainTcpConfig(std::move(ip),
+                     port,
+                     bufLength,
+                     std::move(_nodes),
+                     _maxServerId,
+                     _selfId,
+                     _statusCallback),
+      privateKey{std::move(_privateKey)},
+      publicKeys{std::move(_publicKeys)},
+      authKey{std::move(_authKey)} {
+    commType = CommType::SimpleAuthTcp;
+  }
+};
+
+// TCP over io_uring (Linux >= 6.0), with the same topology as PlainTcp: a
+// node connects to the replicas with a lower id and the replicas listen.
+// Received data lands in a ring of numOfRecvBuffers buffers registered with
+// the kernel, each recvBufferSize bytes long. 0 sizes them for the largest
+// frame, bufferLength and its header, so that a frame is copied out of them
+// only when it arrives in several receives. Smaller buffers take less than
+// numOfRecvBuffers times the largest frame, but every frame larger than them
+// is reassembled, as most state transfer data would be. A peer's output
+// queue holds up to maxQueuedBytes (0 means unbounded), beyond that
+// sendAsyncMessage returns SEND_REJECTED_BACKPRESSURE.
+struct IoUringTcpConfig : PlainTcpConfig {
+  uint32_t recvBufferSize = 0;
+  uint16_t numOfRecvBuffers = 64;
+  uint64_t maxQueuedBytes = 8 * 1024 * 1024;
+
+  IoUringTcpConfig(std::string ip,
+                   uint16_t port,
+                   uint32_t bufLength,
+                   NodeMap _nodes,
+                   int32_t _maxServerId,
+                   NodeNum _selfId,
+                   UPDATE_CONNECTIVITY_FN _statusCallback = nullptr) :
+      PlainTcpConfig(std::move(ip),
+                     port,
+                     bufLength,
+                     std::move(_nodes),
+                     _maxServerId,
+                     _selfId,
+                     _statusCallback) {
+    commType = CommType::IoUringTcp;
+  }
+};
+
+enum class SendQueuePolicy {
+  // reject the new message: sendAsyncMessage returns SEND_REJECTED_BACKPRESSURE
+  Reject,
+  // make room by dropping the oldest queued messages of the same class
+  DropOldest
+};
+
+// Bounds of the output queue kept for each peer, 0 means unbounded. By
+// default, a peer that doesn't read holds up to 8MB, as with
+// IoUringTcpConfig::maxQueuedBytes. A message alone is always accepted,
+// whatever its size.
+// Consensus messages are retransmitted by the engine when needed, so by
+// default new ones push the oldest out. State transfer messages are rejected
+// instead, which lets the state transfer module slow down. Whatever the
+// policies, a consensus message that doesn't fit first evicts the oldest
+// queued state transfer messages, so that bulk block data can't starve the
+// consensus.
+struct SendQueueConfig {
+  uint32_t maxMessages = 0;
+  uint64_t maxBytes = 8 * 1024 * 1024;
+  SendQueuePolicy consensusPolicy = SendQueuePolicy::DropOldest;
+  SendQueuePolicy stateTransferPolicy = SendQueuePolicy::Reject;
+};
+
 struct TlsTcpConfig : PlainTcpConfig {
   std::string certificatesRootPath;
 
@@ -121,6 +225,8 @@ struct TlsTcpConfig : PlainTcpConfig {
   // https://www.openssl.org/docs/man1.0.2/man1/ciphers.html
   std::string cipherSuite;
 
+  SendQueueConfig sendQueue;
+
   TlsTcpConfig(std::string ip,
                uint16_t port,
                uint32_t bufLength,
@@ -143,6 +249,29 @@ struct TlsTcpConfig : PlainTcpConfig {
   }
 };
 
+// In-process transport: all the nodes must live in the same process. The IP
+// and port fields of the node map are only used for status reporting.
+struct SharedMemoryConfig : BaseCommConfig {
+  // capacity (in bytes) of each per-pair and per-message-class ring, rounded
+  // up to a power of 2. 0 means "a few times bufferLength".
+  uint32_t ringCapacity;
+
+  SharedMemoryConfig(uint32_t bufLength,
+                     NodeMap _nodes,
+                     NodeNum _selfId,
+                     uint32_t _ringCapacity = 0,
+                     UPDATE_CONNECTIVITY_FN _statusCallback = nullptr) :
+      BaseCommConfig(CommType::SharedMemory,
+                     "",
+                     0,
+                     bufLength,
+                     std::move(_nodes),
+                     _selfId,
+                     _statusCallback),
+      ringCapacity{_ringCapacity} {
+  }
+};
+
 class PlainUDPCommunication : public ICommunication {
  public:
   static PlainUDPCommunication *create(const PlainUdpConfig &config);
@@ -222,6 +351,58 @@ class TlsTCPCommunication : public ICommunication {
 
   explicit TlsTCPCommunication(const TlsTcpConfig &config);
 };
+
+class SharedMemoryCommunication : public ICommunication {
+ public:
+  static SharedMemoryCommunication *create(const SharedMemoryConfig &config);
+
+  int getMaxMessageSize() override;
+  int Start() override;
+  int Stop() override;
+  bool isRunning() const override;
+  ConnectionStatus getCurrentConnectionStatus(
+      const NodeNum node) const override;
+
+  int sendAsyncMessage(const NodeNum destNode,
+                       const char *const message,
+                       const size_t messageLength) override;
+
+  void setReceiver(NodeNum receiverNum,
+                   IReceiver *receiver) override;
+
+  virtual ~SharedMemoryCommunication();
+ private:
+  class SharedMemoryImpl;
+  std::unique_ptr<SharedMemoryImpl> _ptrImpl;
+
+  explicit SharedMemoryCommunication(const SharedMemoryConfig &config);
+};
+
+class IoUringTcpCommunication : public ICommunication {
+ public:
+  static IoUringTcpCommunication *create(const IoUringTcpConfig &config);
+
+  int getMaxMessageSize() override;
+  int Start() override;
+  int Stop() override;
+  bool isRunning() const override;
+  ConnectionStatus getCurrentConnectionStatus(
+      const NodeNum node) const override;
+
+  int sendAsyncMessage(const NodeNum destNode,
+                       const char *const message,
+                       const size_t messageLength) override;
+
+  void setReceiver(NodeNum receiverNum,
+                   IReceiver *receiver) override;
+
+  virtual ~IoUringTcpCommunication();
+ private:
+  class IoUringTcpImpl;
+  std::unique_ptr<IoUringTcpImpl> _ptrImpl;
+
+  explicit IoUringTcpCommunication(const IoUringTcpConfig &config);
+};
 }
 
 #endif //BYZ_COMMDEFS_HPP
@@ -22,6 +22,7 @@
 #include "STDigest.hpp"
 #include "InMemoryDataStore.hpp"
 #include "assertUtils.hpp"
+#include "ICommunication.hpp"
 
 // TODO(GG): for debugging - remove
 // #define DEBUG_SEND_CHECKPOINTS_IN_REVERSE_ORDER (1)
@@ -175,6 +176,7 @@ BCStateTran::BCStateTran(
       metrics_component_.RegisterCounter("sent_fetch_res_pages_msg"),
       metrics_component_.RegisterCounter("sent_reject_fetch_msg"),
       metrics_component_.RegisterCounter("sent_item_data_msg"),
+      metrics_component_.RegisterCounter("item_data_msg_backpressure"),
 
       metrics_component_.RegisterCounter("received_ask_for_checkpoint_summaries_msg"),
       metrics_component_.RegisterCounter("received_checkpoint_summary_msg"),
@@ -471,6 +473,8 @@ void BCStateTran::createCheckpointOfCurrentState(uint64_t checkpointNumber) {
   auto checkDesc = createCheckpointDesc(checkpointNumber, digestOfResPagesDescriptor);
   psd_->setCheckpointDesc(checkpointNumber, checkDesc);
   deleteOldCheckpoints(checkpointNumber);
+  as_->onCheckpointCreated(checkpointNumber, checkDesc.lastBlock,
+                           *reinterpret_cast<const StateTransferDigest *>(&checkDesc.digestOfLastBlock));
 }
 
 void BCStateTran::markCheckpointAsStable(uint64_t checkpointNumber) {
@@ -1135,9 +1139,11 @@ bool BCStateTran::onMessage(const FetchBlocksMsg *m, uint32_t msgLen, uint16_t r
 
   FetchingState fs = getFetchingState();
 
-  // if msg should be rejected
+  // if msg should be rejected (the blocks before the first one are pruned,
+  // another replica may still have them)
   if (fs != FetchingState::NotFetching ||
-      m->lastRequiredBlock > as_->getLastReachableBlockNum()) {
+      m->lastRequiredBlock > as_->getLastReachableBlockNum() ||
+      m->firstRequiredBlock < as_->getFirstBlockNum()) {
     RejectFetchingMsg outMsg;
     outMsg.requestMsgSeqNum = m->msgSeqNum;
 
@@ -1198,9 +1204,18 @@ bool BCStateTran::onMessage(const FetchBlocksMsg *m, uint32_t msgLen, uint16_t r
         << " dataSize" << outMsg->dataSize << " )");
 
     metrics_.sent_item_data_msg_.Get().Inc();
-    replicaForStateTransfer_->sendStateTransferMessage(reinterpret_cast<char *>(outMsg), outMsg->size(), replicaId);
+    int res = replicaForStateTransfer_->sendStateTransferMessage(reinterpret_cast<char *>(outMsg),
+                                                                 outMsg->size(), replicaId);
 
     ItemDataMsg::free(outMsg);
+
+    // the link to the destination is congested: stop this batch, the
+    // destination will ask again for the chunks it misses
+    if (res == SEND_REJECTED_BACKPRESSURE) {
+      LOG_DEBUG(STLogger, "Backpressure from replica " << replicaId << ", stopped sending chunks");
+      metrics_.item_data_msg_backpressure_.Get().Inc();
+      break;
+    }
     numOfSentChunks++;
 
     // if we've already sent enough chunks
@@ -1339,11 +1354,18 @@ bool BCStateTran::onMessage(const FetchResPagesMsg *m, uint32_t msgLen, uint16_t
         << " dataSize" << outMsg->dataSize << " )");
     metrics_.sent_item_data_msg_.Get().Inc();
 
-    replicaForStateTransfer_->sendStateTransferMessage(
+    int res = replicaForStateTransfer_->sendStateTransferMessage(
         reinterpret_cast<char *>(outMsg),
         outMsg->size(), replicaId);
 
     ItemDataMsg::free(outMsg);
+
+    // see onMessage(const FetchBlocksMsg *...)
+    if (res == SEND_REJECTED_BACKPRESSURE) {
+      LOG_DEBUG(STLogger, "Backpressure from replica " << replicaId << ", stopped sending chunks");
+      metrics_.item_data_msg_backpressure_.Get().Inc();
+      break;
+    }
     numOfSentChunks++;
 
     // if we've already sent enough chunks
@@ -2168,7 +2190,7 @@ bool BCStateTran::checkConsistency(bool checkAllBlocks) {
   const uint64_t lastReachableBlockNum = as_->getLastReachableBlockNum();
 
   if (checkAllBlocks && lastReachableBlockNum > 0) {
-    for (uint64_t currBlock = lastReachableBlockNum - 1; currBlock >= 1; currBlock--) {
+    for (uint64_t currBlock = lastReachableBlockNum - 1; currBlock >= as_->getFirstBlockNum(); currBlock--) {
       STDigest currDigest;
       {
         uint32_t blockSize = 0;
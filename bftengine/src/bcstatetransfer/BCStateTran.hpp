@@ -379,6 +379,7 @@ class BCStateTran : public IStateTransfer {
     CounterHandle sent_fetch_res_pages_msg_;
     CounterHandle sent_reject_fetch_msg_;
     CounterHandle sent_item_data_msg_;
+    CounterHandle item_data_msg_backpressure_;
 
     CounterHandle received_ask_for_checkpoint_summaries_msg_;
     CounterHandle received_checkpoint_summary_msg_;
@@ -165,7 +165,7 @@ void ReplicaImp::onReportAboutInvalidMessage(MessageBase *msg) {
   // TODO(GG): logic that deals with invalid messages (e.g., a node that sends invalid messages may have a problem (old version,bug,malicious,...)).
 }
 
-void ReplicaImp::send(MessageBase *m, NodeIdType dest) {
+int ReplicaImp::send(MessageBase *m, NodeIdType dest) {
   // debug code begin
 
   if (m->type() == MsgCode::Checkpoint) {
@@ -176,7 +176,7 @@ void ReplicaImp::send(MessageBase *m, NodeIdType dest) {
 
   // debug code end
 
-  sendRaw(m->body(), dest, m->type(), m->size());
+  return sendRaw(m->body(), dest, m->type(), m->size());
 }
 
 void ReplicaImp::sendToAllOtherReplicas(MessageBase *m) {
@@ -184,13 +184,15 @@ void ReplicaImp::sendToAllOtherReplicas(MessageBase *m) {
     sendRaw(m->body(), dest, m->type(), m->size());
 }
 
-void ReplicaImp::sendRaw(char *m, NodeIdType dest, uint16_t type, MsgSize size) {
+int ReplicaImp::sendRaw(char *m, NodeIdType dest, uint16_t type, MsgSize size) {
   int errorCode = 0;
 
   if (dest == ALL_OTHER_REPLICAS) {
-    for (ReplicaId d : repsInfo->idsOfPeerReplicas())
-      sendRaw(m, d, type, size);
-    return;
+    for (ReplicaId d : repsInfo->idsOfPeerReplicas()) {
+      int res = sendRaw(m, d, type, size);
+      if (res != 0) errorCode = res;
+    }
+    return errorCode;
   }
 
   if (debugStatisticsEnabled) {
@@ -199,12 +201,18 @@ void ReplicaImp::sendRaw(char *m, NodeIdType dest, uint16_t type, MsgSize size)
 
   errorCode = communication->sendAsyncMessage(dest, m, size);
 
-  if (errorCode != 0) {
+  if (errorCode == SEND_REJECTED_BACKPRESSURE) {
+    LOG_DEBUG_F(GL,
+                "In ReplicaImp::sendRaw - message type %d to node %d rejected, destination queue is full",
+                (int) type,
+                (int) dest);
+  } else if (errorCode != 0) {
     LOG_ERROR_F(GL,
                 "In ReplicaImp::sendRaw - communication->sendAsyncMessage returned error %d for message type %d",
                 errorCode,
                 (int) type);
   }
+  return errorCode;
 }
 
 IncomingMsg ReplicaImp::recvMsg() {
@@ -2691,20 +2699,22 @@ void ReplicaImp::freeStateTransferMsg(char *m) {
   std::free(p);
 }
 
-void ReplicaImp::sendStateTransferMessage(char *m, uint32_t size, uint16_t replicaId) {
+int ReplicaImp::sendStateTransferMessage(char *m, uint32_t size, uint16_t replicaId) {
   // This method may be called by external threads
   // TODO(GG): if this method is invoked by an external thread, then send an "internal message" to the replica's main thread
 
+  int res = 0;
   if (mainThread.get_id() == std::this_thread::get_id()) {
     MessageBase *p = new MessageBase(myReplicaId, MsgCode::StateTransfer, size + sizeof(MessageBase::Header));
     char *x = p->body() + sizeof(MessageBase::Header);
     memcpy(x, m, size);
-    send(p, replicaId);
+    res = send(p, replicaId);
     delete p;
   } else {
     //TODO(GG): implement
     Assert(false);
   }
+  return res;
 }
 
 void ReplicaImp::onTransferringComplete(int64_t checkpointNumberOfNewState) {
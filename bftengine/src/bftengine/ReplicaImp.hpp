@@ -313,7 +313,7 @@ namespace bftEngine
 
 			// IReplicaForStateTransfer
 			virtual void freeStateTransferMsg(char* m) override;
-			virtual void sendStateTransferMessage(char* m, uint32_t size, uint16_t replicaId) override;
+			virtual int sendStateTransferMessage(char* m, uint32_t size, uint16_t replicaId) override;
 			virtual void onTransferringComplete(int64_t checkpointNumberOfNewState) override;
 			virtual void changeStateTransferTimerPeriod(uint32_t timerPeriodMilli) override;
 
@@ -336,9 +336,9 @@ namespace bftEngine
 			bool isCurrentPrimary() const { return (currentPrimary() == myReplicaId); }
 
 			static const uint16_t ALL_OTHER_REPLICAS = UINT16_MAX;
-			void send(MessageBase* m, NodeIdType dest);
+			int send(MessageBase* m, NodeIdType dest);
 			void sendToAllOtherReplicas(MessageBase *m);
-			void sendRaw(char* m, NodeIdType dest, uint16_t type, MsgSize size);
+			int sendRaw(char* m, NodeIdType dest, uint16_t type, MsgSize size);
 
 			bool tryToEnterView();
 			void onNewView(const std::vector<PrePrepareMsg*>& prePreparesForNewView);
@@ -20,8 +20,11 @@
 using bftEngine::CommFactory;
 using bftEngine::CommType;
 using bftEngine::ICommunication;
+using bftEngine::IoUringTcpConfig;
 using bftEngine::PlainTcpConfig;
 using bftEngine::PlainUdpConfig;
+using bftEngine::SharedMemoryConfig;
+using bftEngine::SimpleAuthTcpConfig;
 using bftEngine::TlsTcpConfig;
 
 concordlogger::Logger CommFactory::_logger =
@@ -48,6 +51,12 @@ CommFactory::create(const BaseCommConfig &config) {
 #endif
     break;
   case CommType::SimpleAuthTcp:
+#ifdef USE_COMM_PLAIN_TCP
+    LOG_INFO(_logger, "Using SimpleAuthTCP: " << "IP=" << config.listenIp <<
+                      ", Port=" << config.listenPort);
+    res = PlainTCPCommunication::create(
+      dynamic_cast<const SimpleAuthTcpConfig&>(config));
+#endif
     break;
   case CommType::TlsTcp:
 #ifdef USE_COMM_TLS_TCP
@@ -55,6 +64,19 @@ CommFactory::create(const BaseCommConfig &config) {
                       ", Port=" << config.listenPort);
     res = TlsTCPCommunication::create(
       dynamic_cast<const TlsTcpConfig&>(config));
+#endif
+    break;
+  case CommType::SharedMemory:
+    LOG_INFO(_logger, "Using SharedMemory: " << "Node=" << config.selfId);
+    res = SharedMemoryCommunication::create(
+      dynamic_cast<const SharedMemoryConfig&>(config));
+    break;
+  case CommType::IoUringTcp:
+#ifdef USE_COMM_IO_URING
+    LOG_INFO(_logger, "Using IoUringTCP: " << "IP=" << config.listenIp <<
+                      ", Port=" << config.listenPort);
+    res = IoUringTcpCommunication::create(
+      dynamic_cast<const IoUringTcpConfig&>(config));
 #endif
     break;
   }
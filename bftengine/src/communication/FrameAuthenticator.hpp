@@ -0,0 +1,532 @@
+// Concord
+//
+// Copyright (c) 2019 VMware, Inc. All Rights Reserved.
+//
+// This product is licensed to you under the Apache 2.0 license (the "License").
+// You may not use this product except in compliance with the Apache 2.0
+// License.
+//
+// This product may include a number of subcomponents with separate copyright
+// notices and license terms. Your use of these subcomponents is subject to the
+// terms and conditions of the subcomponent's license, as noted in the LICENSE
+// file.
+
+#ifndef BFTENGINE_SRC_COMMUNICATION_FRAMEAUTHENTICATOR_HPP_
+#define BFTENGINE_SRC_COMMUNICATION_FRAMEAUTHENTICATOR_HPP_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+#include "CommDefs.hpp"
+
+namespace bftEngine {
+
+// first 4 bytes - message length, next 2 bytes - message type
+static constexpr uint8_t LENGTH_FIELD_SIZE = 4;
+static constexpr uint8_t MSGTYPE_FIELD_SIZE = 2;
+
+// SimpleAuthTcp frames carry, after the message type, an 8 bytes counter and
+// end with an HMAC-SHA256 of the receiver's session nonce, the type, the
+// counter and the payload:
+// | length (4) | type (2) | counter (8) | payload | mac (32) |
+static constexpr uint8_t AUTH_COUNTER_FIELD_SIZE = 8;
+static constexpr uint8_t AUTH_MAC_FIELD_SIZE = 32;
+static constexpr uint8_t AUTH_FRAME_OVERHEAD =
+    AUTH_COUNTER_FIELD_SIZE + AUTH_MAC_FIELD_SIZE;
+static constexpr uint8_t AUTH_NONCE_FIELD_SIZE = sizeof(uint64_t);
+// room for the encrypted secret and the signature of RSA keys up to 8192 bits
+static constexpr uint32_t AUTH_MAX_HELLO_SIZE = 2200;
+
+/** Key material of a SimpleAuthTcp node, shared by all its connections and
+ * not modified after construction.
+ * A node with a key pair, as in the replica key files (hex encoded DER, like
+ * ReplicaConfig holds them), authenticates its connections to the other
+ * nodes with a key pair: the connecting node draws a secret for the
+ * connection, encrypts it to the public key of the peer and signs it with its
+ * own private key. No other node can then compute the keys of the
+ * connection. Connections to or from nodes without a key pair, such as
+ * clients, can only use the secret shared by all the nodes, if any; a node
+ * holding it can forge the frames of any other node on those connections.
+ */
+class FrameAuthenticator {
+ private:
+  const NodeNum _selfId;
+  NodeMap _nodes;
+  EVP_PKEY *_privateKey = nullptr;
+  std::unordered_map<NodeNum, EVP_PKEY *> _publicKeys;
+  const std::string _sharedSecret;
+
+  static std::string from_hex(const std::string &hex) {
+    if (hex.size() % 2 != 0) {
+      throw std::invalid_argument("odd length hex key");
+    }
+    std::string res(hex.size() / 2, '\0');
+    for (size_t i = 0; i < res.size(); ++i) {
+      res[i] = static_cast<char>(std::stoi(hex.substr(2 * i, 2), nullptr, 16));
+    }
+    return res;
+  }
+
+  static EVP_PKEY *check_rsa(EVP_PKEY *key, const char *what) {
+    if (!key || EVP_PKEY_base_id(key) != EVP_PKEY_RSA) {
+      EVP_PKEY_free(key);
+      throw std::invalid_argument(std::string("invalid RSA ") + what);
+    }
+    return key;
+  }
+
+  void free_keys() {
+    EVP_PKEY_free(_privateKey);
+    for (auto &it : _publicKeys) {
+      EVP_PKEY_free(it.second);
+    }
+  }
+
+ public:
+  /** 'privateKey' is the one of this node and 'publicKeys' those of the
+   * nodes with a key pair, all hex encoded. 'sharedSecret', if not empty, is
+   * used with the nodes without one. Throws std::invalid_argument for keys
+   * that can't be read, or if the node has neither a private key nor a
+   * shared secret.
+   */
+  FrameAuthenticator(NodeNum selfId,
+                     const NodeMap &nodes,
+                     const std::string &privateKey,
+                     const std::unordered_map<NodeNum, std::string> &publicKeys,
+                     const std::string &sharedSecret) :
+      _selfId{selfId},
+      _nodes{nodes},
+      _sharedSecret{sharedSecret} {
+    if (privateKey.empty() && sharedSecret.empty()) {
+      throw std::invalid_argument(
+          "SimpleAuthTcp needs a key pair or a shared secret");
+    }
+    try {
+      if (!privateKey.empty()) {
+        std::string der = from_hex(privateKey);
+        auto p = reinterpret_cast<const unsigned char *>(der.data());
+        _privateKey = check_rsa(
+            d2i_AutoPrivateKey(nullptr, &p, static_cast<long>(der.size())),
+            "private key");
+      }
+      for (auto &it : publicKeys) {
+        std::string der = from_hex(it.second);
+        auto p = reinterpret_cast<const unsigned char *>(der.data());
+        _publicKeys[it.first] = check_rsa(
+            d2i_PUBKEY(nullptr, &p, static_cast<long>(der.size())),
+            "public key");
+      }
+    } catch (...) {
+      free_keys();
+      throw;
+    }
+  }
+
+  FrameAuthenticator(const FrameAuthenticator &) = delete;
+  FrameAuthenticator &operator=(const FrameAuthenticator &) = delete;
+
+  ~FrameAuthenticator() {
+    free_keys();
+  }
+
+  NodeNum self_id() const {
+    return _selfId;
+  }
+
+  // Whether the connections with 'peer' are authenticated with key pairs.
+  bool uses_key_pairs(NodeNum peer) const {
+    return _privateKey && _publicKeys.count(peer) > 0;
+  }
+
+  // Whether frames can be exchanged with 'peer' at all.
+  bool knows(NodeNum peer) const {
+    return peer != _selfId && _nodes.count(peer) > 0 &&
+        (uses_key_pairs(peer) || !_sharedSecret.empty());
+  }
+
+  // Encrypts 'secret' to the public key of 'dest', with RSA-OAEP.
+  bool seal_secret(NodeNum dest, const std::string &secret,
+                   std::string &sealed) const {
+    auto it = _publicKeys.find(dest);
+    if (it == _publicKeys.end()) {
+      return false;
+    }
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new(it->second, nullptr);
+    size_t length = 0;
+    bool res = ctx && EVP_PKEY_encrypt_init(ctx) == 1 &&
+        EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_OAEP_PADDING) == 1 &&
+        EVP_PKEY_CTX_set_rsa_oaep_md(ctx, EVP_sha256()) == 1 &&
+        EVP_PKEY_encrypt(ctx, nullptr, &length,
+                         reinterpret_cast<const unsigned char *>(secret.data()),
+                         secret.size()) == 1;
+    if (res) {
+      sealed.resize(length);
+      res = EVP_PKEY_encrypt(ctx, reinterpret_cast<unsigned char *>(&sealed[0]),
+                             &length,
+                             reinterpret_cast<const unsigned char *>(
+                                 secret.data()),
+                             secret.size()) == 1;
+      sealed.resize(length);
+    }
+    EVP_PKEY_CTX_free(ctx);
+    return res;
+  }
+
+  // Decrypts a secret sealed to the public key of this node.
+  bool unseal_secret(const std::string &sealed, std::string &secret) const {
+    if (!_privateKey) {
+      return false;
+    }
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new(_privateKey, nullptr);
+    size_t length = 0;
+    bool res = ctx && EVP_PKEY_decrypt_init(ctx) == 1 &&
+        EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_OAEP_PADDING) == 1 &&
+        EVP_PKEY_CTX_set_rsa_oaep_md(ctx, EVP_sha256()) == 1 &&
+        EVP_PKEY_decrypt(ctx, nullptr, &length,
+                         reinterpret_cast<const unsigned char *>(sealed.data()),
+                         sealed.size()) == 1;
+    if (res) {
+      secret.resize(length);
+      res = EVP_PKEY_decrypt(ctx, reinterpret_cast<unsigned char *>(&secret[0]),
+                             &length,
+                             reinterpret_cast<const unsigned char *>(
+                                 sealed.data()),
+                             sealed.size()) == 1;
+      secret.resize(length);
+    }
+    EVP_PKEY_CTX_free(ctx);
+    return res;
+  }
+
+  // Signs 'data' with the private key of this node, RSA PKCS#1 v1.5 SHA-256.
+  bool sign(const std::string &data, std::string &signature) const {
+    if (!_privateKey) {
+      return false;
+    }
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    size_t length = 0;
+    bool res = ctx &&
+        EVP_DigestSignInit(ctx, nullptr, EVP_sha256(), nullptr,
+                           _privateKey) == 1 &&
+        EVP_DigestSignUpdate(ctx, data.data(), data.size()) == 1 &&
+        EVP_DigestSignFinal(ctx, nullptr, &length) == 1;
+    if (res) {
+      signature.resize(length);
+      res = EVP_DigestSignFinal(
+          ctx, reinterpret_cast<unsigned char *>(&signature[0]), &length) == 1;
+      signature.resize(length);
+    }
+    EVP_MD_CTX_free(ctx);
+    return res;
+  }
+
+  // Checks a signature of 'source' on 'data'.
+  bool verify(NodeNum source, const std::string &data,
+              const std::string &signature) const {
+    auto it = _publicKeys.find(source);
+    if (it == _publicKeys.end()) {
+      return false;
+    }
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    bool res = ctx &&
+        EVP_DigestVerifyInit(ctx, nullptr, EVP_sha256(), nullptr,
+                             it->second) == 1 &&
+        EVP_DigestVerifyUpdate(ctx, data.data(), data.size()) == 1 &&
+        EVP_DigestVerifyFinal(
+            ctx, reinterpret_cast<const unsigned char *>(signature.data()),
+            signature.size()) == 1;
+    EVP_MD_CTX_free(ctx);
+    return res;
+  }
+
+  const std::string &shared_secret() const {
+    return _sharedSecret;
+  }
+};
+
+typedef std::shared_ptr<FrameAuthenticator> AUTHENTICATOR_PTR;
+
+/** Authentication state of a single connection, guarded by its owner.
+ * The accepting node sends a random nonce, the challenge. The connecting
+ * node answers with a hello carrying its id, its own nonce and, with key
+ * pairs, the secret of the connection encrypted to the accepting node and
+ * signed along with the challenge. Each direction of the connection then has
+ * its own key, HMAC(secret, label | from | to); the secret is the shared one
+ * for nodes without key pairs. Every MAC also covers the nonce of the
+ * receiver, so frames recorded on another connection, even before a restart
+ * of either node, fail on this one. Within a connection, a frame is accepted
+ * only if its counter is greater than the last accepted one.
+ */
+class FrameSession {
+ private:
+  /** HMAC-SHA256 with the key-dependent inner and outer hash states
+   * computed once, so that a MAC costs two hash copies instead of a full
+   * HMAC setup.
+   */
+  class PairKey {
+   private:
+    EVP_MD_CTX *_inner;
+    EVP_MD_CTX *_outer;
+    EVP_MD_CTX *_work;
+
+   public:
+    explicit PairKey(const std::string &key) :
+        _inner{EVP_MD_CTX_new()},
+        _outer{EVP_MD_CTX_new()},
+        _work{EVP_MD_CTX_new()} {
+      static constexpr size_t BLOCK_SIZE = 64;
+      unsigned char ipad[BLOCK_SIZE];
+      unsigned char opad[BLOCK_SIZE];
+      memset(ipad, 0x36, BLOCK_SIZE);
+      memset(opad, 0x5c, BLOCK_SIZE);
+      // derived keys are 32 bytes long, shorter than a SHA-256 block
+      for (size_t i = 0; i < key.size(); ++i) {
+        ipad[i] ^= static_cast<unsigned char>(key[i]);
+        opad[i] ^= static_cast<unsigned char>(key[i]);
+      }
+      EVP_DigestInit_ex(_inner, EVP_sha256(), nullptr);
+      EVP_DigestUpdate(_inner, ipad, BLOCK_SIZE);
+      EVP_DigestInit_ex(_outer, EVP_sha256(), nullptr);
+      EVP_DigestUpdate(_outer, opad, BLOCK_SIZE);
+    }
+
+    PairKey(const PairKey &) = delete;
+    PairKey &operator=(const PairKey &) = delete;
+
+    ~PairKey() {
+      EVP_MD_CTX_free(_inner);
+      EVP_MD_CTX_free(_outer);
+      EVP_MD_CTX_free(_work);
+    }
+
+    // MAC of the nonce followed by 'length' bytes of 'data'
+    void mac(uint64_t nonce, const char *data, uint32_t length, char *out) {
+      unsigned char innerHash[EVP_MAX_MD_SIZE];
+      unsigned int hashLength = 0;
+      EVP_MD_CTX_copy_ex(_work, _inner);
+      EVP_DigestUpdate(_work, &nonce, sizeof(nonce));
+      EVP_DigestUpdate(_work, data, length);
+      EVP_DigestFinal_ex(_work, innerHash, &hashLength);
+      EVP_MD_CTX_copy_ex(_work, _outer);
+      EVP_DigestUpdate(_work, innerHash, hashLength);
+      EVP_DigestFinal_ex(_work, reinterpret_cast<unsigned char *>(out),
+                         &hashLength);
+    }
+  };
+
+  static constexpr size_t SECRET_SIZE = 32;
+
+  AUTHENTICATOR_PTR _authenticator;
+  std::unique_ptr<PairKey> _sendKey;
+  std::unique_ptr<PairKey> _recvKey;
+  uint64_t _ownNonce = 0;
+  uint64_t _peerNonce = 0;
+  uint64_t _sendCounter = 0;
+  uint64_t _recvCounter = 0;
+
+  static std::string derive_key(const std::string &secret,
+                                NodeNum from,
+                                NodeNum to) {
+    static const char label[] = "concord-bft simple-auth-tcp";
+    char info[sizeof(label) + 2 * sizeof(NodeNum)];
+    memcpy(info, label, sizeof(label));
+    memcpy(info + sizeof(label), &from, sizeof(from));
+    memcpy(info + sizeof(label) + sizeof(from), &to, sizeof(to));
+
+    unsigned char key[EVP_MAX_MD_SIZE];
+    unsigned int keyLength = 0;
+    HMAC(EVP_sha256(),
+         secret.data(), static_cast<int>(secret.size()),
+         reinterpret_cast<const unsigned char *>(info), sizeof(info),
+         key, &keyLength);
+    return std::string(reinterpret_cast<char *>(key), keyLength);
+  }
+
+  // What the connecting node signs: the ids, both nonces and the secret.
+  static std::string signed_hello(NodeNum from, NodeNum to,
+                                  uint64_t challenge, uint64_t nonce,
+                                  const std::string &sealed) {
+    static const char label[] = "concord-bft simple-auth-tcp hello";
+    std::string res(label, sizeof(label));
+    res.append(reinterpret_cast<const char *>(&from), sizeof(from));
+    res.append(reinterpret_cast<const char *>(&to), sizeof(to));
+    res.append(reinterpret_cast<const char *>(&challenge), sizeof(challenge));
+    res.append(reinterpret_cast<const char *>(&nonce), sizeof(nonce));
+    return res + sealed;
+  }
+
+  void set_keys(const std::string &secret, NodeNum peer) {
+    NodeNum self = _authenticator->self_id();
+    _sendKey.reset(new PairKey(derive_key(secret, self, peer)));
+    _recvKey.reset(new PairKey(derive_key(secret, peer, self)));
+  }
+
+ public:
+  explicit FrameSession(AUTHENTICATOR_PTR authenticator) :
+      _authenticator{std::move(authenticator)} {
+    restart();
+  }
+
+  // Starts over for a new connection.
+  void restart() {
+    if (RAND_bytes(reinterpret_cast<unsigned char *>(&_ownNonce),
+                   sizeof(_ownNonce)) != 1) {
+      throw std::runtime_error("failed to draw a session nonce");
+    }
+    _sendKey.reset();
+    _recvKey.reset();
+    _peerNonce = 0;
+    _sendCounter = 0;
+    _recvCounter = 0;
+  }
+
+  uint64_t own_nonce() const {
+    return _ownNonce;
+  }
+
+  // Frames can be sealed and opened once the hello went through.
+  bool established() const {
+    return _sendKey != nullptr;
+  }
+
+  /** On the connecting node, given the challenge of 'dest': sets the keys of
+   * the connection and writes the payload of the hello, which must be sealed
+   * as the first frame.
+   * | id (8) | nonce (8) | [ secret length (2) | secret | signature ] |
+   */
+  bool make_hello(NodeNum dest, uint64_t challenge, std::string &hello) {
+    if (!_authenticator->knows(dest)) {
+      return false;
+    }
+    NodeNum self = _authenticator->self_id();
+    hello.assign(reinterpret_cast<const char *>(&self), sizeof(self));
+    hello.append(reinterpret_cast<const char *>(&_ownNonce),
+                 sizeof(_ownNonce));
+
+    std::string secret = _authenticator->shared_secret();
+    if (_authenticator->uses_key_pairs(dest)) {
+      secret.assign(SECRET_SIZE, '\0');
+      std::string sealed;
+      std::string signature;
+      if (RAND_bytes(reinterpret_cast<unsigned char *>(&secret[0]),
+                     SECRET_SIZE) != 1 ||
+          !_authenticator->seal_secret(dest, secret, sealed) ||
+          !_authenticator->sign(
+              signed_hello(self, dest, challenge, _ownNonce, sealed),
+              signature)) {
+        return false;
+      }
+      uint16_t sealedLength = static_cast<uint16_t>(sealed.size());
+      hello.append(reinterpret_cast<const char *>(&sealedLength),
+                   sizeof(sealedLength));
+      hello += sealed;
+      hello += signature;
+      if (hello.size() > AUTH_MAX_HELLO_SIZE) {
+        return false;
+      }
+    }
+
+    _peerNonce = challenge;
+    set_keys(secret, dest);
+    return true;
+  }
+
+  /** On the accepting node: checks the payload of a hello, whose frame is
+   * to be opened next, and sets the keys of the connection. 'source' is the
+   * node the hello comes from.
+   */
+  bool accept_hello(const char *hello, uint32_t length, NodeNum &source) {
+    static constexpr uint32_t HEADER_SIZE =
+        sizeof(NodeNum) + AUTH_NONCE_FIELD_SIZE;
+    if (established() || length < HEADER_SIZE) {
+      return false;
+    }
+    uint64_t nonce = 0;
+    memcpy(&source, hello, sizeof(source));
+    memcpy(&nonce, hello + sizeof(NodeNum), sizeof(nonce));
+    if (!_authenticator->knows(source)) {
+      return false;
+    }
+
+    std::string secret = _authenticator->shared_secret();
+    if (_authenticator->uses_key_pairs(source)) {
+      uint16_t sealedLength = 0;
+      if (length < HEADER_SIZE + sizeof(sealedLength)) {
+        return false;
+      }
+      memcpy(&sealedLength, hello + HEADER_SIZE, sizeof(sealedLength));
+      uint32_t offset = HEADER_SIZE + sizeof(sealedLength);
+      if (length < offset + sealedLength) {
+        return false;
+      }
+      std::string sealed(hello + offset, sealedLength);
+      std::string signature(hello + offset + sealedLength,
+                            length - offset - sealedLength);
+      if (!_authenticator->verify(
+              source,
+              signed_hello(source, _authenticator->self_id(), _ownNonce,
+                           nonce, sealed),
+              signature) ||
+          !_authenticator->unseal_secret(sealed, secret) ||
+          secret.size() != SECRET_SIZE) {
+        return false;
+      }
+    } else if (length != HEADER_SIZE) {
+      return false;
+    }
+
+    _peerNonce = nonce;
+    set_keys(secret, source);
+    return true;
+  }
+
+  // 'data' points to the message type, 'length' counts everything up to the
+  // MAC. Writes the next counter after the type and the MAC after 'length'.
+  bool seal(char *data, uint32_t length) {
+    if (!established() ||
+        length < MSGTYPE_FIELD_SIZE + AUTH_COUNTER_FIELD_SIZE) {
+      return false;
+    }
+    uint64_t counter = ++_sendCounter;
+    memcpy(data + MSGTYPE_FIELD_SIZE, &counter, AUTH_COUNTER_FIELD_SIZE);
+    _sendKey->mac(_peerNonce, data, length, data + length);
+    return true;
+  }
+
+  // Checks the MAC and the counter of a frame from the peer.
+  bool open(const char *data, uint32_t length) {
+    if (!established() ||
+        length < MSGTYPE_FIELD_SIZE + AUTH_COUNTER_FIELD_SIZE) {
+      return false;
+    }
+    char expected[AUTH_MAC_FIELD_SIZE];
+    _recvKey->mac(_ownNonce, data, length, expected);
+    if (CRYPTO_memcmp(expected, data + length, AUTH_MAC_FIELD_SIZE) != 0) {
+      return false;
+    }
+
+    uint64_t counter = 0;
+    memcpy(&counter, data + MSGTYPE_FIELD_SIZE, AUTH_COUNTER_FIELD_SIZE);
+    if (counter <= _recvCounter) {
+      return false;
+    }
+    _recvCounter = counter;
+    return true;
+  }
+};
+
+}  // namespace bftEngine
+
+#endif  // BFTENGINE_SRC_COMMUNICATION_FRAMEAUTHENTICATOR_HPP_
@@ -0,0 +1,1254 @@
+// Concord
+//
+// Copyright (c) 2019 VMware, Inc. All Rights Reserved.
+//
+// This product is licensed to you under the Apache 2.0 license (the "License").
+// You may not use this product except in compliance with the Apache 2.0 License.
+//
+// This product may include a number of subcomponents with separate copyright
+// notices and license terms. Your use of these subcomponents is subject to the
+// terms and conditions of the subcomponent's license, as noted in the
+// LICENSE file.
+
+// TCP transport on top of io_uring. One thread per node owns the ring and
+// handles every completion: a multishot accept on the listening socket, and a
+// multishot receive on each connection, with the data landing in a ring of
+// buffers provided to the kernel up front, by default each large enough for
+// the largest frame. A frame that arrives whole in one of those buffers is
+// handed to the IReceiver in place; only the frames split between two
+// receives are reassembled. Senders append frames to the output
+// chunks of the connection, which are reused. The sender that finds the
+// connection idle submits them in a single sendmsg, the next batches are
+// submitted by the ring thread as sends complete, so a busy connection costs
+// neither a system call nor an allocation per message.
+//
+// Frames are | length (4) | type (4) | payload |. A connection starts with a
+// Hello frame, from the connecting side, carrying its node id.
+
+#include "CommDefs.hpp"
+#include "Logger.hpp"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define Assert(cond, txtMsg) assert(cond && (txtMsg))
+
+using namespace std;
+using namespace bftEngine;
+
+namespace {
+
+// Minimal binding of the io_uring system calls: the submission and
+// completion rings, and a ring of provided receive buffers. Preparing and
+// submitting entries must be serialized by the caller; completions are
+// reaped by a single thread.
+class IoUring {
+ public:
+  IoUring(unsigned entries, unsigned cqEntries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = cqEntries;
+    _fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if (_fd < 0) {
+      return;
+    }
+
+    _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cqRingSize = params.cq_off.cqes +
+        params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+      _sqRingSize = _cqRingSize = max(_sqRingSize, _cqRingSize);
+    }
+    _sqRing = map(_sqRingSize, IORING_OFF_SQ_RING);
+    _cqRing = singleMmap ? _sqRing : map(_cqRingSize, IORING_OFF_CQ_RING);
+    _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    _sqes = static_cast<io_uring_sqe *>(map(_sqesSize, IORING_OFF_SQES));
+    if (!_sqRing || !_cqRing || !_sqes) {
+      release();
+      return;
+    }
+
+    char *sq = static_cast<char *>(_sqRing);
+    _sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    _sqKernelTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    _sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    _sqEntries = params.sq_entries;
+    _sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    _sqTail = *_sqKernelTail;
+
+    char *cq = static_cast<char *>(_cqRing);
+    _cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    _cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    _cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    _cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+  }
+
+  ~IoUring() {
+    release();
+  }
+
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+
+  bool valid() const {
+    return _fd >= 0;
+  }
+
+  int fd() const {
+    return _fd;
+  }
+
+  unsigned space_left() const {
+    return _sqEntries - (_sqTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE));
+  }
+
+  // Returns a zeroed entry, or nullptr if the submission ring is full.
+  io_uring_sqe *get_sqe() {
+    unsigned head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+    if (_sqTail - head >= _sqEntries) {
+      return nullptr;
+    }
+    unsigned index = _sqTail & _sqMask;
+    io_uring_sqe *sqe = &_sqes[index];
+    _sqArray[index] = index;
+    ++_sqTail;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+  }
+
+  // Hands the prepared entries to the kernel.
+  int submit() {
+    __atomic_store_n(_sqKernelTail, _sqTail, __ATOMIC_RELEASE);
+    unsigned toSubmit = _sqTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+    while (toSubmit) {
+      auto res = syscall(__NR_io_uring_enter, _fd, toSubmit, 0, 0, nullptr, 0);
+      if (res >= 0 || (errno != EINTR && errno != EAGAIN)) {
+        return (int) res;
+      }
+    }
+    return 0;
+  }
+
+  // Blocks until there is at least one completion.
+  void wait() {
+    while (!has_completions()) {
+      auto res = syscall(__NR_io_uring_enter, _fd, 0, 1,
+                         IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (res < 0 && errno != EINTR && errno != EAGAIN) {
+        return;
+      }
+    }
+  }
+
+  bool has_completions() const {
+    return *_cqHead != __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+  }
+
+  // Calls f on every available completion, which is released right after.
+  template <typename F>
+  void reap(F f) {
+    unsigned head = *_cqHead;
+    unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      io_uring_cqe cqe = _cqes[head & _cqMask];
+      ++head;
+      __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+      f(cqe);
+    }
+  }
+
+ private:
+  void *map(size_t size, off_t offset) {
+    void *res = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, _fd, offset);
+    return res == MAP_FAILED ? nullptr : res;
+  }
+
+  void release() {
+    if (_sqes) {
+      munmap(_sqes, _sqesSize);
+    }
+    if (_cqRing && _cqRing != _sqRing) {
+      munmap(_cqRing, _cqRingSize);
+    }
+    if (_sqRing) {
+      munmap(_sqRing, _sqRingSize);
+    }
+    _sqes = nullptr;
+    _sqRing = _cqRing = nullptr;
+    if (_fd >= 0) {
+      close(_fd);
+      _fd = -1;
+    }
+  }
+
+  int _fd = -1;
+  void *_sqRing = nullptr;
+  void *_cqRing = nullptr;
+  size_t _sqRingSize = 0;
+  size_t _cqRingSize = 0;
+  size_t _sqesSize = 0;
+  io_uring_sqe *_sqes = nullptr;
+
+  unsigned *_sqHead = nullptr;
+  unsigned *_sqKernelTail = nullptr;
+  unsigned *_sqArray = nullptr;
+  unsigned _sqMask = 0;
+  unsigned _sqEntries = 0;
+  unsigned _sqTail = 0;
+
+  unsigned *_cqHead = nullptr;
+  unsigned *_cqTail = nullptr;
+  unsigned _cqMask = 0;
+  io_uring_cqe *_cqes = nullptr;
+};
+
+// Receive buffers registered with the kernel as a buffer group: a multishot
+// receive picks one for each chunk of data and reports its id, and the
+// buffer is given back once the data is consumed. Only the ring thread
+// touches it.
+class ProvidedBuffers {
+ public:
+  static constexpr uint16_t kGroupId = 0;
+
+  ~ProvidedBuffers() {
+    if (_ring) {
+      munmap(_ring, _ringSize);
+    }
+  }
+
+  bool init(int ringFd, uint16_t count, uint32_t bufferSize) {
+    Assert((count & (count - 1)) == 0, "Buffer count must be a power of 2!");
+    _bufferSize = bufferSize;
+    _mask = count - 1;
+    _storage.resize((size_t) count * bufferSize);
+    _ringSize = count * sizeof(io_uring_buf);
+    void *ring = mmap(nullptr, _ringSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+      return false;
+    }
+    _ring = static_cast<io_uring_buf *>(ring);
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(_ring);
+    reg.ring_entries = count;
+    reg.bgid = kGroupId;
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING,
+                &reg, 1) < 0) {
+      return false;
+    }
+
+    for (uint16_t i = 0; i < count; ++i) {
+      put(i);
+    }
+    publish();
+    return true;
+  }
+
+  char *buffer(uint16_t id) {
+    return _storage.data() + (size_t) id * _bufferSize;
+  }
+
+  void recycle(uint16_t id) {
+    put(id);
+    publish();
+  }
+
+ private:
+  void put(uint16_t id) {
+    io_uring_buf &buf = _ring[_tail & _mask];
+    buf.addr = reinterpret_cast<uint64_t>(buffer(id));
+    buf.len = _bufferSize;
+    buf.bid = id;
+    ++_tail;
+  }
+
+  // the tail shares its place with the reserved field of the first entry
+  void publish() {
+    auto ring = reinterpret_cast<io_uring_buf_ring *>(_ring);
+    __atomic_store_n(&ring->tail, _tail, __ATOMIC_RELEASE);
+  }
+
+  io_uring_buf *_ring = nullptr;
+  size_t _ringSize = 0;
+  uint16_t _mask = 0;
+  uint16_t _tail = 0;
+  uint32_t _bufferSize = 0;
+  vector<char> _storage;
+};
+
+uint16_t roundUpToPowerOf2(uint32_t v) {
+  uint32_t res = 1;
+  while (res < v && res < (1u << 15)) {
+    res <<= 1;
+  }
+  return static_cast<uint16_t>(res);
+}
+
+}  // namespace
+
+class IoUringTcpCommunication::IoUringTcpImpl {
+ private:
+  enum FrameType : uint32_t {
+    Hello = 0,
+    Data = 1
+  };
+
+  // what a completion is about, in the high byte of its user_data
+  enum Op : uint8_t {
+    Accept = 1,
+    Connect,
+    ConnectTimeout,
+    Recv,
+    Send,
+    Reconnect,
+    Wakeup,
+    CancelAll
+  };
+
+  static constexpr uint32_t kFrameHeaderSize = 2 * sizeof(uint32_t);
+  static constexpr size_t kChunkSize = 256 * 1024;
+  static constexpr size_t kMaxFreeChunks = 64;
+  static constexpr size_t kMaxChunksPerSend = 16;
+  static constexpr unsigned kRingEntries = 256;
+  static constexpr unsigned kCompletionEntries = 4096;
+  static constexpr uint32_t kConnectTimeoutMilli = 2000;
+  static constexpr uint32_t kMinReconnectMilli = 256;
+  static constexpr uint32_t kMaxReconnectMilli = 8192;
+  static constexpr NodeNum kUnknownNode = numeric_limits<NodeNum>::max();
+
+  // Frames waiting to be sent, back to back. Only the last chunk grows,
+  // and only beyond what was handed to the kernel.
+  struct OutChunk {
+    unique_ptr<char[]> data;
+    size_t capacity;
+    size_t length;
+  };
+
+  struct Connection {
+    uint64_t id = 0;
+    int fd = -1;
+    bool outgoing = false;
+    NodeNum peer = kUnknownNode;
+    // read by the kernel when the connect is submitted
+    sockaddr_in peerAddr;
+    __kernel_timespec connectTimeout;
+
+    // ring thread only
+    bool established = false;
+    bool released = false;
+    vector<char> partial;
+    size_t partialLength = 0;
+
+    // operations submitted and not completed yet, the socket is closed and
+    // the connection released when a closing connection has none left
+    atomic<unsigned> pending{0};
+
+    // guards the send state and 'closing'
+    mutex sendLock;
+    bool closing = false;
+    bool sending = false;
+    deque<OutChunk> outChunks;
+    vector<unique_ptr<char[]>> freeChunks;
+    size_t queuedBytes = 0;
+    // bytes of the first chunk already sent
+    size_t sentBytes = 0;
+    iovec iov[kMaxChunksPerSend];
+    msghdr msg;
+  };
+  typedef shared_ptr<Connection> CONN_PTR;
+
+  const uint32_t _maxMessageLength;
+  const NodeMap _nodes;
+  const NodeNum _selfId;
+  const int32_t _maxServerId;
+  const string _listenIp;
+  const uint16_t _listenPort;
+  const uint32_t _recvBufferSize;
+  const uint16_t _numOfRecvBuffers;
+  const uint64_t _maxQueuedBytes;
+  UPDATE_CONNECTIVITY_FN _statusCallback;
+  IReceiver *_receiver = nullptr;
+
+  unique_ptr<IoUring> _ring;
+  // guards the submission ring
+  mutex _sqLock;
+  // operations of the ring not completed yet, the connections' included
+  atomic<unsigned> _pending{0};
+  unique_ptr<ProvidedBuffers> _buffers;
+  int _listenFd = -1;
+
+  // guards _connections, _peers and _nextConnectionId
+  mutable mutex _lock;
+  map<uint64_t, CONN_PTR> _connections;
+  // the established connections
+  map<NodeNum, CONN_PTR> _peers;
+  uint64_t _nextConnectionId = 1;
+
+  // ring thread only
+  map<NodeNum, uint32_t> _reconnectDelayMilli;
+  map<NodeNum, __kernel_timespec> _reconnectTimeouts;
+
+  mutex _runningLock;
+  unique_ptr<thread> _ringThread;
+  atomic<bool> _running{false};
+  atomic<bool> _stopping{false};
+
+  concordlogger::Logger _logger =
+      concordlogger::Log::getLogger("concord-bft.io-uring");
+
+  static uint64_t user_data(Op op, uint64_t id) {
+    return ((uint64_t) op << 56) | (id & ((1ull << 56) - 1));
+  }
+
+  bool check_replica(NodeNum node) const {
+    auto it = _nodes.find(node);
+    if (it == _nodes.end()) {
+      return false;
+    }
+
+    return it->second.isReplica;
+  }
+
+  /// ****************** submission ******************** ///
+
+  // Prepares an entry with f and submits it. Must be called with _sqLock
+  // held.
+  template <typename F>
+  void submit(uint64_t userData, F prepare) {
+    io_uring_sqe *sqe = _ring->get_sqe();
+    while (!sqe) {
+      _ring->submit();
+      this_thread::yield();
+      sqe = _ring->get_sqe();
+    }
+    prepare(sqe);
+    sqe->user_data = userData;
+    ++_pending;
+    _ring->submit();
+  }
+
+  void submit_accept() {
+    lock_guard<mutex> lock(_sqLock);
+    submit(user_data(Accept, 0), [this](io_uring_sqe *sqe) {
+      sqe->opcode = IORING_OP_ACCEPT;
+      sqe->fd = _listenFd;
+      sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    });
+  }
+
+  void submit_recv(Connection &conn) {
+    ++conn.pending;
+    lock_guard<mutex> lock(_sqLock);
+    submit(user_data(Recv, conn.id), [&conn](io_uring_sqe *sqe) {
+      sqe->opcode = IORING_OP_RECV;
+      sqe->fd = conn.fd;
+      sqe->ioprio = IORING_RECV_MULTISHOT;
+      sqe->flags = IOSQE_BUFFER_SELECT;
+      sqe->buf_group = ProvidedBuffers::kGroupId;
+    });
+  }
+
+  void submit_connect(Connection &conn) {
+    conn.pending += 2;
+    conn.connectTimeout.tv_sec = kConnectTimeoutMilli / 1000;
+    conn.connectTimeout.tv_nsec = (kConnectTimeoutMilli % 1000) * 1000000;
+
+    lock_guard<mutex> lock(_sqLock);
+    // the timeout is linked to the connect, both must be in the same batch
+    while (_ring->space_left() < 2) {
+      _ring->submit();
+      this_thread::yield();
+    }
+    io_uring_sqe *sqe = _ring->get_sqe();
+    io_uring_sqe *timeoutSqe = _ring->get_sqe();
+    sqe->opcode = IORING_OP_CONNECT;
+    sqe->fd = conn.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&conn.peerAddr);
+    sqe->off = sizeof(conn.peerAddr);
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = user_data(Connect, conn.id);
+    timeoutSqe->opcode = IORING_OP_LINK_TIMEOUT;
+    timeoutSqe->fd = -1;
+    timeoutSqe->addr = reinterpret_cast<uint64_t>(&conn.connectTimeout);
+    timeoutSqe->len = 1;
+    timeoutSqe->user_data = user_data(ConnectTimeout, conn.id);
+    _pending += 2;
+    _ring->submit();
+  }
+
+  // Sends the queued chunks in one sendmsg. Must be called with the
+  // connection's sendLock held.
+  void submit_send(Connection &conn) {
+    size_t n = 0;
+    for (auto it = conn.outChunks.begin();
+         it != conn.outChunks.end() && n < kMaxChunksPerSend; ++it, ++n) {
+      size_t offset = n == 0 ? conn.sentBytes : 0;
+      conn.iov[n].iov_base = it->data.get() + offset;
+      conn.iov[n].iov_len = it->length - offset;
+    }
+    memset(&conn.msg, 0, sizeof(conn.msg));
+    conn.msg.msg_iov = conn.iov;
+    conn.msg.msg_iovlen = n;
+    conn.sending = true;
+    ++conn.pending;
+
+    lock_guard<mutex> lock(_sqLock);
+    submit(user_data(Send, conn.id), [&conn](io_uring_sqe *sqe) {
+      sqe->opcode = IORING_OP_SENDMSG;
+      sqe->fd = conn.fd;
+      sqe->addr = reinterpret_cast<uint64_t>(&conn.msg);
+      sqe->len = 1;
+      sqe->msg_flags = MSG_NOSIGNAL;
+    });
+  }
+
+  // Queues a frame, and sends it right away if the connection is idle.
+  // Returns -1 if the connection is closing, SEND_REJECTED_BACKPRESSURE if
+  // its queue is full.
+  int enqueue(Connection &conn, FrameType type,
+              const char *payload, uint32_t length) {
+    size_t frameLength = kFrameHeaderSize + length;
+
+    lock_guard<mutex> lock(conn.sendLock);
+    if (conn.closing) {
+      return -1;
+    }
+    if (_maxQueuedBytes && conn.queuedBytes > 0 &&
+        conn.queuedBytes + frameLength > _maxQueuedBytes) {
+      return SEND_REJECTED_BACKPRESSURE;
+    }
+
+    if (conn.outChunks.empty() ||
+        conn.outChunks.back().capacity - conn.outChunks.back().length <
+            frameLength) {
+      conn.outChunks.push_back(new_chunk(conn, frameLength));
+    }
+    OutChunk &chunk = conn.outChunks.back();
+    uint32_t header[2] = {length, type};
+    memcpy(chunk.data.get() + chunk.length, header, sizeof(header));
+    memcpy(chunk.data.get() + chunk.length + kFrameHeaderSize, payload, length);
+    chunk.length += frameLength;
+    conn.queuedBytes += frameLength;
+
+    if (!conn.sending) {
+      submit_send(conn);
+    }
+    return 0;
+  }
+
+  OutChunk new_chunk(Connection &conn, size_t minCapacity) {
+    if (minCapacity <= kChunkSize && !conn.freeChunks.empty()) {
+      OutChunk chunk{std::move(conn.freeChunks.back()), kChunkSize, 0};
+      conn.freeChunks.pop_back();
+      return chunk;
+    }
+    size_t capacity = max(minCapacity, kChunkSize);
+    return OutChunk{unique_ptr<char[]>(new char[capacity]), capacity, 0};
+  }
+
+  void wake_up() {
+    lock_guard<mutex> lock(_sqLock);
+    submit(user_data(Wakeup, 0), [](io_uring_sqe *sqe) {
+      sqe->opcode = IORING_OP_NOP;
+    });
+  }
+
+  /// ****************** connections ******************** ///
+
+  CONN_PTR new_connection(int fd, bool outgoing, NodeNum peer) {
+    auto conn = make_shared<Connection>();
+    conn->fd = fd;
+    conn->outgoing = outgoing;
+    conn->peer = peer;
+    conn->partial.resize(kFrameHeaderSize +
+                         max<size_t>(_maxMessageLength, sizeof(NodeNum)));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    lock_guard<mutex> lock(_lock);
+    conn->id = _nextConnectionId++;
+    _connections[conn->id] = conn;
+    return conn;
+  }
+
+  CONN_PTR find_connection(uint64_t id) {
+    lock_guard<mutex> lock(_lock);
+    auto it = _connections.find(id);
+    return it == _connections.end() ? nullptr : it->second;
+  }
+
+  void connect_to(NodeNum peer) {
+    auto node = _nodes.find(peer);
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      LOG_ERROR(_logger, "socket() failed, node " << _selfId
+                                                  << ", errno: " << errno);
+      schedule_reconnect(peer);
+      return;
+    }
+    auto conn = new_connection(fd, true, peer);
+    memset(&conn->peerAddr, 0, sizeof(conn->peerAddr));
+    conn->peerAddr.sin_family = AF_INET;
+    conn->peerAddr.sin_port = htons(node->second.port);
+    inet_pton(AF_INET, node->second.ip.c_str(), &conn->peerAddr.sin_addr);
+    LOG_DEBUG(_logger, "connecting, node " << _selfId << ", dest: " << peer);
+    submit_connect(*conn);
+  }
+
+  void schedule_reconnect(NodeNum peer) {
+    if (_stopping) {
+      return;
+    }
+    auto &delay = _reconnectDelayMilli[peer];
+    delay = delay == 0 ? kMinReconnectMilli
+                       : min(delay * 2, kMaxReconnectMilli);
+    __kernel_timespec &timeout = _reconnectTimeouts[peer];
+    timeout.tv_sec = delay / 1000;
+    timeout.tv_nsec = (delay % 1000) * 1000000;
+
+    lock_guard<mutex> lock(_sqLock);
+    submit(user_data(Reconnect, peer), [&timeout](io_uring_sqe *sqe) {
+      sqe->opcode = IORING_OP_TIMEOUT;
+      sqe->fd = -1;
+      sqe->addr = reinterpret_cast<uint64_t>(&timeout);
+      sqe->len = 1;
+    });
+  }
+
+  void on_established(const CONN_PTR &conn) {
+    conn->established = true;
+    CONN_PTR previous;
+    {
+      lock_guard<mutex> lock(_lock);
+      auto &slot = _peers[conn->peer];
+      previous = slot;
+      slot = conn;
+    }
+    if (previous) {
+      LOG_INFO(_logger, "replacing the connection, node " << _selfId
+                                                          << ", peer: "
+                                                          << conn->peer);
+      close_connection(previous);
+    }
+    LOG_INFO(_logger, "connection established, node " << _selfId
+                                                      << ", peer: "
+                                                      << conn->peer);
+  }
+
+  void close_connection(const CONN_PTR &conn) {
+    {
+      lock_guard<mutex> lock(conn->sendLock);
+      if (conn->closing) {
+        return;
+      }
+      conn->closing = true;
+    }
+    LOG_DEBUG(_logger, "closing connection, node " << _selfId
+                                                   << ", peer: "
+                                                   << conn->peer);
+    // completes the operations in progress on the socket
+    shutdown(conn->fd, SHUT_RDWR);
+
+    if (conn->established) {
+      {
+        lock_guard<mutex> lock(_lock);
+        auto it = _peers.find(conn->peer);
+        if (it != _peers.end() && it->second == conn) {
+          _peers.erase(it);
+        }
+      }
+      if (_statusCallback && check_replica(conn->peer)) {
+        PeerConnectivityStatus pcs{};
+        pcs.peerId = conn->peer;
+        pcs.statusType = StatusType::Broken;
+        _statusCallback(pcs);
+      }
+    }
+    release_if_done(conn);
+  }
+
+  // Once closing, no operation is added to the connection: it goes away
+  // with the completion of the last one.
+  void release_if_done(const CONN_PTR &conn) {
+    if (conn->released) {
+      return;
+    }
+    {
+      lock_guard<mutex> lock(conn->sendLock);
+      if (!conn->closing) {
+        return;
+      }
+    }
+    if (conn->pending != 0) {
+      return;
+    }
+    conn->released = true;
+    close(conn->fd);
+    {
+      lock_guard<mutex> lock(_lock);
+      _connections.erase(conn->id);
+    }
+    if (conn->outgoing) {
+      schedule_reconnect(conn->peer);
+    }
+  }
+
+  /// ****************** receive path ******************** ///
+
+  bool on_frame(const CONN_PTR &conn, uint32_t type,
+                const char *payload, uint32_t length) {
+    if (type == FrameType::Hello) {
+      NodeNum peer;
+      if (conn->outgoing || conn->established || length != sizeof(peer)) {
+        return false;
+      }
+      memcpy(&peer, payload, sizeof(peer));
+      if (peer == _selfId || _nodes.find(peer) == _nodes.end()) {
+        LOG_ERROR(_logger, "hello from unknown node " << peer
+                                                      << ", node: "
+                                                      << _selfId);
+        return false;
+      }
+      conn->peer = peer;
+      on_established(conn);
+      return true;
+    }
+
+    if (type != FrameType::Data || !conn->established || length == 0) {
+      return false;
+    }
+    if (_receiver) {
+      _receiver->onNewMessage(conn->peer, payload, length);
+    }
+    if (_statusCallback && check_replica(conn->peer)) {
+      PeerConnectivityStatus pcs{};
+      pcs.peerId = conn->peer;
+      pcs.peerIp = _nodes.at(conn->peer).ip;
+      pcs.peerPort = _nodes.at(conn->peer).port;
+      pcs.statusType = StatusType::MessageReceived;
+
+      // pcs.statusTime = we dont set it since it is set by the aggregator
+      // in the upcoming version timestamps should be reviewed
+      _statusCallback(pcs);
+    }
+    return true;
+  }
+
+  bool valid_frame_length(uint32_t length) const {
+    return length <= max<size_t>(_maxMessageLength, sizeof(NodeNum));
+  }
+
+  // Consumes a chunk of the stream. Returns false on protocol errors.
+  bool on_data(const CONN_PTR &conn, const char *data, size_t length) {
+    uint32_t header[2];
+    while (length > 0) {
+      // a whole frame in the chunk: no copy
+      if (conn->partialLength == 0 && length >= kFrameHeaderSize) {
+        memcpy(header, data, sizeof(header));
+        if (!valid_frame_length(header[0])) {
+          return false;
+        }
+        if (length >= kFrameHeaderSize + header[0]) {
+          if (!on_frame(conn, header[1], data + kFrameHeaderSize,
+                        header[0])) {
+            return false;
+          }
+          data += kFrameHeaderSize + header[0];
+          length -= kFrameHeaderSize + header[0];
+          continue;
+        }
+      }
+
+      // the frame continues in the next chunk(s)
+      size_t needed = kFrameHeaderSize - conn->partialLength;
+      if (conn->partialLength >= kFrameHeaderSize) {
+        memcpy(header, conn->partial.data(), sizeof(header));
+        needed = kFrameHeaderSize + header[0] - conn->partialLength;
+      }
+      size_t taken = min(needed, length);
+      memcpy(conn->partial.data() + conn->partialLength, data, taken);
+      conn->partialLength += taken;
+      data += taken;
+      length -= taken;
+      if (conn->partialLength < kFrameHeaderSize) {
+        continue;
+      }
+
+      memcpy(header, conn->partial.data(), sizeof(header));
+      if (!valid_frame_length(header[0])) {
+        return false;
+      }
+      if (conn->partialLength == kFrameHeaderSize + header[0]) {
+        conn->partialLength = 0;
+        if (!on_frame(conn, header[1],
+                      conn->partial.data() + kFrameHeaderSize, header[0])) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  /// ****************** completions ******************** ///
+
+  void on_accept(const io_uring_cqe &cqe) {
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+      --_pending;
+      if (!_stopping) {
+        submit_accept();
+      }
+    }
+    if (cqe.res < 0) {
+      if (!_stopping) {
+        LOG_ERROR(_logger, "accept failed, node " << _selfId
+                                                  << ", errno: " << -cqe.res);
+      }
+      return;
+    }
+    if (_stopping) {
+      close(cqe.res);
+      return;
+    }
+    auto conn = new_connection(cqe.res, false, kUnknownNode);
+    submit_recv(*conn);
+  }
+
+  void on_connect(const CONN_PTR &conn, int res) {
+    if (res < 0 || _stopping) {
+      LOG_DEBUG(_logger, "connect failed, node " << _selfId
+                                                 << ", dest: " << conn->peer
+                                                 << ", errno: " << -res);
+      close_connection(conn);
+      return;
+    }
+    _reconnectDelayMilli[conn->peer] = 0;
+    // the hello goes first, before the connection can be found by senders
+    enqueue(*conn, FrameType::Hello,
+            reinterpret_cast<const char *>(&_selfId), sizeof(_selfId));
+    on_established(conn);
+    submit_recv(*conn);
+  }
+
+  void on_recv(const CONN_PTR &conn, const io_uring_cqe &cqe) {
+    bool more = cqe.flags & IORING_CQE_F_MORE;
+    if (!more) {
+      --conn->pending;
+    }
+
+    bool error = false;
+    if (cqe.flags & IORING_CQE_F_BUFFER) {
+      uint16_t bufferId = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+      if (cqe.res > 0 && !conn->closing) {
+        error = !on_data(conn, _buffers->buffer(bufferId), cqe.res);
+      }
+      _buffers->recycle(bufferId);
+    }
+
+    if (cqe.res == -ENOBUFS && !error) {
+      // all the buffers were taken, they are back by now
+      if (!more && !conn->closing && !_stopping) {
+        submit_recv(*conn);
+      }
+      return;
+    }
+    if (cqe.res <= 0 || error) {
+      if (error) {
+        LOG_ERROR(_logger, "protocol error, node " << _selfId
+                                                   << ", peer: "
+                                                   << conn->peer);
+      }
+      close_connection(conn);
+      return;
+    }
+    if (!more && !conn->closing && !_stopping) {
+      submit_recv(*conn);
+    }
+  }
+
+  void on_send(const CONN_PTR &conn, int res) {
+    --conn->pending;
+    bool failed = false;
+    {
+      lock_guard<mutex> lock(conn->sendLock);
+      conn->sending = false;
+      if (res < 0 || conn->closing) {
+        failed = true;
+      } else {
+        size_t sent = res;
+        conn->queuedBytes -= sent;
+        while (sent > 0) {
+          OutChunk &chunk = conn->outChunks.front();
+          size_t left = chunk.length - conn->sentBytes;
+          if (sent < left) {
+            conn->sentBytes += sent;
+            break;
+          }
+          sent -= left;
+          conn->sentBytes = 0;
+          if (chunk.capacity == kChunkSize &&
+              conn->freeChunks.size() < kMaxFreeChunks) {
+            conn->freeChunks.push_back(std::move(chunk.data));
+          }
+          conn->outChunks.pop_front();
+        }
+        if (!conn->outChunks.empty()) {
+          submit_send(*conn);
+        }
+      }
+    }
+    if (failed) {
+      close_connection(conn);
+    }
+  }
+
+  void on_completion(const io_uring_cqe &cqe) {
+    auto op = static_cast<Op>(cqe.user_data >> 56);
+    uint64_t id = cqe.user_data & ((1ull << 56) - 1);
+
+    switch (op) {
+      case Accept:
+        on_accept(cqe);
+        return;
+      case Reconnect:
+        --_pending;
+        if (!_stopping) {
+          connect_to(id);
+        }
+        return;
+      case Wakeup:
+      case CancelAll:
+        --_pending;
+        return;
+      default:
+        break;
+    }
+
+    if (op == Recv && !(cqe.flags & IORING_CQE_F_MORE)) {
+      --_pending;
+    } else if (op != Recv) {
+      --_pending;
+    }
+    auto conn = find_connection(id);
+    if (!conn) {
+      return;
+    }
+    switch (op) {
+      case Connect:
+        --conn->pending;
+        on_connect(conn, cqe.res);
+        break;
+      case ConnectTimeout:
+        --conn->pending;
+        break;
+      case Recv:
+        on_recv(conn, cqe);
+        break;
+      case Send:
+        on_send(conn, cqe.res);
+        break;
+      default:
+        break;
+    }
+    release_if_done(conn);
+  }
+
+  void begin_shutdown() {
+    if (_listenFd >= 0) {
+      shutdown(_listenFd, SHUT_RDWR);
+    }
+    vector<CONN_PTR> connections;
+    {
+      lock_guard<mutex> lock(_lock);
+      for (auto &it : _connections) {
+        connections.push_back(it.second);
+      }
+    }
+    for (auto &conn : connections) {
+      close_connection(conn);
+    }
+    // the accept, the connects in progress and the reconnect timers
+    lock_guard<mutex> lock(_sqLock);
+    submit(user_data(CancelAll, 0), [](io_uring_sqe *sqe) {
+      sqe->opcode = IORING_OP_ASYNC_CANCEL;
+      sqe->fd = -1;
+      sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL | IORING_ASYNC_CANCEL_ANY;
+    });
+  }
+
+  void ring_thread_routine() {
+    bool shutdownStarted = false;
+    auto onCompletion = [this](const io_uring_cqe &cqe) {
+      on_completion(cqe);
+    };
+    while (true) {
+      if (_stopping && !shutdownStarted) {
+        begin_shutdown();
+        shutdownStarted = true;
+      }
+      if (shutdownStarted && _pending == 0) {
+        break;
+      }
+      _ring->wait();
+      _ring->reap(onCompletion);
+    }
+  }
+
+  int open_listen_socket() {
+    _listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (_listenFd < 0) {
+      return -1;
+    }
+    int one = 1;
+    setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(_listenPort);
+    inet_pton(AF_INET, _listenIp.c_str(), &addr.sin_addr);
+    if (::bind(_listenFd, reinterpret_cast<sockaddr *>(&addr),
+               sizeof(addr)) < 0 || listen(_listenFd, SOMAXCONN) < 0) {
+      LOG_ERROR(_logger, "can't listen on " << _listenIp << ":" << _listenPort
+                                            << ", errno: " << errno);
+      close(_listenFd);
+      _listenFd = -1;
+      return -1;
+    }
+    return 0;
+  }
+
+ public:
+  explicit IoUringTcpImpl(const IoUringTcpConfig &config)
+      : _maxMessageLength{config.bufferLength},
+        _nodes{config.nodes},
+        _selfId{config.selfId},
+        _maxServerId{config.maxServerId},
+        _listenIp{config.listenIp},
+        _listenPort{config.listenPort},
+        _recvBufferSize{config.recvBufferSize
+                        ? config.recvBufferSize
+                        : kFrameHeaderSize + max<uint32_t>(config.bufferLength,
+                                                           sizeof(NodeNum))},
+        _numOfRecvBuffers{roundUpToPowerOf2(config.numOfRecvBuffers)},
+        _maxQueuedBytes{config.maxQueuedBytes},
+        _statusCallback{config.statusCallback} {
+    Assert(config.bufferLength > 0, "Buffer length should be positive!");
+  }
+
+  ~IoUringTcpImpl() {
+    Stop();
+  }
+
+  int getMaxMessageSize() {
+    return _maxMessageLength;
+  }
+
+  int Start() {
+    lock_guard<mutex> guard(_runningLock);
+    if (_running) {
+      return 0;
+    }
+
+    _ring.reset(new IoUring(kRingEntries, kCompletionEntries));
+    _buffers.reset(new ProvidedBuffers());
+    if (!_ring->valid() ||
+        !_buffers->init(_ring->fd(), _numOfRecvBuffers, _recvBufferSize)) {
+      LOG_ERROR(_logger, "io_uring setup failed, node " << _selfId
+                                                        << ", errno: "
+                                                        << errno);
+      _buffers.reset();
+      _ring.reset();
+      return -1;
+    }
+    _stopping = false;
+    _pending = 0;
+
+    // replicas listen, and the nodes connect to the replicas with a lower id
+    bool isReplica = _selfId <= (NodeNum) _maxServerId;
+    if (isReplica) {
+      if (open_listen_socket() != 0) {
+        _buffers.reset();
+        _ring.reset();
+        return -1;
+      }
+      submit_accept();
+    }
+    for (auto &it : _nodes) {
+      if (_statusCallback && it.second.isReplica) {
+        PeerConnectivityStatus pcs{};
+        pcs.peerId = it.first;
+        pcs.peerIp = it.second.ip;
+        pcs.peerPort = it.second.port;
+        pcs.statusType = StatusType::Started;
+        _statusCallback(pcs);
+      }
+      if (it.first < _selfId && it.first <= (NodeNum) _maxServerId) {
+        connect_to(it.first);
+      }
+    }
+
+    _running = true;
+    _ringThread.reset(
+        new thread(&IoUringTcpImpl::ring_thread_routine, this));
+    return 0;
+  }
+
+  int Stop() {
+    lock_guard<mutex> guard(_runningLock);
+    if (!_running) {
+      return 0;
+    }
+
+    _stopping = true;
+    wake_up();
+    _ringThread->join();
+    _ringThread.reset();
+    _running = false;
+
+    if (_listenFd >= 0) {
+      close(_listenFd);
+      _listenFd = -1;
+    }
+    {
+      lock_guard<mutex> lock(_lock);
+      _connections.clear();
+      _peers.clear();
+    }
+    _reconnectDelayMilli.clear();
+    _reconnectTimeouts.clear();
+    _ring.reset();
+    _buffers.reset();
+    return 0;
+  }
+
+  bool isRunning() const {
+    return _running;
+  }
+
+  void setReceiver(NodeNum receiverNum, IReceiver *receiver) {
+    _receiver = receiver;
+  }
+
+  ConnectionStatus getCurrentConnectionStatus(const NodeNum node) const {
+    if (_nodes.find(node) == _nodes.end()) {
+      return ConnectionStatus::Unknown;
+    }
+    lock_guard<mutex> lock(_lock);
+    return _peers.find(node) != _peers.end() ? ConnectionStatus::Connected
+                                             : ConnectionStatus::Disconnected;
+  }
+
+  int sendAsyncMessage(const NodeNum destNode,
+                       const char *const message,
+                       const size_t messageLength) {
+    Assert(message != nullptr, "No message provided!");
+    if (messageLength == 0 || messageLength > _maxMessageLength) {
+      LOG_ERROR(_logger, "invalid message length, node " << _selfId
+                                                         << ", length: "
+                                                         << messageLength);
+      return -1;
+    }
+
+    CONN_PTR conn;
+    {
+      lock_guard<mutex> lock(_lock);
+      auto it = _peers.find(destNode);
+      if (it != _peers.end()) {
+        conn = it->second;
+      }
+    }
+    int res = conn ? enqueue(*conn, FrameType::Data, message, messageLength)
+                   : -1;
+    if (res == SEND_REJECTED_BACKPRESSURE) {
+      LOG_DEBUG(_logger, "output queue full, from: " << _selfId
+                                                     << ", to: " << destNode);
+      return res;
+    }
+    if (res != 0) {
+      LOG_DEBUG(_logger, "connection NOT found, from: " << _selfId
+                                                        << ", to: "
+                                                        << destNode);
+      return 0;
+    }
+
+    if (_statusCallback && check_replica(_selfId)) {
+      PeerConnectivityStatus pcs{};
+      pcs.peerId = _selfId;
+      pcs.statusType = StatusType::MessageSent;
+
+      // pcs.statusTime = we dont set it since it is set by the aggregator
+      // in the upcoming version timestamps should be reviewed
+      _statusCallback(pcs);
+    }
+    return 0;
+  }
+};
+
+IoUringTcpCommunication::IoUringTcpCommunication(
+    const IoUringTcpConfig &config)
+    : _ptrImpl{new IoUringTcpImpl(config)} {
+}
+
+IoUringTcpCommunication::~IoUringTcpCommunication() {
+}
+
+IoUringTcpCommunication *IoUringTcpCommunication::create(
+    const IoUringTcpConfig &config) {
+  return new IoUringTcpCommunication(config);
+}
+
+int IoUringTcpCommunication::getMaxMessageSize() {
+  return _ptrImpl->getMaxMessageSize();
+}
+
+int IoUringTcpCommunication::Start() {
+  return _ptrImpl->Start();
+}
+
+int IoUringTcpCommunication::Stop() {
+  return _ptrImpl->Stop();
+}
+
+bool IoUringTcpCommunication::isRunning() const {
+  return _ptrImpl->isRunning();
+}
+
+ConnectionStatus IoUringTcpCommunication::getCurrentConnectionStatus(
+    const NodeNum node) const {
+  return _ptrImpl->getCurrentConnectionStatus(node);
+}
+
+int IoUringTcpCommunication::sendAsyncMessage(const NodeNum destNode,
+                                              const char *const message,
+                                              const size_t messageLength) {
+  return _ptrImpl->sendAsyncMessage(destNode, message, messageLength);
+}
+
+void IoUringTcpCommunication::setReceiver(NodeNum receiverNum,
+                                          IReceiver *receiver) {
+  _ptrImpl->setReceiver(receiverNum, receiver);
+}
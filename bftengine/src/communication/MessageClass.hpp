@@ -0,0 +1,43 @@
+// Concord
+//
+// Copyright (c) 2019 VMware, Inc. All Rights Reserved.
+//
+// This product is licensed to you under the Apache 2.0 license (the "License").
+// You may not use this product except in compliance with the Apache 2.0
+// License.
+//
+// This product may include a number of subcomponents with separate copyright
+// notices and license terms. Your use of these subcomponents is subject to the
+// terms and conditions of the subcomponent's license, as noted in the LICENSE
+// file.
+
+#ifndef BFTENGINE_SRC_COMMUNICATION_MESSAGECLASS_HPP_
+#define BFTENGINE_SRC_COMMUNICATION_MESSAGECLASS_HPP_
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../bftengine/MsgCode.hpp"
+
+namespace bftEngine {
+
+// What transports need to know about the messages they carry, to treat bulk
+// state transfer data differently from the consensus traffic.
+enum class MessageClass : uint8_t {
+  Consensus,
+  StateTransfer
+};
+
+// Every engine message starts with its MsgCode (see MessageBase::Header).
+inline MessageClass classifyMessage(const char *msg, size_t length) {
+  uint16_t type = impl::MsgCode::None;
+  if (length >= sizeof(type)) {
+    memcpy(&type, msg, sizeof(type));
+  }
+  return type == impl::MsgCode::StateTransfer ? MessageClass::StateTransfer
+                                              : MessageClass::Consensus;
+}
+
+}  // namespace bftEngine
+
+#endif  // BFTENGINE_SRC_COMMUNICATION_MESSAGECLASS_HPP_
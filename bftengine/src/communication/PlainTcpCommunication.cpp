@@ -9,6 +9,7 @@
 // notices and license terms. Your use of these subcomponents is subject to the
 // terms and conditions of the subcomponent's license, anoted in the LICENSE file.
 
+#include <algorithm>
 #include <unordered_map>
 #include <string>
 #include <functional>
@@ -31,6 +32,7 @@
 #endif
 
 #include "CommDefs.hpp"
+#include "FrameAuthenticator.hpp"
 #include "Logger.hpp"
 #include "boost/bind.hpp"
 #include <boost/asio.hpp>
@@ -59,14 +61,12 @@ typedef boost::system::error_code B_ERROR_CODE;
 typedef boost::shared_ptr<AsyncTcpConnection> ASYNC_CONN_PTR;
 typedef tcp::socket B_TCP_SOCKET;
 
-// first 4 bytes - message length, next 2 bytes - message type
-static constexpr uint8_t LENGTH_FIELD_SIZE = 4;
-static constexpr uint8_t MSGTYPE_FIELD_SIZE = 2;
-
 enum MessageType : uint16_t {
   Reserved = 0,
   Hello,
-  Regular
+  Regular,
+  // the session nonce of an accepting SimpleAuthTcp node, unauthenticated
+  Challenge
 };
 
 enum ConnType : uint8_t {
@@ -107,6 +107,12 @@ class AsyncTcpConnection :
   UPDATE_CONNECTIVITY_FN _statusCallback = nullptr;
   NodeMap _nodes;
   recursive_mutex _connectionsGuard;
+  // null for plain TCP
+  unique_ptr<FrameSession> _session;
+  // set once the peer identity is known and, with authentication, proven
+  bool _peerKnown = false;
+  // the answer to the challenge of the peer, with authentication
+  string _hello;
 
  public:
   B_TCP_SOCKET socket;
@@ -122,7 +128,8 @@ class AsyncTcpConnection :
                      ConnType type,
                      concordlogger::Logger logger,
                      UPDATE_CONNECTIVITY_FN statusCallback,
-                     NodeMap nodes) :
+                     NodeMap nodes,
+                     AUTHENTICATOR_PTR authenticator) :
       _service(service),
       _bufferLength(bufferLength),
       _fOnError(onError),
@@ -135,14 +142,26 @@ class AsyncTcpConnection :
       _logger(logger),
       _statusCallback{statusCallback},
       _nodes{std::move(nodes)},
+      _session{authenticator ? new FrameSession(std::move(authenticator))
+                             : nullptr},
+      _peerKnown{type == ConnType::Outgoing},
       socket(*service),
       connected(false) {
 
     LOG_TRACE(_logger, "enter, node " << _selfId << ", dest: " << _destId);
 
     _isReplica = check_replica(_selfId);
-    _inBuffer = new char[bufferLength];
-    _outBuffer = new char[bufferLength];
+    // room for the frame header and, when authenticating, its trailer
+    _bufferLength += LENGTH_FIELD_SIZE + MSGTYPE_FIELD_SIZE;
+    if (_session) {
+      _bufferLength += AUTH_FRAME_OVERHEAD;
+      // a hello carries the keys of the connection
+      _bufferLength = std::max(_bufferLength,
+                               LENGTH_FIELD_SIZE + MSGTYPE_FIELD_SIZE +
+                                   AUTH_FRAME_OVERHEAD + AUTH_MAX_HELLO_SIZE);
+    }
+    _inBuffer = new char[_bufferLength];
+    _outBuffer = new char[_bufferLength];
 
     _connectTimer.expires_at(boost::posix_time::pos_infin);
 
@@ -308,6 +327,12 @@ class AsyncTcpConnection :
       LOG_ERROR(_logger, "on_read_async_header_completed, msgLen=0");
       return;
     }
+    if (msgLength > _bufferLength - LENGTH_FIELD_SIZE) {
+      LOG_ERROR(_logger, "on_read_async_header_completed, msgLen too big: "
+                << msgLength << ", node " << _selfId << ", dest: " << _destId);
+      handle_error(boost::asio::error::message_size);
+      return;
+    }
 
     read_msg_async(LENGTH_FIELD_SIZE, msgLength);
 
@@ -337,17 +362,63 @@ class AsyncTcpConnection :
               << "is_open: " << socket.is_open());
   }
 
-  bool is_service_message() {
-    uint16_t msgType =
-        *(static_cast<uint16_t *>(
-            static_cast<void *>(_inBuffer + LENGTH_FIELD_SIZE)));
-    switch (msgType) {
+  uint16_t get_message_type() {
+    return *(static_cast<uint16_t *>(
+        static_cast<void *>(_inBuffer + LENGTH_FIELD_SIZE)));
+  }
+
+  /** Verifies the frame currently in _inBuffer, whose size (without the
+   * length field) is 'frameLength', and locates its payload.
+   */
+  bool open_frame(uint32_t frameLength,
+                  const char *&payload,
+                  uint32_t &payloadLength) {
+    payload = _inBuffer + LENGTH_FIELD_SIZE + MSGTYPE_FIELD_SIZE;
+    if (!_session) {
+      payloadLength = frameLength - MSGTYPE_FIELD_SIZE;
+      return true;
+    }
+
+    // the nonce an accepting node sends first, to the connecting one, which
+    // answers with the hello
+    if (get_message_type() == MessageType::Challenge) {
+      payloadLength = frameLength - MSGTYPE_FIELD_SIZE;
+      if (_connType != ConnType::Outgoing || _session->established() ||
+          payloadLength != AUTH_NONCE_FIELD_SIZE) {
+        return false;
+      }
+      uint64_t challenge = 0;
+      memcpy(&challenge, payload, sizeof(challenge));
+      return _session->make_hello(_destId, challenge, _hello);
+    }
+
+    if (frameLength < MSGTYPE_FIELD_SIZE + AUTH_FRAME_OVERHEAD) {
+      return false;
+    }
+    payload += AUTH_COUNTER_FIELD_SIZE;
+    payloadLength = frameLength - MSGTYPE_FIELD_SIZE - AUTH_FRAME_OVERHEAD;
+
+    // the sender of a hello is the node it claims to be, its signature or,
+    // without key pairs, its MAC proves it
+    if (get_message_type() == MessageType::Hello) {
+      NodeNum source = 0;
+      if (_peerKnown ||
+          !_session->accept_hello(payload, payloadLength, source)) {
+        return false;
+      }
+    } else if (!_peerKnown) {
+      return false;
+    }
+
+    return _session->open(_inBuffer + LENGTH_FIELD_SIZE,
+                          frameLength - AUTH_MAC_FIELD_SIZE);
+  }
+
+  bool is_service_message(const char *payload) {
+    switch (get_message_type()) {
       case MessageType::Hello:
-        _destId =
-            *(static_cast<NodeNum *>(
-                static_cast<void *>(
-                    _inBuffer + LENGTH_FIELD_SIZE +
-                        MSGTYPE_FIELD_SIZE)));
+        memcpy(&_destId, payload, sizeof(_destId));
+        _peerKnown = true;
 
         LOG_DEBUG(_logger, "node: " << _selfId << " got hello from:" << _destId);
 
@@ -356,6 +427,11 @@ class AsyncTcpConnection :
         LOG_DEBUG(_logger, "node: " << _selfId
                   << " dest is replica: " << _destIsReplica);
         return true;
+      case MessageType::Challenge:
+        if (_session) {
+          send_hello();
+        }
+        return true;
       default:return false;
     }
   }
@@ -378,13 +454,25 @@ class AsyncTcpConnection :
       return;
     }
 
-    if (!is_service_message()) {
+    const char *payload = nullptr;
+    uint32_t payloadLength = 0;
+    if (!open_frame(bytesRead, payload, payloadLength)) {
+      LOG_ERROR(_logger, "frame authentication failed, node " << _selfId
+                << ", dest: " << _destId
+                << ", msgLen: " << bytesRead);
+      if (_peerKnown) {
+        handle_error(boost::asio::error::access_denied);
+      } else {
+        // nothing was registered for this connection yet
+        _wasError = true;
+        close_socket();
+      }
+      return;
+    }
+
+    if (!is_service_message(payload)) {
       LOG_DEBUG(_logger, "data msg received, msgLen: " << bytesRead);
-      _receiver->
-          onNewMessage(_destId,
-                       _inBuffer + LENGTH_FIELD_SIZE +
-                           MSGTYPE_FIELD_SIZE,
-                       bytesRead - MSGTYPE_FIELD_SIZE);
+      _receiver->onNewMessage(_destId, payload, payloadLength);
     }
 
     read_header_async();
@@ -441,25 +529,69 @@ class AsyncTcpConnection :
   }
 
   uint16_t prepare_output_buffer(uint16_t msgType, uint32_t dataLength) {
-    memset(_outBuffer, 0, _bufferLength);
     uint32_t size = sizeof(msgType) + dataLength;
+    if (_session) {
+      size += AUTH_FRAME_OVERHEAD;
+    }
     memcpy(_outBuffer, &size, LENGTH_FIELD_SIZE);
     memcpy(_outBuffer + LENGTH_FIELD_SIZE,
            &msgType,
            MSGTYPE_FIELD_SIZE);
-    return LENGTH_FIELD_SIZE + MSGTYPE_FIELD_SIZE;
+    if (!_session) {
+      return LENGTH_FIELD_SIZE + MSGTYPE_FIELD_SIZE;
+    }
+
+    // the counter is written when sealing
+    return LENGTH_FIELD_SIZE + MSGTYPE_FIELD_SIZE + AUTH_COUNTER_FIELD_SIZE;
+  }
+
+  /** Appends the MAC, if any, to a frame whose header and payload are
+   * already in _outBuffer. Returns the number of bytes to write.
+   */
+  uint32_t seal_output_buffer(uint32_t length) {
+    if (!_session) {
+      return length;
+    }
+
+    _session->seal(_outBuffer + LENGTH_FIELD_SIZE,
+                   length - LENGTH_FIELD_SIZE);
+    return length + AUTH_MAC_FIELD_SIZE;
   }
 
+  // With authentication, the hello made when the challenge arrived.
   void send_hello() {
-    auto offset = prepare_output_buffer(MessageType::Hello, sizeof(_selfId));
-    memcpy(_outBuffer + offset, &_selfId, sizeof(_selfId));
+    if (!_session) {
+      _hello.assign(reinterpret_cast<const char *>(&_selfId),
+                    sizeof(_selfId));
+    }
+    uint32_t length = _hello.size();
+    auto offset = prepare_output_buffer(MessageType::Hello, length);
+    memcpy(_outBuffer + offset, _hello.data(), length);
+    auto size = seal_output_buffer(offset + length);
 
     LOG_DEBUG(_logger, "sending hello from:" << _selfId
               << " to: " << _destId
-              << ", size: " << (offset + sizeof(_selfId)));
+              << ", size: " << size);
+
+    AsyncTcpConnection::write_async((const char *) _outBuffer, size);
+  }
+
+  // The nonce of an accepting node, the only frame sent without a MAC: a
+  // forged one only makes the frames of the connecting node fail.
+  void send_challenge() {
+    uint16_t msgType = MessageType::Challenge;
+    uint64_t nonce = _session->own_nonce();
+    uint32_t size = MSGTYPE_FIELD_SIZE + sizeof(nonce);
+    memcpy(_outBuffer, &size, LENGTH_FIELD_SIZE);
+    memcpy(_outBuffer + LENGTH_FIELD_SIZE, &msgType, MSGTYPE_FIELD_SIZE);
+    memcpy(_outBuffer + LENGTH_FIELD_SIZE + MSGTYPE_FIELD_SIZE,
+           &nonce,
+           sizeof(nonce));
+
+    LOG_DEBUG(_logger, "sending challenge from:" << _selfId);
 
     AsyncTcpConnection::write_async((const char *) _outBuffer,
-                                    offset + sizeof(_selfId));
+                                    LENGTH_FIELD_SIZE + size);
   }
 
   void setTimeOut() {
@@ -534,7 +666,12 @@ class AsyncTcpConnection :
       _connecting = false;
       _connectTimer.expires_at(boost::posix_time::pos_infin);
       _currentTimeout = _minTimeout;
-      send_hello();
+      // with authentication, the hello waits for the challenge of the peer
+      if (_session) {
+        _session->restart();
+      } else {
+        send_hello();
+      }
       read_header_async();
     }
 
@@ -591,17 +728,37 @@ class AsyncTcpConnection :
   }
 
   void start() {
+    lock_guard<recursive_mutex> lock(_connectionsGuard);
+    if (_session) {
+      send_challenge();
+    }
     read_header_async();
   }
 
-  void send(const char *data, uint32_t length) {
+  /** Returns -1 for a message longer than the buffer of the connection,
+   * and 0 otherwise, even if the message is dropped since the peer isn't
+   * ready to receive it.
+   */
+  int send(const char *data, uint32_t length) {
     LOG_TRACE(_logger, "enter, node " << _selfId << ", dest: " << _destId);
 
     lock_guard<recursive_mutex> lock(_connectionsGuard);
+    if (length > _bufferLength - LENGTH_FIELD_SIZE - MSGTYPE_FIELD_SIZE -
+        (_session ? AUTH_FRAME_OVERHEAD : 0)) {
+      LOG_ERROR(_logger, "message too big, node " << _selfId
+                << ", dest: " << _destId
+                << ", length: " << length);
+      return -1;
+    }
+    if (_session && !_session->established()) {
+      LOG_TRACE(_logger, "session not established, node " << _selfId
+                << ", dest: " << _destId);
+      return 0;
+    }
     auto offset = prepare_output_buffer(MessageType::Regular,
                                         length);
     memcpy(_outBuffer + offset, data, length);
-    write_async(_outBuffer, offset + length);
+    write_async(_outBuffer, seal_output_buffer(offset + length));
 
     if (_statusCallback && _isReplica) {
       PeerConnectivityStatus pcs{};
@@ -617,6 +774,7 @@ class AsyncTcpConnection :
               << ", offset: " << offset
               << ", length: " << length);
     LOG_TRACE(_logger, "exit, node " << _selfId << ", dest: " << _destId);
+    return 0;
   }
 
   static ASYNC_CONN_PTR create(io_service *service,
@@ -628,7 +786,8 @@ class AsyncTcpConnection :
                                ConnType type,
                                concordlogger::Logger logger,
                                UPDATE_CONNECTIVITY_FN statusCallback,
-                               NodeMap nodes) {
+                               NodeMap nodes,
+                               AUTHENTICATOR_PTR authenticator) {
     auto res = ASYNC_CONN_PTR(
         new AsyncTcpConnection(service,
                                onError,
@@ -639,7 +798,8 @@ class AsyncTcpConnection :
                                type,
                                logger,
                                statusCallback,
-                               nodes));
+                               nodes,
+                               authenticator));
     res->init();
     return res;
   }
@@ -684,6 +844,7 @@ class PlainTCPCommunication::PlainTcpImpl {
   uint32_t _bufferLength;
   uint32_t _maxServerId;
   UPDATE_CONNECTIVITY_FN _statusCallback = nullptr;
+  AUTHENTICATOR_PTR _authenticator;
   recursive_mutex _connectionsGuard;
 
   void on_async_connection_error(NodeNum peerId) {
@@ -736,7 +897,8 @@ class PlainTCPCommunication::PlainTcpImpl {
            ConnType::Incoming,
            _logger,
            _statusCallback,
-           nodes);
+           nodes,
+           _authenticator);
     _pAcceptor->async_accept(conn->socket,
                              boost::bind(
                                  &PlainTcpImpl::on_accept,
@@ -758,13 +920,15 @@ class PlainTCPCommunication::PlainTcpImpl {
                uint16_t listenPort,
                uint32_t maxServerId,
                string listenIp,
-               UPDATE_CONNECTIVITY_FN statusCallback) :
+               UPDATE_CONNECTIVITY_FN statusCallback,
+               AUTHENTICATOR_PTR authenticator) :
       _selfId{selfNodeId},
       _listenPort{listenPort},
       _listenIp{listenIp},
       _bufferLength{bufferLength},
       _maxServerId{maxServerId},
-      _statusCallback{statusCallback} {
+      _statusCallback{statusCallback},
+      _authenticator{std::move(authenticator)} {
     // all replicas are in listen mode
     if (_selfId <= _maxServerId) {
       LOG_DEBUG(_logger, "node " << _selfId << " listening on " << _listenPort);
@@ -797,7 +961,8 @@ class PlainTCPCommunication::PlainTcpImpl {
                    ConnType::Outgoing,
                    _logger,
                    _statusCallback,
-                   nodes);
+                   nodes,
+                   _authenticator);
 
         _connections.insert(make_pair(it->first, conn));
         string peerIp = it->second.ip;
@@ -829,14 +994,16 @@ class PlainTCPCommunication::PlainTcpImpl {
          uint16_t listenPort,
          uint32_t tempHighestNodeForConnecting,
          string listenIp,
-         UPDATE_CONNECTIVITY_FN statusCallback) {
+         UPDATE_CONNECTIVITY_FN statusCallback,
+         AUTHENTICATOR_PTR authenticator) {
     return new PlainTcpImpl(selfNodeId,
                             nodes,
                             bufferLength,
                             listenPort,
                             tempHighestNodeForConnecting,
                             listenIp,
-                            statusCallback);
+                            statusCallback,
+                            authenticator);
   }
 
   int Start() {
@@ -891,6 +1058,7 @@ class PlainTCPCommunication::PlainTcpImpl {
     LOG_TRACE(_logger, "enter, from: " << _selfId
               << ", to: " << to_string(destNode));
 
+    int res = 0;
     lock_guard<recursive_mutex> lock(_connectionsGuard);
     auto temp = _connections.find(destNode);
     if (temp != _connections.end()) {
@@ -898,7 +1066,7 @@ class PlainTCPCommunication::PlainTcpImpl {
                 << ", to: " << destNode);
 
       if (temp->second->connected) {
-        temp->second->send(message, messageLength);
+        res = temp->second->send(message, messageLength);
       } else {
         LOG_TRACE(_logger,
            "conncection found but disconnected, from: " << _selfId
@@ -909,7 +1077,7 @@ class PlainTCPCommunication::PlainTcpImpl {
     LOG_TRACE(_logger, "exit, from: " << _selfId
               << ", to: " << destNode);
 
-    return 0;
+    return res;
   }
 
   /// TODO(IG): return real max message size... what is should be for TCP?
@@ -937,13 +1105,24 @@ PlainTCPCommunication::~PlainTCPCommunication() {
 }
 
 PlainTCPCommunication::PlainTCPCommunication(const PlainTcpConfig &config) {
+  AUTHENTICATOR_PTR authenticator = nullptr;
+  if (config.commType == CommType::SimpleAuthTcp) {
+    auto &authConfig = dynamic_cast<const SimpleAuthTcpConfig &>(config);
+    authenticator = std::make_shared<FrameAuthenticator>(config.selfId,
+                                                         config.nodes,
+                                                         authConfig.privateKey,
+                                                         authConfig.publicKeys,
+                                                         authConfig.authKey);
+  }
+
   _ptrImpl = PlainTcpImpl::create(config.selfId,
                                   config.nodes,
                                   config.bufferLength,
                                   config.listenPort,
                                   config.maxServerId,
                                   config.listenIp,
-                                  config.statusCallback);
+                                  config.statusCallback,
+                                  authenticator);
 }
 
 PlainTCPCommunication *PlainTCPCommunication::create(
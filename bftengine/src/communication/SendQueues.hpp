@@ -0,0 +1,257 @@
+// Concord
+//
+// Copyright (c) 2019 VMware, Inc. All Rights Reserved.
+//
+// This product is licensed to you under the Apache 2.0 license (the "License").
+// You may not use this product except in compliance with the Apache 2.0
+// License.
+//
+// This product may include a number of subcomponents with separate copyright
+// notices and license terms. Your use of these subcomponents is subject to the
+// terms and conditions of the subcomponent's license, as noted in the LICENSE
+// file.
+
+#ifndef BFTENGINE_SRC_COMMUNICATION_SENDQUEUES_HPP_
+#define BFTENGINE_SRC_COMMUNICATION_SENDQUEUES_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <utility>
+
+#include "CommDefs.hpp"
+#include "MessageClass.hpp"
+
+namespace bftEngine {
+
+/**
+ * Output queue state of a peer, kept by the transport across the
+ * reconnections to that peer and published as metrics.
+ */
+struct PeerQueueStats {
+  std::atomic<uint64_t> queuedMessages{0};
+  std::atomic<uint64_t> queuedBytes{0};
+  std::atomic<uint64_t> droppedMessages{0};
+  std::atomic<uint64_t> rejectedMessages{0};
+};
+
+typedef std::shared_ptr<PeerQueueStats> QUEUE_STATS_PTR;
+
+/**
+ * A message to write, owning its buffer.
+ */
+struct OutMessage {
+  char* data = nullptr;
+  size_t length = 0;
+  MessageClass msgClass = MessageClass::Consensus;
+
+  OutMessage(char* msg, uint32_t msgLength, MessageClass msgClass) :
+      data{msg},
+      length{msgLength},
+      msgClass{msgClass}
+  {
+  }
+
+  OutMessage& operator=(OutMessage&& other) {
+    if (this != &other) {
+      if(data) {
+        delete[] data;
+      }
+      data = other.data;
+      length = other.length;
+      msgClass = other.msgClass;
+      other.data = nullptr;
+      other.length = 0;
+    }
+    return *this;
+  }
+
+  OutMessage(OutMessage&& other) : data{nullptr}, length{0} {
+    *this = std::move(other);
+  };
+
+  OutMessage& operator=(const OutMessage&) = delete;
+  OutMessage(const OutMessage& other) = delete;
+
+  ~OutMessage() {
+    if(data) {
+      delete[] data;
+    }
+  }
+};
+
+/**
+ * The bounded output queues of a connection, one per MessageClass. Consensus
+ * messages are taken first, so that the queued state transfer ones (bulk
+ * block data) don't delay the consensus.
+ *
+ * When a new message doesn't fit in the limits, room is made for it by
+ * dropping queued messages:
+ * - a consensus message first evicts the oldest queued state transfer
+ *   messages, whatever the policies: otherwise a queue filled with state
+ *   transfer data would starve the consensus, as the engine can retransmit
+ *   the former but stalls without the latter.
+ * - then, under the DropOldest policy of its class, it drops the oldest
+ *   queued messages of its own class.
+ * Nothing is dropped unless the new message fits afterwards.
+ *
+ * The message taken for writing stays accounted until it is released.
+ * Not thread safe.
+ */
+class SendQueues {
+ public:
+  explicit SendQueues(SendQueueConfig limits) : _limits{limits} {}
+
+  ~SendQueues() {
+    // the messages left are lost with the queues
+    if (_stats) {
+      _stats->queuedMessages -= _queuedMessages;
+      _stats->queuedBytes -= _queuedBytes;
+    }
+  }
+
+  SendQueues(const SendQueues&) = delete;
+  SendQueues& operator=(const SendQueues&) = delete;
+
+  /**
+   * from then on, the queues are accounted in 'stats'
+   */
+  void setStats(QUEUE_STATS_PTR stats) {
+    _stats = stats;
+    _stats->queuedMessages += _queuedMessages;
+    _stats->queuedBytes += _queuedBytes;
+  }
+
+  /**
+   * @return false if the message is rejected, in which case it is released
+   */
+  bool push(OutMessage&& msg) {
+    if (!make_room(msg.msgClass, msg.length)) {
+      if (_stats) {
+        ++_stats->rejectedMessages;
+      }
+      return false;
+    }
+
+    ++_queuedMessages;
+    _queuedBytes += msg.length;
+    if (_stats) {
+      ++_stats->queuedMessages;
+      _stats->queuedBytes += msg.length;
+    }
+    queue_of(msg.msgClass).push_back(std::move(msg));
+    return true;
+  }
+
+  /**
+   * takes the next message to write, consensus first. It stays accounted
+   * until release() is called with its length.
+   * @return false if the queues are empty
+   */
+  bool pop(OutMessage& out) {
+    auto &queue = queue_of(MessageClass::Consensus).empty()
+                  ? queue_of(MessageClass::StateTransfer)
+                  : queue_of(MessageClass::Consensus);
+    if (queue.empty()) {
+      return false;
+    }
+    out = std::move(queue.front());
+    queue.pop_front();
+    return true;
+  }
+
+  /**
+   * the message of the given length taken by pop() has been written
+   */
+  void release(size_t length) {
+    --_queuedMessages;
+    _queuedBytes -= length;
+    if (_stats) {
+      --_stats->queuedMessages;
+      _stats->queuedBytes -= length;
+    }
+  }
+
+  // the messages taken and not released included
+  size_t queuedMessages() const { return _queuedMessages; }
+  size_t queuedBytes() const { return _queuedBytes; }
+  // the messages of the class waiting in the queue
+  size_t waiting(MessageClass msgClass) const {
+    return _queues[static_cast<size_t>(msgClass)].size();
+  }
+
+ private:
+  std::deque<OutMessage> &queue_of(MessageClass msgClass) {
+    return _queues[static_cast<size_t>(msgClass)];
+  }
+
+  // a message alone fits, or those larger than maxBytes would never be sent
+  bool fits(size_t messages, size_t bytes) const {
+    return messages <= 1 ||
+           ((_limits.maxMessages == 0 || messages <= _limits.maxMessages) &&
+            (_limits.maxBytes == 0 || bytes <= _limits.maxBytes));
+  }
+
+  /**
+   * makes room for a new message of the given class, see the class comment.
+   * @return false if the new message must be rejected
+   */
+  bool make_room(MessageClass msgClass, size_t length) {
+    size_t messages = _queuedMessages + 1;
+    size_t bytes = _queuedBytes + length;
+    if (fits(messages, bytes)) {
+      return true;
+    }
+
+    SendQueuePolicy policy = msgClass == MessageClass::StateTransfer
+                             ? _limits.stateTransferPolicy
+                             : _limits.consensusPolicy;
+
+    // the number of messages to drop from the front of each queue
+    size_t toDrop[2] = {0, 0};
+    auto count = [&](MessageClass victim) {
+      auto &queue = queue_of(victim);
+      size_t &n = toDrop[static_cast<size_t>(victim)];
+      while (n < queue.size() && !fits(messages, bytes)) {
+        --messages;
+        bytes -= queue[n].length;
+        ++n;
+      }
+    };
+    if (msgClass == MessageClass::Consensus) {
+      count(MessageClass::StateTransfer);
+    }
+    if (policy == SendQueuePolicy::DropOldest) {
+      count(msgClass);
+    }
+    if (!fits(messages, bytes)) {
+      return false;
+    }
+
+    for (size_t c = 0; c < 2; ++c) {
+      auto &queue = _queues[c];
+      for (size_t i = 0; i < toDrop[c]; ++i) {
+        release(queue.front().length);
+        if (_stats) {
+          ++_stats->droppedMessages;
+        }
+        queue.pop_front();
+      }
+    }
+    return true;
+  }
+
+  std::deque<OutMessage> _queues[2];
+  SendQueueConfig _limits;
+  // the messages taken and not released included
+  size_t _queuedMessages = 0;
+  size_t _queuedBytes = 0;
+  QUEUE_STATS_PTR _stats = nullptr;
+};
+
+}  // namespace bftEngine
+
+#endif  // BFTENGINE_SRC_COMMUNICATION_SENDQUEUES_HPP_
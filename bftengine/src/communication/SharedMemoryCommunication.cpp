@@ -0,0 +1,567 @@
+// Concord
+//
+// Copyright (c) 2019 VMware, Inc. All Rights Reserved.
+//
+// This product is licensed to you under the Apache 2.0 license (the "License").
+// You may not use this product except in compliance with the Apache 2.0 License.
+//
+// This product may include a number of subcomponents with separate copyright
+// notices and license terms. Your use of these subcomponents is subject to the
+// terms and conditions of the subcomponent's license, as noted in the
+// LICENSE file.
+
+// In-process transport. Every ordered pair of nodes (sender, receiver) owns a
+// single-producer/single-consumer byte ring per message class; a message is
+// written into the ring as a 4 bytes length followed by the payload. Each node
+// runs one receiving thread that polls its inbound rings, spinning for a short
+// while before parking on a condition variable, so a busy system never enters
+// the kernel on the data path. Consensus rings are polled ahead of the state
+// transfer ones, and bulk state transfer data can't fill the consensus ring.
+
+#include "Logger.hpp"
+#include "CommDefs.hpp"
+#include "MessageClass.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <map>
+#include <tuple>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+#include <functional>
+
+#define Assert(cond, txtMsg) assert(cond && (txtMsg))
+
+using namespace std;
+using namespace bftEngine;
+
+namespace {
+
+constexpr size_t kCacheLineSize = 64;
+
+// Byte ring with one writer and one reader. Positions grow monotonically and
+// are masked on access, so head == tail means "empty".
+class SpscRing {
+ public:
+  explicit SpscRing(uint32_t capacity)
+      : _capacity{capacity},
+        _mask{capacity - 1},
+        _buf{new char[capacity]} {
+    Assert((capacity & (capacity - 1)) == 0,
+           "Ring capacity must be a power of 2!");
+  }
+
+  ~SpscRing() {
+    delete[] _buf;
+  }
+
+  SpscRing(const SpscRing &) = delete;
+  SpscRing &operator=(const SpscRing &) = delete;
+
+  // Producer side. Returns false if there is not enough room for the message.
+  bool push(const char *msg, uint32_t len) {
+    const uint64_t need = sizeof(len) + len;
+    const uint64_t tail = _tail.load(memory_order_relaxed);
+    const uint64_t head = _head.load(memory_order_acquire);
+    if (need > _capacity - (tail - head)) {
+      return false;
+    }
+
+    copyIn(tail, reinterpret_cast<const char *>(&len), sizeof(len));
+    copyIn(tail + sizeof(len), msg, len);
+    _tail.store(tail + need, memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Copies the next message into 'out' and returns its length,
+  // or 0 if the ring is empty. 'out' must hold the largest message allowed.
+  uint32_t pop(char *out) {
+    const uint64_t head = _head.load(memory_order_relaxed);
+    const uint64_t tail = _tail.load(memory_order_acquire);
+    if (head == tail) {
+      return 0;
+    }
+
+    uint32_t len = 0;
+    copyOut(head, reinterpret_cast<char *>(&len), sizeof(len));
+    copyOut(head + sizeof(len), out, len);
+    _head.store(head + sizeof(len) + len, memory_order_release);
+    return len;
+  }
+
+  // Consumer side. Drops the messages pushed so far, but none of those pushed
+  // meanwhile, so it takes the same time however busy the producer is.
+  void discard() {
+    _head.store(_tail.load(memory_order_acquire), memory_order_release);
+  }
+
+  bool empty() const {
+    return _head.load(memory_order_acquire) ==
+        _tail.load(memory_order_acquire);
+  }
+
+  // Serializes concurrent senders of the same node. The lock is uncontended
+  // when a node sends from a single thread, and the reader never takes it.
+  mutex producerLock;
+
+ private:
+  void copyIn(uint64_t pos, const char *src, uint32_t len) {
+    const uint32_t off = pos & _mask;
+    const uint32_t first = min(len, _capacity - off);
+    memcpy(_buf + off, src, first);
+    memcpy(_buf, src + first, len - first);
+  }
+
+  void copyOut(uint64_t pos, char *dst, uint32_t len) const {
+    const uint32_t off = pos & _mask;
+    const uint32_t first = min(len, _capacity - off);
+    memcpy(dst, _buf + off, first);
+    memcpy(dst + first, _buf, len - first);
+  }
+
+  const uint32_t _capacity;
+  const uint32_t _mask;
+  char *const _buf;
+
+  // keep the reader and the writer positions on separate cache lines
+  char _pad0[kCacheLineSize];
+  atomic<uint64_t> _head{0};
+  char _pad1[kCacheLineSize - sizeof(atomic<uint64_t>)];
+  atomic<uint64_t> _tail{0};
+  char _pad2[kCacheLineSize - sizeof(atomic<uint64_t>)];
+};
+
+// Per-node wake-up channel, used only when the receiving thread is parked.
+struct Mailbox {
+  atomic<bool> running{false};
+  atomic<bool> waiting{false};
+  mutex waitLock;
+  condition_variable waitCond;
+
+  void notify() {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (waiting.load(memory_order_relaxed)) {
+      lock_guard<mutex> lock(waitLock);
+      waitCond.notify_one();
+    }
+  }
+};
+
+// Process wide registry of rings and mailboxes. Both ends of a pair may be
+// created in any order, whoever comes first creates the shared objects.
+class SharedMemoryBus {
+ public:
+  static SharedMemoryBus &instance() {
+    static SharedMemoryBus bus;
+    return bus;
+  }
+
+  shared_ptr<Mailbox> mailbox(NodeNum node) {
+    lock_guard<mutex> lock(_lock);
+    auto &res = _mailboxes[node];
+    if (!res) {
+      res = make_shared<Mailbox>();
+    }
+    return res;
+  }
+
+  shared_ptr<SpscRing> ring(NodeNum from,
+                            NodeNum to,
+                            MessageClass msgClass,
+                            uint32_t capacity) {
+    lock_guard<mutex> lock(_lock);
+    auto &res = _rings[make_tuple(from, to, msgClass)];
+    if (!res) {
+      res = make_shared<SpscRing>(capacity);
+    }
+    return res;
+  }
+
+ private:
+  SharedMemoryBus() = default;
+
+  mutex _lock;
+  map<NodeNum, shared_ptr<Mailbox>> _mailboxes;
+  map<tuple<NodeNum, NodeNum, MessageClass>, shared_ptr<SpscRing>> _rings;
+};
+
+uint32_t roundUpToPowerOf2(uint64_t v) {
+  uint64_t res = 1;
+  while (res < v) {
+    res <<= 1;
+  }
+  return static_cast<uint32_t>(res);
+}
+
+}  // namespace
+
+class SharedMemoryCommunication::SharedMemoryImpl {
+ private:
+  static constexpr size_t kNumOfClasses = 2;
+
+  // rings are indexed by MessageClass
+  struct Outbound {
+    shared_ptr<SpscRing> rings[kNumOfClasses];
+    shared_ptr<Mailbox> mailbox;
+  };
+
+  struct Inbound {
+    NodeNum sender;
+    shared_ptr<SpscRing> rings[kNumOfClasses];
+  };
+
+  // number of messages taken from one ring before moving to the next one
+  static constexpr int kBurst = 16;
+  // state transfer messages are large and have a low priority: the consensus
+  // rings are polled again after taking one from each peer
+  static constexpr int kStateTransferBurst = 1;
+  // empty polling rounds before yielding, and before parking
+  static constexpr int kSpinRounds = 1000;
+  static constexpr int kYieldRounds = 100;
+  static constexpr chrono::milliseconds kParkTimeout{10};
+
+  const uint32_t maxMsgSize;
+
+  /* The list of all nodes we're communicating with. */
+  const NodeMap endpoints;
+
+  unordered_map<NodeNum, Outbound> outbound;
+  vector<Inbound> inbound;
+
+  shared_ptr<Mailbox> selfMailbox;
+
+  /** Reference to the receiving thread. */
+  unique_ptr<thread> recvThreadRef;
+
+  /** Prevent multiple Start() invocations, i.e., multiple recvThread. */
+  mutex runningLock;
+
+  /** Reference to an IReceiver where we dispatch any received messages. */
+  IReceiver *receiverRef = nullptr;
+
+  vector<char> bufferForIncomingMessages;
+
+  UPDATE_CONNECTIVITY_FN statusCallback = nullptr;
+
+  NodeNum selfId;
+
+  /** Flag to indicate whether the current communication layer still runs. */
+  atomic<bool> running;
+
+  concordlogger::Logger _logger =
+      concordlogger::Log::getLogger("shared-memory");
+
+  bool check_replica(NodeNum node) const {
+    auto it = endpoints.find(node);
+    if (it == endpoints.end()) {
+      return false;
+    }
+
+    return it->second.isReplica;
+  }
+
+  bool has_pending() const {
+    for (auto &in : inbound) {
+      for (auto &ring : in.rings) {
+        if (!ring->empty()) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // Returns the number of messages dispatched.
+  int poll(MessageClass msgClass, int burst) {
+    int res = 0;
+    for (auto &in : inbound) {
+      auto &ring = in.rings[static_cast<size_t>(msgClass)];
+      for (int i = 0; i < burst; ++i) {
+        auto len = ring->pop(bufferForIncomingMessages.data());
+        if (!len) {
+          break;
+        }
+        ++res;
+        dispatch(in.sender, len);
+      }
+    }
+    return res;
+  }
+
+  int poll() {
+    int res = poll(MessageClass::Consensus, kBurst);
+    return res + poll(MessageClass::StateTransfer, kStateTransferBurst);
+  }
+
+  void dispatch(NodeNum sender, uint32_t len) {
+    LOG_DEBUG(_logger, "Node " << selfId << ": Calling onNewMessage, msg from: "
+                               << sender << ", length: " << len);
+    receiverRef->onNewMessage(sender, bufferForIncomingMessages.data(), len);
+
+    if (statusCallback && check_replica(sender)) {
+      PeerConnectivityStatus pcs{};
+      pcs.peerId = sender;
+      pcs.peerIp = endpoints.at(sender).ip;
+      pcs.peerPort = endpoints.at(sender).port;
+      pcs.statusType = StatusType::MessageReceived;
+
+      // pcs.statusTime = we dont set it since it is set by the aggregator
+      // in the upcoming version timestamps should be reviewed
+      statusCallback(pcs);
+    }
+  }
+
+  void recvThreadRoutine() {
+    int idleRounds = 0;
+    while (running) {
+      if (poll()) {
+        idleRounds = 0;
+        continue;
+      }
+
+      ++idleRounds;
+      if (idleRounds < kSpinRounds) {
+        continue;
+      }
+      if (idleRounds < kSpinRounds + kYieldRounds) {
+        this_thread::yield();
+        continue;
+      }
+
+      // Park. A sender that observes 'waiting' after publishing its message
+      // takes waitLock, so the notification can't get lost; the timeout is
+      // a safety net only.
+      unique_lock<mutex> lock(selfMailbox->waitLock);
+      selfMailbox->waiting.store(true, memory_order_relaxed);
+      atomic_thread_fence(memory_order_seq_cst);
+      if (running && !has_pending()) {
+        selfMailbox->waitCond.wait_for(lock, kParkTimeout);
+      }
+      selfMailbox->waiting.store(false, memory_order_relaxed);
+      idleRounds = 0;
+    }
+  }
+
+ public:
+  explicit SharedMemoryImpl(const SharedMemoryConfig &config)
+      : maxMsgSize{config.bufferLength},
+        endpoints{config.nodes},
+        bufferForIncomingMessages(config.bufferLength),
+        statusCallback{config.statusCallback},
+        selfId{config.selfId},
+        running{false} {
+    Assert(config.bufferLength > 0, "Buffer length should be positive!");
+    Assert(config.nodes.size() > 0, "No communication endpoints specified!");
+
+    uint64_t capacity = config.ringCapacity;
+    if (capacity == 0) {
+      capacity = 4 * ((uint64_t) maxMsgSize + sizeof(uint32_t));
+    }
+    capacity = max<uint64_t>(capacity, maxMsgSize + sizeof(uint32_t));
+    const uint32_t ringCapacity = roundUpToPowerOf2(capacity);
+
+    auto &bus = SharedMemoryBus::instance();
+    selfMailbox = bus.mailbox(selfId);
+
+    for (auto &next : endpoints) {
+      Outbound out;
+      Inbound in;
+      in.sender = next.first;
+      for (auto msgClass : {MessageClass::Consensus,
+                            MessageClass::StateTransfer}) {
+        auto i = static_cast<size_t>(msgClass);
+        out.rings[i] = bus.ring(selfId, next.first, msgClass, ringCapacity);
+        in.rings[i] = bus.ring(next.first, selfId, msgClass, ringCapacity);
+      }
+      out.mailbox = bus.mailbox(next.first);
+      outbound[next.first] = out;
+      inbound.push_back(in);
+
+      LOG_DEBUG(_logger, "Node " << selfId << ", got peer: " << next.first);
+
+      if (statusCallback && next.second.isReplica) {
+        PeerConnectivityStatus pcs{};
+        pcs.peerId = next.first;
+        pcs.peerIp = next.second.ip;
+        pcs.peerPort = next.second.port;
+        pcs.statusType = StatusType::Started;
+        statusCallback(pcs);
+      }
+    }
+
+    LOG_DEBUG(_logger, "Node " << selfId << ", ring capacity: " << ringCapacity
+                               << ", #endpoints = " << endpoints.size());
+  }
+
+  int getMaxMessageSize() {
+    return maxMsgSize;
+  }
+
+  int Start() {
+    if (!receiverRef) {
+      LOG_DEBUG(_logger, "Cannot Start(): Receiver not set");
+      return -1;
+    }
+
+    lock_guard<mutex> guard(runningLock);
+
+    if (running) {
+      LOG_DEBUG(_logger, "Cannot Start(): already running!");
+      return -1;
+    }
+
+    // Like a freshly bound socket, we don't see what was sent to this node
+    // before it started (e.g. leftovers of a previous instance). Peers may
+    // keep sending meanwhile: what they send from now on is received.
+    for (auto &in : inbound) {
+      for (auto &ring : in.rings) {
+        ring->discard();
+      }
+    }
+
+    running = true;
+    selfMailbox->running = true;
+    recvThreadRef.reset(
+        new thread(bind(&SharedMemoryImpl::recvThreadRoutine, this)));
+
+    return 0;
+  }
+
+  int Stop() {
+    lock_guard<mutex> guard(runningLock);
+    if (!running) {
+      LOG_DEBUG(_logger, "Cannot Stop(): not running!");
+      return -1;
+    }
+
+    running = false;
+    selfMailbox->running = false;
+    {
+      lock_guard<mutex> lock(selfMailbox->waitLock);
+      selfMailbox->waitCond.notify_one();
+    }
+    recvThreadRef->join();
+    recvThreadRef.reset();
+
+    return 0;
+  }
+
+  bool isRunning() const {
+    return running;
+  }
+
+  void setReceiver(NodeNum receiverNum, IReceiver *pRcv) {
+    receiverRef = pRcv;
+  }
+
+  ConnectionStatus getCurrentConnectionStatus(const NodeNum node) const {
+    auto it = outbound.find(node);
+    if (it == outbound.end()) {
+      return ConnectionStatus::Unknown;
+    }
+    return it->second.mailbox->running ? ConnectionStatus::Connected
+                                       : ConnectionStatus::Disconnected;
+  }
+
+  int sendAsyncMessage(const NodeNum destNode,
+                       const char *const message,
+                       const size_t messageLength) {
+    Assert(message != NULL, "No message provided!");
+
+    auto it = outbound.find(destNode);
+    if (it == outbound.end()) {
+      LOG_ERROR(_logger, "Node " << selfId << ": unknown destination "
+                                 << destNode);
+      return -1;
+    }
+    if (messageLength == 0 || messageLength > maxMsgSize) {
+      LOG_ERROR(_logger, "Node " << selfId << ": invalid message length "
+                                 << messageLength);
+      return -1;
+    }
+
+    auto &ring = it->second.rings[static_cast<size_t>(
+        classifyMessage(message, messageLength))];
+    bool pushed = false;
+    {
+      lock_guard<mutex> lock(ring->producerLock);
+      pushed = ring->push(message, (uint32_t) messageLength);
+    }
+    if (!pushed) {
+      LOG_DEBUG(_logger, "Node " << selfId << ": ring to " << destNode
+                                 << " is full, message rejected");
+      return SEND_REJECTED_BACKPRESSURE;
+    }
+    it->second.mailbox->notify();
+
+    if (statusCallback) {
+      PeerConnectivityStatus pcs{};
+      pcs.peerId = selfId;
+      pcs.statusType = StatusType::MessageSent;
+
+      // pcs.statusTime = we dont set it since it is set by the aggregator
+      // in the upcoming version timestamps should be reviewed
+      statusCallback(pcs);
+    }
+
+    return 0;
+  }
+};
+
+constexpr chrono::milliseconds
+    SharedMemoryCommunication::SharedMemoryImpl::kParkTimeout;
+
+SharedMemoryCommunication::~SharedMemoryCommunication() {
+  if (_ptrImpl && _ptrImpl->isRunning()) {
+    _ptrImpl->Stop();
+  }
+}
+
+SharedMemoryCommunication::SharedMemoryCommunication(
+    const SharedMemoryConfig &config)
+    : _ptrImpl{new SharedMemoryImpl(config)} {
+}
+
+SharedMemoryCommunication *
+SharedMemoryCommunication::create(const SharedMemoryConfig &config) {
+  return new SharedMemoryCommunication(config);
+}
+
+int SharedMemoryCommunication::getMaxMessageSize() {
+  return _ptrImpl->getMaxMessageSize();
+}
+
+int SharedMemoryCommunication::Start() {
+  return _ptrImpl->Start();
+}
+
+int SharedMemoryCommunication::Stop() {
+  return _ptrImpl->Stop();
+}
+
+bool SharedMemoryCommunication::isRunning() const {
+  return _ptrImpl->isRunning();
+}
+
+ConnectionStatus
+SharedMemoryCommunication::getCurrentConnectionStatus(
+    const NodeNum node) const {
+  return _ptrImpl->getCurrentConnectionStatus(node);
+}
+
+int
+SharedMemoryCommunication::sendAsyncMessage(const NodeNum destNode,
+                                            const char *const message,
+                                            const size_t messageLength) {
+  return _ptrImpl->sendAsyncMessage(destNode, message, messageLength);
+}
+
+void
+SharedMemoryCommunication::setReceiver(NodeNum receiverNum,
+                                       IReceiver *receiver) {
+  _ptrImpl->setReceiver(receiverNum, receiver);
+}
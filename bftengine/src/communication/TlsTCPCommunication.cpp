@@ -46,6 +46,9 @@
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 #include "Logger.hpp"
+#include "Metrics.hpp"
+#include "MessageClass.hpp"
+#include "SendQueues.hpp"
 
 using namespace std;
 using namespace concordlogger;
@@ -86,43 +89,6 @@ class AsyncTlsConnection : public
 
  private:
 
-  struct OutMessage {
-    char* data = nullptr;
-    size_t length = 0;
-
-    OutMessage(char* msg, uint32_t msgLength) :
-        data{msg},
-        length{msgLength}
-    {
-    }
-
-    OutMessage& operator=(OutMessage&& other) {
-      if (this != &other) {
-        if(data) {
-          delete[] data;
-        }
-        data = other.data;
-        length = other.length;
-        other.data = nullptr;
-        other.length = 0;
-      }
-      return *this;
-    }
-
-    OutMessage(OutMessage&& other) : data{nullptr}, length{0} {
-      *this = std::move(other);
-    };
-
-    OutMessage& operator=(const OutMessage&) = delete;
-    OutMessage(const OutMessage& other) = delete;
-
-    ~OutMessage() {
-      if(data) {
-        delete[] data;
-      }
-    }
-  };
-
   // msg header: 4 bytes msg length
   static constexpr uint8_t MSG_LENGTH_FIELD_SIZE = 4;
   static constexpr uint8_t MSG_HEADER_SIZE = MSG_LENGTH_FIELD_SIZE;
@@ -159,7 +125,12 @@ class AsyncTlsConnection : public
   UPDATE_CONNECTIVITY_FN _statusCallback = nullptr;
   NodeMap _nodes;
   asio::ssl::context _sslContext;
-  deque<OutMessage> _outQueue;
+  // the output queues, consensus messages first
+  SendQueues _queues;
+  // the message being written, and whether a write is in progress or posted
+  OutMessage _inFlight{nullptr, 0, MessageClass::Consensus};
+  bool _writing = false;
+  // guards _queues, _inFlight and _writing
   mutex _writeLock;
 
   // internal state
@@ -179,6 +150,7 @@ class AsyncTlsConnection : public
                      ConnType type,
                      NodeMap nodes,
                      string cipherSuite,
+                     SendQueueConfig queueLimits,
                      UPDATE_CONNECTIVITY_FN statusCallback = nullptr) :
       _service(service),
       _maxMessageLength(bufferLength + MSG_HEADER_SIZE + 1),
@@ -199,6 +171,7 @@ class AsyncTlsConnection : public
       _sslContext{asio::ssl::context(type == ConnType::Incoming
                                      ? asio::ssl::context::tlsv12_server
                                      : asio::ssl::context::tlsv12_client)},
+      _queues{queueLimits},
       _disposed(false),
       _authenticated{false},
       _connected{false} {
@@ -890,10 +863,19 @@ class AsyncTlsConnection : public
     }
   }
 
+  /**
+   * takes the next message, consensus first, and starts writing it.
+   * Must be called with _writeLock held.
+   */
   void start_async_write() {
+    if (!_queues.pop(_inFlight)) {
+      _writing = false;
+      return;
+    }
+
     asio::async_write(
         *_socket,
-        asio::buffer(_outQueue.front().data, _outQueue.front().length),
+        asio::buffer(_inFlight.data, _inFlight.length),
         boost::bind(
             &AsyncTlsConnection::async_write_complete,
             shared_from_this(),
@@ -929,14 +911,13 @@ class AsyncTlsConnection : public
     }
 
     lock_guard<mutex> l(_writeLock);
-    //remove the message that has been sent
-    _outQueue.pop_front();
+    //release the message that has been sent
+    _queues.release(_inFlight.length);
+    _inFlight = OutMessage(nullptr, 0, MessageClass::Consensus);
 
-    // if there are more messages, continue to send but don' renmove, s.t.
+    // if there are more messages, continue to send, _writing stays set s.t.
     // the send() method will not trigger concurrent write
-    if(_outQueue.size() > 0) {
-      start_async_write();
-    }
+    start_async_write();
   }
 
   /**
@@ -951,9 +932,7 @@ class AsyncTlsConnection : public
 
     //
     lock_guard<mutex> l(_writeLock);
-    if(_outQueue.size() > 0) {
-      start_async_write();
-    }
+    start_async_write();
   }
 
   /// ************* write functions end ******************* ////
@@ -1000,8 +979,9 @@ class AsyncTlsConnection : public
    * is executed in the worker thread.
    * @param data data to be sent
    * @param length data length
+   * @return 0 or SEND_REJECTED_BACKPRESSURE if the output queue is full
    */
-  void send(const char *data, uint32_t length) {
+  int send(const char *data, uint32_t length) {
     assert(data);
     assert(length > 0 && length <= _maxMessageLength - MSG_HEADER_SIZE);
 
@@ -1009,20 +989,26 @@ class AsyncTlsConnection : public
     memset(buf, 0, length + MSG_HEADER_SIZE);
     put_message_header(buf, length);
     memcpy(buf + MSG_HEADER_SIZE, data, length);
+    OutMessage out = OutMessage(buf,
+                                length + MSG_HEADER_SIZE,
+                                classifyMessage(data, length));
 
     // here we lock to protect multiple thread access and to synch with callback
     // queue access
     lock_guard<mutex> l(_writeLock);
 
-    // push to the output queue
-    OutMessage out = OutMessage(buf, length + MSG_HEADER_SIZE);
-    _outQueue.push_back(std::move(out));
+    if (!_queues.push(std::move(out))) {
+      LOG_DEBUG(_logger, "output queue full, from: " << _selfId
+                                                     << ", to: " << _destId
+                                                     << ", length: " << length);
+      return SEND_REJECTED_BACKPRESSURE;
+    }
 
-    // if there is only one message in the queue there are no pending writes
-    // - we can start one
+    // if there are no pending writes - we can start one
     // we must post to asio service because async operations should be
     // started from asio threads and not during pending async read
-    if(_outQueue.size() == 1) {
+    if(!_writing) {
+      _writing = true;
       _service->post(boost::bind(&AsyncTlsConnection::do_write,
                                  shared_from_this()));
     }
@@ -1040,12 +1026,22 @@ class AsyncTlsConnection : public
       // in the upcoming version timestamps should be reviewed
       _statusCallback(pcs);
     }
+    return 0;
   }
 
   void setReceiver(NodeNum nodeId, IReceiver *rec) {
     _receiver = rec;
   }
 
+  /**
+   * the peer is known only once the connection is authenticated, from then
+   * on the queue of this connection is accounted in the peer stats
+   */
+  void setQueueStats(QUEUE_STATS_PTR stats) {
+    lock_guard<mutex> l(_writeLock);
+    _queues.setStats(stats);
+  }
+
   static ASYNC_CONN_PTR create(asio::io_service *service,
                                function<void(NodeNum)> onError,
                                function<void(NodeNum, ASYNC_CONN_PTR)> onReady,
@@ -1056,7 +1052,8 @@ class AsyncTlsConnection : public
                                ConnType type,
                                UPDATE_CONNECTIVITY_FN statusCallback,
                                NodeMap nodes,
-                               string cipherSuite) {
+                               string cipherSuite,
+                               SendQueueConfig queueLimits) {
     auto res = ASYNC_CONN_PTR(
         new AsyncTlsConnection(service,
                                onError,
@@ -1068,6 +1065,7 @@ class AsyncTlsConnection : public
                                type,
                                nodes,
                                cipherSuite,
+                               queueLimits,
                                statusCallback));
     res->init();
     return res;
@@ -1078,8 +1076,6 @@ class AsyncTlsConnection : public
                                             _connType);
 
     delete[] _inBuffer;
-
-    
   }
 
   void dispose() {
@@ -1119,6 +1115,21 @@ class TlsTCPCommunication::TlsTcpImpl :
   Logger _logger;
   UPDATE_CONNECTIVITY_FN _statusCallback;
   string _cipherSuite;
+  SendQueueConfig _sendQueue;
+
+  // output queue stats and metrics, per peer
+  static constexpr uint32_t METRICS_UPDATE_PERIOD_MILLI = 1000;
+  typedef concordMetrics::Component::Handle<concordMetrics::Gauge> GaugeHandle;
+  struct PeerQueueMetrics {
+    QUEUE_STATS_PTR stats;
+    GaugeHandle queuedMessages;
+    GaugeHandle queuedBytes;
+    GaugeHandle droppedMessages;
+    GaugeHandle rejectedMessages;
+  };
+  concordMetrics::Component _metrics;
+  unordered_map<NodeNum, PeerQueueMetrics> _queueMetrics;
+  asio::deadline_timer _metricsTimer;
 
   mutex _connectionsGuard;
   mutable mutex _startStopGuard;
@@ -1171,9 +1182,42 @@ class TlsTCPCommunication::TlsTcpImpl :
     }
 
     conn->setReceiver(id, _pReceiver);
+    auto metrics = _queueMetrics.find(id);
+    if (metrics != _queueMetrics.end()) {
+      conn->setQueueStats(metrics->second.stats);
+    }
     _connections.insert(make_pair(id, conn));
   }
 
+  void on_metrics_timer(const B_ERROR_CODE &ec) {
+    if (ec == asio::error::operation_aborted) {
+      return;
+    }
+
+    for (auto &it : _queueMetrics) {
+      PeerQueueMetrics &m = it.second;
+      m.queuedMessages.Get().Set(m.stats->queuedMessages);
+      m.queuedBytes.Get().Set(m.stats->queuedBytes);
+      m.droppedMessages.Get().Set(m.stats->droppedMessages);
+      m.rejectedMessages.Get().Set(m.stats->rejectedMessages);
+    }
+    _metrics.UpdateAggregator();
+    start_metrics_timer();
+  }
+
+  // the pending wait holds no reference, so that it doesn't keep a stopped
+  // object alive
+  void start_metrics_timer() {
+    _metricsTimer.expires_from_now(
+        boost::posix_time::milliseconds(METRICS_UPDATE_PERIOD_MILLI));
+    std::weak_ptr<TlsTcpImpl> self = shared_from_this();
+    _metricsTimer.async_wait([self](const B_ERROR_CODE &ec) {
+      if (auto impl = self.lock()) {
+        impl->on_metrics_timer(ec);
+      }
+    });
+  }
+
   void on_accept(ASYNC_CONN_PTR conn,
                  const B_ERROR_CODE &ec) {
     LOG_DEBUG(_logger, "on_accept, enter, node: " + to_string(_selfId) +
@@ -1215,7 +1259,8 @@ class TlsTCPCommunication::TlsTcpImpl :
             ConnType::Incoming,
             _statusCallback,
             _nodes,
-            _cipherSuite);
+            _cipherSuite,
+            _sendQueue);
     _pAcceptor->async_accept(conn->get_socket().lowest_layer(),
                              boost::bind(
                                  &TlsTcpImpl::on_accept,
@@ -1237,6 +1282,8 @@ class TlsTCPCommunication::TlsTcpImpl :
              string listenIp,
              string certRootFolder,
              string cipherSuite,
+             SendQueueConfig sendQueue,
+             std::shared_ptr<concordMetrics::Aggregator> aggregator,
              UPDATE_CONNECTIVITY_FN statusCallback = nullptr) :
       _selfId(selfNodeNum),
       _listenPort(listenPort),
@@ -1246,11 +1293,27 @@ class TlsTCPCommunication::TlsTcpImpl :
       _certRootFolder(certRootFolder),
       _logger(Log::getLogger("concord.tls")),
       _statusCallback{statusCallback},
-      _cipherSuite{cipherSuite} {
+      _cipherSuite{cipherSuite},
+      _sendQueue{sendQueue},
+      _metrics{"tls_communication",
+               aggregator ? aggregator
+                          : std::make_shared<concordMetrics::Aggregator>()},
+      _metricsTimer{_service} {
     //_service = new io_service();
     for (auto it = nodes.begin(); it != nodes.end(); it++) {
       _nodes.insert({it->first, it->second});
+      if (it->first == _selfId) {
+        continue;
+      }
+      string peer = to_string(it->first);
+      _queueMetrics.insert(make_pair(it->first, PeerQueueMetrics{
+          std::make_shared<PeerQueueStats>(),
+          _metrics.RegisterGauge("send_queue_messages_" + peer, 0),
+          _metrics.RegisterGauge("send_queue_bytes_" + peer, 0),
+          _metrics.RegisterGauge("send_queue_dropped_" + peer, 0),
+          _metrics.RegisterGauge("send_queue_rejected_" + peer, 0)}));
     }
+    _metrics.Register();
   }
 
   void create_outgoing_connection(
@@ -1273,7 +1336,8 @@ class TlsTCPCommunication::TlsTcpImpl :
             ConnType::Outgoing,
             _statusCallback,
             _nodes,
-            _cipherSuite);
+            _cipherSuite,
+            _sendQueue);
 
     conn->connect(peerIp, peerPort);
     LOG_INFO(_logger, "connect called for node " << _selfId << ", dest: " << nodeId);
@@ -1288,6 +1352,9 @@ class TlsTCPCommunication::TlsTcpImpl :
                             string listenIp,
                             string certRootFolder,
                             string cipherSuite,
+                            SendQueueConfig sendQueue,
+                            std::shared_ptr<concordMetrics::Aggregator>
+                                aggregator,
                             UPDATE_CONNECTIVITY_FN statusCallback) {
     return std::shared_ptr<TlsTcpImpl>(new TlsTcpImpl(selfNodeId,
                           nodes,
@@ -1297,6 +1364,8 @@ class TlsTCPCommunication::TlsTcpImpl :
                           listenIp,
                           certRootFolder,
                           cipherSuite,
+                          sendQueue,
+                          aggregator,
                           statusCallback));
   }
 
@@ -1347,6 +1416,8 @@ class TlsTCPCommunication::TlsTcpImpl :
       }
     }
 
+    start_metrics_timer();
+
     _pIoThread =
         new std::thread(std::bind
                             (static_cast<size_t(boost::asio::io_service::*)()>
@@ -1373,6 +1444,10 @@ class TlsTCPCommunication::TlsTcpImpl :
     }
     _pIoThread = nullptr;
 
+    // the io thread is gone, the timer can be used from here
+    B_ERROR_CODE ec;
+    _metricsTimer.cancel(ec);
+
     if(_pAcceptor) {
       _pAcceptor->close();
     }
@@ -1411,7 +1486,8 @@ class TlsTCPCommunication::TlsTcpImpl :
   /**
   * Sends a message on the underlying communication layer to a given
   * destination node. Asynchronous (non-blocking) method.
-  * Returns 0 on success.
+  * Returns 0 on success, SEND_REJECTED_BACKPRESSURE if the output queue to
+  * the destination is full.
   */
   int sendAsyncMessage(const NodeNum destNode,
                        const char *const message,
@@ -1419,7 +1495,7 @@ class TlsTCPCommunication::TlsTcpImpl :
     lock_guard<mutex> lock(_connectionsGuard);
     auto temp = _connections.find(destNode);
     if (temp != _connections.end()) {
-      temp->second->send(message, messageLength);
+      return temp->second->send(message, messageLength);
     } else {
       LOG_DEBUG(_logger,
                 "connection NOT found, from: " << _selfId
@@ -1435,6 +1511,8 @@ class TlsTCPCommunication::TlsTcpImpl :
   }
 };
 
+constexpr uint32_t TlsTCPCommunication::TlsTcpImpl::METRICS_UPDATE_PERIOD_MILLI;
+
 TlsTCPCommunication::~TlsTCPCommunication() {
 
 }
@@ -1448,6 +1526,8 @@ TlsTCPCommunication::TlsTCPCommunication(const TlsTcpConfig &config) {
                                 config.listenIp,
                                 config.certificatesRootPath,
                                 config.cipherSuite,
+                                config.sendQueue,
+                                config.aggregator,
                                 config.statusCallback);
 }
 
@@ -159,10 +159,10 @@ class SimpleStateTran : public ISimpleInMemoryStateTransfer {
       realInterface_->freeStateTransferMsg(m);
     }
 
-    void sendStateTransferMessage(char *m,
+    int sendStateTransferMessage(char *m,
       uint32_t size,
       uint16_t replicaId) override  {
-      realInterface_->sendStateTransferMessage(m, size, replicaId);
+      return realInterface_->sendStateTransferMessage(m, size, replicaId);
     }
 
     void changeStateTransferTimerPeriod(
@@ -47,15 +47,16 @@ class TestReplica : public IReplicaForStateTransfer {
     std::free(p);
   }
 
-  void sendStateTransferMessage(char* m,
-                                uint32_t size,
-                                uint16_t replicaId) override {
+  int sendStateTransferMessage(char* m,
+                               uint32_t size,
+                               uint16_t replicaId) override {
 
     std::unique_ptr<char> msg{new char[size]};
     memcpy(msg.get(), m, size);
 
 
     sent_messages_.push_back(Msg{std::move(msg), size, replicaId});
+    return 0;
   }
 
   void changeStateTransferTimerPeriod(uint32_t timerPeriodMilli) override{};
@@ -0,0 +1,234 @@
+// Concord
+//
+// Copyright (c) 2019 VMware, Inc. All Rights Reserved.
+//
+// This product is licensed to you under the Apache 2.0 license (the "License").
+// You may not use this product except in compliance with the Apache 2.0
+// License.
+//
+// This product may include a number of subcomponents with separate copyright
+// notices and license terms. Your use of these subcomponents is subject to the
+// terms and conditions of the subcomponent's license, as noted in the LICENSE
+// file.
+
+// Point to point throughput of the ICommunication implementations available
+// in this build: node 1 sends a stream of messages to node 0, both in this
+// process. Reports messages/sec and the CPU time (of the whole process, i.e.
+// both ends) spent per message.
+//
+// Plain and TLS TCP can't be built together, compare them by running the
+// benchmark from both builds with the same arguments. io_uring TCP is built
+// along with either (BUILD_COMM_IO_URING).
+//
+// usage: comm_benchmark [-n messages] [-s message size] [-c certificates dir]
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "CommDefs.hpp"
+
+using namespace bftEngine;
+
+namespace {
+
+const uint16_t kBasePort = 3790;
+const uint32_t kBufferLength = 64000;
+
+class CountingReceiver : public IReceiver {
+ public:
+  std::atomic<uint64_t> messages{0};
+
+  void onNewMessage(const NodeNum,
+                    const char *const,
+                    const size_t) override {
+    ++messages;
+  }
+
+  void onConnectionStatusChanged(const NodeNum,
+                                 const ConnectionStatus) override {}
+};
+
+// Creates the communication object of a node, for the given transport.
+typedef std::function<ICommunication *(NodeNum, const NodeMap &)> Factory;
+
+NodeMap benchmarkNodes() {
+  NodeMap nodes;
+  nodes[0] = NodeInfo{"127.0.0.1", kBasePort, true};
+  nodes[1] = NodeInfo{"127.0.0.1", kBasePort + 2, true};
+  return nodes;
+}
+
+bool waitFor(const CountingReceiver &receiver, uint64_t count, int seconds) {
+  auto deadline = std::chrono::steady_clock::now() +
+      std::chrono::seconds(seconds);
+  while (receiver.messages < count) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  return true;
+}
+
+void run(const std::string &name,
+         const Factory &factory,
+         uint64_t numOfMessages,
+         uint32_t messageSize) {
+  NodeMap nodes = benchmarkNodes();
+  std::unique_ptr<ICommunication> server(factory(0, nodes));
+  std::unique_ptr<ICommunication> client(factory(1, nodes));
+  CountingReceiver serverReceiver, clientReceiver;
+  server->setReceiver(0, &serverReceiver);
+  client->setReceiver(1, &clientReceiver);
+  server->Start();
+  client->Start();
+
+  std::vector<char> msg(messageSize, 'x');
+
+  // Connection oriented transports drop what is sent before the connection
+  // is up: probe until something goes through.
+  uint64_t warmup = 0;
+  while (serverReceiver.messages == 0 && warmup < 10000) {
+    client->sendAsyncMessage(0, msg.data(), msg.size());
+    ++warmup;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  if (!waitFor(serverReceiver, 1, 10)) {
+    std::cout << name << ": no connection" << std::endl;
+    return;
+  }
+  // let in flight probes arrive
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  uint64_t base = serverReceiver.messages;
+
+  auto cpuStart = std::clock();
+  auto start = std::chrono::steady_clock::now();
+  uint64_t rejected = 0;
+  for (uint64_t i = 0; i < numOfMessages; ++i) {
+    while (client->sendAsyncMessage(0, msg.data(), msg.size()) != 0) {
+      ++rejected;
+      std::this_thread::yield();
+    }
+  }
+  bool complete = waitFor(serverReceiver, base + numOfMessages, 60);
+  auto end = std::chrono::steady_clock::now();
+  auto cpuEnd = std::clock();
+
+  client->Stop();
+  server->Stop();
+
+  uint64_t received = serverReceiver.messages - base;
+  double seconds = std::chrono::duration<double>(end - start).count();
+  double cpuSeconds = double(cpuEnd - cpuStart) / CLOCKS_PER_SEC;
+  std::cout << std::left << std::setw(14) << name
+            << " messages: " << received << "/" << numOfMessages
+            << (complete ? "" : " (incomplete)")
+            << ", msg/sec: " << uint64_t(received / seconds)
+            << ", MB/sec: " << (received * messageSize / seconds / 1e6)
+            << ", CPU usec/msg: "
+            << (received ? cpuSeconds * 1e6 / received : 0)
+            << ", send retries: " << rejected << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  uint64_t numOfMessages = 100000;
+  uint32_t messageSize = 1024;
+  std::string certificatesPath;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:c:")) != -1) {
+    switch (opt) {
+      case 'n':
+        numOfMessages = std::stoull(optarg);
+        break;
+      case 's':
+        messageSize = std::stoul(optarg);
+        break;
+      case 'c':
+        certificatesPath = optarg;
+        break;
+      default:
+        std::cerr << "usage: " << argv[0]
+                  << " [-n messages] [-s message size] [-c certificates dir]"
+                  << std::endl;
+        return 1;
+    }
+  }
+  if (messageSize == 0 || messageSize > kBufferLength) {
+    std::cerr << "message size must be in [1, " << kBufferLength << "]"
+              << std::endl;
+    return 1;
+  }
+
+  std::cout << "messages: " << numOfMessages
+            << ", message size: " << messageSize << std::endl;
+
+  run("SharedMemory",
+      [](NodeNum id, const NodeMap &nodes) -> ICommunication * {
+        return SharedMemoryCommunication::create(
+            SharedMemoryConfig(kBufferLength, nodes, id));
+      },
+      numOfMessages, messageSize);
+
+#ifdef USE_COMM_PLAIN_TCP
+  run("PlainTcp",
+      [](NodeNum id, const NodeMap &nodes) -> ICommunication * {
+        return PlainTCPCommunication::create(
+            PlainTcpConfig("127.0.0.1", nodes.at(id).port, kBufferLength,
+                           nodes, 1, id));
+      },
+      numOfMessages, messageSize);
+
+  // with a shared secret rather than key pairs, which only change the
+  // handshake of a connection, not the cost of a frame
+  run("SimpleAuthTcp",
+      [](NodeNum id, const NodeMap &nodes) -> ICommunication * {
+        return PlainTCPCommunication::create(
+            SimpleAuthTcpConfig("127.0.0.1", nodes.at(id).port, kBufferLength,
+                                nodes, 1, id, "", {},
+                                "comm benchmark secret"));
+      },
+      numOfMessages, messageSize);
+#endif
+
+#ifdef USE_COMM_IO_URING
+  run("IoUringTcp",
+      [](NodeNum id, const NodeMap &nodes) -> ICommunication * {
+        return IoUringTcpCommunication::create(
+            IoUringTcpConfig("127.0.0.1", nodes.at(id).port, kBufferLength,
+                             nodes, 1, id));
+      },
+      numOfMessages, messageSize);
+#endif
+
+#ifdef USE_COMM_TLS_TCP
+  if (certificatesPath.empty()) {
+    std::cout << "TlsTcp: skipped, no certificates directory (-c)"
+              << std::endl;
+  } else {
+    run("TlsTcp",
+        [&certificatesPath](NodeNum id,
+                            const NodeMap &nodes) -> ICommunication * {
+          return TlsTCPCommunication::create(
+              TlsTcpConfig("127.0.0.1", nodes.at(id).port, kBufferLength,
+                           nodes, 1, id, certificatesPath,
+                           "ECDHE-ECDSA-AES256-GCM-SHA384"));
+        },
+        numOfMessages, messageSize);
+  }
+#endif
+
+  return 0;
+}
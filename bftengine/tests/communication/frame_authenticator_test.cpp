@@ -0,0 +1,317 @@
+// Concord
+//
+// Copyright (c) 2019 VMware, Inc. All Rights Reserved.
+//
+// This product is licensed to you under the Apache 2.0 license (the "License").
+// You may not use this product except in compliance with the Apache 2.0
+// License.
+//
+// This product may include a number of subcomponents with separate copyright
+// notices and license terms. Your use of these subcomponents is subject to the
+// terms and conditions of the subcomponent's license, as noted in the LICENSE
+// file.
+
+#include "gtest/gtest.h"
+#include "FrameAuthenticator.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace bftEngine;
+
+namespace {
+
+const NodeNum NUM_REPLICAS = 4;
+// a client, without a key pair
+const NodeNum CLIENT = NUM_REPLICAS;
+const std::string SECRET = "deployment secret";
+const uint16_t TYPE = 2;
+
+NodeMap nodes() {
+  NodeMap res;
+  for (NodeNum i = 0; i <= CLIENT; ++i) {
+    res[i] = NodeInfo{"127.0.0.1", static_cast<uint16_t>(3800 + i), i < CLIENT};
+  }
+  return res;
+}
+
+// The keys of the replica key files, as ReplicaConfig holds them.
+struct Keys {
+  std::vector<std::string> privateKeys;
+  std::unordered_map<NodeNum, std::string> publicKeys;
+
+  Keys() {
+    for (NodeNum i = 0; i < NUM_REPLICAS; ++i) {
+      std::ifstream file(std::string(KEYS_DIR) + "/private_replica_" +
+                         std::to_string(i));
+      NodeNum publicKeyIndex = 0;
+      bool inPublicKeys = false;
+      std::string line;
+      while (std::getline(file, line)) {
+        if (line == "rsa_public_keys:") {
+          inPublicKeys = true;
+        } else if (inPublicKeys && line.compare(0, 4, "  - ") == 0) {
+          publicKeys[publicKeyIndex++] = line.substr(4);
+        } else if (line.compare(0, 17, "rsa_private_key: ") == 0) {
+          privateKeys.push_back(line.substr(17));
+        } else if (!line.empty() && line[0] != ' ') {
+          inPublicKeys = false;
+        }
+      }
+    }
+  }
+};
+
+const Keys &keys() {
+  static Keys res;
+  return res;
+}
+
+// The key material of node 'selfId', which holds the private key of replica
+// 'privateKeyOf' if any.
+AUTHENTICATOR_PTR authenticator(NodeNum selfId,
+                                const std::string &secret = "",
+                                NodeNum privateKeyOf = CLIENT) {
+  if (privateKeyOf == CLIENT && selfId < CLIENT) {
+    privateKeyOf = selfId;
+  }
+  return std::make_shared<FrameAuthenticator>(
+      selfId, nodes(),
+      privateKeyOf < CLIENT ? keys().privateKeys[privateKeyOf] : "",
+      keys().publicKeys, secret);
+}
+
+// A frame, from the message type to the MAC, as sealed by 'session'.
+std::string seal(FrameSession &session, const std::string &payload) {
+  std::string frame(MSGTYPE_FIELD_SIZE + AUTH_COUNTER_FIELD_SIZE +
+                    payload.size() + AUTH_MAC_FIELD_SIZE, '\0');
+  memcpy(&frame[0], &TYPE, sizeof(TYPE));
+  memcpy(&frame[MSGTYPE_FIELD_SIZE + AUTH_COUNTER_FIELD_SIZE],
+         payload.data(), payload.size());
+  session.seal(&frame[0], frame.size() - AUTH_MAC_FIELD_SIZE);
+  return frame;
+}
+
+bool open(FrameSession &session, const std::string &frame) {
+  return session.open(frame.data(), frame.size() - AUTH_MAC_FIELD_SIZE);
+}
+
+// Both ends of a connection from node 'from' to node 'to' take the hello,
+// which is returned.
+std::string connect(FrameSession &from, NodeNum to, FrameSession &accepting) {
+  std::string hello;
+  EXPECT_TRUE(from.make_hello(to, accepting.own_nonce(), hello));
+  NodeNum source = 0;
+  EXPECT_TRUE(accepting.accept_hello(hello.data(), hello.size(), source));
+  EXPECT_TRUE(open(accepting, seal(from, hello)));
+  return hello;
+}
+
+size_t hello_size() {
+  FrameSession session(authenticator(1));
+  std::string hello;
+  session.make_hello(0, 0, hello);
+  return hello.size();
+}
+
+TEST(frame_authenticator_test, tampered_frames) {
+  FrameSession sender(authenticator(1));
+  FrameSession receiver(authenticator(0));
+  connect(sender, 0, receiver);
+
+  std::string frame = seal(sender, "payload");
+  // every byte is covered: type, counter, payload and the MAC itself
+  for (size_t i = 0; i < frame.size(); ++i) {
+    std::string tampered = frame;
+    tampered[i] ^= 1;
+    EXPECT_FALSE(open(receiver, tampered)) << "byte " << i;
+  }
+  EXPECT_TRUE(open(receiver, frame));
+
+  // and every byte of the hello
+  auto connectingKeys = authenticator(1);
+  auto acceptingKeys = authenticator(0);
+  size_t helloSize = hello_size();
+  for (size_t i = 0; i < helloSize; ++i) {
+    FrameSession connecting(connectingKeys);
+    FrameSession accepting(acceptingKeys);
+    std::string hello;
+    ASSERT_TRUE(connecting.make_hello(0, accepting.own_nonce(), hello));
+    hello[i] ^= 1;
+    NodeNum source = 0;
+    EXPECT_FALSE(accepting.accept_hello(hello.data(), hello.size(), source))
+        << "byte " << i;
+  }
+
+  // nothing is sealed or opened before the hello
+  FrameSession early(authenticator(1));
+  std::string buffer(MSGTYPE_FIELD_SIZE + AUTH_COUNTER_FIELD_SIZE +
+                     AUTH_MAC_FIELD_SIZE, '\0');
+  EXPECT_FALSE(early.seal(&buffer[0], buffer.size() - AUTH_MAC_FIELD_SIZE));
+  EXPECT_FALSE(open(early, frame));
+}
+
+TEST(frame_authenticator_test, replayed_frames) {
+  auto receiverKeys = authenticator(0);
+  FrameSession sender(authenticator(1));
+  FrameSession receiver(receiverKeys);
+  std::string hello = connect(sender, 0, receiver);
+
+  std::string first = seal(sender, "first");
+  std::string second = seal(sender, "second");
+  EXPECT_TRUE(open(receiver, first));
+  EXPECT_FALSE(open(receiver, first));
+  EXPECT_TRUE(open(receiver, second));
+  EXPECT_FALSE(open(receiver, first));
+  EXPECT_FALSE(open(receiver, second));
+
+  // a new connection, to the same or to a restarted receiver, has a new
+  // challenge: neither the hello nor the frames of this one go through
+  FrameSession reconnected(receiverKeys);
+  FrameSession restarted(authenticator(0));
+  NodeNum source = 0;
+  EXPECT_FALSE(reconnected.accept_hello(hello.data(), hello.size(), source));
+  EXPECT_FALSE(restarted.accept_hello(hello.data(), hello.size(), source));
+  EXPECT_FALSE(open(restarted, first));
+  receiver.restart();
+  EXPECT_FALSE(receiver.accept_hello(hello.data(), hello.size(), source));
+  EXPECT_FALSE(open(receiver, first));
+
+  // while the sender starts counting anew
+  FrameSession newSender(authenticator(1));
+  connect(newSender, 0, reconnected);
+  EXPECT_TRUE(open(reconnected, seal(newSender, "first")));
+}
+
+// A replica can't act as another one, whatever keys it holds.
+TEST(frame_authenticator_test, byzantine_node) {
+  // replica 1 with a key that isn't its own
+  FrameSession forger(authenticator(1, "", 2));
+  FrameSession receiver(authenticator(0));
+  std::string hello;
+  ASSERT_TRUE(forger.make_hello(0, receiver.own_nonce(), hello));
+  NodeNum source = 0;
+  EXPECT_FALSE(receiver.accept_hello(hello.data(), hello.size(), source));
+
+  // replica 3 claiming to be replica 2
+  FrameSession impostor(authenticator(2, "", 3));
+  ASSERT_TRUE(impostor.make_hello(0, receiver.own_nonce(), hello));
+  EXPECT_FALSE(receiver.accept_hello(hello.data(), hello.size(), source));
+
+  // replica 3 can't read the secret of a connection from 1 to 0
+  auto keys1 = authenticator(1);
+  auto keys3 = authenticator(3);
+  std::string secret(32, 's');
+  std::string sealed;
+  std::string unsealed;
+  ASSERT_TRUE(keys1->seal_secret(0, secret, sealed));
+  EXPECT_FALSE(keys3->unseal_secret(sealed, unsealed));
+  EXPECT_TRUE(authenticator(0)->unseal_secret(sealed, unsealed));
+  EXPECT_EQ(secret, unsealed);
+
+  // nor take over a hello meant for another replica
+  FrameSession sender(authenticator(1));
+  FrameSession other(authenticator(3));
+  ASSERT_TRUE(sender.make_hello(0, other.own_nonce(), hello));
+  EXPECT_FALSE(other.accept_hello(hello.data(), hello.size(), source));
+
+  // and the shared secret doesn't stand in for the key pairs of replicas
+  FrameSession sharing(std::make_shared<FrameAuthenticator>(
+      1, nodes(), "", keys().publicKeys, SECRET));
+  FrameSession sharingReceiver(authenticator(0, SECRET));
+  ASSERT_TRUE(sharing.make_hello(0, sharingReceiver.own_nonce(), hello));
+  EXPECT_FALSE(sharingReceiver.accept_hello(hello.data(), hello.size(),
+                                            source));
+}
+
+TEST(frame_authenticator_test, wrong_keys) {
+  FrameSession sender(authenticator(1));
+  FrameSession receiver(authenticator(0));
+  connect(sender, 0, receiver);
+
+  // another connection between the same nodes has other keys, even if it
+  // was given the nonces of this one
+  FrameSession otherSender(authenticator(1));
+  std::string hello;
+  ASSERT_TRUE(otherSender.make_hello(0, receiver.own_nonce(), hello));
+  EXPECT_FALSE(open(receiver, seal(otherSender, "payload")));
+
+  // the key of the other direction
+  EXPECT_FALSE(open(receiver, seal(receiver, "payload")));
+  EXPECT_TRUE(open(sender, seal(receiver, "payload")));
+
+  // nodes out of the configuration have no keys
+  FrameSession unknown(authenticator(1));
+  EXPECT_FALSE(unknown.make_hello(7, 0, hello));
+  EXPECT_FALSE(unknown.make_hello(1, 0, hello));
+}
+
+TEST(frame_authenticator_test, shared_secret) {
+  // a client and a replica with the same secret
+  FrameSession client(authenticator(CLIENT, SECRET));
+  FrameSession replica(authenticator(0, SECRET));
+  connect(client, 0, replica);
+  EXPECT_TRUE(open(replica, seal(client, "request")));
+  EXPECT_TRUE(open(client, seal(replica, "reply")));
+
+  // with another secret
+  FrameSession outsider(authenticator(CLIENT, "another secret"));
+  FrameSession receiver(authenticator(0, SECRET));
+  std::string hello;
+  NodeNum source = 0;
+  ASSERT_TRUE(outsider.make_hello(0, receiver.own_nonce(), hello));
+  ASSERT_TRUE(receiver.accept_hello(hello.data(), hello.size(), source));
+  EXPECT_FALSE(open(receiver, seal(outsider, hello)));
+
+  // a replica without the secret refuses clients
+  FrameSession refusing(authenticator(0));
+  EXPECT_FALSE(refusing.accept_hello(hello.data(), hello.size(), source));
+  EXPECT_FALSE(FrameSession(authenticator(1)).make_hello(CLIENT, 0, hello));
+
+  // and a node needs either a private key or the secret, and valid keys
+  EXPECT_THROW(authenticator(CLIENT), std::invalid_argument);
+  EXPECT_THROW(FrameAuthenticator(0, nodes(), "0011", keys().publicKeys, ""),
+               std::invalid_argument);
+  auto publicKeys = keys().publicKeys;
+  publicKeys[2] = keys().privateKeys[2];
+  EXPECT_THROW(FrameAuthenticator(0, nodes(), keys().privateKeys[0],
+                                  publicKeys, ""),
+               std::invalid_argument);
+}
+
+// The connections of a node to its peers share its key material.
+TEST(frame_authenticator_test, concurrent_connections) {
+  auto ownKeys = authenticator(0);
+  std::vector<AUTHENTICATOR_PTR> peerKeys;
+  for (NodeNum peer = 1; peer < NUM_REPLICAS; ++peer) {
+    peerKeys.push_back(authenticator(peer));
+  }
+  std::vector<std::thread> threads;
+  std::vector<int> opened(6, 0);
+  for (size_t i = 0; i < opened.size(); ++i) {
+    threads.emplace_back([&, i]() {
+      for (int c = 0; c < 5; ++c) {
+        FrameSession peerSession(peerKeys[i % peerKeys.size()]);
+        FrameSession ownSession(ownKeys);
+        connect(peerSession, 0, ownSession);
+        for (int j = 0; j < 200; ++j) {
+          opened[i] += open(ownSession, seal(peerSession, "payload"));
+          opened[i] += open(peerSession, seal(ownSession, "payload"));
+        }
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  for (int count : opened) {
+    EXPECT_EQ(2000, count);
+  }
+}
+
+}  // namespace
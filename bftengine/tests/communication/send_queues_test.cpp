@@ -0,0 +1,182 @@
+// Concord
+//
+// Copyright (c) 2019 VMware, Inc. All Rights Reserved.
+//
+// This product is licensed to you under the Apache 2.0 license (the "License").
+// You may not use this product except in compliance with the Apache 2.0
+// License.
+//
+// This product may include a number of subcomponents with separate copyright
+// notices and license terms. Your use of these subcomponents is subject to the
+// terms and conditions of the subcomponent's license, as noted in the LICENSE
+// file.
+
+#include "gtest/gtest.h"
+#include "SendQueues.hpp"
+
+#include <cstring>
+#include <memory>
+
+using namespace bftEngine;
+
+namespace {
+
+// A message of the given class, its first byte being 'tag'.
+OutMessage message(MessageClass msgClass, uint32_t length, char tag) {
+  char *data = new char[length];
+  memset(data, 0, length);
+  uint16_t type = msgClass == MessageClass::StateTransfer
+                  ? impl::MsgCode::StateTransfer
+                  : impl::MsgCode::PrePrepare;
+  memcpy(data, &type, sizeof(type));
+  data[sizeof(type)] = tag;
+  EXPECT_EQ(msgClass, classifyMessage(data, length));
+  return OutMessage(data, length, msgClass);
+}
+
+char tagOf(const OutMessage &msg) { return msg.data[sizeof(uint16_t)]; }
+
+SendQueueConfig limits(uint32_t maxMessages, uint64_t maxBytes) {
+  SendQueueConfig config;
+  config.maxMessages = maxMessages;
+  config.maxBytes = maxBytes;
+  return config;
+}
+
+TEST(send_queues_test, consensus_first) {
+  SendQueues queues(limits(0, 0));
+  ASSERT_TRUE(queues.push(message(MessageClass::StateTransfer, 16, 's')));
+  ASSERT_TRUE(queues.push(message(MessageClass::Consensus, 16, 'c')));
+
+  OutMessage out(nullptr, 0, MessageClass::Consensus);
+  ASSERT_TRUE(queues.pop(out));
+  EXPECT_EQ('c', tagOf(out));
+  ASSERT_TRUE(queues.pop(out));
+  EXPECT_EQ('s', tagOf(out));
+  EXPECT_FALSE(queues.pop(out));
+
+  // the messages popped stay accounted until released
+  EXPECT_EQ(2u, queues.queuedMessages());
+  queues.release(16);
+  queues.release(16);
+  EXPECT_EQ(0u, queues.queuedMessages());
+  EXPECT_EQ(0u, queues.queuedBytes());
+}
+
+TEST(send_queues_test, state_transfer_rejected_when_full) {
+  auto stats = std::make_shared<PeerQueueStats>();
+  SendQueues queues(limits(4, 0));
+  queues.setStats(stats);
+  for (char i = 0; i < 4; ++i) {
+    ASSERT_TRUE(queues.push(message(MessageClass::StateTransfer, 16, i)));
+  }
+  EXPECT_FALSE(queues.push(message(MessageClass::StateTransfer, 16, 'x')));
+  EXPECT_EQ(4u, queues.waiting(MessageClass::StateTransfer));
+  EXPECT_EQ(1u, stats->rejectedMessages);
+  EXPECT_EQ(0u, stats->droppedMessages);
+}
+
+// The queue is full of state transfer data: a consensus message must still
+// get through, whatever the policies.
+TEST(send_queues_test, consensus_accepted_when_full_of_state_transfer) {
+  for (auto policy : {SendQueuePolicy::Reject, SendQueuePolicy::DropOldest}) {
+    auto stats = std::make_shared<PeerQueueStats>();
+    SendQueueConfig config = limits(4, 0);
+    config.consensusPolicy = policy;
+    SendQueues queues(config);
+    queues.setStats(stats);
+    for (char i = 0; i < 4; ++i) {
+      ASSERT_TRUE(queues.push(message(MessageClass::StateTransfer, 16, i)));
+    }
+
+    ASSERT_TRUE(queues.push(message(MessageClass::Consensus, 16, 'c')));
+    EXPECT_EQ(4u, queues.queuedMessages());
+    EXPECT_EQ(1u, stats->droppedMessages);
+    EXPECT_EQ(0u, stats->rejectedMessages);
+    EXPECT_EQ(4u, stats->queuedMessages);
+
+    // the oldest state transfer message made room
+    OutMessage out(nullptr, 0, MessageClass::Consensus);
+    ASSERT_TRUE(queues.pop(out));
+    EXPECT_EQ('c', tagOf(out));
+    ASSERT_TRUE(queues.pop(out));
+    EXPECT_EQ(1, tagOf(out));
+  }
+}
+
+TEST(send_queues_test, consensus_evicts_state_transfer_bytes) {
+  SendQueues queues(limits(0, 1000));
+  for (char i = 0; i < 4; ++i) {
+    ASSERT_TRUE(queues.push(message(MessageClass::StateTransfer, 250, i)));
+  }
+
+  // needs the room of two state transfer messages
+  ASSERT_TRUE(queues.push(message(MessageClass::Consensus, 400, 'c')));
+  EXPECT_EQ(2u, queues.waiting(MessageClass::StateTransfer));
+  EXPECT_EQ(900u, queues.queuedBytes());
+}
+
+// The message being written is never dropped: when only it is left, a
+// consensus message that doesn't fit is rejected.
+TEST(send_queues_test, message_in_flight_not_dropped) {
+  SendQueues queues(limits(1, 0));
+  ASSERT_TRUE(queues.push(message(MessageClass::StateTransfer, 16, 's')));
+  OutMessage inFlight(nullptr, 0, MessageClass::Consensus);
+  ASSERT_TRUE(queues.pop(inFlight));
+
+  EXPECT_FALSE(queues.push(message(MessageClass::Consensus, 16, 'c')));
+  queues.release(inFlight.length);
+  EXPECT_TRUE(queues.push(message(MessageClass::Consensus, 16, 'c')));
+}
+
+TEST(send_queues_test, bounded_by_default) {
+  SendQueueConfig config;
+  ASSERT_LT(0u, config.maxBytes);
+  SendQueues queues(config);
+  const size_t length = config.maxBytes / 4;
+  for (char i = 0; i < 4; ++i) {
+    ASSERT_TRUE(queues.push(message(MessageClass::StateTransfer, length, i)));
+  }
+  EXPECT_FALSE(queues.push(message(MessageClass::StateTransfer, length, 'x')));
+}
+
+// A message larger than the bounds is sent once the queue is empty.
+TEST(send_queues_test, large_message_alone_accepted) {
+  SendQueues queues(limits(0, 1000));
+  ASSERT_TRUE(queues.push(message(MessageClass::StateTransfer, 16, 's')));
+  EXPECT_FALSE(queues.push(message(MessageClass::StateTransfer, 2000, 'l')));
+
+  OutMessage out(nullptr, 0, MessageClass::Consensus);
+  ASSERT_TRUE(queues.pop(out));
+  queues.release(out.length);
+  EXPECT_TRUE(queues.push(message(MessageClass::StateTransfer, 2000, 'l')));
+}
+
+TEST(send_queues_test, consensus_drop_oldest) {
+  SendQueues queues(limits(2, 0));
+  for (char i = 0; i < 3; ++i) {
+    ASSERT_TRUE(queues.push(message(MessageClass::Consensus, 16, i)));
+  }
+  OutMessage out(nullptr, 0, MessageClass::Consensus);
+  ASSERT_TRUE(queues.pop(out));
+  EXPECT_EQ(1, tagOf(out));
+}
+
+TEST(send_queues_test, stats_follow_the_queues) {
+  auto stats = std::make_shared<PeerQueueStats>();
+  {
+    SendQueues queues(limits(0, 0));
+    ASSERT_TRUE(queues.push(message(MessageClass::Consensus, 16, 'c')));
+    // the messages queued before are accounted
+    queues.setStats(stats);
+    EXPECT_EQ(1u, stats->queuedMessages);
+    EXPECT_EQ(16u, stats->queuedBytes);
+    ASSERT_TRUE(queues.push(message(MessageClass::StateTransfer, 32, 's')));
+    EXPECT_EQ(48u, stats->queuedBytes);
+  }
+  // and the messages left are lost with the queues
+  EXPECT_EQ(0u, stats->queuedMessages);
+  EXPECT_EQ(0u, stats->queuedBytes);
+}
+
+}  // namespace
@@ -0,0 +1,263 @@
+// Concord
+//
+// Copyright (c) 2019 VMware, Inc. All Rights Reserved.
+//
+// This product is licensed to you under the Apache 2.0 license (the "License").
+// You may not use this product except in compliance with the Apache 2.0
+// License.
+//
+// This product may include a number of subcomponents with separate copyright
+// notices and license terms. Your use of these subcomponents is subject to the
+// terms and conditions of the subcomponent's license, as noted in the LICENSE
+// file.
+
+#include "gtest/gtest.h"
+#include "CommDefs.hpp"
+#include "MsgCode.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace bftEngine;
+
+namespace {
+
+class TestReceiver : public IReceiver {
+ public:
+  void onNewMessage(const NodeNum sourceNode,
+                    const char *const message,
+                    const size_t messageLength) override {
+    std::lock_guard<std::mutex> lock(lock_);
+    messages_.emplace_back(sourceNode, std::string(message, messageLength));
+  }
+
+  void onConnectionStatusChanged(const NodeNum,
+                                 const ConnectionStatus) override {}
+
+  // Wait until 'count' messages arrived, or a timeout.
+  std::vector<std::pair<NodeNum, std::string>> wait(size_t count) {
+    for (int i = 0; i < 5000; ++i) {
+      {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (messages_.size() >= count) {
+          return messages_;
+        }
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::lock_guard<std::mutex> lock(lock_);
+    return messages_;
+  }
+
+ private:
+  std::mutex lock_;
+  std::vector<std::pair<NodeNum, std::string>> messages_;
+};
+
+NodeMap testNodes() {
+  NodeMap nodes;
+  nodes[0] = NodeInfo{"127.0.0.1", 3710, true};
+  nodes[1] = NodeInfo{"127.0.0.1", 3712, true};
+  nodes[2] = NodeInfo{"127.0.0.1", 3714, false};
+  return nodes;
+}
+
+// Each test uses its own node ids: the rings are process wide.
+NodeMap shiftedNodes(NodeNum base) {
+  NodeMap nodes;
+  for (auto &n : testNodes()) {
+    nodes[base + n.first] = n.second;
+  }
+  return nodes;
+}
+
+TEST(shared_memory_comm_test, send_and_receive) {
+  const NodeNum base = 100;
+  std::atomic<int> sent{0};
+  std::atomic<int> received{0};
+  auto callback = [&](PeerConnectivityStatus pcs) {
+    if (pcs.statusType == StatusType::MessageSent) ++sent;
+    if (pcs.statusType == StatusType::MessageReceived) ++received;
+  };
+
+  std::unique_ptr<ICommunication> a(SharedMemoryCommunication::create(
+      SharedMemoryConfig(1024, shiftedNodes(base), base, 0, callback)));
+  std::unique_ptr<ICommunication> b(SharedMemoryCommunication::create(
+      SharedMemoryConfig(1024, shiftedNodes(base), base + 1, 0, callback)));
+  TestReceiver ra, rb;
+  a->setReceiver(base, &ra);
+  b->setReceiver(base + 1, &rb);
+
+  ASSERT_EQ(ConnectionStatus::Disconnected,
+            a->getCurrentConnectionStatus(base + 1));
+  ASSERT_EQ(0, a->Start());
+  ASSERT_EQ(0, b->Start());
+  ASSERT_EQ(ConnectionStatus::Connected,
+            a->getCurrentConnectionStatus(base + 1));
+  ASSERT_EQ(ConnectionStatus::Unknown, a->getCurrentConnectionStatus(7));
+
+  ASSERT_EQ(0, a->sendAsyncMessage(base + 1, "hello", 5));
+  ASSERT_EQ(0, b->sendAsyncMessage(base, "world!", 6));
+
+  auto atB = rb.wait(1);
+  ASSERT_EQ(1, atB.size());
+  ASSERT_EQ(base, atB[0].first);
+  ASSERT_EQ("hello", atB[0].second);
+
+  auto atA = ra.wait(1);
+  ASSERT_EQ(1, atA.size());
+  ASSERT_EQ(base + 1, atA[0].first);
+  ASSERT_EQ("world!", atA[0].second);
+
+  ASSERT_EQ(2, sent);
+  ASSERT_EQ(2, received);
+
+  ASSERT_EQ(0, a->Stop());
+  ASSERT_EQ(0, b->Stop());
+  ASSERT_EQ(ConnectionStatus::Disconnected,
+            b->getCurrentConnectionStatus(base));
+}
+
+TEST(shared_memory_comm_test, rejects_invalid_messages) {
+  const NodeNum base = 200;
+  std::unique_ptr<ICommunication> a(SharedMemoryCommunication::create(
+      SharedMemoryConfig(16, shiftedNodes(base), base)));
+  TestReceiver ra;
+  a->setReceiver(base, &ra);
+  ASSERT_EQ(0, a->Start());
+
+  std::string tooLong(17, 'x');
+  ASSERT_NE(0, a->sendAsyncMessage(base + 1, tooLong.data(), tooLong.size()));
+  ASSERT_NE(0, a->sendAsyncMessage(base + 1, "", 0));
+  ASSERT_NE(0, a->sendAsyncMessage(base + 50, "x", 1));
+  ASSERT_EQ(0, a->Stop());
+}
+
+TEST(shared_memory_comm_test, ring_wraps_and_preserves_order) {
+  const NodeNum base = 300;
+  // a small ring, so that messages wrap around its end many times
+  std::unique_ptr<ICommunication> a(SharedMemoryCommunication::create(
+      SharedMemoryConfig(100, shiftedNodes(base), base, 256)));
+  std::unique_ptr<ICommunication> b(SharedMemoryCommunication::create(
+      SharedMemoryConfig(100, shiftedNodes(base), base + 1, 256)));
+  TestReceiver ra, rb;
+  a->setReceiver(base, &ra);
+  b->setReceiver(base + 1, &rb);
+  ASSERT_EQ(0, a->Start());
+  ASSERT_EQ(0, b->Start());
+
+  const int kMessages = 2000;
+  for (int i = 0; i < kMessages; ++i) {
+    auto msg = std::to_string(i) + std::string(i % 90, 'a' + i % 26);
+    // a full ring is reported to the sender, who may retry later
+    while (a->sendAsyncMessage(base + 1, msg.data(), msg.size()) != 0) {
+      std::this_thread::yield();
+    }
+  }
+
+  auto atB = rb.wait(kMessages);
+  ASSERT_EQ(kMessages, atB.size());
+  for (int i = 0; i < kMessages; ++i) {
+    ASSERT_EQ(std::to_string(i) + std::string(i % 90, 'a' + i % 26),
+              atB[i].second);
+  }
+
+  ASSERT_EQ(0, a->Stop());
+  ASSERT_EQ(0, b->Stop());
+}
+
+// A message of the given type, as the engine lays it out.
+std::string testMessage(uint16_t msgType, size_t length) {
+  std::string msg(length, 'x');
+  memcpy(&msg[0], &msgType, sizeof(msgType));
+  return msg;
+}
+
+TEST(shared_memory_comm_test, state_transfer_does_not_block_consensus) {
+  const NodeNum base = 400;
+  std::unique_ptr<ICommunication> a(SharedMemoryCommunication::create(
+      SharedMemoryConfig(100, shiftedNodes(base), base, 256)));
+  std::unique_ptr<ICommunication> b(SharedMemoryCommunication::create(
+      SharedMemoryConfig(100, shiftedNodes(base), base + 1, 256)));
+  TestReceiver ra, rb;
+  a->setReceiver(base, &ra);
+  b->setReceiver(base + 1, &rb);
+  ASSERT_EQ(0, a->Start());
+
+  // b doesn't read yet: fill the state transfer ring
+  auto stMsg = testMessage(impl::MsgCode::StateTransfer, 100);
+  int sent = 0;
+  while (a->sendAsyncMessage(base + 1, stMsg.data(), stMsg.size()) == 0) {
+    ++sent;
+  }
+  ASSERT_GT(sent, 0);
+  ASSERT_EQ(SEND_REJECTED_BACKPRESSURE,
+            a->sendAsyncMessage(base + 1, stMsg.data(), stMsg.size()));
+
+  ASSERT_EQ(0, b->Start());
+  auto commit = testMessage(impl::MsgCode::CommitFull, 50);
+  ASSERT_EQ(0, a->sendAsyncMessage(base + 1, commit.data(), commit.size()));
+  ASSERT_EQ(0, a->sendAsyncMessage(base + 1, stMsg.data(), stMsg.size()));
+
+  auto atB = rb.wait(2);
+  ASSERT_EQ(2, atB.size());
+  ASSERT_EQ(commit, atB[0].second);
+  ASSERT_EQ(stMsg, atB[1].second);
+
+  ASSERT_EQ(0, a->Stop());
+  ASSERT_EQ(0, b->Stop());
+}
+
+TEST(shared_memory_comm_test, starts_while_a_peer_keeps_sending) {
+  const NodeNum base = 500;
+  std::unique_ptr<ICommunication> a(SharedMemoryCommunication::create(
+      SharedMemoryConfig(100, shiftedNodes(base), base, 256)));
+  std::unique_ptr<ICommunication> b(SharedMemoryCommunication::create(
+      SharedMemoryConfig(100, shiftedNodes(base), base + 1, 256)));
+  TestReceiver ra, rb;
+  a->setReceiver(base, &ra);
+  b->setReceiver(base + 1, &rb);
+  ASSERT_EQ(0, a->Start());
+
+  // the rings of b never stay empty while it starts
+  std::atomic<bool> sending{true};
+  std::atomic<int> sent{0};
+  std::thread sender([&]() {
+    while (sending) {
+      if (a->sendAsyncMessage(base + 1, "early", 5) == 0) {
+        ++sent;
+      }
+    }
+  });
+  while (sent < 10) {
+    std::this_thread::yield();
+  }
+  ASSERT_EQ(0, b->Start());
+  sending = false;
+  sender.join();
+
+  // the messages sent before b started are lost, not the next ones
+  ASSERT_EQ(0, a->sendAsyncMessage(base + 1, "last", 4));
+  std::vector<std::pair<NodeNum, std::string>> atB;
+  for (int i = 0; i < 5000; ++i) {
+    atB = rb.wait(0);
+    if (!atB.empty() && atB.back().second == "last") {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_FALSE(atB.empty());
+  ASSERT_EQ("last", atB.back().second);
+  ASSERT_LE(atB.size(), sent + 1 - 10);
+
+  ASSERT_EQ(0, a->Stop());
+  ASSERT_EQ(0, b->Stop());
+}
+
+}  // namespace
@@ -14,6 +14,7 @@
 #include <cassert>
 #include <chrono>
 #include <cstdlib>
+#include <unordered_set>
 #include "CommDefs.hpp"
 #include "kv_types.hpp"
 #include "hex_tools.h"
@@ -30,11 +31,14 @@ using bftEngine::SimpleBlockchainStateTransfer::StateTransferDigest;
 
 using concord::storage::blockchain::Key;
 using concord::storage::IDBClient;
+using concord::storage::KeysVector;
+using concord::storage::ValuesVector;
 using concord::storage::DBMetadataStorage;
 
 using concord::storage::blockchain::DBAdapter;
-using concord::storage::blockchain::BlockEntry;
+using concord::storage::blockchain::BlockCompression;
 using concord::storage::blockchain::BlockHeader;
+using concord::storage::blockchain::BlockView;
 using concord::storage::blockchain::BlockId;
 using concord::storage::blockchain::ILocalKeyValueStorageReadOnly;
 using concord::storage::blockchain::ILocalKeyValueStorageReadOnlyIterator;
@@ -66,6 +70,15 @@ Status ReplicaImp::start() {
 
   createReplicaAndSyncState();
   m_replicaPtr->SetAggregator(aggregator_);
+  if (m_bcDbAdapter->blockCache()) {
+    m_bcDbAdapter->blockCache()->setAggregator(aggregator_);
+  }
+  if (m_bcDbAdapter->latestValueCache()) {
+    m_bcDbAdapter->latestValueCache()->setAggregator(aggregator_);
+  }
+  if (m_bcDbAdapter->blockCompressor().compression() != BlockCompression::None) {
+    m_bcDbAdapter->blockCompressor().setAggregator(aggregator_);
+  }
   m_replicaPtr->start();
   m_currentRepStatus = RepStatus::Running;
 
@@ -84,7 +97,10 @@ void ReplicaImp::createReplicaAndSyncState() {
     uint64_t removedBlocksNum = m_replicaStateSync.execute(
         logger, *m_bcDbAdapter, *this, m_appState->m_lastReachableBlock, m_replicaPtr->getLastExecutedSequenceNum());
     m_lastBlock -= removedBlocksNum;
-    m_appState->m_lastReachableBlock -= removedBlocksNum;
+    m_appState->m_lastReachableBlock = m_bcDbAdapter->getLastReachableBlock();
+    if (removedBlocksNum > 0) {
+      loadLastBlockDigest();
+    }
     LOG_INFO(logger,
              "createReplicaAndSyncState: removedBlocksNum = "
                  << removedBlocksNum << ", new m_lastBlock = " << m_lastBlock
@@ -92,6 +108,80 @@ void ReplicaImp::createReplicaAndSyncState() {
   }
 }
 
+// The snapshot hard-links the files of the database, so that replacing it at
+// each checkpoint is cheap.
+void ReplicaImp::createSnapshot(uint64_t checkpointNumber, BlockId lastBlock) {
+  if (m_snapshotsDir.empty()) {
+    return;
+  }
+  std::string snapshot = m_snapshotsDir + "/checkpoint_" + std::to_string(checkpointNumber);
+  Status s = m_bcDbAdapter->getDb()->createCheckpoint(snapshot);
+  if (!s.isOK()) {
+    LOG_ERROR(logger, "Failed to create snapshot " << snapshot << ": " << s);
+    return;
+  }
+  LOG_INFO(logger, "Created snapshot " << snapshot << " of checkpoint " << checkpointNumber << ", last block " << lastBlock);
+  if (!m_lastSnapshot.empty()) {
+    m_bcDbAdapter->getDb()->deleteCheckpoint(m_lastSnapshot);
+  }
+  m_lastSnapshot = snapshot;
+}
+
+bool ReplicaImp::verifySnapshot(const DBAdapter &dbAdapter,
+                                BlockId lastBlock,
+                                const StateTransferDigest &digestOfLastBlock) {
+  auto logger = concordlogger::Log::getLogger("skvbc.replicaImp");
+  if (dbAdapter.getLastReachableBlock() != lastBlock) {
+    LOG_ERROR(logger, "Snapshot ends at block " << dbAdapter.getLastReachableBlock() << " instead of " << lastBlock);
+    return false;
+  }
+
+  // each block holds the digest of the previous one, and the database holds
+  // the entries of each block, under its id. The first block met that holds
+  // a key, from the last one, holds its latest version.
+  StateTransferDigest expectedDigest = digestOfLastBlock;
+  std::unordered_set<Key> latestChecked;
+  for (BlockId blockId = lastBlock; blockId >= dbAdapter.getFirstBlock() && blockId > 0; blockId--) {
+    Sliver block;
+    bool found = false;
+    if (!dbAdapter.getBlockById(blockId, block, found).isOK() || !found || block.length() < sizeof(BlockHeader)) {
+      LOG_ERROR(logger, "Snapshot is missing block " << blockId);
+      return false;
+    }
+    const BlockView view(block);
+    if (!view.isValid()) {
+      LOG_ERROR(logger, "Snapshot has a malformed block " << blockId);
+      return false;
+    }
+    StateTransferDigest digest;
+    bftEngine::SimpleBlockchainStateTransfer::computeBlockDigest(
+        blockId, reinterpret_cast<const char *>(block.data()), block.length(), &digest);
+    if (memcmp(digest.content, expectedDigest.content, BLOCK_DIGEST_SIZE) != 0) {
+      LOG_ERROR(logger, "Snapshot has a wrong digest for block " << blockId);
+      return false;
+    }
+    memcpy(expectedDigest.content, view.header().parentDigest, BLOCK_DIGEST_SIZE);
+
+    for (const KeyValuePair &entry : view) {
+      Value value;
+      BlockId actualBlock = 0;
+      if (!dbAdapter.getKeyByReadVersion(blockId, entry.first, value, actualBlock).isOK() ||
+          actualBlock != blockId || value != entry.second) {
+        LOG_ERROR(logger, "Snapshot has a wrong version of key " << entry.first << " in block " << blockId);
+        return false;
+      }
+      if (latestChecked.insert(entry.first).second) {
+        if (!dbAdapter.getKeyByReadVersion(lastBlock, entry.first, value, actualBlock).isOK() ||
+            actualBlock != blockId || value != entry.second) {
+          LOG_ERROR(logger, "Snapshot has a wrong latest version of key " << entry.first << ", from block " << blockId);
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
 /**
  * Closes the database. Call `wait()` after this to wait for thread to stop.
  */
@@ -147,6 +237,18 @@ Status ReplicaImp::getBlockData(BlockId blockId, SetOfKeyValuePairs &outBlockDat
   return Status::OK();
 }
 
+Status ReplicaImp::getBlockView(BlockId blockId, BlockView &outBlock) const {
+  Sliver block = getBlockInternal(blockId);
+
+  if (block.length() == 0) {
+    return Status::NotFound("todo");
+  }
+
+  outBlock = BlockView(block);
+
+  return Status::OK();
+}
+
 Status ReplicaImp::mayHaveConflictBetween(const Sliver& key, BlockId fromBlock, BlockId toBlock, bool &outRes) const {
   // TODO(GG): add assert or print warning if fromBlock==0 (all keys have a
   // conflict in block 0)
@@ -164,6 +266,13 @@ Status ReplicaImp::mayHaveConflictBetween(const Sliver& key, BlockId fromBlock,
   return s;
 }
 
+Status ReplicaImp::mayHaveConflictBetween(const KeysVector &keys,
+                                          BlockId fromBlock,
+                                          BlockId toBlock,
+                                          std::vector<bool> &outConflicts) const {
+  return getConflictsInternal(keys, fromBlock, toBlock, outConflicts);
+}
+
 ILocalKeyValueStorageReadOnlyIterator *ReplicaImp::getSnapIterator() const {
   return m_InternalStorageWrapperForIdleMode.getSnapIterator();
 }
@@ -206,6 +315,7 @@ ReplicaImp::ReplicaImp(ICommunication *comm,
 
   m_appState = new BlockchainAppState(this);
   m_stateTransfer = bftEngine::SimpleBlockchainStateTransfer::create(state_transfer_config, m_appState, false);
+  loadLastBlockDigest();
 }
 
 ReplicaImp::~ReplicaImp() {
@@ -226,7 +336,6 @@ ReplicaImp::~ReplicaImp() {
 
 Status ReplicaImp::addBlockInternal(const SetOfKeyValuePairs &updates, BlockId &outBlockId) {
   m_lastBlock++;
-  m_appState->m_lastReachableBlock++;
 
   BlockId block = m_lastBlock;
   SetOfKeyValuePairs updatesInNewBlock;
@@ -234,7 +343,9 @@ Status ReplicaImp::addBlockInternal(const SetOfKeyValuePairs &updates, BlockId &
   LOG_DEBUG(logger, "addBlockInternal: Got " << updates.size() << " updates");
 
   StateTransferDigest stDigest;
-  if (block > 1) {
+  if (block > 1 && m_digestedBlock == block - 1) {
+    stDigest = m_lastBlockDigest;
+  } else if (block > 1) {
     Sliver parentBlockData;
     bool found;
     m_bcDbAdapter->getBlockById(block - 1, parentBlockData, found);
@@ -255,8 +366,18 @@ Status ReplicaImp::addBlockInternal(const SetOfKeyValuePairs &updates, BlockId &
   Status s = m_bcDbAdapter->addBlockAndUpdateMultiKey(updatesInNewBlock, block, blockRaw);
   if (!s.isOK()) {
     LOG_ERROR(logger, "Failed to add block or update keys for block " << block);
+    m_digestedBlock = 0;
     return s;
   }
+  m_appState->m_lastReachableBlock = m_bcDbAdapter->getLastReachableBlock();
+  cacheLastBlockDigest(block, blockRaw);
+  if (m_bcDbAdapter->blockCache()) {
+    m_bcDbAdapter->blockCache()->updateMetrics();
+  }
+  if (m_bcDbAdapter->latestValueCache()) {
+    m_bcDbAdapter->latestValueCache()->updateMetrics();
+  }
+  m_bcDbAdapter->blockCompressor().updateMetrics();
 
   outBlockId = block;
   return Status::OK();
@@ -272,16 +393,31 @@ Status ReplicaImp::getInternal(BlockId readVersion, Sliver key, Sliver &outValue
   return Status::OK();
 }
 
+Status ReplicaImp::getConflictsInternal(const KeysVector &keys,
+                                        BlockId fromBlock,
+                                        BlockId toBlock,
+                                        std::vector<bool> &outConflicts) const {
+  // we conservatively assume that we have conflicts
+  outConflicts.assign(keys.size(), true);
+
+  ValuesVector values;
+  std::vector<BlockId> blocks;
+  Status s = m_bcDbAdapter->getKeysByReadVersion(toBlock, keys, values, blocks);
+  if (!s.isOK()) {
+    LOG_ERROR(logger, "Failed to get " << keys.size() << " keys by read version " << toBlock);
+    return s;
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    outConflicts[i] = blocks[i] >= fromBlock;
+  }
+
+  return Status::OK();
+}
+
 void ReplicaImp::insertBlockInternal(BlockId blockId, Sliver block) {
   if (blockId > m_lastBlock) {
     m_lastBlock = blockId;
   }
-  // when ST runs, blocks arrive in batches in reverse order. we need to keep
-  // track on the "Gap" and to close it. Only when it is closed, the last
-  // reachable block becomes the same as the last block
-  if (blockId == m_appState->m_lastReachableBlock + 1) {
-    m_appState->m_lastReachableBlock = m_lastBlock;
-  }
 
   bool found = false;
   Sliver existingBlock;
@@ -307,6 +443,10 @@ void ReplicaImp::insertBlockInternal(BlockId blockId, Sliver block) {
                                    << (memcmp(existingBlock.data(), block.data(), block.length())));
 
       m_bcDbAdapter->deleteBlockAndItsKeys(blockId);
+      m_appState->m_lastReachableBlock = m_bcDbAdapter->getLastReachableBlock();
+      if (blockId == m_digestedBlock) {
+        m_digestedBlock = 0;
+      }
 
       // TODO(GG): how do we want to handle this - restart replica?
       // exit(1);
@@ -314,15 +454,14 @@ void ReplicaImp::insertBlockInternal(BlockId blockId, Sliver block) {
     }
   } else {
     if (block.length() > 0) {
-      uint16_t numOfElements = ((BlockHeader *)block.data())->numberOfElements;
-      auto *entries = (BlockEntry *)(block.data() + sizeof(BlockHeader));
-      for (size_t i = 0; i < numOfElements; i++) {
-        const Sliver keySliver(block, entries[i].keyOffset, entries[i].keySize);
-        const Sliver valSliver(block, entries[i].valOffset, entries[i].valSize);
-
-        const KeyIDPair pk(keySliver, blockId);
+      const BlockView view(block);
+      if (!view.isValid()) {
+        LOG_ERROR(logger, "Block " << blockId << " has entries out of its bounds: its keys are not added");
+      }
+      for (size_t i = 0; i < view.size(); i++) {
+        const KeyIDPair pk(view.key(i), blockId);
 
-        s = m_bcDbAdapter->updateKey(pk.key, pk.blockId, valSliver);
+        s = m_bcDbAdapter->updateKey(pk.key, pk.blockId, view.value(i));
         if (!s.isOK()) {
           // TODO(SG): What to do?
           LOG_FATAL(logger, "Failed to update key");
@@ -345,6 +484,34 @@ void ReplicaImp::insertBlockInternal(BlockId blockId, Sliver block) {
       }
     }
   }
+  // when ST runs, blocks arrive in batches in reverse order: the adapter
+  // advances the last reachable block once the gap is closed
+  m_appState->m_lastReachableBlock = m_bcDbAdapter->getLastReachableBlock();
+  // the first block fetched is the last one: the blocks are appended after it
+  // once ST is done
+  if (blockId == m_lastBlock && blockId != m_digestedBlock) {
+    cacheLastBlockDigest(blockId, block);
+  }
+}
+
+void ReplicaImp::cacheLastBlockDigest(BlockId blockId, const Sliver &block) {
+  if (block.length() < sizeof(BlockHeader)) {
+    m_digestedBlock = 0;
+    return;
+  }
+  bftEngine::SimpleBlockchainStateTransfer::computeBlockDigest(
+      blockId, reinterpret_cast<const char *>(block.data()), block.length(), &m_lastBlockDigest);
+  memcpy(m_lastBlockParentDigest.content,
+         reinterpret_cast<const BlockHeader *>(block.data())->parentDigest,
+         BLOCK_DIGEST_SIZE);
+  m_digestedBlock = blockId;
+}
+
+void ReplicaImp::loadLastBlockDigest() {
+  m_digestedBlock = 0;
+  if (m_lastBlock > 0) {
+    cacheLastBlockDigest(m_lastBlock, getBlockInternal(m_lastBlock));
+  }
 }
 
 Sliver ReplicaImp::getBlockInternal(BlockId blockId) const {
@@ -405,6 +572,14 @@ Status ReplicaImp::StorageWrapperForIdleMode::getBlockData(BlockId blockId, SetO
   return Status::OK();
 }
 
+Status ReplicaImp::StorageWrapperForIdleMode::getBlockView(BlockId blockId, BlockView &outBlock) const {
+  if (rep->getReplicaStatus() != IReplica::RepStatus::Idle) {
+    return Status::IllegalOperation("");
+  }
+
+  return rep->getBlockView(blockId, outBlock);
+}
+
 Status ReplicaImp::StorageWrapperForIdleMode::mayHaveConflictBetween(const Sliver& key,
                                                                      BlockId fromBlock,
                                                                      BlockId toBlock,
@@ -422,6 +597,13 @@ Status ReplicaImp::StorageWrapperForIdleMode::mayHaveConflictBetween(const Slive
   return s;
 }
 
+Status ReplicaImp::StorageWrapperForIdleMode::mayHaveConflictBetween(const KeysVector &keys,
+                                                                     BlockId fromBlock,
+                                                                     BlockId toBlock,
+                                                                     std::vector<bool> &outConflicts) const {
+  return rep->getConflictsInternal(keys, fromBlock, toBlock, outConflicts);
+}
+
 ILocalKeyValueStorageReadOnlyIterator *ReplicaImp::StorageWrapperForIdleMode::getSnapIterator() const {
   return new StorageIterator(this->rep);
 }
@@ -447,84 +629,20 @@ Sliver ReplicaImp::createBlockFromUpdates(const SetOfKeyValuePairs &updates,
 
   assert(outUpdatesInNewBlock.size() == 0);
 
-  uint32_t blockBodySize = 0;
-  uint16_t numOfElements = updates.size();
-  for (const auto &elem : updates) {
-    // body is all of the keys and values strung together
-    blockBodySize += (elem.first.length() + elem.second.length());
-  }
-
-  const uint32_t metadataSize = sizeof(BlockHeader) + sizeof(BlockEntry) * numOfElements;
-
-  const uint32_t blockSize = metadataSize + blockBodySize;
-
   try {
-    uint8_t *blockBuffer = new uint8_t[blockSize];
-    memset(blockBuffer, 0, blockSize);
-    Sliver blockSliver(blockBuffer, blockSize);
-
-    BlockHeader *header = (BlockHeader *)blockBuffer;
-    memcpy(header->parentDigest, parentDigest.content, BLOCK_DIGEST_SIZE);
-    header->parentDigestLength = BLOCK_DIGEST_SIZE;
-
-    int16_t idx = 0;
-    header->numberOfElements = numOfElements;
-    int32_t currentOffset = metadataSize;
-    auto *entries = (BlockEntry *)(blockBuffer + sizeof(BlockHeader));
-    for (const auto &elem : updates) {
-      const KeyValuePair &kvPair = elem;
-
-      // key
-      entries[idx].keyOffset = currentOffset;
-      entries[idx].keySize = kvPair.first.length();
-      memcpy(blockBuffer + currentOffset, kvPair.first.data(), kvPair.first.length());
-      Sliver newKey(blockSliver, currentOffset, kvPair.first.length());
-
-      currentOffset += kvPair.first.length();
-
-      // value
-      entries[idx].valOffset = currentOffset;
-      entries[idx].valSize = kvPair.second.length();
-      memcpy(blockBuffer + currentOffset, kvPair.second.data(), kvPair.second.length());
-      Sliver newVal(blockSliver, currentOffset, kvPair.second.length());
-
-      currentOffset += kvPair.second.length();
-
-      // add to outUpdatesInNewBlock
-      KeyValuePair newKVPair(newKey, newVal);
-      outUpdatesInNewBlock.insert(newKVPair);
-
-      idx++;
-    }
-    assert(idx == numOfElements);
-    assert((uint32_t)currentOffset == blockSize);
-
-    return blockSliver;
+    return BlockView::createBlock(
+        updates, reinterpret_cast<const int8_t *>(parentDigest.content), BLOCK_DIGEST_SIZE, &outUpdatesInNewBlock);
   } catch (std::bad_alloc &ba) {
     LOG_ERROR(concordlogger::Log::getLogger("skvbc.replicaImp"),
-              "Failed to alloc size " << blockSize << ", error: " << ba.what());
+              "Failed to alloc a block of " << updates.size() << " updates, error: " << ba.what());
+    outUpdatesInNewBlock.clear();
     uint8_t *emptyBlockBuffer = new uint8_t[1];
     memset(emptyBlockBuffer, 0, 1);
     return Sliver(emptyBlockBuffer, 1);
   }
 }
 
-SetOfKeyValuePairs ReplicaImp::fetchBlockData(Sliver block) {
-  SetOfKeyValuePairs retVal;
-
-  if (block.length() > 0) {
-    uint16_t numOfElements = ((BlockHeader *)block.data())->numberOfElements;
-    auto *entries = (BlockEntry *)(block.data() + sizeof(BlockHeader));
-    for (size_t i = 0; i < numOfElements; i++) {
-      Sliver keySliver(block, entries[i].keyOffset, entries[i].keySize);
-      Sliver valSliver(block, entries[i].valOffset, entries[i].valSize);
-
-      KeyValuePair kv(keySliver, valSliver);
-      retVal.insert(kv);
-    }
-  }
-  return retVal;
-}
+SetOfKeyValuePairs ReplicaImp::fetchBlockData(Sliver block) { return BlockView(block).toSet(); }
 
 ReplicaImp::StorageIterator::StorageIterator(const ReplicaImp *r)
     : logger(concordlogger::Log::getLogger("skvbc.ReplicaImp")), rep(r) {
@@ -668,6 +786,11 @@ bool ReplicaImp::BlockchainAppState::hasBlock(uint64_t blockId) {
 
 bool ReplicaImp::BlockchainAppState::getPrevDigestFromBlock(uint64_t blockId, StateTransferDigest *outPrevBlockDigest) {
   assert(blockId > 0);
+  assert(outPrevBlockDigest);
+  if (blockId == m_ptrReplicaImpl->m_digestedBlock) {
+    *outPrevBlockDigest = m_ptrReplicaImpl->m_lastBlockParentDigest;
+    return true;
+  }
   Sliver result;
   bool found;
   m_ptrReplicaImpl->m_bcDbAdapter->getBlockById(blockId, result, found);
@@ -703,4 +826,14 @@ uint64_t ReplicaImp::BlockchainAppState::getLastReachableBlockNum() {
 
 uint64_t ReplicaImp::BlockchainAppState::getLastBlockNum() { return m_ptrReplicaImpl->m_lastBlock; }
 
+uint64_t ReplicaImp::BlockchainAppState::getFirstBlockNum() {
+  return m_ptrReplicaImpl->m_bcDbAdapter->getFirstBlock();
+}
+
+void ReplicaImp::BlockchainAppState::onCheckpointCreated(uint64_t checkpointNumber,
+                                                         uint64_t lastBlock,
+                                                         const StateTransferDigest &) {
+  m_ptrReplicaImpl->createSnapshot(checkpointNumber, lastBlock);
+}
+
 }  // namespace SimpleKVBC
@@ -65,11 +65,19 @@ class ReplicaImp : public SimpleKVBC::IReplica,
   virtual Status getBlockData(concord::storage::blockchain::BlockId blockId,
                               concord::storage::SetOfKeyValuePairs &outBlockData) const override;
 
+  virtual Status getBlockView(concord::storage::blockchain::BlockId blockId,
+                              concord::storage::blockchain::BlockView &outBlock) const override;
+
   virtual Status mayHaveConflictBetween(const Sliver& key,
                                         concord::storage::blockchain::BlockId fromBlock,
                                         concord::storage::blockchain::BlockId toBlock,
                                         bool &outRes) const override;
 
+  virtual Status mayHaveConflictBetween(const concord::storage::KeysVector &keys,
+                                        concord::storage::blockchain::BlockId fromBlock,
+                                        concord::storage::blockchain::BlockId toBlock,
+                                        std::vector<bool> &outConflicts) const override;
+
   virtual concord::storage::blockchain::ILocalKeyValueStorageReadOnlyIterator *getSnapIterator() const override;
 
   virtual Status freeSnapIterator(
@@ -90,6 +98,18 @@ class ReplicaImp : public SimpleKVBC::IReplica,
 
   ~ReplicaImp() override;
 
+  // Keeps a checkpoint of the database in 'dir' at each checkpoint of the
+  // state, replacing the previous one. Disabled if 'dir' is empty.
+  void setSnapshotsDir(const std::string &dir) { m_snapshotsDir = dir; }
+
+  // Checks that the blocks of a database bootstrapped from such a snapshot
+  // chain up to 'lastBlock', whose digest is the one of the checkpoint, and
+  // that the keys of the database, and their latest versions, are those of
+  // the blocks.
+  static bool verifySnapshot(const concord::storage::blockchain::DBAdapter &dbAdapter,
+                             concord::storage::blockchain::BlockId lastBlock,
+                             const bftEngine::SimpleBlockchainStateTransfer::StateTransferDigest &digestOfLastBlock);
+
  protected:
   // METHODS
 
@@ -99,12 +119,21 @@ class ReplicaImp : public SimpleKVBC::IReplica,
                      Sliver key,
                      Sliver &outValue,
                      concord::storage::blockchain::BlockId &outBlock) const;
+  Status getConflictsInternal(const concord::storage::KeysVector &keys,
+                              concord::storage::blockchain::BlockId fromBlock,
+                              concord::storage::blockchain::BlockId toBlock,
+                              std::vector<bool> &outConflicts) const;
   void insertBlockInternal(concord::storage::blockchain::BlockId blockId, Sliver block);
   Sliver getBlockInternal(concord::storage::blockchain::BlockId blockId) const;
   concord::storage::blockchain::DBAdapter *getBcDbAdapter() const { return m_bcDbAdapter; }
 
  private:
   void createReplicaAndSyncState();
+  void createSnapshot(uint64_t checkpointNumber, concord::storage::blockchain::BlockId lastBlock);
+  // Keeps the digests of a block that is now the last one, or forgets them if
+  // the block is empty.
+  void cacheLastBlockDigest(concord::storage::blockchain::BlockId blockId, const Sliver &block);
+  void loadLastBlockDigest();
 
   // INTERNAL TYPES
 
@@ -152,11 +181,19 @@ class ReplicaImp : public SimpleKVBC::IReplica,
     virtual Status getBlockData(concord::storage::blockchain::BlockId blockId,
                                 concord::storage::SetOfKeyValuePairs &outBlockData) const override;
 
+    virtual Status getBlockView(concord::storage::blockchain::BlockId blockId,
+                                concord::storage::blockchain::BlockView &outBlock) const override;
+
     virtual Status mayHaveConflictBetween(const Sliver& key,
                                           concord::storage::blockchain::BlockId fromBlock,
                                           concord::storage::blockchain::BlockId toBlock,
                                           bool &outRes) const override;
 
+    virtual Status mayHaveConflictBetween(const concord::storage::KeysVector &keys,
+                                          concord::storage::blockchain::BlockId fromBlock,
+                                          concord::storage::blockchain::BlockId toBlock,
+                                          std::vector<bool> &outConflicts) const override;
+
     virtual concord::storage::blockchain::ILocalKeyValueStorageReadOnlyIterator *getSnapIterator() const override;
 
     virtual Status freeSnapIterator(
@@ -242,6 +279,11 @@ class ReplicaImp : public SimpleKVBC::IReplica,
     virtual bool putBlock(uint64_t blockId, char *block, uint32_t blockSize) override;
     virtual uint64_t getLastReachableBlockNum() override;
     virtual uint64_t getLastBlockNum() override;
+    virtual uint64_t getFirstBlockNum() override;
+    virtual void onCheckpointCreated(
+        uint64_t checkpointNumber,
+        uint64_t lastBlock,
+        const bftEngine::SimpleBlockchainStateTransfer::StateTransferDigest &digestOfLastBlock) override;
 
    private:
     ReplicaImp *const m_ptrReplicaImpl = nullptr;
@@ -272,6 +314,13 @@ class ReplicaImp : public SimpleKVBC::IReplica,
   concord::storage::DBMetadataStorage *m_metadataStorage = nullptr;
   ReplicaStateSyncImp m_replicaStateSync;
   std::shared_ptr<concordMetrics::Aggregator> aggregator_;
+  std::string m_snapshotsDir;
+  std::string m_lastSnapshot;
+  // The digest of the last block, and its parent digest, so that the next
+  // block is appended without reading and hashing it again. 0 if not known.
+  concord::storage::blockchain::BlockId m_digestedBlock = 0;
+  bftEngine::SimpleBlockchainStateTransfer::StateTransferDigest m_lastBlockDigest;
+  bftEngine::SimpleBlockchainStateTransfer::StateTransferDigest m_lastBlockParentDigest;
 
   // static methods
   static Sliver createBlockFromUpdates(const concord::storage::SetOfKeyValuePairs &updates,
@@ -26,7 +26,9 @@ using concordUtils::Status;
 using concordUtils::Sliver;
 using concordUtils::BlockId;
 using concordUtils::KeyValuePair;
+using concord::storage::KeysVector;
 using concord::storage::SetOfKeyValuePairs;
+using concord::storage::blockchain::BlockView;
 
 int InternalCommandsHandler::execute(uint16_t clientId,
                                      uint64_t sequenceNum,
@@ -60,9 +62,7 @@ void InternalCommandsHandler::addMetadataKeyValue(SetOfKeyValuePairs &updates, u
 }
 
 Sliver InternalCommandsHandler::buildSliverFromStaticBuf(char *buf) {
-  char *newBuf = new char[KV_LEN];
-  memcpy(newBuf, buf, KV_LEN);
-  return Sliver(newBuf, KV_LEN);
+  return Sliver::copy(buf, KV_LEN);
 }
 
 bool InternalCommandsHandler::verifyWriteCommand(uint32_t requestSize,
@@ -104,12 +104,15 @@ bool InternalCommandsHandler::executeWriteCommand(uint32_t requestSize,
   SimpleKey *readSetArray = writeReq->readSetArray();
   BlockId currBlock = m_storage->getLastBlock();
 
-  // Look for conflicts
-  bool hasConflict = false;
-  for (size_t i = 0; !hasConflict && i < writeReq->numOfKeysInReadSet; i++) {
-    m_storage->mayHaveConflictBetween(
-        buildSliverFromStaticBuf(readSetArray[i].key), writeReq->readVersion + 1, currBlock, hasConflict);
+  // Look for conflicts, reading the keys of the read set together
+  KeysVector readSet;
+  readSet.reserve(writeReq->numOfKeysInReadSet);
+  for (size_t i = 0; i < writeReq->numOfKeysInReadSet; i++) {
+    readSet.push_back(buildSliverFromStaticBuf(readSetArray[i].key));
   }
+  std::vector<bool> conflicts;
+  m_storage->mayHaveConflictBetween(readSet, writeReq->readVersion + 1, currBlock, conflicts);
+  bool hasConflict = std::find(conflicts.begin(), conflicts.end(), true) != conflicts.end();
 
   if (!hasConflict) {
     SimpleKV *keyValArray = writeReq->keyValueArray();
@@ -156,15 +159,18 @@ bool InternalCommandsHandler::executeGetBlockDataCommand(
   }
 
   auto block_id = req->block_id;
-  SetOfKeyValuePairs outBlockData;
-  if (!m_storage->getBlockData(block_id, outBlockData).isOK()) {
+  BlockView block;
+  if (!m_storage->getBlockView(block_id, block).isOK()) {
     LOG_ERROR(m_logger, "GetBlockData: Failed to retrieve block %" << block_id);
     return false;
   }
 
+  SimpleKVBC::BlockMetadata metadata(*m_storage);
+  const Sliver metadataKey = metadata.Key();
+
   // Each block contains a single metadata key holding the sequence number
-  const int numMetadataKeys = 1;
-  auto numOfElements = outBlockData.size() - numMetadataKeys;
+  const size_t metadataIndex = block.find(metadataKey);
+  auto numOfElements = block.size() - (metadataIndex < block.size() ? 1 : 0);
   size_t replySize = SimpleReply_Read::getSize(numOfElements);
   LOG_ERROR(m_logger, "NUM OF ELEMENTS IN BLOCK = " << numOfElements);
   if (maxReplySize < replySize) {
@@ -178,14 +184,11 @@ bool InternalCommandsHandler::executeGetBlockDataCommand(
   pReply->header.type = READ;
   pReply->numOfItems = numOfElements;
 
-  SimpleKVBC::BlockMetadata metadata(*m_storage);
-  const Sliver metadataKey = metadata.Key();
-
   auto i = 0;
-  for (auto kv : outBlockData) {
-    if (kv.first != metadataKey) {
-      memcpy(pReply->items[i].simpleKey.key, kv.first.data(), KV_LEN);
-      memcpy(pReply->items[i].simpleValue.value, kv.second.data(), KV_LEN);
+  for (size_t entry = 0; entry < block.size(); entry++) {
+    if (entry != metadataIndex) {
+      memcpy(pReply->items[i].simpleKey.key, block.key(entry).data(), KV_LEN);
+      memcpy(pReply->items[i].simpleValue.value, block.value(entry).data(), KV_LEN);
       ++i;
     }
   }
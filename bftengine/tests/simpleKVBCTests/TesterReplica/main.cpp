@@ -14,6 +14,8 @@
 #include "setup.hpp"
 #include "ReplicaImp.h"
 #include "memorydb/client.h"
+#include "memorydb/concurrent_client.h"
+#include "blockchain/block_pruner.h"
 #include "internalCommandsHandler.hpp"
 #include "commonKVBTests.hpp"
 
@@ -33,19 +35,30 @@ int main(int argc, char** argv) {
     auto* comparator = new concord::storage::rocksdb::KeyComparator(key_manipulator);
     std::stringstream dbPath;
     dbPath << BasicRandomTests::DB_FILE_PREFIX << setup->GetReplicaConfig().replicaId;
-    db = new concord::storage::rocksdb::Client(dbPath.str(), comparator);
+    db = new concord::storage::rocksdb::Client(dbPath.str(), comparator, nullptr,
+                                               concord::storage::rocksdb::blockchainColumnFamilies());
 #else
     // Abort if we haven't built rocksdb storage
     LOG_ERROR(logger, "Must build with -DBUILD_ROCKSDB_STORAGE=TRUE cmake option in order to test with persistent storage enabled");
     exit(-1);
 #endif
   } else {
-    // Use in-memory storage
+    // Use in-memory storage, safe to use from the pruning thread if blocks are
+    // pruned
     auto comparator = concord::storage::memorydb::KeyComparator(key_manipulator);
-    db = new concord::storage::memorydb::Client(comparator);
+    if (setup->GetRetainedBlocks() > 0)
+      db = new concord::storage::memorydb::ConcurrentClient(comparator);
+    else
+      db = new concord::storage::memorydb::Client(comparator);
   }
 
   auto* dbAdapter = new concord::storage::blockchain::DBAdapter(db);
+  dbAdapter->enableBlockCache(concord::storage::blockchain::BlockCacheConfig());
+  dbAdapter->enableLatestValueCache(concord::storage::blockchain::LatestValueCacheConfig());
+  if (concord::storage::blockchain::BlockCompressor::isAvailable(concord::storage::blockchain::BlockCompression::LZ4)) {
+    auto s = dbAdapter->enableBlockCompression(concord::storage::blockchain::BlockCompressionConfig());
+    if (!s.isOK()) LOG_WARN(logger, "Blocks are stored uncompressed: " << s);
+  }
   auto* replica = new SimpleKVBC::ReplicaImp(
       setup->GetCommunication(), setup->GetReplicaConfig(), dbAdapter, setup->GetMetricsServer().GetAggregator());
 
@@ -58,6 +71,13 @@ int main(int argc, char** argv) {
   replica->set_command_handler(&cmdHandler);
   replica->start();
 
+  std::unique_ptr<concord::storage::blockchain::BlockPruner> pruner;
+  if (setup->GetRetainedBlocks() > 0) {
+    concord::storage::blockchain::PruningConfig pruningConfig;
+    pruningConfig.retainedBlocks = setup->GetRetainedBlocks();
+    pruner.reset(new concord::storage::blockchain::BlockPruner(*dbAdapter, pruningConfig));
+    pruner->start();
+  }
 
   while (replica->isRunning()) std::this_thread::sleep_for(std::chrono::seconds(1));
 }
@@ -39,9 +39,10 @@ std::unique_ptr<TestSetup> TestSetup::ParseArgs(int argc, char** argv) {
 
   char argTempBuffer[PATH_MAX + 10];
   string idStr;
+  uint64_t retainedBlocks = 0;
 
   int o = 0;
-  while ((o = getopt(argc, argv, "r:i:k:n:s:v:p")) != EOF) {
+  while ((o = getopt(argc, argv, "r:i:k:n:s:v:pb:")) != EOF) {
     switch (o) {
       case 'i': {
         strncpy(argTempBuffer, optarg, sizeof(argTempBuffer) - 1);
@@ -84,6 +85,10 @@ std::unique_ptr<TestSetup> TestSetup::ParseArgs(int argc, char** argv) {
       case 'p':
         rp.persistencyMode = PersistencyMode::RocksDB;
         break;
+      // Prune the blocks in the background, keeping the given number of them.
+      case 'b':
+        retainedBlocks = std::stoull(optarg);
+        break;
 
       default:
         break;
@@ -91,7 +96,7 @@ std::unique_ptr<TestSetup> TestSetup::ParseArgs(int argc, char** argv) {
   }
 
   if (rp.replicaId == UINT16_MAX || rp.keysFilePrefix.empty()) {
-    fprintf(stderr, "%s -k KEYS_FILE_PREFIX -i ID -n COMM_CONFIG_FILE", argv[0]);
+    fprintf(stderr, "%s -k KEYS_FILE_PREFIX -i ID -n COMM_CONFIG_FILE [-p] [-b RETAINED_BLOCKS]", argv[0]);
     exit(-1);
   }
 
@@ -128,7 +133,7 @@ std::unique_ptr<TestSetup> TestSetup::ParseArgs(int argc, char** argv) {
   uint16_t metrics_port = conf.listenPort + 1000;
 
   return std::unique_ptr<TestSetup>(new TestSetup{
-      replicaConfig, std::move(comm), logger, metrics_port, rp.persistencyMode == PersistencyMode::RocksDB});
+      replicaConfig, std::move(comm), logger, metrics_port, rp.persistencyMode == PersistencyMode::RocksDB, retainedBlocks});
 }
 
 }  // namespace SimpleKVBC
@@ -31,14 +31,17 @@ class TestSetup {
   concordMetrics::Server& GetMetricsServer() { return metrics_server_; }
   concordlogger::Logger GetLogger() { return logger_; }
   const bool UsePersistentStorage() const { return use_persistent_storage_; }
+  // Blocks kept by the background pruning, 0 if the blocks are not pruned
+  uint64_t GetRetainedBlocks() const { return retained_blocks_; }
 
  private:
   TestSetup(bftEngine::ReplicaConfig config,
             std::unique_ptr<bftEngine::ICommunication> comm,
             concordlogger::Logger logger,
             uint16_t metrics_port,
-            bool use_persistent_storage)
-      : replica_config_(config), communication_(std::move(comm)), logger_(logger), metrics_server_(metrics_port), use_persistent_storage_(use_persistent_storage) {
+            bool use_persistent_storage,
+            uint64_t retained_blocks)
+      : replica_config_(config), communication_(std::move(comm)), logger_(logger), metrics_server_(metrics_port), use_persistent_storage_(use_persistent_storage), retained_blocks_(retained_blocks) {
   }
   TestSetup() = delete;
 
@@ -47,6 +50,7 @@ class TestSetup {
   concordlogger::Logger logger_;
   concordMetrics::Server metrics_server_;
   bool use_persistent_storage_;
+  uint64_t retained_blocks_;
 };
 
 }  // namespace SimpleKVBC
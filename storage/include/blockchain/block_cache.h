@@ -0,0 +1,92 @@
+// Copyright 2019 VMware, all rights reserved
+//
+// Cache of the raw blocks read by id.
+
+#pragma once
+
+#include "Metrics.hpp"
+#include "sliver.hpp"
+#include "blockchain/db_types.h"
+#include "blockchain/stats_metrics.h"
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace concord {
+namespace storage {
+namespace blockchain {
+
+using concordUtils::Sliver;
+
+struct BlockCacheConfig {
+  // Bytes of the cached blocks, split evenly between the shards
+  size_t capacityBytes = 64 * 1024 * 1024;
+  size_t numOfShards = 16;
+};
+
+// A size-bounded cache of blocks, each shard with its own lock and least
+// recently used order. Consecutive blocks fall in different shards, so that
+// the readers of a range of blocks, like the replicas fetching them by state
+// transfer, don't wait on the same lock. A block larger than a shard is not
+// cached.
+class BlockCache {
+ public:
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t numOfBlocks = 0;
+    uint64_t bytes = 0;
+  };
+
+  explicit BlockCache(const BlockCacheConfig &config);
+
+  bool get(BlockId blockId, Sliver &outBlock);
+  void put(BlockId blockId, const Sliver &block);
+  void erase(BlockId blockId);
+  // Erases the blocks before 'untilBlock'.
+  void eraseBefore(BlockId untilBlock);
+  void clear();
+
+  Stats stats() const;
+  // Reports the stats as the values of a "block_cache" component, updated by
+  // updateMetrics().
+  void setAggregator(std::shared_ptr<concordMetrics::Aggregator> aggregator);
+  void updateMetrics();
+
+ private:
+  typedef std::list<std::pair<BlockId, Sliver>> LruList;
+
+  struct Shard {
+    std::mutex lock;
+    // most recently used first
+    LruList lru;
+    std::unordered_map<BlockId, LruList::iterator> blocks;
+    size_t bytes = 0;
+  };
+
+  // Bytes a block takes, with its entries in the list and the map
+  static size_t charge(const Sliver &block) { return block.length() + kEntryOverhead; }
+  static constexpr size_t kEntryOverhead = 64;
+
+  Shard &shardOf(BlockId blockId) { return *shards_[blockId % shards_.size()]; }
+  // Under the lock of the shard
+  void remove(Shard &shard, LruList::iterator it);
+
+  const size_t shardCapacity_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> evictions_{0};
+  std::atomic<uint64_t> numOfBlocks_{0};
+  std::atomic<uint64_t> bytes_{0};
+
+  StatsMetrics metrics_;
+};
+
+}  // namespace blockchain
+}  // namespace storage
+}  // namespace concord
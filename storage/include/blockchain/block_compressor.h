@@ -0,0 +1,128 @@
+// Copyright 2019 VMware, all rights reserved
+//
+// Compression of the blocks stored by the adapter.
+
+#pragma once
+
+#include "Metrics.hpp"
+#include "sliver.hpp"
+#include "status.hpp"
+#include "blockchain/db_types.h"
+#include "blockchain/stats_metrics.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace concord {
+namespace storage {
+namespace blockchain {
+
+using concordUtils::Sliver;
+using concordUtils::Status;
+
+enum class BlockCompression : uint8_t {
+  None = 0,
+  LZ4 = 1,
+  Zstd = 2,
+};
+
+struct BlockCompressionConfig {
+  BlockCompression compression = BlockCompression::LZ4;
+  // The zstd level: LZ4 always compresses at its default speed
+  int level = 3;
+  // A zstd dictionary, as trained by BlockCompressor::trainDictionary on blocks
+  // of the chain. The blocks compressed with a dictionary are only read with
+  // it: it must be configured as long as such blocks are stored.
+  std::string dictionary;
+  // Shorter blocks are stored as is
+  size_t minBlockSize = 256;
+};
+
+// The first byte of the blocks of a database whose blocks are framed, which
+// the adapter records in its metadata: the blocks of other databases are
+// stored as added, and never decoded.
+enum class StoredBlockFormat : uint8_t {
+  Raw = 0,
+  Compressed = 1,
+};
+
+constexpr uint8_t kCompressedBlockFormatVersion = 1;
+
+// Starts a compressed block, followed by the block compressed.
+struct CompressedBlockHeader {
+  // StoredBlockFormat::Compressed
+  uint8_t format;
+  uint8_t formatVersion;
+  uint8_t compression;
+  uint8_t reserved;
+  // The id of the zstd dictionary the block is compressed with, else 0
+  uint32_t dictionaryId;
+  uint32_t blockLength;
+};
+
+// Frames the blocks stored, compressed or not, and decodes the blocks read
+// by their format byte: a block that doesn't get shorter, or the blocks
+// stored without compression, follow a StoredBlockFormat::Raw byte.
+//
+// LZ4 and zstd are available when built with BUILD_BLOCK_COMPRESSION.
+// Compressions and decompressions can be called from several threads.
+class BlockCompressor {
+ public:
+  struct Stats {
+    uint64_t compressedBlocks = 0;
+    uint64_t uncompressedBlocks = 0;
+    // Of the blocks compressed
+    uint64_t blockBytes = 0;
+    uint64_t compressedBytes = 0;
+    uint64_t compressMicros = 0;
+    uint64_t decompressedBlocks = 0;
+    uint64_t decompressMicros = 0;
+  };
+
+  // Only decompresses, without a dictionary.
+  BlockCompressor();
+  ~BlockCompressor();
+
+  // Fails if the compression isn't built, or the dictionary can't be used.
+  Status init(const BlockCompressionConfig &config);
+  BlockCompression compression() const { return config_.compression; }
+
+  // The framed block to store for 'block'.
+  Sliver compress(const Sliver &block);
+  // Whether a framed block is compressed.
+  static bool isCompressed(const Sliver &stored);
+  // The block framed as 'stored'.
+  Status decompress(const Sliver &stored, Sliver &outBlock) const;
+
+  static bool isAvailable(BlockCompression compression);
+  // Trains a zstd dictionary of at most 'capacity' bytes on sample blocks.
+  static Status trainDictionary(const std::vector<Sliver> &blocks, size_t capacity, std::string &outDictionary);
+
+  Stats stats() const;
+  // Reports the stats as the values of a "block_compression" component,
+  // updated by updateMetrics(), with ratio_percent, compressed_bytes /
+  // block_bytes in percents.
+  void setAggregator(std::shared_ptr<concordMetrics::Aggregator> aggregator);
+  void updateMetrics();
+
+ private:
+  struct Codec;
+
+  BlockCompressionConfig config_;
+  std::unique_ptr<Codec> codec_;
+  std::atomic<uint64_t> compressedBlocks_{0};
+  std::atomic<uint64_t> uncompressedBlocks_{0};
+  std::atomic<uint64_t> blockBytes_{0};
+  std::atomic<uint64_t> compressedBytes_{0};
+  std::atomic<uint64_t> compressMicros_{0};
+  mutable std::atomic<uint64_t> decompressedBlocks_{0};
+  mutable std::atomic<uint64_t> decompressMicros_{0};
+
+  StatsMetrics metrics_;
+};
+
+}  // namespace blockchain
+}  // namespace storage
+}  // namespace concord
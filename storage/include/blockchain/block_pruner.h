@@ -0,0 +1,62 @@
+// Copyright 2019 VMware, all rights reserved
+//
+// Background pruning of the blockchain history.
+
+#pragma once
+
+#include "Logger.hpp"
+#include "blockchain/db_adapter.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace concord {
+namespace storage {
+namespace blockchain {
+
+struct PruningConfig {
+  // Number of blocks kept, up to the last reachable one
+  BlockId retainedBlocks = 100000;
+  // Blocks pruned at once, and at most per second
+  BlockId blocksPerBatch = 1000;
+  uint32_t maxBlocksPerSecond = 10000;
+  // Period of the checks for blocks to prune
+  uint32_t intervalMilli = 60000;
+};
+
+// Prunes the blocks of a DBAdapter that fall out of the retained ones, in
+// batches, from a thread of its own. The adapter's client is used from that
+// thread too: it must be safe to use from several threads, as the RocksDB
+// client and the concurrent in-memory one are.
+class BlockPruner {
+ public:
+  BlockPruner(DBAdapter &adapter, const PruningConfig &config);
+  ~BlockPruner() { stop(); }
+
+  void start();
+  void stop();
+
+  // The block before which blocks are pruned, given the last reachable one.
+  BlockId retentionPoint() const;
+  // Prunes up to the retention point from the calling thread, at the
+  // configured rate. Returns early, with OK, once stop() is called.
+  Status pruneToRetentionPoint();
+
+ private:
+  void run();
+  // Waits for 'milli' milliseconds, or less if stop() is called. Returns
+  // false if it was.
+  bool sleep(uint64_t milli);
+
+  concordlogger::Logger logger_;
+  DBAdapter &adapter_;
+  const PruningConfig config_;
+  std::thread thread_;
+  std::mutex lock_;
+  std::condition_variable stopCond_;
+  bool stopRequested_ = false;
+};
+
+}
+}
+}
@@ -0,0 +1,95 @@
+// Copyright 2019 VMware, all rights reserved
+//
+// Read-only access to a block, in place.
+
+#pragma once
+
+#include "sliver.hpp"
+#include "kv_types.hpp"
+#include "hash_defs.h"
+#include "blockchain/db_types.h"
+#include <iterator>
+
+namespace concord {
+namespace storage {
+namespace blockchain {
+
+using concordUtils::Key;
+using concordUtils::KeyValuePair;
+using concordUtils::SetOfKeyValuePairs;
+using concordUtils::Sliver;
+using concordUtils::Value;
+
+// Reads the header and the entries of a block from its buffer, without
+// copying them: the keys and values are sub-slivers of the block. A key is
+// found by binary search in a block whose entries are sorted, as the blocks
+// made by createBlock are, else by a linear scan.
+//
+// A block too short for its header, or with entries out of its bounds, is
+// invalid: it has no entries.
+class BlockView {
+ public:
+  class Iterator {
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef KeyValuePair value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const KeyValuePair *pointer;
+    typedef KeyValuePair reference;
+
+    KeyValuePair operator*() const { return KeyValuePair(view_->key(index_), view_->value(index_)); }
+    Iterator &operator++() {
+      ++index_;
+      return *this;
+    }
+    bool operator==(const Iterator &other) const { return index_ == other.index_ && view_ == other.view_; }
+    bool operator!=(const Iterator &other) const { return !(*this == other); }
+
+   private:
+    Iterator(const BlockView *view, size_t index) : view_(view), index_(index) {}
+
+    const BlockView *view_;
+    size_t index_;
+
+    friend class BlockView;
+  };
+
+  BlockView() = default;
+  explicit BlockView(const Sliver &block);
+
+  bool isValid() const { return valid_; }
+  bool isSorted() const { return valid_ && (header().flags & kBlockEntriesSorted); }
+  const Sliver &raw() const { return block_; }
+  const BlockHeader &header() const { return *reinterpret_cast<const BlockHeader *>(block_.data()); }
+
+  size_t size() const { return size_; }
+  Key key(size_t index) const;
+  Value value(size_t index) const;
+  Iterator begin() const { return Iterator(this, 0); }
+  Iterator end() const { return Iterator(this, size_); }
+
+  // The index of the entry of 'key', or size() if there is none.
+  size_t find(const Key &key) const;
+  bool get(const Key &key, Value &outValue) const;
+  // Copies the entries into a set, for the readers that need one.
+  SetOfKeyValuePairs toSet() const;
+
+  // Lays out a block of 'updates', with its entries sorted. The keys and
+  // values of the block are put in 'outUpdatesInBlock', as sub-slivers of it.
+  static Sliver createBlock(const SetOfKeyValuePairs &updates,
+                            const int8_t *parentDigest,
+                            uint32_t parentDigestLength,
+                            SetOfKeyValuePairs *outUpdatesInBlock = nullptr);
+
+ private:
+  BlockEntry entry(size_t index) const;
+  int compareKey(size_t index, const Key &key) const;
+
+  Sliver block_;
+  size_t size_ = 0;
+  bool valid_ = false;
+};
+
+}  // namespace blockchain
+}  // namespace storage
+}  // namespace concord
@@ -8,10 +8,16 @@
 #include "Logger.hpp"
 
 #include "sliver.hpp"
+#include "blockchain/block_cache.h"
+#include "blockchain/block_compressor.h"
 #include "blockchain/db_types.h"
 #include "blockchain/db_interfaces.h"
+#include "blockchain/latest_value_cache.h"
 #include "storage/db_interface.h"
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <vector>
 namespace concord {
 namespace storage {
 namespace blockchain {
@@ -19,10 +25,13 @@ namespace blockchain {
 
 class KeyManipulator: public IDBClient::IKeyManipulator{
  public:
-  KeyManipulator():logger_(concordlogger::Log::getLogger("concord.storage.blockchain.KeyManipulator")){}
+  explicit KeyManipulator(KeyLayout layout = KeyLayout::Composed):
+      logger_(concordlogger::Log::getLogger("concord.storage.blockchain.KeyManipulator")), layout_(layout){}
   virtual int   composedKeyComparison(const uint8_t* _a_data, size_t _a_length, const uint8_t* _b_data, size_t _b_length) override;
 
   Sliver        genDbKey(EDBKeyType _type, const Key& _key, BlockId _blockId);
+  // Generates the key in a buffer, whose memory is reused across keys.
+  void          genDbKey(EDBKeyType _type, const Key& _key, BlockId _blockId, std::vector<uint8_t> &_out);
   Sliver        genBlockDbKey(BlockId _blockId);
   Sliver        genDataDbKey(const Key& _key, BlockId _blockId);
   char          extractTypeFromKey(const Key& _key);
@@ -37,17 +46,27 @@ class KeyManipulator: public IDBClient::IKeyManipulator{
   bool          isKeyContainBlockId(const Key& _composedKey);
   KeyValuePair  composedToSimple(KeyValuePair _p);
   static Sliver generateMetadataKey(ObjectId objectId);
+  KeyLayout     layout() const { return layout_; }
  protected:
 
   static bool   copyToAndAdvance(uint8_t *_buf, size_t *_offset, size_t _maxOffset, uint8_t *_src, size_t _srcSize);
+  size_t        dbKeySize(const Key& _key) const;
+  void          encodeDbKey(EDBKeyType _type, const Key& _key, BlockId _blockId, uint8_t *_out, size_t _size);
+  void          encodeBytewiseDbKey(EDBKeyType _type, const Key& _key, BlockId _blockId, uint8_t *_out);
 
+  // 0x00 0x01, ending the escaped key of the Bytewise layout
+  static constexpr size_t kKeyTerminatorSize = 2;
 
   concordlogger::Logger logger_;
+  KeyLayout             layout_;
 };
 
 class DBAdapter {
  public:
-  explicit DBAdapter(IDBClient *db, bool readOnly = false);
+  // 'keyLayout' must be the layout of the database, and the one of the
+  // KeyManipulator given to its comparator.
+  explicit DBAdapter(IDBClient *db, bool readOnly = false, KeyLayout keyLayout = KeyLayout::Composed);
+  ~DBAdapter();
 
   std::shared_ptr<IDBClient> getDb() { return db_; }
 
@@ -55,8 +74,31 @@ class DBAdapter {
   Status updateKey(const Key& _key, BlockId _block, Value _value);
   Status addBlockAndUpdateMultiKey(const SetOfKeyValuePairs &_kvMap, BlockId _block, Sliver _blockRaw);
   Status getKeyByReadVersion(BlockId readVersion, const Sliver& key, Sliver &outValue, BlockId &outBlock) const;
+  // Reads a batch of keys as getKeyByReadVersion does, with the value and block
+  // of each key at its index in outValues and outBlocks.
+  Status getKeysByReadVersion(BlockId readVersion, const KeysVector &keys, ValuesVector &outValues,
+                              std::vector<BlockId> &outBlocks) const;
   Status getBlockById(BlockId _blockId, Sliver &_blockRaw, bool &_found) const;
 
+  // Keeps the blocks read and added in a cache, shared by all the readers of
+  // blocks by id. Call before using the adapter from several threads.
+  void enableBlockCache(const BlockCacheConfig &config);
+  // Null unless the cache is enabled.
+  BlockCache *blockCache() const { return blockCache_.get(); }
+  // Keeps the latest version of the keys read and written in a cache, in
+  // front of the latest version index. Call before using the adapter from
+  // several threads.
+  void enableLatestValueCache(const LatestValueCacheConfig &config);
+  // Null unless the cache is enabled.
+  LatestValueCache *latestValueCache() const { return latestValueCache_.get(); }
+  // Compresses the blocks added from now on. Only a database without blocks,
+  // or one compressed before, can be: it then frames its blocks with a
+  // format byte, which tells the compressed ones apart. The blocks are read
+  // as they were stored, compressed or not, whatever the compression. Call
+  // before using the adapter from several threads.
+  Status enableBlockCompression(const BlockCompressionConfig &config);
+  BlockCompressor &blockCompressor() { return blockCompressor_; }
+
   IDBClient::IDBClientIterator* getIterator() { return db_->getIterator(); }
 
   Status freeIterator(IDBClient::IDBClientIterator *_iter) { return db_->freeIterator(_iter); }
@@ -74,19 +116,102 @@ class DBAdapter {
   Status delKey(const Sliver& _key, BlockId _blockID);
   Status delBlock(BlockId _blockId);
   void   deleteBlockAndItsKeys(BlockId blockId);
+  // Deletes the blocks before 'untilBlock', and the versions of their keys
+  // that reads from 'untilBlock' on don't see. The last reachable block is
+  // never pruned.
+  Status pruneBlocks(BlockId untilBlock);
   void   monitor() const;
+  // Makes a read-only adapter over a follower of another database, such as a
+  // RocksDB secondary instance, see the blocks and keys written to it since.
+  // Safe to call while other threads read.
+  Status catchUpWithPrimary();
 
   BlockId getLatestBlock();
-  BlockId getLastReachableBlock();
+  BlockId getLastReachableBlock() const { return lastReachableBlock_; }
+  // The blocks before the first one were pruned.
+  BlockId getFirstBlock() const { return firstBlock_; }
 
  private:
+  // Reads a block, putting it in the cache if 'fillCache'.
+  Status  readBlock(BlockId blockId, Sliver &blockRaw, bool &found, bool fillCache) const;
+  Status  putBlockUpdates(IDBClient::IWriteBatch &batch, BlockId blockId);
+  // Puts in a batch a composite key, encoded in keyBuffer_.
+  void    putInBatch(IDBClient::IWriteBatch &batch, EDBKeyType type, const Key &key, BlockId blockId,
+                     const Sliver &value);
+  Sliver  genLatestVersionDbKey(const Key &key) const;
+  Status  addLatestVersion(const Key &key, BlockId blockId, IDBClient::IWriteBatch &batch);
+  // After the write of a version: 'latest' if no block after it was written.
+  void    cacheLatestVersion(const Key &key, BlockId blockId, const Value &value, bool latest);
+  Status  repairLatestVersion(const Key &key, BlockId deletedBlockId, IDBClient::IWriteBatch &batch);
+  Status  setLatestVersionIndexValid(bool valid);
+  Status  rebuildLatestVersionIndex();
+  void    loadLatestVersionIndex();
+  IDBClient::IDBClientIterator *lookupIterator() const;
+  // Seeks the version of 'key' visible at 'readVersion', from its composite
+  // key at 'readVersion'.
+  void    seekVersion(IDBClient::IDBClientIterator *iter, const Key &key, const Sliver &searchKey,
+                      BlockId readVersion, Sliver &outValue, BlockId &outBlock) const;
+  void    writeDone(BlockId blockId = 0);
+  Status  lowerLastReachableBlock(BlockId deletedBlockId);
+  Status  persistLastReachableBlock(BlockId blockId);
+  BlockId loadLastReachableBlock();
+  BlockId findLastReachableBlock(BlockId from) const;
+  Status  persistFirstBlock(BlockId blockId);
+  BlockId loadFirstBlock();
+  bool    loadFramedBlocks();
+  Sliver  blockToStore(const Sliver &block);
+
+  // The last reachable block is kept in the metadata keyspace, under an object
+  // id out of the range the BFT engine uses for its own metadata.
+  static constexpr ObjectId kLastReachableBlockObjectId = 0xFFFFFFFF;
+  // Present when the latest version index is complete. The index is rebuilt on
+  // open if it is missing, e.g. in a database written before it existed.
+  static constexpr ObjectId kLatestVersionIndexObjectId = 0xFFFFFFFE;
+  // The first block, once blocks were pruned.
+  static constexpr ObjectId kFirstBlockObjectId = 0xFFFFFFFD;
+  // Present when the blocks are stored after a StoredBlockFormat byte.
+  static constexpr ObjectId kFramedBlocksObjectId = 0xFFFFFFFC;
+
+  // The iterator getKeyByReadVersion uses on a thread, reused until a write.
+  // The thread owns it and frees it when it exits, unless the adapter is
+  // destroyed first.
+  struct LookupIterator;
+  // The lookup iterators of a thread, by adapter.
+  class ThreadLookupIterators;
+  static uint64_t newAdapterId();
+
   concordlogger::Logger      logger_;
   std::shared_ptr<IDBClient> db_;
   std::shared_ptr<KeyManipulator> key_manipulator_;
   KeyValuePair m_current;
   bool m_isEnd;
+  bool readOnly_;
+  // read by the pruning thread
+  std::atomic<BlockId> lastReachableBlock_{0};
+  std::atomic<BlockId> firstBlock_{1};
+  std::atomic<BlockId> latestBlock_{0};
+  bool framedBlocks_ = false;
+  std::atomic_bool latestVersionIndexValid_{false};
+  std::atomic<uint64_t> writeGeneration_{0};
+  // tells this adapter's iterators apart from those of the adapters that a
+  // thread used before, even one at the same address
+  const uint64_t id_ = newAdapterId();
+  // the iterators of the threads still alive, to free with the adapter
+  mutable std::mutex lookupIteratorsLock_;
+  mutable std::vector<std::weak_ptr<LookupIterator>> lookupIterators_;
+  // The batch the blocks and the keys are written with, and the buffers their
+  // keys and index entries are encoded in, reused across the writes.
+  std::unique_ptr<IDBClient::IWriteBatch> writeBatch_;
+  std::vector<uint8_t> keyBuffer_;
+  std::vector<uint8_t> entryBuffer_;
+  std::unique_ptr<BlockCache> blockCache_;
+  std::unique_ptr<LatestValueCache> latestValueCache_;
+  BlockCompressor blockCompressor_;
 };
 
+// Copies all the entries of a database into another one, converting their keys
+// from one layout to the other.
+Status migrateKeyLayout(const IDBClient &from, KeyLayout fromLayout, IDBClient &to, KeyLayout toLayout);
 
 }
 }
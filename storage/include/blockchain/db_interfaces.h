@@ -9,6 +9,7 @@
 #include "sliver.hpp"
 #include "status.hpp"
 #include "storage/db_interface.h"
+#include "blockchain/block_view.h"
 
 using std::pair;
 using std::string;
@@ -36,10 +37,18 @@ class ILocalKeyValueStorageReadOnly {
   virtual BlockId getLastBlock() const = 0;
   virtual Status getBlockData(BlockId blockId,
                               SetOfKeyValuePairs& outBlockData) const = 0;
+  // The block, read in place: cheaper than getBlockData for a lookup or a
+  // pass over its entries.
+  virtual Status getBlockView(BlockId blockId, BlockView& outBlock) const = 0;
   // TODO(GG): explain motivation
   virtual Status mayHaveConflictBetween(const Sliver& key, BlockId fromBlock,
                                         BlockId toBlock,
                                         bool& outRes) const = 0;
+  // The conflicts of a batch of keys, at the index of each key in
+  // outConflicts: the keys are read together, cheaper than one by one.
+  virtual Status mayHaveConflictBetween(const KeysVector& keys,
+                                        BlockId fromBlock, BlockId toBlock,
+                                        std::vector<bool>& outConflicts) const = 0;
 
   virtual ILocalKeyValueStorageReadOnlyIterator* getSnapIterator() const = 0;
   virtual Status freeSnapIterator(
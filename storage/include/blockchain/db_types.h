@@ -22,13 +22,27 @@ namespace concord {
 namespace storage {
 namespace blockchain {
 
+// The block format of the simple KVBC: a header, the entries, then the keys
+// and the values the entries point to. BlockView reads it in place. The
+// fields are little endian, the byte order of the hosts it is read on: the
+// flags are the upper half of the former digest length only in that order.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "The block format is read in place, in little endian byte order"
+#endif
 struct BlockHeader {
   uint32_t numberOfElements;
-  uint32_t parentDigestLength;
+  // Formerly a uint32_t, of which the blocks only used the lower half, as the
+  // digest length is at most BLOCK_DIGEST_SIZE: flags are 0 in the blocks
+  // written before they existed.
+  uint16_t parentDigestLength;
+  uint16_t flags;
   int8_t
       parentDigest[bftEngine::SimpleBlockchainStateTransfer::BLOCK_DIGEST_SIZE];
 };
 
+// The entries are sorted by key, compared as slivers are.
+constexpr uint16_t kBlockEntriesSorted = 0x1;
+
 // BlockEntry structures are coming immediately after the header.
 struct BlockEntry {
   uint32_t keyOffset;
@@ -42,9 +56,29 @@ enum class EDBKeyType : std::uint8_t {
   E_DB_KEY_TYPE_BLOCK = E_DB_KEY_TYPE_FIRST,
   E_DB_KEY_TYPE_KEY,
   E_DB_KEY_TYPE_BFT_METADATA_KEY,
+  E_DB_KEY_TYPE_LATEST_VERSION_KEY,  // block id of a key's latest version
   E_DB_KEY_TYPE_LAST
 };
 
+// How composite database keys are laid out.
+//
+// Composed: Key Type | Key | Block Id, the block id in host order. Ordering
+//           the keys takes a comparator parsing them (composedKeyComparison).
+// Bytewise: Key Type | Escaped Key | 0x00 0x01 | ~Block Id, the block id big
+//           endian. Plain memcmp gives the same order as the Composed layout,
+//           so RocksDB can use its built-in comparator.
+//
+// Metadata keys (Key Type | Object Id) are the same in both layouts: they are
+// only looked up, never iterated in order.
+//
+// A database keeps the layout it was created with (Composed for databases
+// written before Bytewise existed); migrateKeyLayout copies a database into
+// one of the other layout.
+enum class KeyLayout : std::uint8_t {
+  Composed,
+  Bytewise
+};
+
 typedef uint64_t BlockId;
 typedef uint32_t ObjectId;
 
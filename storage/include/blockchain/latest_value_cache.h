@@ -0,0 +1,112 @@
+// Copyright 2019 VMware, all rights reserved
+//
+// Cache of the latest version of the keys read and written.
+
+#pragma once
+
+#include "Metrics.hpp"
+#include "sliver.hpp"
+#include "hash_defs.h"
+#include "blockchain/db_types.h"
+#include "blockchain/stats_metrics.h"
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace concord {
+namespace storage {
+namespace blockchain {
+
+using concordUtils::Key;
+using concordUtils::Sliver;
+using concordUtils::Value;
+
+struct LatestValueCacheConfig {
+  // Bytes of the cached keys and values, split evenly between the shards
+  size_t capacityBytes = 16 * 1024 * 1024;
+  size_t numOfShards = 16;
+};
+
+// A size-bounded cache of the latest version of keys: its block id and its
+// value, as in the latest version index of the database. Each shard has its
+// own lock and least recently used order, so a small set of hot keys is served
+// without reading the database.
+//
+// An entry is never replaced by an older version. Filling the cache from a
+// read races with the deletions of versions: the fill is dropped if the cache
+// was invalidated since the read started, as told by epoch().
+class LatestValueCache {
+ public:
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t numOfKeys = 0;
+    uint64_t bytes = 0;
+  };
+
+  explicit LatestValueCache(const LatestValueCacheConfig &config);
+
+  bool get(const Key &key, BlockId &outBlock, Value &outValue);
+  // The version written is the latest one of the key.
+  void put(const Key &key, BlockId blockId, const Value &value);
+  // The version written may be older than an uncached one: only replaces an
+  // older cached version.
+  void update(const Key &key, BlockId blockId, const Value &value);
+  // The latest version read from the database, at 'epoch'.
+  void fill(const Key &key, BlockId blockId, const Value &value, uint64_t epoch);
+  void erase(const Key &key);
+  void clear();
+  uint64_t epoch() const { return epoch_; }
+
+  Stats stats() const;
+  // Reports the stats as the values of a "latest_value_cache" component,
+  // updated by updateMetrics().
+  void setAggregator(std::shared_ptr<concordMetrics::Aggregator> aggregator);
+  void updateMetrics();
+
+ private:
+  struct Entry {
+    Key key;
+    BlockId blockId;
+    Value value;
+  };
+  typedef std::list<Entry> LruList;
+
+  struct Shard {
+    std::mutex lock;
+    // most recently used first
+    LruList lru;
+    std::unordered_map<Key, LruList::iterator> keys;
+    size_t bytes = 0;
+  };
+
+  enum class Replace { Always, IfOlder, IfOlderOrAbsent };
+
+  // Bytes an entry takes, with its nodes in the list and the map
+  static size_t charge(const Entry &entry) { return entry.key.length() + entry.value.length() + kEntryOverhead; }
+  static constexpr size_t kEntryOverhead = 96;
+
+  Shard &shardOf(const Key &key) { return *shards_[std::hash<Key>()(key) % shards_.size()]; }
+  // Under the lock of the shard
+  void insert(Shard &shard, const Key &key, BlockId blockId, const Value &value, Replace replace);
+  void remove(Shard &shard, LruList::iterator it);
+
+  const size_t shardCapacity_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::atomic<uint64_t> epoch_{0};
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> evictions_{0};
+  std::atomic<uint64_t> numOfKeys_{0};
+  std::atomic<uint64_t> bytes_{0};
+
+  StatsMetrics metrics_;
+};
+
+}  // namespace blockchain
+}  // namespace storage
+}  // namespace concord
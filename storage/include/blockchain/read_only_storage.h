@@ -0,0 +1,81 @@
+// Copyright 2019 VMware, all rights reserved
+//
+// Read-only storage over a follower of the database of a replica.
+
+#pragma once
+
+#include "Logger.hpp"
+#include "blockchain/db_adapter.h"
+#include "blockchain/db_interfaces.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace concord {
+namespace storage {
+namespace blockchain {
+
+struct ReadOnlyStorageConfig {
+  // Period of the catch-ups with the primary database
+  uint32_t catchUpIntervalMilli = 1000;
+};
+
+// Serves the reads of a replica's storage from a read-only DBAdapter over a
+// follower of its database, such as a RocksDB secondary instance: historical
+// reads, block reads and snapshot iterations don't compete with the writes of
+// the replica for its database. The follower catches up with the primary every
+// catchUpIntervalMilli, from a thread of its own, and the reads lag the
+// primary by as much.
+//
+// The reads are at the last reachable block of the follower. The adapter's
+// client is used from several threads: it must be safe to, as the RocksDB
+// client is.
+class ReadOnlyStorage : public ILocalKeyValueStorageReadOnly {
+ public:
+  ReadOnlyStorage(DBAdapter &adapter, const ReadOnlyStorageConfig &config);
+  ~ReadOnlyStorage() { stop(); }
+
+  void start();
+  void stop();
+  // Catches up with the primary from the calling thread.
+  Status catchUp();
+
+  Status get(const Key &key, Value &outValue) const override;
+  Status get(BlockId readVersion, const Sliver &key, Sliver &outValue, BlockId &outBlock) const override;
+  BlockId getLastBlock() const override;
+  Status getBlockData(BlockId blockId, SetOfKeyValuePairs &outBlockData) const override;
+  Status getBlockView(BlockId blockId, BlockView &outBlock) const override;
+  Status mayHaveConflictBetween(const Sliver &key, BlockId fromBlock, BlockId toBlock, bool &outRes) const override;
+  Status mayHaveConflictBetween(const KeysVector &keys,
+                                BlockId fromBlock,
+                                BlockId toBlock,
+                                std::vector<bool> &outConflicts) const override;
+  // The iterators read at the last reachable block as of their creation, and
+  // see the database as of then.
+  ILocalKeyValueStorageReadOnlyIterator *getSnapIterator() const override;
+  Status freeSnapIterator(ILocalKeyValueStorageReadOnlyIterator *iter) const override;
+  void monitor() const override;
+
+ private:
+  class Iterator;
+
+  void run();
+  // Waits for 'milli' milliseconds, or less if stop() is called. Returns
+  // false if it was.
+  bool sleep(uint64_t milli);
+
+  concordlogger::Logger logger_;
+  DBAdapter &adapter_;
+  const ReadOnlyStorageConfig config_;
+  // The adapter keeps the position of the iterations it serves: they are
+  // serialized.
+  mutable std::mutex iterationLock_;
+  std::thread thread_;
+  std::mutex lock_;
+  std::condition_variable stopCond_;
+  bool stopRequested_ = false;
+};
+
+}  // namespace blockchain
+}  // namespace storage
+}  // namespace concord
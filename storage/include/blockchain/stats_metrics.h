@@ -0,0 +1,47 @@
+// Copyright 2019 VMware, all rights reserved
+//
+// Metrics of the statistics a storage component counts itself.
+
+#pragma once
+
+#include "Metrics.hpp"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace concord {
+namespace storage {
+namespace blockchain {
+
+// Reports the statistics of a component, like a cache, as the values of a
+// metrics component: its running totals as counters, and its current sizes
+// as gauges. Nothing is reported until an aggregator is set. Thread safe.
+class StatsMetrics {
+ public:
+  StatsMetrics(std::string name, std::vector<std::string> counterNames, std::vector<std::string> gaugeNames);
+
+  void setAggregator(std::shared_ptr<concordMetrics::Aggregator> aggregator);
+  // The values in the order of the names given to the constructor.
+  void update(const std::vector<uint64_t> &counters, const std::vector<uint64_t> &gauges);
+
+ private:
+  struct Registered {
+    Registered(const StatsMetrics &metrics, std::shared_ptr<concordMetrics::Aggregator> aggregator);
+
+    concordMetrics::Component component;
+    std::vector<concordMetrics::Component::Handle<concordMetrics::Counter>> counters;
+    std::vector<concordMetrics::Component::Handle<concordMetrics::Gauge>> gauges;
+  };
+
+  const std::string name_;
+  const std::vector<std::string> counterNames_;
+  const std::vector<std::string> gaugeNames_;
+  // the components are not thread safe
+  std::mutex lock_;
+  std::unique_ptr<Registered> registered_;
+};
+
+}  // namespace blockchain
+}  // namespace storage
+}  // namespace concord
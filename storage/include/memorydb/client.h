@@ -15,6 +15,7 @@
 #include <map>
 #include "sliver.hpp"
 #include "key_comparator.h"
+#include "write_batch.h"
 #include "storage/db_interface.h"
 #include <functional>
 
@@ -71,8 +72,12 @@ class Client : public IDBClient {
   virtual concordUtils::Status put(const Sliver& _key, const Sliver& _value) override;
   virtual concordUtils::Status del(const Sliver& _key) override;
   concordUtils::Status multiGet(const KeysVector &_keysVec, OUT ValuesVector &_valuesVec) override;
+  using IDBClient::multiGet;
   concordUtils::Status multiPut(const SetOfKeyValuePairs &_keyValueMap) override;
   concordUtils::Status multiDel(const KeysVector &_keysVec) override;
+  concordUtils::Status rangeDel(const Sliver& _beginKey, const Sliver& _endKey) override;
+  std::unique_ptr<IWriteBatch> newWriteBatch() const override { return std::unique_ptr<IWriteBatch>(new WriteBatch()); }
+  concordUtils::Status write(IWriteBatch &_batch) override;
   virtual void monitor() const override{};
   bool isNew() override { return true; }
   ITransaction* beginTransaction() override {return nullptr;} // TODO [TK] implement in-memory transaction?
@@ -0,0 +1,197 @@
+// Copyright 2019 VMware, all rights reserved
+
+// ConcurrentClient is an in memory database that is safe to use from several
+// threads, implemented as a skip list.
+//
+// Writes are serialized, and reads take no lock: they follow the links of the
+// skip list, which are published with release stores once a node is built.
+// Nodes are never unlinked, so iterators stay valid across writes. Each key
+// has a chain of versions, numbered by write. A write of several keys, like a
+// multiPut, is made visible at once by publishing its number.
+//
+// Keys are allocated in an arena that is only released with the client, and
+// the Slivers of keys returned by reads share it: the node of a key stays
+// after it is deleted. Values are allocated one by one. The versions that a
+// write supersedes, and their values, are retired with it and freed once no
+// reader can still see them: each reader pins the write it reads as of in a
+// slot, for the time of a get, or from a seek of an iterator to its next seek
+// or its release. An iterator kept without moving holds the versions
+// superseded after its seek, as a RocksDB iterator does.
+
+#pragma once
+
+#include "Logger.hpp"
+#include "sliver.hpp"
+#include "key_comparator.h"
+#include "write_batch.h"
+#include "storage/db_interface.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace concord {
+namespace storage {
+namespace memorydb {
+
+// Memory of the keys and values, allocated by a single writer at a time.
+class Arena {
+ public:
+  uint8_t *allocate(size_t size);
+  size_t memoryUsage() const { return memoryUsage_.load(std::memory_order_relaxed); }
+
+ private:
+  static constexpr size_t kBlockSize = 1024 * 1024;
+
+  std::vector<std::unique_ptr<uint8_t[]>> blocks_;
+  uint8_t *current_ = nullptr;
+  size_t remaining_ = 0;
+  std::atomic<size_t> memoryUsage_{0};
+};
+
+class ConcurrentClient : public IDBClient {
+  friend class ConcurrentClientIterator;
+
+ public:
+  ConcurrentClient(KeyComparator comp);
+  ~ConcurrentClient();
+
+  virtual void init(bool readOnly) override;
+  virtual Status get(const Sliver &_key, OUT Sliver &_outValue) const override;
+  Status get(const Sliver &_key, OUT char *&buf, uint32_t bufSize, OUT uint32_t &_size) const override;
+  virtual IDBClientIterator *getIterator() const override;
+  virtual concordUtils::Status freeIterator(IDBClientIterator *_iter) const override;
+  virtual concordUtils::Status put(const Sliver &_key, const Sliver &_value) override;
+  virtual concordUtils::Status del(const Sliver &_key) override;
+  concordUtils::Status multiGet(const KeysVector &_keysVec, OUT ValuesVector &_valuesVec) override;
+  using IDBClient::multiGet;
+  // All the keys are written or deleted at once.
+  concordUtils::Status multiPut(const SetOfKeyValuePairs &_keyValueMap) override;
+  concordUtils::Status multiDel(const KeysVector &_keysVec) override;
+  concordUtils::Status rangeDel(const Sliver &_beginKey, const Sliver &_endKey) override;
+  std::unique_ptr<IWriteBatch> newWriteBatch() const override { return std::unique_ptr<IWriteBatch>(new WriteBatch()); }
+  // All the operations of the batch are visible at once.
+  concordUtils::Status write(IWriteBatch &_batch) override;
+  virtual void monitor() const override;
+  // Of the keys and of the values not freed yet.
+  size_t memoryUsage() const;
+  bool isNew() override { return true; }
+  ITransaction *beginTransaction() override { return nullptr; }
+
+ private:
+  static constexpr int kMaxHeight = 12;
+
+  struct Version {
+    uint64_t sequence;
+    // cut when the older versions are freed
+    std::atomic<Version *> previous;
+    // shared with the Slivers read
+    std::shared_ptr<uint8_t> data;
+    uint32_t length;
+    bool deleted;
+  };
+
+  static constexpr uint64_t kUnpinned = UINT64_MAX;
+
+  // The write a reader reads as of. Slots are reused by the readers that
+  // come next, and freed with the client.
+  struct ReaderSlot {
+    std::atomic<uint64_t> pinned{kUnpinned};
+    std::atomic<bool> inUse{false};
+    ReaderSlot *next = nullptr;
+  };
+
+  struct Node {
+    const uint8_t *key;
+    uint32_t keyLength;
+    std::atomic<Version *> version;
+    int height;
+    // height links, allocated with the node
+    std::atomic<Node *> next[1];
+
+    Node *getNext(int level) const { return next[level].load(std::memory_order_acquire); }
+  };
+
+  int compare(const Node *node, const Sliver &key) const {
+    return comp_.compare(node->key, node->keyLength, key.data(), key.length());
+  }
+  // The first node whose key is not less than 'key', or null. Fills 'prev'
+  // with the last node before it at each level, if not null.
+  Node *findGreaterOrEqual(const Sliver &key, Node **prev) const;
+  // The last node whose key is less than 'key', or the head.
+  Node *findLessThan(const Sliver &key) const;
+  Node *findLast() const;
+  // The version of a node as of write 'sequence', or null if it is deleted.
+  static const Version *visibleVersion(const Node *node, uint64_t sequence);
+  uint64_t lastSequence() const { return sequence_.load(std::memory_order_seq_cst); }
+  Sliver keyOf(const Node *node) const;
+  Sliver valueOf(const Version *version) const;
+
+  // Writes of a batch, under writeLock_, published by publish(). A null value
+  // deletes the key.
+  void write(const Sliver &key, const Sliver *value, uint64_t sequence);
+  void addVersion(Node *node, const Sliver *value, uint64_t sequence);
+  // Makes the writes visible, and frees the versions no reader can see.
+  void publish(uint64_t sequence);
+  void reclaim();
+  void freeVersions(Version *version);
+  ReaderSlot *acquireSlot() const;
+  // Pins the last write in 'slot', and returns it.
+  uint64_t pin(ReaderSlot *slot) const;
+  static void releaseSlot(ReaderSlot *slot);
+  Node *newNode(const Sliver &key, int height);
+  int randomHeight();
+
+  concordlogger::Logger logger;
+  KeyComparator comp_;
+  std::shared_ptr<Arena> arena_;
+  Node *head_;
+  std::atomic<int> height_{1};
+  std::atomic<uint64_t> sequence_{0};
+  std::atomic<size_t> numOfNodes_{0};
+  std::atomic<size_t> valueBytes_{0};
+  mutable std::atomic<ReaderSlot *> readers_{nullptr};
+  std::mutex writeLock_;
+  // The versions that superseded others, with their write, in write order:
+  // the versions before them are freed once no reader pins an older write.
+  std::deque<std::pair<uint64_t, Version *>> retired_;
+  std::minstd_rand random_;
+};
+
+class ConcurrentClientIterator : public concord::storage::IDBClient::IDBClientIterator {
+  friend class ConcurrentClient;
+
+ public:
+  ConcurrentClientIterator(const ConcurrentClient *_parentClient);
+  virtual ~ConcurrentClientIterator();
+
+  // Inherited via IDBClientIterator. first() and seekAtLeast() read the last
+  // writes: the moves that follow them read the same ones.
+  virtual KeyValuePair first() override;
+  virtual KeyValuePair seekAtLeast(const Sliver &_searchKey) override;
+  virtual KeyValuePair previous() override;
+  virtual KeyValuePair next() override;
+  virtual KeyValuePair getCurrent() override;
+  virtual bool isEnd() override;
+  virtual concordUtils::Status getStatus() override;
+
+ private:
+  KeyValuePair skipToVisible();
+  // Pins the last write, for the moves that follow.
+  void pinLastWrite();
+
+  concordlogger::Logger logger;
+
+  const ConcurrentClient *m_parentClient;
+  // Number of the last write read, pinned in m_slot
+  uint64_t m_sequence = 0;
+  ConcurrentClient::ReaderSlot *m_slot = nullptr;
+  const ConcurrentClient::Node *m_current = nullptr;
+};
+
+}  // namespace memorydb
+}  // namespace storage
+}  // namespace concord
@@ -28,6 +28,10 @@ class KeyComparator {
     return ret < 0;
   }
 
+  int compare(const uint8_t *a_data, size_t a_length, const uint8_t *b_data, size_t b_length) const {
+    return key_manipulator_->composedKeyComparison(a_data, a_length, b_data, b_length);
+  }
+
  private:
   std::shared_ptr<IDBClient::IKeyManipulator> key_manipulator_;
   concordlogger::Logger logger_;
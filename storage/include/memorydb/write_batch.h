@@ -0,0 +1,52 @@
+// Copyright 2019 VMware, all rights reserved
+
+// The write batch of the in memory clients: the operations, in order, on
+// copies of their keys and values, which the clients keep as they are. The
+// copies are made in an arena, as the keys and values of a batch are mostly
+// kept or dropped together.
+
+#pragma once
+
+#include "sliver.hpp"
+#include "storage/db_interface.h"
+#include <vector>
+
+namespace concord {
+namespace storage {
+namespace memorydb {
+
+class WriteBatch : public IDBClient::IWriteBatch {
+ public:
+  struct Operation {
+    Sliver key;
+    Sliver value;
+    bool deleted;
+  };
+
+  void put(const Sliver &_key, const Sliver &_value) override {
+    operations_.push_back(Operation{copy(_key), copy(_value), false});
+  }
+  void del(const Sliver &_key) override { operations_.push_back(Operation{copy(_key), Sliver(), true}); }
+  void clear() override {
+    operations_.clear();
+    arena_.reset();
+  }
+  size_t count() const override { return operations_.size(); }
+
+  const std::vector<Operation> &operations() const { return operations_; }
+
+ private:
+  Sliver copy(const Sliver &s) {
+    if (s.length() == 0) {
+      return Sliver();
+    }
+    return arena_.copy(s.data(), s.length());
+  }
+
+  std::vector<Operation> operations_;
+  concordUtils::SliverArena arena_;
+};
+
+}  // namespace memorydb
+}  // namespace storage
+}  // namespace concord
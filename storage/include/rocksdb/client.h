@@ -13,6 +13,10 @@
  *  contain variables for storing the database directory path, connection object
  *  and comparator.
  *
+ *  A database may be split in column families, by the first byte of the keys.
+ *  The keys of a family sort before the keys of the next one, so iterators go
+ *  through the families as through a single keyspace.
+ *
  */
 
 #pragma once
@@ -20,8 +24,12 @@
 #ifdef USE_ROCKSDB
 #include "Logger.hpp"
 #include <rocksdb/utilities/transaction_db.h>
+#include <rocksdb/write_batch.h>
 #include "kv_types.hpp"
 #include "storage/db_interface.h"
+#include <array>
+#include <atomic>
+#include <vector>
 
 namespace concord {
 namespace storage {
@@ -29,13 +37,56 @@ namespace rocksdb {
 
 class Client;
 
+// A column family holds the keys whose first byte is at least firstKeyByte,
+// and less than the firstKeyByte of the next family. The first family is the
+// default one, with firstKeyByte 0.
+struct ColumnFamily {
+  std::string name;
+  uint8_t firstKeyByte;
+  ::rocksdb::ColumnFamilyOptions options;
+};
+
+// How the writes reach the disk.
+//
+// A write is in the write ahead log once it returns, and survives a crash of
+// the process. It survives a crash of the machine once the log is synced. A
+// sync makes the writes before it durable too: syncing every few writes
+// groups their syncs, and a crash of the machine loses the writes since the
+// last sync. The writes of concurrent threads are grouped by RocksDB in single
+// log writes.
+struct WritePolicy {
+  // Every syncInterval-th write syncs the log: 1 syncs all of them, and 0
+  // none, leaving the log to the OS.
+  uint32_t syncInterval = 0;
+  // A write goes to the memtables while the next one is appended to the log,
+  // rather than after it.
+  bool pipelinedWrites = false;
+};
+
+// A batch in RocksDB's own encoding.
+class WriteBatch : public concord::storage::IDBClient::IWriteBatch {
+  friend class Client;
+
+ public:
+  explicit WriteBatch(const Client *_client) : m_client(_client) {}
+
+  void put(const concordUtils::Sliver& _key, const concordUtils::Sliver& _value) override;
+  void del(const concordUtils::Sliver& _key) override;
+  void clear() override { m_batch.Clear(); }
+  size_t count() const override { return m_batch.Count(); }
+
+ private:
+  const Client *m_client;
+  ::rocksdb::WriteBatch m_batch;
+};
+
 class ClientIterator
     : public concord::storage::IDBClient::IDBClientIterator {
   friend class Client;
 
  public:
-  ClientIterator(const Client *_parentClient);
-  ~ClientIterator() { delete m_iter; }
+  ClientIterator(const Client *_parentClient, bool _prefixSameAsStart = false);
+  ~ClientIterator();
 
   // Inherited via IDBClientIterator
   concordUtils::KeyValuePair first() override;
@@ -47,9 +98,19 @@ class ClientIterator
   concordUtils::Status getStatus() override;
 
  private:
+  // The iterator of a column family, created on first use.
+  ::rocksdb::Iterator *iterator(size_t _family);
+  // Moves from the end of the current column family to the next key of the
+  // following ones, or to their previous key if _backward.
+  void skipEmptyFamilies(bool _backward);
+  KeyValuePair currentKeyValue();
+
   concordlogger::Logger logger;
 
-  ::rocksdb::Iterator *m_iter;
+  std::vector<::rocksdb::Iterator *> m_iters;
+  // Column family of the current position
+  size_t m_family = 0;
+  bool m_prefixSameAsStart;
 
   // Reference to the RocksDBClient
   const Client *m_parentClient;
@@ -59,28 +120,81 @@ class ClientIterator
 
 class Client : public concord::storage::IDBClient {
  public:
-  Client(std::string _dbPath, ::rocksdb::Comparator *_comparator)
+  // A database with keys in the Bytewise layout takes no comparator: RocksDB's
+  // built-in one orders them, and a KeyPrefixExtractor, for prefix bloom
+  // filters used by getPrefixIterator.
+  //
+  // The comparator applies to all the column families. Without column
+  // families, the database has a single keyspace, tuned with the prefix
+  // extractor. A database created without column families keeps a single
+  // keyspace when it is opened with them.
+  Client(std::string _dbPath,
+         ::rocksdb::Comparator *_comparator = nullptr,
+         const ::rocksdb::SliceTransform *_prefixExtractor = nullptr,
+         std::vector<ColumnFamily> _columnFamilies = std::vector<ColumnFamily>())
       : logger(concordlogger::Log::getLogger("rocksdb_client")),
         m_dbPath(_dbPath),
-        m_comparator(_comparator) {}
-
+        m_comparator(_comparator),
+        m_prefixExtractor(_prefixExtractor),
+        m_columnFamilies(std::move(_columnFamilies)) {}
+  ~Client();
+
+  // Takes effect at init().
+  void setWritePolicy(const WritePolicy &_policy) { m_writePolicy = _policy; }
+  // Takes effect at init(): the database at the path of the client is opened
+  // as a secondary instance, a read-only follower of the primary instance that
+  // writes it, possibly from another process. The secondary keeps its own info
+  // log in _secondaryPath, and sees the writes of the primary as of its
+  // opening, then of each tryCatchUpWithPrimary().
+  void setSecondaryPath(const std::string &_secondaryPath) { m_secondaryPath = _secondaryPath; }
+  bool isSecondary() const { return !m_secondaryPath.empty(); }
+  // The writes that synced the log, under the write policy. A transaction
+  // counts as a write when it begins.
+  uint64_t numOfSyncedWrites() const { return m_numOfSyncedWrites; }
   void init(bool readOnly = false) override;
   concordUtils::Status get(const concordUtils::Sliver& _key, concordUtils::Sliver &_outValue) const override;
   concordUtils::Status get(const concordUtils::Sliver& _key, char *&buf, uint32_t bufSize, uint32_t &_realSize) const override;
   IDBClientIterator*   getIterator() const override;
+  IDBClientIterator*   getPrefixIterator() const override;
   concordUtils::Status freeIterator(IDBClientIterator *_iter) const override;
   concordUtils::Status put(const concordUtils::Sliver& _key, const concordUtils::Sliver& _value) override;
   concordUtils::Status del(const concordUtils::Sliver& _key) override;
   concordUtils::Status multiGet(const KeysVector &_keysVec, ValuesVector &_valuesVec) override;
+  // The values are pinned RocksDB buffers, without copies: they keep the
+  // buffers of the whole batch alive until they are all released, which
+  // must happen before the client is destroyed.
+  concordUtils::Status multiGet(const KeysVector &_keysVec,
+                                ValuesVector &_valuesVec,
+                                std::vector<concordUtils::Status> &_statusesVec) override;
   concordUtils::Status multiPut(const SetOfKeyValuePairs &_keyValueMap) override;
   concordUtils::Status multiDel(const KeysVector &_keysVec) override;
-  ::rocksdb::Iterator* getNewRocksDbIterator() const;
+  // Both keys must be in the same column family.
+  concordUtils::Status rangeDel(const concordUtils::Sliver& _beginKey, const concordUtils::Sliver& _endKey) override;
+  std::unique_ptr<IWriteBatch> newWriteBatch() const override;
+  concordUtils::Status write(IWriteBatch &_batch) override;
+  // A checkpoint hard-links the table files of the database, so it takes
+  // little space and time while the database keeps its files.
+  concordUtils::Status createCheckpoint(const std::string &_path) const override;
+  concordUtils::Status deleteCheckpoint(const std::string &_path) const override;
+  // Loads the checkpoint at _path, with the same column families, into this
+  // database, which must be empty. The keys of each column family are written
+  // in a table file that is ingested as is, without going through the
+  // memtables and the compactions.
+  concordUtils::Status ingestCheckpoint(const std::string &_path);
+  concordUtils::Status tryCatchUpWithPrimary() override;
+  ::rocksdb::Iterator* getNewRocksDbIterator(size_t family, bool prefixSameAsStart = false) const;
+  // The column family of a key, and its index.
+  ::rocksdb::ColumnFamilyHandle* columnFamily(const concordUtils::Sliver& _key) const;
+  size_t columnFamilyIndex(const concordUtils::Sliver& _key) const;
+  size_t numOfColumnFamilies() const { return m_columnFamilyHandles.size(); }
   void monitor() const override;
   bool isNew() override;
   ITransaction* beginTransaction() override;
 
  private:
   concordUtils::Status launchBatchJob(::rocksdb::WriteBatch &_batchJob);
+  // The options of the next write, under the write policy.
+  ::rocksdb::WriteOptions writeOptions();
   concordUtils::Status get(const concordUtils::Sliver& _key, std::string &_value) const;
 
  private:
@@ -91,6 +205,18 @@ class Client : public concord::storage::IDBClient {
   std::unique_ptr<::rocksdb::DB> m_dbInstance;
   ::rocksdb::TransactionDB*      txn_db_ = nullptr;
   ::rocksdb::Comparator*         m_comparator = nullptr;
+  std::shared_ptr<const ::rocksdb::SliceTransform> m_prefixExtractor;
+  // Column families as configured, and as opened.
+  std::vector<ColumnFamily>                    m_columnFamilies;
+  std::vector<std::string>                     m_columnFamilyNames;
+  std::vector<::rocksdb::ColumnFamilyHandle*>  m_columnFamilyHandles;
+  // Index of the column family of each first byte of a key
+  std::array<uint8_t, 256>                     m_familyOfKeyByte{};
+  WritePolicy                                  m_writePolicy;
+  // Empty unless the client is a secondary instance
+  std::string                                  m_secondaryPath;
+  std::atomic<uint64_t>                        m_numOfWrites{0};
+  std::atomic<uint64_t>                        m_numOfSyncedWrites{0};
 };
 
 ::rocksdb::Slice toRocksdbSlice(const concordUtils::Sliver& _s);
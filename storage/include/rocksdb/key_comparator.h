@@ -1,6 +1,6 @@
 // Copyright 2018 VMware, all rights reserved
 //
-// Storage key comparators definition.
+// Storage key comparators, prefix extractor and column families definition.
 
 #pragma once
 #ifdef USE_ROCKSDB
@@ -8,8 +8,12 @@
 #include "Logger.hpp"
 #include <rocksdb/comparator.h>
 #include <rocksdb/slice.h>
+#include <rocksdb/slice_transform.h>
 #include "sliver.hpp"
 #include "storage/db_interface.h"
+#include "blockchain/db_types.h"
+#include "rocksdb/client.h"
+#include <vector>
 
 namespace concord {
 namespace storage {
@@ -34,6 +38,26 @@ class KeyComparator: public ::rocksdb::Comparator {
   concordlogger::Logger logger_;
 };
 
+// Prefix of the keys of type Key in the Bytewise layout: the composite key up
+// to the end of its escaped application key. All the versions of a key share
+// it, so the seek for a version skips the files that don't have the key.
+class KeyPrefixExtractor: public ::rocksdb::SliceTransform {
+ public:
+  virtual const char*      Name() const override { return "concord.KeyPrefixExtractor"; }
+  virtual ::rocksdb::Slice Transform(const ::rocksdb::Slice& _key) const override;
+  virtual bool             InDomain(const ::rocksdb::Slice& _key) const override;
+
+ private:
+  // Length of the prefix, or 0 if the key has none.
+  static size_t prefixLength(const ::rocksdb::Slice& _key);
+};
+
+// Column families of a blockchain database, one per key type: blocks (large
+// values, appended), versioned keys (seeks for a version), BFT metadata (small
+// values, rewritten often) and latest versions of keys (point lookups). Keys
+// of the Bytewise layout get a KeyPrefixExtractor.
+std::vector<ColumnFamily> blockchainColumnFamilies(blockchain::KeyLayout layout = blockchain::KeyLayout::Composed);
+
 }
 }
 }
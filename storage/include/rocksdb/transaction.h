@@ -24,7 +24,7 @@ namespace rocksdb {
 
 class Transaction: public ITransaction {
  public:
-  Transaction(::rocksdb::Transaction* txn, ID id): ITransaction(id), txn_(txn){}
+  Transaction(::rocksdb::Transaction* txn, ID id, const Client* client): ITransaction(id), txn_(txn), client_(client){}
 
   void commit() override {
     ::rocksdb::Status s = txn_->Commit();
@@ -38,25 +38,26 @@ class Transaction: public ITransaction {
 
   }
   void put(const Sliver& key, const Sliver& value)  override {
-    ::rocksdb::Status s = txn_->Put(toRocksdbSlice(key), toRocksdbSlice(value));
+    ::rocksdb::Status s = txn_->Put(client_->columnFamily(key), toRocksdbSlice(key), toRocksdbSlice(value));
     if (!s.ok() )
       ROCKSDB_THROW("Put", s);
   }
   std::string get(const Sliver& key) override {
     std::string val;
-    ::rocksdb::Status s = txn_->Get(::rocksdb::ReadOptions(), toRocksdbSlice(key), &val);
+    ::rocksdb::Status s = txn_->Get(::rocksdb::ReadOptions(), client_->columnFamily(key), toRocksdbSlice(key), &val);
     if (!s.ok() && !s.IsNotFound())
       ROCKSDB_THROW("Get", s);
     return val;
   }
   void remove(const Sliver& key) override {
-    ::rocksdb::Status s =txn_->Delete(toRocksdbSlice(key));
+    ::rocksdb::Status s =txn_->Delete(client_->columnFamily(key), toRocksdbSlice(key));
     if (!s.ok())
       ROCKSDB_THROW("Delete", s);
   }
 
  protected:
   std::unique_ptr<::rocksdb::Transaction> txn_;
+  const Client* client_;
 };
 
 }
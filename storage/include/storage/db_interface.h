@@ -57,8 +57,60 @@ class IDBClient {
   virtual Status put(const Sliver& _key, const Sliver& _value) = 0;
   virtual Status del(const Sliver& _key) = 0;
   virtual Status multiGet(const KeysVector &_keysVec, OUT ValuesVector &_valuesVec) = 0;
+  // Reads a batch of keys, some of which may be missing: the value and status
+  // of each key are at its index in _valuesVec and _statusesVec, with an empty
+  // value for a missing key. Returns the first status that is neither OK nor
+  // NotFound, else OK.
+  virtual Status multiGet(const KeysVector &_keysVec,
+                          OUT ValuesVector &_valuesVec,
+                          OUT std::vector<Status> &_statusesVec) {
+    Status status = Status::OK();
+    _valuesVec.assign(_keysVec.size(), Sliver());
+    _statusesVec.assign(_keysVec.size(), Status::OK());
+    for (size_t i = 0; i < _keysVec.size(); i++) {
+      _statusesVec[i] = get(_keysVec[i], _valuesVec[i]);
+      if (status.isOK() && !_statusesVec[i].isOK() && !_statusesVec[i].isNotFound()) {
+        status = _statusesVec[i];
+      }
+    }
+    return status;
+  }
   virtual Status multiPut(const SetOfKeyValuePairs &_keyValueMap) = 0;
   virtual Status multiDel(const KeysVector &_keysVec) = 0;
+
+  // Puts and deletes, applied in order and at once by write(). The keys and
+  // values are copied as they are added, so they may be views of temporary
+  // buffers. A batch is reused after a clear(), keeping its memory.
+  class IWriteBatch {
+   public:
+    virtual void   put(const Sliver& _key, const Sliver& _value) = 0;
+    virtual void   del(const Sliver& _key) = 0;
+    virtual void   clear() = 0;
+    virtual size_t count() const = 0;
+    virtual ~IWriteBatch() = default;
+  };
+  // A batch for this client only.
+  virtual std::unique_ptr<IWriteBatch> newWriteBatch() const = 0;
+  // Applies a batch of this client. The batch is left as is.
+  virtual Status write(IWriteBatch &_batch) = 0;
+  // Deletes the keys from _beginKey, included, to _endKey, excluded, in the
+  // order of the database.
+  virtual Status rangeDel(const Sliver& _beginKey, const Sliver& _endKey) = 0;
+  // Creates a consistent copy of the database in the directory _path, which
+  // must not exist, and deletes such a copy. Clients without files on disk
+  // don't support them.
+  virtual Status createCheckpoint(const std::string & /* _path */) const {
+    return Status::IllegalOperation("Checkpoints are not supported");
+  }
+  virtual Status deleteCheckpoint(const std::string & /* _path */) const {
+    return Status::IllegalOperation("Checkpoints are not supported");
+  }
+  // Makes a read-only follower of a database see the writes made to it since
+  // it was opened, or since the last catch-up. Other clients don't follow a
+  // database.
+  virtual Status tryCatchUpWithPrimary() {
+    return Status::IllegalOperation("Not a follower of another database");
+  }
   virtual void   monitor() const = 0;
   virtual bool   isNew() = 0;
 
@@ -88,6 +140,10 @@ class IDBClient {
   };
 
   virtual IDBClientIterator *getIterator() const = 0;
+  // An iterator for seeks whose result is only used if it has the prefix of
+  // the searched key: a client with a prefix bloom filter skips the data of
+  // other prefixes. Freed by freeIterator.
+  virtual IDBClientIterator *getPrefixIterator() const { return getIterator(); }
   virtual Status freeIterator(IDBClientIterator *_iter) const = 0;
 };
 
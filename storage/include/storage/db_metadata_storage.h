@@ -16,6 +16,8 @@
 #include <mutex>
 #include <functional>
 #include <map>
+#include <memory>
+#include <vector>
 #include "Logger.hpp"
 #include "bftengine/MetadataStorage.hpp"
 #include "storage/db_interface.h"
@@ -31,8 +33,11 @@ class DBMetadataStorage : public bftEngine::MetadataStorage {
  public:
   explicit DBMetadataStorage(IDBClient *dbClient, std::function<concordUtils::Sliver(uint32_t)> genMetadataKey)
       : logger_(concordlogger::Log::getLogger("com.concord.vmware.metadatastorage")),
-        dbClient_(dbClient), genMetadataKey_(std::move(genMetadataKey)) {
+        dbClient_(dbClient), batch_(dbClient->newWriteBatch()), genMetadataKey_(std::move(genMetadataKey)) {
     objectIdToSizeMap_[objectsNumParameterId_] = sizeof(objectsNum_);
+    for (uint32_t objectId = 0; objectId <= objectsNumParameterId_; objectId++) {
+      metadataKeys_.push_back(genMetadataKey_(objectId));
+    }
   }
 
   bool initMaxSizeOfObjects(ObjectDesc *metadataObjectsArray, uint32_t metadataObjectsArrayLength) override;
@@ -47,6 +52,7 @@ class DBMetadataStorage : public bftEngine::MetadataStorage {
 
  private:
   void verifyOperation(uint32_t objectId, uint32_t dataLen, const char *buffer, bool writeOperation) const;
+  Sliver metadataKey(uint32_t objectId) const;
 
  private:
   const char *WRONG_FLOW = "beginAtomicWriteOnlyBatch should be launched first";
@@ -56,13 +62,18 @@ class DBMetadataStorage : public bftEngine::MetadataStorage {
 
   concordlogger::Logger logger_;
   IDBClient *dbClient_ = nullptr;
-  SetOfKeyValuePairs *batch_ = nullptr;
+  // The objects written in the open batch are encoded straight into a native
+  // batch of the client, reused across the batches.
+  std::unique_ptr<IDBClient::IWriteBatch> batch_;
+  bool batchOpen_ = false;
   std::mutex ioMutex_;
   ObjectIdToSizeMap objectIdToSizeMap_;
   uint32_t objectsNum_ = 0;
 
   // A function that creates a metadata key given an object ID
   std::function<Sliver(uint32_t)> genMetadataKey_;
+  // The keys of the objects declared, by object ID
+  std::vector<Sliver> metadataKeys_;
 };
 
 }
@@ -0,0 +1,120 @@
+// Copyright 2019 VMware, all rights reserved
+//
+// Cache of the raw blocks read by id.
+
+#include "blockchain/block_cache.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace concord {
+namespace storage {
+namespace blockchain {
+
+constexpr size_t BlockCache::kEntryOverhead;
+
+BlockCache::BlockCache(const BlockCacheConfig &config)
+    : shardCapacity_(config.capacityBytes / std::max<size_t>(config.numOfShards, 1)),
+      metrics_("block_cache", {"hits", "misses", "evictions"}, {"blocks", "bytes"}) {
+  for (size_t i = 0; i < std::max<size_t>(config.numOfShards, 1); i++) {
+    shards_.emplace_back(new Shard());
+  }
+}
+
+bool BlockCache::get(BlockId blockId, Sliver &outBlock) {
+  Shard &shard = shardOf(blockId);
+  std::lock_guard<std::mutex> lock(shard.lock);
+  auto found = shard.blocks.find(blockId);
+  if (found == shard.blocks.end()) {
+    misses_++;
+    return false;
+  }
+  shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+  outBlock = found->second->second;
+  hits_++;
+  return true;
+}
+
+void BlockCache::put(BlockId blockId, const Sliver &block) {
+  const size_t blockCharge = charge(block);
+  Shard &shard = shardOf(blockId);
+  std::lock_guard<std::mutex> lock(shard.lock);
+  auto found = shard.blocks.find(blockId);
+  if (found != shard.blocks.end()) {
+    remove(shard, found->second);
+  }
+  if (blockCharge > shardCapacity_) {
+    return;
+  }
+  while (shard.bytes + blockCharge > shardCapacity_) {
+    remove(shard, std::prev(shard.lru.end()));
+    evictions_++;
+  }
+  shard.lru.emplace_front(blockId, block);
+  shard.blocks[blockId] = shard.lru.begin();
+  shard.bytes += blockCharge;
+  bytes_ += blockCharge;
+  numOfBlocks_++;
+}
+
+void BlockCache::erase(BlockId blockId) {
+  Shard &shard = shardOf(blockId);
+  std::lock_guard<std::mutex> lock(shard.lock);
+  auto found = shard.blocks.find(blockId);
+  if (found != shard.blocks.end()) {
+    remove(shard, found->second);
+  }
+}
+
+void BlockCache::eraseBefore(BlockId untilBlock) {
+  for (auto &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->lock);
+    for (auto it = shard->lru.begin(); it != shard->lru.end();) {
+      auto current = it++;
+      if (current->first < untilBlock) {
+        remove(*shard, current);
+      }
+    }
+  }
+}
+
+void BlockCache::clear() {
+  for (auto &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->lock);
+    while (!shard->lru.empty()) {
+      remove(*shard, shard->lru.begin());
+    }
+  }
+}
+
+void BlockCache::remove(Shard &shard, LruList::iterator it) {
+  const size_t blockCharge = charge(it->second);
+  shard.bytes -= blockCharge;
+  bytes_ -= blockCharge;
+  numOfBlocks_--;
+  shard.blocks.erase(it->first);
+  shard.lru.erase(it);
+}
+
+BlockCache::Stats BlockCache::stats() const {
+  Stats stats;
+  stats.hits = hits_;
+  stats.misses = misses_;
+  stats.evictions = evictions_;
+  stats.numOfBlocks = numOfBlocks_;
+  stats.bytes = bytes_;
+  return stats;
+}
+
+void BlockCache::setAggregator(std::shared_ptr<concordMetrics::Aggregator> aggregator) {
+  metrics_.setAggregator(aggregator);
+}
+
+void BlockCache::updateMetrics() {
+  const Stats current = stats();
+  metrics_.update({current.hits, current.misses, current.evictions}, {current.numOfBlocks, current.bytes});
+}
+
+}  // namespace blockchain
+}  // namespace storage
+}  // namespace concord
@@ -0,0 +1,358 @@
+// Copyright 2019 VMware, all rights reserved
+//
+// Compression of the blocks stored by the adapter.
+
+#include "blockchain/block_compressor.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+#ifdef USE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+namespace concord {
+namespace storage {
+namespace blockchain {
+
+namespace {
+
+uint64_t microsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+// The state of the compression libraries, made by init.
+struct BlockCompressor::Codec {
+  // The capacity to compress a block of 'length' into, 0 if it can't be.
+  size_t bound(BlockCompression compression, size_t length) const {
+    switch (compression) {
+#ifdef USE_LZ4
+      case BlockCompression::LZ4:
+        return length <= LZ4_MAX_INPUT_SIZE ? LZ4_compressBound(length) : 0;
+#endif
+#ifdef USE_ZSTD
+      case BlockCompression::Zstd:
+        return ZSTD_compressBound(length);
+#endif
+      default:
+        return 0;
+    }
+  }
+
+  // The length of the compressed block, 0 if it failed.
+  size_t compress(BlockCompression compression, int level, const char *src, size_t length, char *dst, size_t capacity) {
+    switch (compression) {
+#ifdef USE_LZ4
+      case BlockCompression::LZ4: {
+        int n = LZ4_compress_default(src, dst, length, capacity);
+        return n > 0 ? n : 0;
+      }
+#endif
+#ifdef USE_ZSTD
+      case BlockCompression::Zstd: {
+        std::lock_guard<std::mutex> lock(cctxLock);
+        size_t n = cdict ? ZSTD_compress_usingCDict(cctx, dst, capacity, src, length, cdict)
+                         : ZSTD_compressCCtx(cctx, dst, capacity, src, length, level);
+        return ZSTD_isError(n) ? 0 : n;
+      }
+#endif
+      default:
+        return 0;
+    }
+  }
+
+  // Whether the block of 'blockLength' was decompressed.
+  bool decompress(BlockCompression compression,
+                  bool withDictionary,
+                  const char *src,
+                  size_t length,
+                  char *dst,
+                  size_t blockLength) {
+    switch (compression) {
+#ifdef USE_LZ4
+      case BlockCompression::LZ4: {
+        int n = LZ4_decompress_safe(src, dst, length, blockLength);
+        return n >= 0 && static_cast<size_t>(n) == blockLength;
+      }
+#endif
+#ifdef USE_ZSTD
+      case BlockCompression::Zstd: {
+        ZSTD_DCtx *dctx = acquireDCtx();
+        size_t n = withDictionary ? ZSTD_decompress_usingDDict(dctx, dst, blockLength, src, length, ddict)
+                         : ZSTD_decompressDCtx(dctx, dst, blockLength, src, length);
+        releaseDCtx(dctx);
+        return !ZSTD_isError(n) && n == blockLength;
+      }
+#endif
+      default:
+        return false;
+    }
+  }
+
+  uint32_t dictionaryId = 0;
+#ifdef USE_ZSTD
+  ~Codec() {
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeCDict(cdict);
+    ZSTD_freeDDict(ddict);
+    for (auto dctx : idleDCtxs) {
+      ZSTD_freeDCtx(dctx);
+    }
+  }
+
+  ZSTD_DCtx *acquireDCtx() {
+    std::lock_guard<std::mutex> lock(dctxsLock);
+    if (idleDCtxs.empty()) {
+      return ZSTD_createDCtx();
+    }
+    ZSTD_DCtx *dctx = idleDCtxs.back();
+    idleDCtxs.pop_back();
+    return dctx;
+  }
+  void releaseDCtx(ZSTD_DCtx *dctx) {
+    std::lock_guard<std::mutex> lock(dctxsLock);
+    idleDCtxs.push_back(dctx);
+  }
+
+  ZSTD_CDict *cdict = nullptr;
+  ZSTD_DDict *ddict = nullptr;
+  // the blocks are compressed by the writer of the adapter
+  std::mutex cctxLock;
+  ZSTD_CCtx *cctx = nullptr;
+  // the blocks are decompressed by any reader
+  std::mutex dctxsLock;
+  std::vector<ZSTD_DCtx *> idleDCtxs;
+#endif
+};
+
+BlockCompressor::BlockCompressor()
+    : codec_(new Codec()),
+      metrics_("block_compression",
+               {"compressed_blocks",
+                "uncompressed_blocks",
+                "block_bytes",
+                "compressed_bytes",
+                "compress_micros",
+                "decompressed_blocks",
+                "decompress_micros"},
+               {"ratio_percent"}) {
+  config_.compression = BlockCompression::None;
+}
+
+BlockCompressor::~BlockCompressor() {}
+
+bool BlockCompressor::isAvailable(BlockCompression compression) {
+  switch (compression) {
+    case BlockCompression::None:
+      return true;
+    case BlockCompression::LZ4:
+#ifdef USE_LZ4
+      return true;
+#else
+      return false;
+#endif
+    case BlockCompression::Zstd:
+#ifdef USE_ZSTD
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+Status BlockCompressor::init(const BlockCompressionConfig &config) {
+  if (!isAvailable(config.compression)) {
+    return Status::InvalidArgument("Compression " + std::to_string((int)config.compression) +
+                                   " of blocks isn't built: build with BUILD_BLOCK_COMPRESSION");
+  }
+  if (!config.dictionary.empty() && config.compression != BlockCompression::Zstd) {
+    return Status::InvalidArgument("Only zstd compresses blocks with a dictionary");
+  }
+  std::unique_ptr<Codec> codec(new Codec());
+#ifdef USE_ZSTD
+  if (config.compression == BlockCompression::Zstd) {
+    codec->cctx = ZSTD_createCCtx();
+    if (!config.dictionary.empty()) {
+      // the blocks record the id of their dictionary
+      codec->dictionaryId = ZSTD_getDictID_fromDict(config.dictionary.data(), config.dictionary.size());
+      if (codec->dictionaryId == 0) {
+        return Status::InvalidArgument("Not a trained zstd dictionary");
+      }
+      codec->cdict = ZSTD_createCDict(config.dictionary.data(), config.dictionary.size(), config.level);
+      codec->ddict = ZSTD_createDDict(config.dictionary.data(), config.dictionary.size());
+    }
+    if (!codec->cctx || (!config.dictionary.empty() && (!codec->cdict || !codec->ddict))) {
+      return Status::GeneralError("Failed to set up zstd");
+    }
+  }
+#endif
+  config_ = config;
+  codec_ = std::move(codec);
+  return Status::OK();
+}
+
+namespace {
+
+Sliver rawBlock(const Sliver &block) {
+  uint8_t *stored = new uint8_t[1 + block.length()];
+  stored[0] = static_cast<uint8_t>(StoredBlockFormat::Raw);
+  memcpy(stored + 1, block.data(), block.length());
+  return Sliver(stored, 1 + block.length());
+}
+
+}  // namespace
+
+Sliver BlockCompressor::compress(const Sliver &block) {
+  if (config_.compression == BlockCompression::None || block.length() < config_.minBlockSize ||
+      block.length() > UINT32_MAX) {
+    uncompressedBlocks_++;
+    return rawBlock(block);
+  }
+  const auto start = std::chrono::steady_clock::now();
+  const size_t bound = codec_->bound(config_.compression, block.length());
+  std::unique_ptr<uint8_t[]> stored(new uint8_t[sizeof(CompressedBlockHeader) + bound]);
+  const size_t compressedLength =
+      bound == 0 ? 0
+                 : codec_->compress(config_.compression,
+                                    config_.level,
+                                    reinterpret_cast<const char *>(block.data()),
+                                    block.length(),
+                                    reinterpret_cast<char *>(stored.get()) + sizeof(CompressedBlockHeader),
+                                    bound);
+  // failed, or not worth it
+  if (compressedLength == 0 || sizeof(CompressedBlockHeader) + compressedLength >= block.length()) {
+    uncompressedBlocks_++;
+    return rawBlock(block);
+  }
+
+  CompressedBlockHeader header;
+  memset(&header, 0, sizeof(header));
+  header.format = static_cast<uint8_t>(StoredBlockFormat::Compressed);
+  header.formatVersion = kCompressedBlockFormatVersion;
+  header.compression = static_cast<uint8_t>(config_.compression);
+  header.dictionaryId = codec_->dictionaryId;
+  header.blockLength = block.length();
+  memcpy(stored.get(), &header, sizeof(header));
+
+  compressedBlocks_++;
+  blockBytes_ += block.length();
+  compressedBytes_ += sizeof(CompressedBlockHeader) + compressedLength;
+  compressMicros_ += microsSince(start);
+  return Sliver(stored.release(), sizeof(CompressedBlockHeader) + compressedLength);
+}
+
+bool BlockCompressor::isCompressed(const Sliver &stored) {
+  return stored.length() > 0 && stored.data()[0] == static_cast<uint8_t>(StoredBlockFormat::Compressed);
+}
+
+Status BlockCompressor::decompress(const Sliver &stored, Sliver &outBlock) const {
+  if (stored.length() == 0) {
+    return Status::GeneralError("Stored block without a format");
+  }
+  if (stored.data()[0] == static_cast<uint8_t>(StoredBlockFormat::Raw)) {
+    outBlock = Sliver(stored, 1, stored.length() - 1);
+    return Status::OK();
+  }
+  if (!isCompressed(stored)) {
+    return Status::GeneralError("Unknown format " + std::to_string(stored.data()[0]) + " of a stored block");
+  }
+  CompressedBlockHeader header;
+  if (stored.length() < sizeof(header)) {
+    return Status::GeneralError("Truncated compressed block");
+  }
+  memcpy(&header, stored.data(), sizeof(header));
+  if (header.formatVersion != kCompressedBlockFormatVersion) {
+    return Status::GeneralError("Unknown format version " + std::to_string(header.formatVersion) +
+                                " of a compressed block");
+  }
+  if (!isAvailable(static_cast<BlockCompression>(header.compression))) {
+    return Status::GeneralError("Block compressed with compression " + std::to_string(header.compression) +
+                                ", which isn't built");
+  }
+  if (header.dictionaryId != 0 && header.dictionaryId != codec_->dictionaryId) {
+    return Status::GeneralError("Block compressed with zstd dictionary " + std::to_string(header.dictionaryId) +
+                                ", which isn't configured");
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  std::unique_ptr<uint8_t[]> block(new uint8_t[header.blockLength]);
+  const bool ok = codec_->decompress(static_cast<BlockCompression>(header.compression),
+                                     header.dictionaryId != 0,
+                                     reinterpret_cast<const char *>(stored.data()) + sizeof(header),
+                                     stored.length() - sizeof(header),
+                                     reinterpret_cast<char *>(block.get()),
+                                     header.blockLength);
+  if (!ok) {
+    return Status::GeneralError("Corrupted compressed block");
+  }
+
+  decompressedBlocks_++;
+  decompressMicros_ += microsSince(start);
+  outBlock = Sliver(block.release(), header.blockLength);
+  return Status::OK();
+}
+
+Status BlockCompressor::trainDictionary(const std::vector<Sliver> &blocks, size_t capacity, std::string &outDictionary) {
+#ifdef USE_ZSTD
+  std::string samples;
+  std::vector<size_t> sampleSizes;
+  for (const auto &block : blocks) {
+    samples.append(reinterpret_cast<const char *>(block.data()), block.length());
+    sampleSizes.push_back(block.length());
+  }
+  std::string dictionary(capacity, '\0');
+  size_t n = ZDICT_trainFromBuffer(
+      &dictionary[0], capacity, samples.data(), sampleSizes.data(), static_cast<unsigned>(sampleSizes.size()));
+  if (ZDICT_isError(n)) {
+    return Status::GeneralError(std::string("Failed to train a dictionary: ") + ZDICT_getErrorName(n));
+  }
+  dictionary.resize(n);
+  outDictionary = std::move(dictionary);
+  return Status::OK();
+#else
+  (void)blocks;
+  (void)capacity;
+  (void)outDictionary;
+  return Status::IllegalOperation("zstd compression of blocks isn't built: build with BUILD_BLOCK_COMPRESSION");
+#endif
+}
+
+BlockCompressor::Stats BlockCompressor::stats() const {
+  Stats stats;
+  stats.compressedBlocks = compressedBlocks_;
+  stats.uncompressedBlocks = uncompressedBlocks_;
+  stats.blockBytes = blockBytes_;
+  stats.compressedBytes = compressedBytes_;
+  stats.compressMicros = compressMicros_;
+  stats.decompressedBlocks = decompressedBlocks_;
+  stats.decompressMicros = decompressMicros_;
+  return stats;
+}
+
+void BlockCompressor::setAggregator(std::shared_ptr<concordMetrics::Aggregator> aggregator) {
+  metrics_.setAggregator(aggregator);
+}
+
+void BlockCompressor::updateMetrics() {
+  const Stats current = stats();
+  metrics_.update({current.compressedBlocks,
+                   current.uncompressedBlocks,
+                   current.blockBytes,
+                   current.compressedBytes,
+                   current.compressMicros,
+                   current.decompressedBlocks,
+                   current.decompressMicros},
+                  {current.blockBytes ? current.compressedBytes * 100 / current.blockBytes : 0});
+}
+
+}  // namespace blockchain
+}  // namespace storage
+}  // namespace concord
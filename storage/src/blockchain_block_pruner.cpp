@@ -0,0 +1,90 @@
+// Copyright 2019 VMware, all rights reserved
+//
+// Background pruning of the blockchain history.
+
+#include "blockchain/block_pruner.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace concord {
+namespace storage {
+namespace blockchain {
+
+BlockPruner::BlockPruner(DBAdapter &adapter, const PruningConfig &config)
+    : logger_(concordlogger::Log::getLogger("concord.storage.BlockPruner")),
+      adapter_(adapter),
+      config_(config) {}
+
+void BlockPruner::start() {
+  std::lock_guard<std::mutex> lock(lock_);
+  if (thread_.joinable()) {
+    return;
+  }
+  stopRequested_ = false;
+  thread_ = std::thread(&BlockPruner::run, this);
+}
+
+void BlockPruner::stop() {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    stopRequested_ = true;
+  }
+  stopCond_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+BlockId BlockPruner::retentionPoint() const {
+  BlockId lastReachable = adapter_.getLastReachableBlock();
+  if (lastReachable < config_.retainedBlocks) {
+    return 0;
+  }
+  return lastReachable - config_.retainedBlocks + 1;
+}
+
+Status BlockPruner::pruneToRetentionPoint() {
+  BlockId untilBlock = retentionPoint();
+  BlockId batchSize = std::max<BlockId>(config_.blocksPerBatch, 1);
+  while (adapter_.getFirstBlock() < untilBlock) {
+    auto start = std::chrono::steady_clock::now();
+    BlockId batchEnd = std::min(adapter_.getFirstBlock() + batchSize, untilBlock);
+    BlockId numOfBlocks = batchEnd - adapter_.getFirstBlock();
+    Status s = adapter_.pruneBlocks(batchEnd);
+    if (!s.isOK()) {
+      return s;
+    }
+
+    // the rate limit: each batch takes at least its share of a second
+    if (config_.maxBlocksPerSecond > 0) {
+      uint64_t batchMilli = numOfBlocks * 1000 / config_.maxBlocksPerSecond;
+      auto elapsedMilli = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start).count());
+      if (batchMilli > elapsedMilli && !sleep(batchMilli - elapsedMilli)) {
+        break;
+      }
+    }
+  }
+  return Status::OK();
+}
+
+void BlockPruner::run() {
+  LOG_INFO(logger_, "Pruning started, retaining " << config_.retainedBlocks << " blocks");
+  do {
+    Status s = pruneToRetentionPoint();
+    if (!s.isOK()) {
+      LOG_ERROR(logger_, "Pruning failed: " << s);
+    }
+  } while (sleep(config_.intervalMilli));
+  LOG_INFO(logger_, "Pruning stopped");
+}
+
+bool BlockPruner::sleep(uint64_t milli) {
+  std::unique_lock<std::mutex> lock(lock_);
+  return !stopCond_.wait_for(lock, std::chrono::milliseconds(milli), [this]() { return stopRequested_; });
+}
+
+}
+}
+}
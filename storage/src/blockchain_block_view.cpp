@@ -0,0 +1,168 @@
+// Copyright 2019 VMware, all rights reserved
+//
+// Read-only access to a block, in place.
+
+#include "blockchain/block_view.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace concord {
+namespace storage {
+namespace blockchain {
+
+BlockView::BlockView(const Sliver &block) : block_(block) {
+  if (block_.length() < sizeof(BlockHeader)) {
+    return;
+  }
+  const size_t numOfElements = header().numberOfElements;
+  if (numOfElements > (block_.length() - sizeof(BlockHeader)) / sizeof(BlockEntry)) {
+    return;
+  }
+  for (size_t i = 0; i < numOfElements; i++) {
+    BlockEntry e = entry(i);
+    if (e.keyOffset > block_.length() || e.keySize > block_.length() - e.keyOffset ||
+        e.valOffset > block_.length() || e.valSize > block_.length() - e.valOffset) {
+      return;
+    }
+  }
+  size_ = numOfElements;
+  valid_ = true;
+}
+
+// The entries may not be aligned in the buffer of the block
+BlockEntry BlockView::entry(size_t index) const {
+  BlockEntry e;
+  memcpy(&e, block_.data() + sizeof(BlockHeader) + index * sizeof(BlockEntry), sizeof(BlockEntry));
+  return e;
+}
+
+Key BlockView::key(size_t index) const {
+  BlockEntry e = entry(index);
+  return Sliver(block_, e.keyOffset, e.keySize);
+}
+
+Value BlockView::value(size_t index) const {
+  BlockEntry e = entry(index);
+  return Sliver(block_, e.valOffset, e.valSize);
+}
+
+// As Sliver::compare, without making a sliver of the key of the entry
+int BlockView::compareKey(size_t index, const Key &key) const {
+  BlockEntry e = entry(index);
+  int comp = memcmp(block_.data() + e.keyOffset, key.data(), std::min<size_t>(e.keySize, key.length()));
+  if (comp == 0 && e.keySize != key.length()) {
+    comp = e.keySize < key.length() ? -1 : 1;
+  }
+  return comp;
+}
+
+size_t BlockView::find(const Key &key) const {
+  if (!isSorted()) {
+    for (size_t i = 0; i < size_; i++) {
+      if (compareKey(i, key) == 0) {
+        return i;
+      }
+    }
+    return size_;
+  }
+  size_t low = 0;
+  size_t high = size_;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    int comp = compareKey(middle, key);
+    if (comp == 0) {
+      return middle;
+    }
+    if (comp < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return size_;
+}
+
+bool BlockView::get(const Key &key, Value &outValue) const {
+  size_t index = find(key);
+  if (index == size_) {
+    return false;
+  }
+  outValue = value(index);
+  return true;
+}
+
+SetOfKeyValuePairs BlockView::toSet() const {
+  SetOfKeyValuePairs entries;
+  entries.reserve(size_);
+  for (size_t i = 0; i < size_; i++) {
+    entries.insert(KeyValuePair(key(i), value(i)));
+  }
+  return entries;
+}
+
+Sliver BlockView::createBlock(const SetOfKeyValuePairs &updates,
+                              const int8_t *parentDigest,
+                              uint32_t parentDigestLength,
+                              SetOfKeyValuePairs *outUpdatesInBlock) {
+  assert(updates.size() <= std::numeric_limits<uint32_t>::max());
+  typedef SetOfKeyValuePairs::value_type Update;
+  std::vector<const Update *> sorted;
+  sorted.reserve(updates.size());
+  size_t blockSize = sizeof(BlockHeader) + updates.size() * sizeof(BlockEntry);
+  for (const auto &kv : updates) {
+    sorted.push_back(&kv);
+    blockSize += kv.first.length() + kv.second.length();
+  }
+  std::sort(sorted.begin(), sorted.end(), [](const Update *a, const Update *b) {
+    return a->first.compare(b->first) < 0;
+  });
+
+  auto *blockBuffer = new uint8_t[blockSize];
+  memset(blockBuffer, 0, sizeof(BlockHeader) + updates.size() * sizeof(BlockEntry));
+  Sliver block(blockBuffer, blockSize);
+
+  BlockHeader header;
+  memset(&header, 0, sizeof(header));
+  header.numberOfElements = static_cast<uint32_t>(updates.size());
+  header.flags = kBlockEntriesSorted;
+  header.parentDigestLength = static_cast<uint16_t>(std::min<size_t>(parentDigestLength, sizeof(header.parentDigest)));
+  if (header.parentDigestLength > 0) {
+    memcpy(header.parentDigest, parentDigest, header.parentDigestLength);
+  }
+  memcpy(blockBuffer, &header, sizeof(header));
+
+  if (outUpdatesInBlock) {
+    outUpdatesInBlock->reserve(outUpdatesInBlock->size() + updates.size());
+  }
+  uint32_t offset = sizeof(BlockHeader) + updates.size() * sizeof(BlockEntry);
+  for (size_t i = 0; i < sorted.size(); i++) {
+    const Update &kv = *sorted[i];
+    BlockEntry e;
+    e.keyOffset = offset;
+    e.keySize = kv.first.length();
+    if (kv.first.length() > 0) {
+      memcpy(blockBuffer + offset, kv.first.data(), kv.first.length());
+    }
+    offset += kv.first.length();
+    e.valOffset = offset;
+    e.valSize = kv.second.length();
+    if (kv.second.length() > 0) {
+      memcpy(blockBuffer + offset, kv.second.data(), kv.second.length());
+    }
+    offset += kv.second.length();
+    memcpy(blockBuffer + sizeof(BlockHeader) + i * sizeof(BlockEntry), &e, sizeof(e));
+    if (outUpdatesInBlock) {
+      outUpdatesInBlock->insert(
+          KeyValuePair(Sliver(block, e.keyOffset, e.keySize), Sliver(block, e.valOffset, e.valSize)));
+    }
+  }
+  return block;
+}
+
+}  // namespace blockchain
+}  // namespace storage
+}  // namespace concord
@@ -7,6 +7,7 @@
 //
 // Data is stored in the form of key value pairs. However, the key used is a
 // composite database key. Its composition is : Key Type | Key | Block Id
+// (see KeyLayout for how the parts are laid out in bytes).
 //
 // Block Id is functionally equivalent to the version of the block.
 //
@@ -16,8 +17,12 @@
 //       -> Descending order of Block Id
 
 #include "Logger.hpp"
+#include <algorithm>
 #include <chrono>
+#include <iterator>
 #include <limits>
+#include <unordered_map>
+#include <unordered_set>
 #include "hash_defs.h"
 #include "hex_tools.h"
 #include "sliver.hpp"
@@ -25,6 +30,7 @@
 #include <string.h>
 #include "blockchain/db_interfaces.h"
 #include "blockchain/db_adapter.h"
+#include "blockchain/block_view.h"
 
 using concordlogger::Logger;
 using concordUtils::Status;
@@ -45,14 +51,85 @@ std::ostream& operator<<(std::ostream& s, const HexPrintBuffer p) {
   return s;
 }
 
-DBAdapter::DBAdapter(IDBClient* db, bool readOnly):
+// Shared by the thread that uses it and, weakly, by the adapter: whichever
+// of the two goes first frees the iterator.
+struct DBAdapter::LookupIterator {
+  std::mutex lock;
+  // null once released
+  IDBClient *db = nullptr;
+  IDBClient::IDBClientIterator *iter = nullptr;
+  uint64_t writeGeneration = 0;
+
+  void release() {
+    std::lock_guard<std::mutex> l(lock);
+    if (db && iter) {
+      db->freeIterator(iter);
+    }
+    db = nullptr;
+    iter = nullptr;
+  }
+
+  bool released() {
+    std::lock_guard<std::mutex> l(lock);
+    return db == nullptr;
+  }
+};
+
+class DBAdapter::ThreadLookupIterators {
+ public:
+  ~ThreadLookupIterators() {
+    for (auto &it : iterators_) {
+      it.second->release();
+    }
+  }
+
+  std::shared_ptr<LookupIterator> find(uint64_t adapterId) const {
+    auto it = iterators_.find(adapterId);
+    return it == iterators_.end() ? nullptr : it->second;
+  }
+
+  // Also forgets the iterators of the adapters destroyed since
+  void add(uint64_t adapterId, std::shared_ptr<LookupIterator> lookup) {
+    for (auto it = iterators_.begin(); it != iterators_.end();) {
+      it = it->second->released() ? iterators_.erase(it) : std::next(it);
+    }
+    iterators_[adapterId] = lookup;
+  }
+
+ private:
+  std::unordered_map<uint64_t, std::shared_ptr<LookupIterator>> iterators_;
+};
+
+uint64_t DBAdapter::newAdapterId() {
+  static std::atomic<uint64_t> lastId{0};
+  return ++lastId;
+}
+
+DBAdapter::DBAdapter(IDBClient* db, bool readOnly, KeyLayout keyLayout):
     logger_(concordlogger::Log::getLogger("concord.storage.BlockchainDBAdapter")),
     db_(db),
-    key_manipulator_(new KeyManipulator()),
-    m_isEnd(false)
+    key_manipulator_(new KeyManipulator(keyLayout)),
+    m_isEnd(false),
+    readOnly_(readOnly)
     {
 
   db_->init(readOnly);
+  writeBatch_ = db_->newWriteBatch();
+  firstBlock_ = loadFirstBlock();
+  framedBlocks_ = loadFramedBlocks();
+  lastReachableBlock_ = loadLastReachableBlock();
+  latestBlock_ = getLatestBlock();
+  loadLatestVersionIndex();
+}
+
+DBAdapter::~DBAdapter() {
+  std::lock_guard<std::mutex> lock(lookupIteratorsLock_);
+  for (auto &weak : lookupIterators_) {
+    std::shared_ptr<LookupIterator> lookup = weak.lock();
+    if (lookup) {
+      lookup->release();
+    }
+  }
 }
 
 /*
@@ -62,9 +139,19 @@ DBAdapter::DBAdapter(IDBClient* db, bool readOnly):
  * Comparison is done by decomposed parts. Types are compared first, followed by
  * the application key, and finally the block id. Types and keys are sorted in
  * ascending order, and block IDs are sorted in descending order.
+ *
+ * Keys in the Bytewise layout give this order when compared as byte strings.
  */
 int KeyManipulator::composedKeyComparison(const uint8_t* _a_data, size_t _a_length,
                                           const uint8_t* _b_data, size_t _b_length) {
+  if (layout_ == KeyLayout::Bytewise) {
+    int ret = memcmp(_a_data, _b_data, std::min(_a_length, _b_length));
+    if (ret != 0 || _a_length == _b_length) {
+      return ret;
+    }
+    return (_a_length < _b_length) ? -1 : 1;
+  }
+
   char aType = KeyManipulator::extractTypeFromKey(_a_data);
   char bType = KeyManipulator::extractTypeFromKey(_b_data);
   if (aType != bType) {
@@ -123,15 +210,70 @@ int KeyManipulator::composedKeyComparison(const uint8_t* _a_data, size_t _a_leng
  * @return Sliver object of the generated composite database key.
  */
 Sliver KeyManipulator::genDbKey(EDBKeyType _type, const Key& _key, BlockId _blockId) {
-  size_t sz = sizeof(EDBKeyType) + sizeof(BlockId) + _key.length();
+  size_t sz = dbKeySize(_key);
+  if (sz <= Sliver::kInlineCapacity) {
+    // short keys are kept inline, without allocating
+    uint8_t out[Sliver::kInlineCapacity];
+    encodeDbKey(_type, _key, _blockId, out, sz);
+    return Sliver::copy(out, sz);
+  }
   uint8_t *out = new uint8_t[sz];
-  size_t offset = 0;
-  copyToAndAdvance(out, &offset, sz, (uint8_t *)&_type, sizeof(EDBKeyType));
-  copyToAndAdvance(out, &offset, sz, (uint8_t *)_key.data(), _key.length());
-  copyToAndAdvance(out, &offset, sz, (uint8_t *)&_blockId, sizeof(BlockId));
+  encodeDbKey(_type, _key, _blockId, out, sz);
   return Sliver(out, sz);
 }
 
+void KeyManipulator::genDbKey(EDBKeyType _type, const Key& _key, BlockId _blockId, std::vector<uint8_t> &_out) {
+  _out.resize(dbKeySize(_key));
+  encodeDbKey(_type, _key, _blockId, _out.data(), _out.size());
+}
+
+size_t KeyManipulator::dbKeySize(const Key& _key) const {
+  if (layout_ == KeyLayout::Bytewise) {
+    size_t zeros = std::count(_key.data(), _key.data() + _key.length(), 0);
+    return sizeof(EDBKeyType) + _key.length() + zeros + kKeyTerminatorSize + sizeof(BlockId);
+  }
+  return sizeof(EDBKeyType) + sizeof(BlockId) + _key.length();
+}
+
+void KeyManipulator::encodeDbKey(EDBKeyType _type, const Key& _key, BlockId _blockId, uint8_t *_out, size_t _size) {
+  if (layout_ == KeyLayout::Bytewise) {
+    encodeBytewiseDbKey(_type, _key, _blockId, _out);
+    return;
+  }
+  size_t offset = 0;
+  copyToAndAdvance(_out, &offset, _size, (uint8_t *)&_type, sizeof(EDBKeyType));
+  copyToAndAdvance(_out, &offset, _size, (uint8_t *)_key.data(), _key.length());
+  copyToAndAdvance(_out, &offset, _size, (uint8_t *)&_blockId, sizeof(BlockId));
+}
+
+/**
+ * @brief Encodes a Composite Database Key in the Bytewise layout.
+ *
+ * Format : Key Type | Escaped Key | 0x00 0x01 | ~Block Id (big endian)
+ *
+ * Zero bytes of the key are escaped as 0x00 0xFF. The terminator sorts before
+ * any continuation of the key, so that a key sorts before the keys it is a
+ * prefix of, and the inverted block id sorts the versions of a key in
+ * descending order.
+ */
+void KeyManipulator::encodeBytewiseDbKey(EDBKeyType _type, const Key& _key, BlockId _blockId, uint8_t *_out) {
+  const uint8_t *key = _key.data();
+  size_t offset = 0;
+  _out[offset++] = static_cast<uint8_t>(_type);
+  for (size_t i = 0; i < _key.length(); ++i) {
+    _out[offset++] = key[i];
+    if (key[i] == 0) {
+      _out[offset++] = 0xFF;
+    }
+  }
+  _out[offset++] = 0x00;
+  _out[offset++] = 0x01;
+  BlockId inverted = ~_blockId;
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    _out[offset++] = static_cast<uint8_t>(inverted >> shift);
+  }
+}
+
 /**
  * @brief Helper function that generates a composite database Key of type Block.
  *
@@ -210,7 +352,15 @@ BlockId KeyManipulator::extractBlockIdFromKey(const Key& _key) {
  */
 BlockId KeyManipulator::extractBlockIdFromKey(const uint8_t* _key_data, size_t _key_length) {
   size_t offset = _key_length - sizeof(BlockId);
-  BlockId id = *(BlockId *)(_key_data + offset);
+  BlockId id = 0;
+  if (layout_ == KeyLayout::Bytewise) {
+    for (size_t i = offset; i < _key_length; ++i) {
+      id = (id << 8) | _key_data[i];
+    }
+    id = ~id;
+  } else {
+    id = *(BlockId *)(_key_data + offset);
+  }
 
   LOG_TRACE(logger_, "Got block ID " << id << " from key " << (HexPrintBuffer{_key_data, _key_length})  << ", offset " << offset);
   return id;
@@ -255,6 +405,22 @@ ObjectId KeyManipulator::extractObjectIdFromKey(const uint8_t* _key_data, size_t
  * @return Sliver object of the key extracted from the composite database key.
  */
 Sliver KeyManipulator::extractKeyFromKeyComposedWithBlockId(const Key& _composedKey) {
+  if (layout_ == KeyLayout::Bytewise) {
+    size_t sz = _composedKey.length() - sizeof(BlockId) - kKeyTerminatorSize - sizeof(EDBKeyType);
+    const uint8_t *escaped = _composedKey.data() + sizeof(EDBKeyType);
+    if (!memchr(escaped, 0, sz)) {
+      return Sliver(_composedKey, sizeof(EDBKeyType), sz);
+    }
+    uint8_t *key = new uint8_t[sz];
+    size_t keyLength = 0;
+    for (size_t i = 0; i < sz; ++i) {
+      key[keyLength++] = escaped[i];
+      if (escaped[i] == 0) {
+        ++i;  // skip the escape
+      }
+    }
+    return Sliver(key, keyLength);
+  }
   size_t sz = _composedKey.length() - sizeof(BlockId) - sizeof(EDBKeyType);
   Sliver out = Sliver(_composedKey, sizeof(EDBKeyType), sz);
   LOG_TRACE(logger_, "Got key " << out << " from composed key " << _composedKey);
@@ -310,6 +476,9 @@ Sliver KeyManipulator::extractKeyFromMetadataKey(const Key& _composedKey) {
 }
 
 bool KeyManipulator::isKeyContainBlockId(const Key& _composedKey) {
+  if (layout_ == KeyLayout::Bytewise) {
+    return extractTypeFromKey(_composedKey) != (char)EDBKeyType::E_DB_KEY_TYPE_BFT_METADATA_KEY;
+  }
   return (_composedKey.length() > sizeof(BlockId) + sizeof(EDBKeyType));
 }
 
@@ -346,15 +515,15 @@ KeyValuePair KeyManipulator::composedToSimple(KeyValuePair _p) {
  */
 
 Sliver KeyManipulator::generateMetadataKey(ObjectId objectId) {
-  size_t keySize = sizeof(EDBKeyType) + sizeof(objectId);
-  auto keyBuf = new uint8_t[keySize];
+  const size_t keySize = sizeof(EDBKeyType) + sizeof(objectId);
+  uint8_t keyBuf[keySize];
   size_t offset = 0;
   EDBKeyType keyType = EDBKeyType::E_DB_KEY_TYPE_BFT_METADATA_KEY;
   copyToAndAdvance(keyBuf, &offset, keySize, (uint8_t *)&keyType,
                    sizeof(EDBKeyType));
   copyToAndAdvance(keyBuf, &offset, keySize, (uint8_t *)&objectId,
                    sizeof(objectId));
-  return Sliver(keyBuf, keySize);
+  return Sliver::copy(keyBuf, keySize);
 }
 
 /**
@@ -370,8 +539,12 @@ Sliver KeyManipulator::generateMetadataKey(ObjectId objectId) {
  * @return Status of the put operation.
  */
 Status DBAdapter::addBlock(BlockId _blockId, Sliver _blockRaw) {
-  Sliver dbKey = key_manipulator_->genBlockDbKey(_blockId);
-  Status s = db_->put(dbKey, _blockRaw);
+  writeBatch_->clear();
+  putInBatch(*writeBatch_, EDBKeyType::E_DB_KEY_TYPE_BLOCK, Sliver(), _blockId, blockToStore(_blockRaw));
+  Status s = putBlockUpdates(*writeBatch_, _blockId);
+  if (s.isOK() && blockCache_) {
+    blockCache_->put(_blockId, _blockRaw);
+  }
   return s;
 }
 
@@ -401,28 +574,360 @@ bool KeyManipulator::copyToAndAdvance(uint8_t *_buf, size_t *_offset, size_t _ma
  * @return Status of the put operation.
  */
 Status DBAdapter::updateKey(const Key& _key, BlockId _block, Value _value) {
-  Sliver composedKey = key_manipulator_->genDataDbKey(_key, _block);
-
-  LOG_TRACE(logger_, "Updating composed key " << composedKey
-                                                   << " with value " << _value
-                                                   << " in block " << _block);
+  LOG_TRACE(logger_, "Updating key " << _key << " with value " << _value << " in block " << _block);
 
-  Status s = db_->put(composedKey, _value);
+  writeBatch_->clear();
+  putInBatch(*writeBatch_, EDBKeyType::E_DB_KEY_TYPE_KEY, _key, _block, _value);
+  Status s = addLatestVersion(_key, _block, *writeBatch_);
+  if (!s.isOK()) {
+    return s;
+  }
+  const bool latest = _block >= latestBlock_;
+  s = db_->write(*writeBatch_);
+  if (s.isOK()) {
+    writeDone(_block);
+    cacheLatestVersion(_key, _block, _value, latest);
+  }
   return s;
 }
 
+/**
+ * @brief Adds a block and the versions of its keys, in a single write.
+ *
+ * The composite keys are encoded straight into the reused batch of the
+ * adapter, in the encoding of the database, without intermediate slivers.
+ *
+ * @param _kvMap The keys and values updated by the block.
+ * @param _block The id of the block.
+ * @param _blockRaw The block.
+ * @return Status of the write.
+ */
 Status DBAdapter::addBlockAndUpdateMultiKey(
     const SetOfKeyValuePairs &_kvMap, BlockId _block, Sliver _blockRaw) {
-  SetOfKeyValuePairs updatedKVMap;
+  IDBClient::IWriteBatch &batch = *writeBatch_;
+  batch.clear();
   for (auto &it : _kvMap) {
-    Sliver composedKey = key_manipulator_->genDataDbKey(it.first, _block);
-    LOG_TRACE(logger_, "Updating composed key "
-                                << composedKey << " with value " << it.second
-                                << " in block " << _block);
-    updatedKVMap[composedKey] = it.second;
+    LOG_TRACE(logger_, "Updating key " << it.first << " with value " << it.second << " in block " << _block);
+    putInBatch(batch, EDBKeyType::E_DB_KEY_TYPE_KEY, it.first, _block, it.second);
+    Status s = addLatestVersion(it.first, _block, batch);
+    if (!s.isOK()) {
+      return s;
+    }
+  }
+  putInBatch(batch, EDBKeyType::E_DB_KEY_TYPE_BLOCK, Sliver(), _block, blockToStore(_blockRaw));
+  const bool latest = _block >= latestBlock_;
+  Status s = putBlockUpdates(batch, _block);
+  if (s.isOK() && blockCache_) {
+    blockCache_->put(_block, _blockRaw);
+  }
+  if (s.isOK() && latestValueCache_) {
+    for (auto &it : _kvMap) {
+      cacheLatestVersion(it.first, _block, it.second, latest);
+    }
+  }
+  return s;
+}
+
+/**
+ * @brief Writes the updates of a block, in one batch with the last reachable
+ * block marker when the block extends the reachable chain.
+ *
+ * State transfer adds blocks in reverse order: when the block closing the gap
+ * arrives, the marker is advanced over the blocks already present after it.
+ *
+ * @param batch The database updates of the block, including the block itself.
+ * @param blockId The id of the block being added.
+ * @return Status of the write.
+ */
+Status DBAdapter::putBlockUpdates(IDBClient::IWriteBatch &batch, BlockId blockId) {
+  BlockId lastReachable = lastReachableBlock_;
+  if (blockId == lastReachable + 1) {
+    lastReachable = findLastReachableBlock(blockId);
+    batch.put(KeyManipulator::generateMetadataKey(kLastReachableBlockObjectId),
+              Sliver(reinterpret_cast<const uint8_t *>(&lastReachable), sizeof(BlockId)));
+  }
+  Status s = db_->write(batch);
+  if (s.isOK()) {
+    lastReachableBlock_ = lastReachable;
+    writeDone(blockId);
+  }
+  return s;
+}
+
+void DBAdapter::putInBatch(IDBClient::IWriteBatch &batch, EDBKeyType type, const Key &key, BlockId blockId,
+                           const Sliver &value) {
+  key_manipulator_->genDbKey(type, key, blockId, keyBuffer_);
+  batch.put(Sliver(static_cast<const uint8_t *>(keyBuffer_.data()), keyBuffer_.size()), value);
+}
+
+/**
+ * @brief Generates the key of the latest version index entry of a key.
+ *
+ * The entry holds the block id of the key's latest version: reading a key at
+ * or after its latest version takes two point lookups, of the entry and of
+ * the version, instead of a seek. The value is not repeated in the entry.
+ */
+Sliver DBAdapter::genLatestVersionDbKey(const Key &key) const {
+  return key_manipulator_->genDbKey(EDBKeyType::E_DB_KEY_TYPE_LATEST_VERSION_KEY, key, 0);
+}
+
+// The latest version index entry of a key: Block Id. The entries written
+// before the index referred to the versions were followed by the value, which
+// is ignored.
+inline Sliver latestVersionEntry(BlockId blockId) {
+  auto *entry = new uint8_t[sizeof(BlockId)];
+  memcpy(entry, &blockId, sizeof(BlockId));
+  return Sliver(entry, sizeof(BlockId));
+}
+
+inline bool latestVersionOf(const Sliver &entry, BlockId &outBlockId) {
+  if (entry.length() < sizeof(BlockId)) {
+    return false;
+  }
+  memcpy(&outBlockId, entry.data(), sizeof(BlockId));
+  return true;
+}
+
+/**
+ * @brief Adds to a block's updates the latest version index entry of one of
+ * its keys, unless the key has a newer version.
+ *
+ * @param key The key updated in the block.
+ * @param blockId The id of the block.
+ * @param batch The updates of the block.
+ * @return Status of the lookup of the indexed version, if one was needed.
+ */
+Status DBAdapter::addLatestVersion(const Key &key, BlockId blockId, IDBClient::IWriteBatch &batch) {
+  key_manipulator_->genDbKey(EDBKeyType::E_DB_KEY_TYPE_LATEST_VERSION_KEY, key, 0, keyBuffer_);
+  Sliver indexKey(static_cast<const uint8_t *>(keyBuffer_.data()), keyBuffer_.size());
+  if (blockId < latestBlock_) {
+    // an older block, e.g. from state transfer: the key may have a newer version
+    BlockId cachedBlockId = 0;
+    Value cachedValue;
+    if (latestValueCache_ && latestValueCache_->get(key, cachedBlockId, cachedValue) && cachedBlockId > blockId) {
+      return Status::OK();
+    }
+    Sliver latest;
+    BlockId latestBlockId = 0;
+    Status s = db_->get(indexKey, latest);
+    if (s.isOK() && latestVersionOf(latest, latestBlockId)) {
+      if (latestBlockId > blockId) {
+        return Status::OK();
+      }
+    } else if (!s.isOK() && !s.isNotFound()) {
+      return s;
+    }
+  }
+  entryBuffer_.resize(sizeof(BlockId));
+  memcpy(entryBuffer_.data(), &blockId, sizeof(BlockId));
+  batch.put(indexKey, Sliver(static_cast<const uint8_t *>(entryBuffer_.data()), entryBuffer_.size()));
+  return Status::OK();
+}
+
+/**
+ * @brief Puts a version just written in the latest value cache.
+ *
+ * A version of a block older than the latest block, e.g. from state transfer,
+ * may be superseded by a version that is not cached: it only replaces an
+ * older cached version.
+ */
+void DBAdapter::cacheLatestVersion(const Key &key, BlockId blockId, const Value &value, bool latest) {
+  if (!latestValueCache_) {
+    return;
+  }
+  if (latest) {
+    latestValueCache_->put(key, blockId, value);
+  } else {
+    latestValueCache_->update(key, blockId, value);
+  }
+}
+
+/**
+ * @brief Adds to the batch deleting a version of a key the update of its
+ * latest version index entry, if the deleted version is the indexed one: the
+ * entry then points at the newest older version, or is deleted.
+ *
+ * @param key The key whose version is deleted.
+ * @param deletedBlockId The block id of the deleted version, not deleted yet.
+ * @param batch The deletion of the version.
+ * @return Status of the reads of the index and of the older version.
+ */
+Status DBAdapter::repairLatestVersion(const Key &key, BlockId deletedBlockId, IDBClient::IWriteBatch &batch) {
+  Sliver indexKey = genLatestVersionDbKey(key);
+  Sliver latest;
+  Status s = db_->get(indexKey, latest);
+  if (s.isNotFound()) {
+    return Status::OK();
+  }
+  if (!s.isOK()) {
+    return s;
+  }
+  BlockId latestBlockId = 0;
+  if (latestVersionOf(latest, latestBlockId) && latestBlockId != deletedBlockId) {
+    return Status::OK();
+  }
+
+  bool found = false;
+  BlockId olderBlockId = 0;
+  if (deletedBlockId > 0) {
+    IDBClient::IDBClientIterator *iter = db_->getPrefixIterator();
+    KeyValuePair p = iter->seekAtLeast(key_manipulator_->genDataDbKey(key, deletedBlockId - 1));
+    found = !iter->isEnd() && p.first.length() > 0 &&
+            key_manipulator_->extractTypeFromKey(p.first) == (char)EDBKeyType::E_DB_KEY_TYPE_KEY &&
+            key_manipulator_->composedToSimple(p).first == key;
+    olderBlockId = found ? key_manipulator_->extractBlockIdFromKey(p.first) : 0;
+    db_->freeIterator(iter);
+  }
+
+  if (!found) {
+    batch.del(indexKey);
+  } else {
+    batch.put(indexKey, latestVersionEntry(olderBlockId));
+  }
+  return Status::OK();
+}
+
+Status DBAdapter::setLatestVersionIndexValid(bool valid) {
+  Sliver key = KeyManipulator::generateMetadataKey(kLatestVersionIndexObjectId);
+  if (!valid) {
+    latestVersionIndexValid_ = false;
+    return db_->del(key);
+  }
+  auto *value = new uint8_t[1];
+  value[0] = 1;
+  Status s = db_->put(key, Sliver(value, 1));
+  if (s.isOK()) {
+    latestVersionIndexValid_ = true;
+  }
+  return s;
+}
+
+/**
+ * @brief Enables the latest version index, building it first if it is missing
+ * or was left incomplete.
+ *
+ * A read only database without a complete index is read without it.
+ */
+void DBAdapter::loadLatestVersionIndex() {
+  Sliver valid;
+  Status s = db_->get(KeyManipulator::generateMetadataKey(kLatestVersionIndexObjectId), valid);
+  if (s.isOK()) {
+    latestVersionIndexValid_ = true;
+    return;
   }
-  updatedKVMap[key_manipulator_->genBlockDbKey(_block)] = _blockRaw;
-  return db_->multiPut(updatedKVMap);
+  if (readOnly_) {
+    LOG_INFO(logger_, "No latest version index, reads will seek");
+    return;
+  }
+  LOG_INFO(logger_, "Building the latest version index");
+  s = rebuildLatestVersionIndex();
+  if (!s.isOK()) {
+    LOG_ERROR(logger_, "Failed to build the latest version index, reads will seek");
+  }
+}
+
+/**
+ * @brief Rebuilds the latest version index from the versions of the keys.
+ *
+ * The versions of a key are sorted in descending order of block ids: the first
+ * one met is the latest.
+ *
+ * @return Status of the first failed operation, else OK.
+ */
+Status DBAdapter::rebuildLatestVersionIndex() {
+  const size_t kBatchSize = 1000;
+  Status s = Status::OK();
+  IDBClient::IDBClientIterator *iter = db_->getIterator();
+
+  // entries left over by an interrupted deletion
+  KeysVector staleEntries;
+  KeyValuePair p = iter->seekAtLeast(
+      key_manipulator_->genDbKey(EDBKeyType::E_DB_KEY_TYPE_LATEST_VERSION_KEY, Sliver(), std::numeric_limits<BlockId>::max()));
+  while (s.isOK() && !iter->isEnd() && p.first.length() > 0 &&
+         key_manipulator_->extractTypeFromKey(p.first) == (char)EDBKeyType::E_DB_KEY_TYPE_LATEST_VERSION_KEY) {
+    staleEntries.push_back(p.first);
+    p = iter->next();
+    if (staleEntries.size() == kBatchSize || iter->isEnd()) {
+      s = db_->multiDel(staleEntries);
+      staleEntries.clear();
+    }
+  }
+  if (s.isOK() && !staleEntries.empty()) {
+    s = db_->multiDel(staleEntries);
+  }
+
+  std::unique_ptr<IDBClient::IWriteBatch> entries = db_->newWriteBatch();
+  Key lastKey;
+  bool first = true;
+  p = iter->seekAtLeast(key_manipulator_->genDbKey(EDBKeyType::E_DB_KEY_TYPE_KEY, Sliver(), std::numeric_limits<BlockId>::max()));
+  while (s.isOK() && !iter->isEnd() && p.first.length() > 0 &&
+         key_manipulator_->extractTypeFromKey(p.first) == (char)EDBKeyType::E_DB_KEY_TYPE_KEY) {
+    Key key = key_manipulator_->composedToSimple(p).first;
+    if (first || key != lastKey) {
+      s = addLatestVersion(key, key_manipulator_->extractBlockIdFromKey(p.first), *entries);
+      lastKey = key;
+      first = false;
+    }
+    p = iter->next();
+    if (s.isOK() && entries->count() == kBatchSize) {
+      s = db_->write(*entries);
+      entries->clear();
+    }
+  }
+  db_->freeIterator(iter);
+  if (s.isOK() && entries->count() > 0) {
+    s = db_->write(*entries);
+  }
+  if (s.isOK()) {
+    s = setLatestVersionIndexValid(true);
+  }
+  writeDone();
+  return s;
+}
+
+/**
+ * @brief Returns the iterator of getKeyByReadVersion for the calling thread.
+ *
+ * Iterators don't see the writes made after they were created, so a thread's
+ * iterator is replaced once the adapter has written. It is freed when the
+ * thread exits, so that threads coming and going don't pile iterators up.
+ */
+IDBClient::IDBClientIterator *DBAdapter::lookupIterator() const {
+  static thread_local ThreadLookupIterators threadIterators;
+  uint64_t writeGeneration = writeGeneration_;
+  std::shared_ptr<LookupIterator> lookup = threadIterators.find(id_);
+  if (!lookup) {
+    lookup = std::make_shared<LookupIterator>();
+    lookup->db = db_.get();
+    {
+      std::lock_guard<std::mutex> lock(lookupIteratorsLock_);
+      lookupIterators_.erase(std::remove_if(lookupIterators_.begin(), lookupIterators_.end(),
+                                            [](const std::weak_ptr<LookupIterator> &weak) { return weak.expired(); }),
+                             lookupIterators_.end());
+      lookupIterators_.push_back(lookup);
+    }
+    threadIterators.add(id_, lookup);
+  }
+
+  // the adapter outlives its reads: the iterator isn't released while in use
+  std::lock_guard<std::mutex> lock(lookup->lock);
+  if (!lookup->iter || lookup->writeGeneration != writeGeneration) {
+    if (lookup->iter) {
+      db_->freeIterator(lookup->iter);
+    }
+    lookup->iter = db_->getPrefixIterator();
+    lookup->writeGeneration = writeGeneration;
+  }
+  return lookup->iter;
+}
+
+// Also called by the pruning thread, with no block id: only the writer
+// raises latestBlock_.
+void DBAdapter::writeDone(BlockId blockId) {
+  if (blockId > latestBlock_) {
+    latestBlock_ = blockId;
+  }
+  ++writeGeneration_;
 }
 
 /**
@@ -437,9 +942,19 @@ Status DBAdapter::addBlockAndUpdateMultiKey(
  * @return Status of the operation.
  */
 Status DBAdapter::delKey(const Sliver& _key, BlockId _blockId) {
-  Sliver composedKey = key_manipulator_->genDataDbKey(_key, _blockId);
   LOG_TRACE(logger_, "Deleting key " << _key << " block id " << _blockId);
-  Status s = db_->del(composedKey);
+  IDBClient::IWriteBatch &batch = *writeBatch_;
+  batch.clear();
+  batch.del(key_manipulator_->genDataDbKey(_key, _blockId));
+  Status s = repairLatestVersion(_key, _blockId, batch);
+  if (s.isOK()) {
+    s = db_->write(batch);
+    writeDone();
+  }
+  // after the write: the fills of the reads before it are dropped
+  if (latestValueCache_) {
+    latestValueCache_->erase(_key);
+  }
   return s;
 }
 
@@ -454,38 +969,222 @@ Status DBAdapter::delKey(const Sliver& _key, BlockId _blockId) {
  * @return Status of the operation.
  */
 Status DBAdapter::delBlock(BlockId _blockId) {
+  Status s = lowerLastReachableBlock(_blockId);
+  if (!s.isOK()) {
+    return s;
+  }
+  if (blockCache_) {
+    blockCache_->erase(_blockId);
+  }
   Sliver dbKey = key_manipulator_->genBlockDbKey(_blockId);
-  Status s = db_->del(dbKey);
+  s = db_->del(dbKey);
+  if (s.isOK()) {
+    writeDone();
+  }
   return s;
 }
 
+// The keys updated by a block, pointing into the block.
+inline KeysVector blockKeys(const Sliver &blockRaw) {
+  KeysVector keys;
+  BlockView block(blockRaw);
+  keys.reserve(block.size());
+  for (size_t i = 0; i < block.size(); i++) {
+    keys.push_back(block.key(i));
+  }
+  return keys;
+}
+
 void DBAdapter::deleteBlockAndItsKeys(BlockId blockId) {
+  Status s = lowerLastReachableBlock(blockId);
+  if (!s.isOK()) {
+    LOG_FATAL(logger_, "Failed to update the last reachable block before deleting block id: " << blockId);
+    exit(1);
+  }
   Sliver blockRaw;
   bool found = false;
-  Status s = getBlockById(blockId, blockRaw, found);
+  s = readBlock(blockId, blockRaw, found, false);
   if (!s.isOK()) {
     LOG_FATAL(logger_, "Failed to read block id: " << blockId);
     exit(1);
   }
-  KeysVector keysVec;
-  if (found && blockRaw.length() > 0) {
-    uint16_t numOfElements = ((BlockHeader *)blockRaw.data())->numberOfElements;
-    auto *entries = (BlockEntry *)(blockRaw.data() + sizeof(BlockHeader));
-    for (size_t i = 0; i < numOfElements; i++) {
-      keysVec.push_back(
-          Key(blockRaw, entries[i].keyOffset, entries[i].keySize));
-    }
+  if (blockCache_) {
+    blockCache_->erase(blockId);
   }
+  KeysVector keys;
   if (found) {
-    keysVec.push_back(key_manipulator_->genBlockDbKey(blockId));
+    keys = blockKeys(blockRaw);
+  }
+  // the versions, the block and the index entries they were in, at once
+  IDBClient::IWriteBatch &batch = *writeBatch_;
+  batch.clear();
+  for (size_t i = 0; s.isOK() && i < keys.size(); i++) {
+    batch.del(key_manipulator_->genDataDbKey(keys[i], blockId));
+    s = repairLatestVersion(keys[i], blockId, batch);
+  }
+  if (s.isOK() && found) {
+    batch.del(key_manipulator_->genBlockDbKey(blockId));
+  }
+  if (s.isOK()) {
+    s = db_->write(batch);
+    writeDone();
+  }
+  if (latestValueCache_) {
+    for (const auto &key : keys) {
+      latestValueCache_->erase(key);
+    }
   }
-  s = db_->multiDel(keysVec);
   if (!s.isOK()) {
     LOG_FATAL(logger_, "Failed to delete block id: " << blockId);
     exit(1);
   }
 }
 
+/**
+ * @brief Prunes the history before a block.
+ *
+ * The versions of the keys of the pruned blocks are deleted, except the latest
+ * one up to 'untilBlock': reads at 'untilBlock' and later are unchanged. Then
+ * the blocks are deleted, and the first block marker moved to 'untilBlock'.
+ * The versions and the blocks are deleted with range deletions. The first
+ * block is kept: its header holds the digest of the last pruned block, which
+ * anchors the verification of the remaining chain.
+ *
+ * Pruning again after an interruption completes the interrupted pruning.
+ *
+ * @param untilBlock The block before which blocks are pruned, lowered to the
+ *                   last reachable block.
+ * @return Status of the first failed operation, else OK.
+ */
+Status DBAdapter::pruneBlocks(BlockId untilBlock) {
+  untilBlock = std::min<BlockId>(untilBlock, lastReachableBlock_);
+  BlockId firstBlock = firstBlock_;
+  if (untilBlock <= firstBlock) {
+    return Status::OK();
+  }
+  LOG_INFO(logger_, "Pruning blocks " << firstBlock << " to " << untilBlock - 1);
+
+  std::unordered_set<Key> keys;
+  for (BlockId blockId = firstBlock; blockId < untilBlock; blockId++) {
+    Sliver blockRaw;
+    bool found = false;
+    // the pruned blocks are not read again: they don't go to the cache
+    Status s = readBlock(blockId, blockRaw, found, false);
+    if (!s.isOK()) {
+      return s;
+    }
+    // a missing block was pruned by an interrupted pruning, with its versions
+    if (found) {
+      for (const auto &key : blockKeys(blockRaw)) {
+        keys.insert(key);
+      }
+    }
+  }
+
+  Status s = Status::OK();
+  IDBClient::IDBClientIterator *iter = db_->getIterator();
+  for (auto it = keys.begin(); s.isOK() && it != keys.end(); ++it) {
+    // the version read from 'untilBlock' on, preceded by the pruned ones
+    KeyValuePair p = iter->seekAtLeast(key_manipulator_->genDataDbKey(*it, untilBlock));
+    if (iter->isEnd() || p.first.length() == 0 ||
+        key_manipulator_->extractTypeFromKey(p.first) != (char)EDBKeyType::E_DB_KEY_TYPE_KEY ||
+        key_manipulator_->composedToSimple(p).first != *it) {
+      continue;
+    }
+    BlockId keptVersion = key_manipulator_->extractBlockIdFromKey(p.first);
+    if (keptVersion > 1) {
+      s = db_->rangeDel(key_manipulator_->genDataDbKey(*it, keptVersion - 1), key_manipulator_->genDataDbKey(*it, 0));
+    }
+  }
+  db_->freeIterator(iter);
+
+  // blocks are sorted in descending order of block ids
+  if (s.isOK()) {
+    s = db_->rangeDel(key_manipulator_->genBlockDbKey(untilBlock - 1), key_manipulator_->genBlockDbKey(firstBlock - 1));
+  }
+  if (s.isOK()) {
+    s = persistFirstBlock(untilBlock);
+  }
+  if (blockCache_) {
+    blockCache_->eraseBefore(untilBlock);
+  }
+  // the latest versions are kept: the latest value cache stays valid
+  writeDone();
+  if (!s.isOK()) {
+    LOG_ERROR(logger_, "Failed to prune blocks " << firstBlock << " to " << untilBlock - 1);
+    return s;
+  }
+  firstBlock_ = untilBlock;
+  return s;
+}
+
+/**
+ * @brief Catches up a read-only adapter with the primary database it follows.
+ *
+ * The client catches up, then the markers are read again. The primary only
+ * deletes blocks by pruning them, or while state transfer fills a gap: the
+ * pruned blocks leave the block cache, which is cleared if the last reachable
+ * block went down. The latest versions of the keys may have changed: the
+ * latest value cache is cleared.
+ *
+ * @return Status IllegalOperation if the adapter is not read-only, else the
+ *         status of the catch-up of the client.
+ */
+Status DBAdapter::catchUpWithPrimary() {
+  if (!readOnly_) {
+    return Status::IllegalOperation("Only a read-only adapter follows another database");
+  }
+  Status s = db_->tryCatchUpWithPrimary();
+  if (!s.isOK()) {
+    return s;
+  }
+
+  firstBlock_ = loadFirstBlock();
+  BlockId marker = 0;
+  Sliver value;
+  s = db_->get(KeyManipulator::generateMetadataKey(kLastReachableBlockObjectId), value);
+  if (s.isOK() && value.length() == sizeof(BlockId)) {
+    memcpy(&marker, value.data(), sizeof(BlockId));
+  }
+  const BlockId lastReachable = findLastReachableBlock(std::max<BlockId>(marker, firstBlock_ - 1));
+  if (blockCache_) {
+    if (lastReachable < lastReachableBlock_) {
+      blockCache_->clear();
+    } else {
+      blockCache_->eraseBefore(firstBlock_);
+    }
+  }
+  lastReachableBlock_ = lastReachable;
+  latestVersionIndexValid_ =
+      db_->get(KeyManipulator::generateMetadataKey(kLatestVersionIndexObjectId), value).isOK();
+  if (latestValueCache_) {
+    latestValueCache_->clear();
+  }
+  // the lookup iterators of the readers are recreated, over the new state
+  writeDone();
+  return Status::OK();
+}
+
+Status DBAdapter::persistFirstBlock(BlockId blockId) {
+  auto *value = new uint8_t[sizeof(BlockId)];
+  memcpy(value, &blockId, sizeof(BlockId));
+  return db_->put(KeyManipulator::generateMetadataKey(kFirstBlockObjectId), Sliver(value, sizeof(BlockId)));
+}
+
+BlockId DBAdapter::loadFirstBlock() {
+  Sliver value;
+  Status s = db_->get(KeyManipulator::generateMetadataKey(kFirstBlockObjectId), value);
+  if (s.isOK() && value.length() == sizeof(BlockId)) {
+    BlockId firstBlock = 1;
+    memcpy(&firstBlock, value.data(), sizeof(BlockId));
+    return firstBlock;
+  }
+  if (!s.isNotFound()) {
+    LOG_ERROR(logger_, "Failed to read the first block");
+  }
+  return 1;
+}
+
 /**
  * @brief Searches for record in the database by the read version.
  *
@@ -505,34 +1204,177 @@ Status DBAdapter::getKeyByReadVersion(BlockId readVersion,
                                                 Sliver &outValue,
                                                 BlockId &outBlock) const {
   LOG_TRACE(logger_, "Getting value of key " << key << " for read version "  << readVersion);
-  IDBClient::IDBClientIterator *iter = db_->getIterator();
+  outValue = Sliver();
+  outBlock = 0;
+
+  // read before the index is: a fill racing with a deletion is dropped
+  const uint64_t cacheEpoch = latestValueCache_ ? latestValueCache_->epoch() : 0;
+  if (latestVersionIndexValid_) {
+    BlockId latestBlockId = 0;
+    Value latestValue;
+    bool found = latestValueCache_ && latestValueCache_->get(key, latestBlockId, latestValue);
+    if (!found) {
+      Sliver latest;
+      Status s = db_->get(genLatestVersionDbKey(key), latest);
+      if (s.isNotFound()) {
+        // the key has no version at all
+        return Status::OK();
+      }
+      // the indexed version, unless it was deleted since the entry was read
+      if (s.isOK() && latestVersionOf(latest, latestBlockId) && latestBlockId <= readVersion &&
+          db_->get(key_manipulator_->genDataDbKey(key, latestBlockId), latestValue).isOK()) {
+        found = true;
+        if (latestValueCache_) {
+          latestValueCache_->fill(key, latestBlockId, latestValue, cacheEpoch);
+        }
+      }
+    }
+    if (found && latestBlockId <= readVersion) {
+      outValue = latestValue;
+      outBlock = latestBlockId;
+      return Status::OK();
+    }
+    // reading before the latest version: seek for the older one
+  }
+
+  seekVersion(lookupIterator(), key, key_manipulator_->genDataDbKey(key, readVersion), readVersion, outValue,
+              outBlock);
+
+  // TODO(GG): maybe return status of the operation?
+  return Status::OK();
+}
+
+void DBAdapter::seekVersion(IDBClient::IDBClientIterator *iter, const Key &key, const Sliver &searchKey,
+                            BlockId readVersion, Sliver &outValue, BlockId &outBlock) const {
   Sliver foundKey, foundValue;
-  Sliver searchKey = key_manipulator_->genDataDbKey(key, readVersion);
   KeyValuePair p = iter->seekAtLeast(searchKey);
   foundKey = key_manipulator_->composedToSimple(p).first;
   foundValue = p.second;
 
   LOG_TRACE(logger_, "Found key " << foundKey << " and value " << foundValue);
 
-  if (!iter->isEnd()) {
+  // past the versions of the key, the seek may land on keys of another type
+  if (!iter->isEnd() &&
+      key_manipulator_->extractTypeFromKey(p.first) == (char)EDBKeyType::E_DB_KEY_TYPE_KEY) {
     BlockId currentReadVersion = key_manipulator_->extractBlockIdFromKey(p.first);
 
     // TODO(JGC): Ask about reason for version comparison logic
     if (currentReadVersion <= readVersion && foundKey == key) {
       outValue = foundValue;
       outBlock = currentReadVersion;
-    } else {
-      outValue = Sliver();
-      outBlock = 0;
     }
-  } else {
-    outValue = Sliver();
-    outBlock = 0;
   }
+}
 
-  db_->freeIterator(iter);
+/**
+ * @brief Searches for a batch of records in the database by the read version.
+ *
+ * The latest versions of the keys not in the latest value cache are read with
+ * a single multiGet of the latest version index. The keys read before their
+ * latest version are then seeked in the order of the database, each seek
+ * landing close to the previous one.
+ *
+ * @param readVersion The read version of all the keys.
+ * @param keys The keys to read.
+ * @param outValues The values of the keys, empty for a key without a version
+ *                  at the read version.
+ * @param outBlocks The read versions of the results, 0 for a key without a
+ *                  version at the read version.
+ * @return Status of the read of the index, if it failed, else OK.
+ */
+Status DBAdapter::getKeysByReadVersion(BlockId readVersion, const KeysVector &keys, ValuesVector &outValues,
+                                       std::vector<BlockId> &outBlocks) const {
+  outValues.assign(keys.size(), Sliver());
+  outBlocks.assign(keys.size(), 0);
+  // the keys to seek
+  std::vector<size_t> older;
+
+  const uint64_t cacheEpoch = latestValueCache_ ? latestValueCache_->epoch() : 0;
+  if (latestVersionIndexValid_) {
+    KeysVector indexKeys;
+    std::vector<size_t> indexed;
+    for (size_t i = 0; i < keys.size(); i++) {
+      BlockId latestBlockId = 0;
+      Value latestValue;
+      if (!latestValueCache_ || !latestValueCache_->get(keys[i], latestBlockId, latestValue)) {
+        indexKeys.push_back(genLatestVersionDbKey(keys[i]));
+        indexed.push_back(i);
+      } else if (latestBlockId <= readVersion) {
+        outValues[i] = latestValue;
+        outBlocks[i] = latestBlockId;
+      } else {
+        older.push_back(i);
+      }
+    }
 
-  // TODO(GG): maybe return status of the operation?
+    ValuesVector latest;
+    std::vector<Status> statuses;
+    if (!indexKeys.empty()) {
+      Status s = db_->multiGet(indexKeys, latest, statuses);
+      if (!s.isOK()) {
+        return s;
+      }
+    }
+    // then the indexed versions visible at the read version
+    KeysVector versionKeys;
+    std::vector<size_t> versioned;
+    std::vector<BlockId> versionBlocks;
+    for (size_t j = 0; j < indexed.size(); j++) {
+      const size_t i = indexed[j];
+      if (statuses[j].isNotFound()) {
+        // the key has no version at all
+        continue;
+      }
+      BlockId latestBlockId = 0;
+      if (!latestVersionOf(latest[j], latestBlockId) || latestBlockId > readVersion) {
+        older.push_back(i);
+        continue;
+      }
+      versionKeys.push_back(key_manipulator_->genDataDbKey(keys[i], latestBlockId));
+      versioned.push_back(i);
+      versionBlocks.push_back(latestBlockId);
+    }
+    ValuesVector versions;
+    if (!versionKeys.empty()) {
+      Status s = db_->multiGet(versionKeys, versions, statuses);
+      if (!s.isOK()) {
+        return s;
+      }
+    }
+    for (size_t j = 0; j < versioned.size(); j++) {
+      const size_t i = versioned[j];
+      if (!statuses[j].isOK()) {
+        // deleted since the entry was read
+        older.push_back(i);
+        continue;
+      }
+      if (latestValueCache_) {
+        latestValueCache_->fill(keys[i], versionBlocks[j], versions[j], cacheEpoch);
+      }
+      outValues[i] = versions[j];
+      outBlocks[i] = versionBlocks[j];
+    }
+  } else {
+    for (size_t i = 0; i < keys.size(); i++) {
+      older.push_back(i);
+    }
+  }
+  if (older.empty()) {
+    return Status::OK();
+  }
+
+  KeysVector searchKeys(keys.size());
+  for (size_t i : older) {
+    searchKeys[i] = key_manipulator_->genDataDbKey(keys[i], readVersion);
+  }
+  std::sort(older.begin(), older.end(), [this, &searchKeys](size_t a, size_t b) {
+    return key_manipulator_->composedKeyComparison(searchKeys[a].data(), searchKeys[a].length(),
+                                                   searchKeys[b].data(), searchKeys[b].length()) < 0;
+  });
+  IDBClient::IDBClientIterator *iter = lookupIterator();
+  for (size_t i : older) {
+    seekVersion(iter, keys[i], searchKeys[i], readVersion, outValues[i], outBlocks[i]);
+  }
   return Status::OK();
 }
 
@@ -540,6 +1382,8 @@ Status DBAdapter::getKeyByReadVersion(BlockId readVersion,
  * @brief Looks up data by block id.
  *
  * Constructs a composite database key using the block id to fire a get request.
+ * With the block cache enabled, the block is served from it if present, and
+ * put in it otherwise.
  *
  * @param _blockId BlockId object used for looking up data.
  * @param _blockRaw Sliver object where the result of the lookup is stored.
@@ -548,17 +1392,107 @@ Status DBAdapter::getKeyByReadVersion(BlockId readVersion,
  */
 Status DBAdapter::getBlockById(BlockId _blockId, Sliver &_blockRaw,
                                          bool &_found) const {
-  Sliver key = key_manipulator_->genBlockDbKey(_blockId);
-  Status s = db_->get(key, _blockRaw);
+  return readBlock(_blockId, _blockRaw, _found, true);
+}
+
+Status DBAdapter::readBlock(BlockId blockId, Sliver &blockRaw, bool &found, bool fillCache) const {
+  if (blockCache_ && blockCache_->get(blockId, blockRaw)) {
+    found = true;
+    return Status::OK();
+  }
+  Sliver key = key_manipulator_->genBlockDbKey(blockId);
+  Sliver stored;
+  Status s = db_->get(key, stored);
   if (s.isNotFound()) {
-    _found = false;
+    found = false;
     return Status::OK();
   }
 
-  _found = true;
+  found = true;
+  if (s.isOK() && framedBlocks_) {
+    s = blockCompressor_.decompress(stored, blockRaw);
+  } else if (s.isOK()) {
+    blockRaw = stored;
+  }
+  if (s.isOK() && fillCache && blockCache_) {
+    blockCache_->put(blockId, blockRaw);
+  }
   return s;
 }
 
+/**
+ * @brief Keeps the blocks read by id and the blocks added in a cache.
+ *
+ * The blocks added are cached as given: they must own their memory, or view
+ * memory that is not reused. Blocks deleted or pruned through the adapter are
+ * removed from the cache.
+ *
+ * @param config The size of the cache, and its number of shards.
+ */
+void DBAdapter::enableBlockCache(const BlockCacheConfig &config) {
+  blockCache_.reset(new BlockCache(config));
+}
+
+/**
+ * @brief Keeps the latest version of the keys read and written in a cache.
+ *
+ * Reads of a key at or after its latest version are served from the cache,
+ * and the conflict checks of recent blocks with them. The versions written
+ * through the adapter update the cache, and the deleted ones, e.g. by state
+ * transfer, are removed from it.
+ *
+ * @param config The size of the cache, and its number of shards.
+ */
+void DBAdapter::enableLatestValueCache(const LatestValueCacheConfig &config) {
+  latestValueCache_.reset(new LatestValueCache(config));
+}
+
+/**
+ * @brief Compresses the blocks added, with LZ4 or zstd.
+ *
+ * The blocks are decompressed when read by id: the block cache and the readers
+ * of blocks see them as they were added. The blocks of a database with
+ * compression are framed, i.e. stored after a format byte, whether they are
+ * compressed or not. A database records it in its metadata the first time
+ * compression is enabled, which is only possible before it has blocks: the
+ * blocks of other databases are application data, not told apart by their
+ * content.
+ *
+ * @param config The compression, and the zstd level and dictionary.
+ * @return InvalidArgument if the compression isn't built, or the dictionary
+ *         can't be used. IllegalOperation if the database has blocks that
+ *         aren't framed.
+ */
+Status DBAdapter::enableBlockCompression(const BlockCompressionConfig &config) {
+  if (!framedBlocks_ && (readOnly_ || getLatestBlock() != 0)) {
+    return Status::IllegalOperation("Blocks are stored without compression in this database");
+  }
+  Status s = blockCompressor_.init(config);
+  if (!s.isOK() || framedBlocks_) {
+    return s;
+  }
+  uint8_t *value = new uint8_t[1];
+  value[0] = 1;
+  s = db_->put(KeyManipulator::generateMetadataKey(kFramedBlocksObjectId), Sliver(value, 1));
+  if (s.isOK()) {
+    framedBlocks_ = true;
+  }
+  return s;
+}
+
+Sliver DBAdapter::blockToStore(const Sliver &block) {
+  return framedBlocks_ ? blockCompressor_.compress(block) : block;
+}
+
+bool DBAdapter::loadFramedBlocks() {
+  Sliver value;
+  Status s = db_->get(KeyManipulator::generateMetadataKey(kFramedBlocksObjectId), value);
+  if (!s.isOK() && !s.isNotFound()) {
+    LOG_ERROR(logger_, "Failed to read the format of the blocks");
+  }
+  return s.isOK();
+}
+
 // TODO(BWF): is this still needed?
 /**
  * @brief Makes a copy of a Sliver object.
@@ -610,10 +1544,11 @@ Status DBAdapter::first(IDBClient::IDBClientIterator *iter,
   while (!iter->isEnd() && p.first == firstKey) {
     BlockId currentBlock = key_manipulator_->extractBlockIdFromKey(iter->getCurrent().first);
     if (currentBlock <= readVersion) {
+      // the versions of a key are newest first
       value = p.second;
       actualBlock = currentBlock;
       foundKey = true;
-      p = key_manipulator_->composedToSimple(iter->next());
+      break;
     } else {
       if (!foundKey) {
         // If not found a key with actual block version < readVersion, then we
@@ -786,7 +1721,8 @@ Status DBAdapter::next(IDBClient::IDBClientIterator *iter,
     p = key_manipulator_->composedToSimple(iter->next());
   }
 
-  if (iter->isEnd()) {
+  // the data keys are followed by the metadata keys
+  if (iter->isEnd() || key_manipulator_->extractTypeFromKey(iter->getCurrent().first) != (char)EDBKeyType::E_DB_KEY_TYPE_KEY) {
     m_isEnd = true;
     _isEnd = true;
     return Status::OK();
@@ -802,9 +1738,11 @@ Status DBAdapter::next(IDBClient::IDBClientIterator *iter,
   while (!iter->isEnd() && p.first == nextKey) {
     BlockId currentBlockId = key_manipulator_->extractBlockIdFromKey(iter->getCurrent().first);
     if (currentBlockId <= _readVersion) {
+      // the versions of a key are newest first
       value = p.second;
       actualBlock = currentBlockId;
-      p = key_manipulator_->composedToSimple(iter->next());
+      foundKey = true;
+      break;
     } else {
       if (!foundKey) {
         // If not found a key with actual block version < readVersion, then
@@ -816,7 +1754,7 @@ Status DBAdapter::next(IDBClient::IDBClientIterator *iter,
           p = key_manipulator_->composedToSimple(iter->next());
         }
 
-        if (iter->isEnd()) {
+        if (iter->isEnd() || key_manipulator_->extractTypeFromKey(iter->getCurrent().first) != (char)EDBKeyType::E_DB_KEY_TYPE_KEY) {
           break;
         }
 
@@ -829,6 +1767,12 @@ Status DBAdapter::next(IDBClient::IDBClientIterator *iter,
     }
   }
 
+  if (!foundKey) {
+    m_isEnd = true;
+    _isEnd = true;
+    return Status::OK();
+  }
+
   m_isEnd = false;
   _isEnd = false;
   _actualVersion = actualBlock;
@@ -890,9 +1834,9 @@ void DBAdapter::monitor() const { db_->monitor(); }
 BlockId DBAdapter::getLatestBlock() {
   // Note: RocksDB stores keys in a sorted fashion as per the logic
   // provided in a custom comparator (for our case, refer to
-  // Comparators.cpp). In short, keys of type 'block' are stored
+  // composedKeyComparison). In short, keys of type 'block' are stored
   // first followed by keys of type 'key'. All keys of type 'block'
-  // are sorted in ascending order of block ids.
+  // are sorted in descending order of block ids.
 
   // Generate maximal key for type 'block'
   Sliver maxKey = key_manipulator_->genDbKey(EDBKeyType::E_DB_KEY_TYPE_BLOCK,
@@ -901,15 +1845,13 @@ BlockId DBAdapter::getLatestBlock() {
   IDBClient::IDBClientIterator *iter = db_->getIterator();
 
   // Since we use the maximal key, SeekAtLeast will take the iterator
-  // to one position beyond the key corresponding to the largest block id.
+  // to the key corresponding to the largest block id.
   KeyValuePair x = iter->seekAtLeast(maxKey);
 
-  // Read the previous key
-  x = iter->previous();
-
   db_->freeIterator(iter);
 
-  if ((x.first).length() == 0) {  // no blocks
+  if ((x.first).length() == 0 ||
+      key_manipulator_->extractTypeFromKey(x.first) != (char)EDBKeyType::E_DB_KEY_TYPE_BLOCK) {  // no blocks
     return 0;
   }
 
@@ -919,32 +1861,86 @@ BlockId DBAdapter::getLatestBlock() {
 }
 
 /**
- * @brief Used to retrieve the last reachable block
+ * @brief Makes the last reachable block precede a block about to be deleted.
  *
- * Searches for the last reachable block.
- * From ST perspective, this is maximal block number N
- * such that all blocks 1 <= i <= N exist.
- * In the normal state, it should be equal to last block ID
+ * The marker is lowered before the deletion: if the deletion doesn't happen,
+ * the marker is behind the chain, which loadLastReachableBlock repairs.
+ *
+ * @param deletedBlockId The id of the block about to be deleted.
+ * @return Status of the marker update.
+ */
+Status DBAdapter::lowerLastReachableBlock(BlockId deletedBlockId) {
+  if (deletedBlockId == 0 || deletedBlockId > lastReachableBlock_) {
+    return Status::OK();
+  }
+  Status s = persistLastReachableBlock(deletedBlockId - 1);
+  if (s.isOK()) {
+    lastReachableBlock_ = deletedBlockId - 1;
+  }
+  return s;
+}
+
+Status DBAdapter::persistLastReachableBlock(BlockId blockId) {
+  auto *value = new uint8_t[sizeof(BlockId)];
+  memcpy(value, &blockId, sizeof(BlockId));
+  return db_->put(KeyManipulator::generateMetadataKey(kLastReachableBlockObjectId), Sliver(value, sizeof(BlockId)));
+}
+
+/**
+ * @brief Reads the last reachable block marker, and moves it past the blocks
+ * that follow it.
+ *
+ * Databases written before the marker existed have none: their chain is
+ * scanned once from the first block, and the result is persisted.
  *
  * @return Block ID of the last reachable block.
  */
-BlockId DBAdapter::getLastReachableBlock() {
-  IDBClient::IDBClientIterator *iter = db_->getIterator();
+BlockId DBAdapter::loadLastReachableBlock() {
+  BlockId marker = 0;
+  Sliver value;
+  Status s = db_->get(KeyManipulator::generateMetadataKey(kLastReachableBlockObjectId), value);
+  if (s.isOK() && value.length() == sizeof(BlockId)) {
+    memcpy(&marker, value.data(), sizeof(BlockId));
+  } else if (!s.isNotFound()) {
+    LOG_ERROR(logger_, "Failed to read the last reachable block, scanning from the first block");
+  }
 
-  BlockId lastReachableId = 0;
-  Sliver blockKey = key_manipulator_->genBlockDbKey(1);
-  KeyValuePair kvp = iter->seekAtLeast(blockKey);
-  if (kvp.first.length() == 0) {
-    db_->freeIterator(iter);
-    return 0;
+  // the pruned blocks count as reachable
+  BlockId lastReachable = findLastReachableBlock(std::max<BlockId>(marker, firstBlock_ - 1));
+  if (lastReachable != marker && !readOnly_) {
+    s = persistLastReachableBlock(lastReachable);
+    if (!s.isOK()) {
+      LOG_ERROR(logger_, "Failed to persist the last reachable block " << lastReachable);
+    }
   }
+  LOG_INFO(logger_, "Last reachable block " << lastReachable << ", persisted marker " << marker);
+  return lastReachable;
+}
+
+/**
+ * @brief Probes the blocks following a reachable one.
+ *
+ * From ST perspective, the last reachable block is the maximal block number N
+ * such that all blocks 1 <= i <= N exist, or were pruned. In the normal state,
+ * it is equal to the last block ID.
+ *
+ * @param from A block known to be reachable, or 0.
+ * @return Block ID of the last block in the contiguous run following 'from'.
+ */
+BlockId DBAdapter::findLastReachableBlock(BlockId from) const {
+  IDBClient::IDBClientIterator *iter = db_->getIterator();
 
-  while (!iter->isEnd() &&
+  // Block keys are sorted in descending order of block ids: the blocks
+  // following 'from' are reached by walking backwards.
+  BlockId lastReachableId = from;
+  Sliver blockKey = key_manipulator_->genBlockDbKey(from + 1);
+  KeyValuePair kvp = iter->seekAtLeast(blockKey);
+  while (kvp.first.length() > 0 &&
         (key_manipulator_->extractTypeFromKey(kvp.first) == (char)EDBKeyType::E_DB_KEY_TYPE_BLOCK)) {
     BlockId id = key_manipulator_->extractBlockIdFromKey(kvp.first);
     if (id == lastReachableId + 1) {
       lastReachableId++;
-      kvp = iter->next();
+      kvp = iter->previous();
     } else {
       break;
     }
@@ -954,6 +1950,50 @@ BlockId DBAdapter::getLastReachableBlock() {
   return lastReachableId;
 }
 
+/**
+ * @brief Copies all the entries of a database into another one, converting
+ * their keys from one layout to the other.
+ *
+ * The entries are written in batches; the destination is expected to be a new
+ * database, opened with the comparator of its layout.
+ *
+ * @param from The database to read.
+ * @param fromLayout The key layout of 'from'.
+ * @param to The database to write.
+ * @param toLayout The key layout of 'to'.
+ * @return Status of the first failed write, else OK.
+ */
+Status migrateKeyLayout(const IDBClient &from, KeyLayout fromLayout, IDBClient &to, KeyLayout toLayout) {
+  const size_t kBatchSize = 1000;
+  KeyManipulator fromKeys(fromLayout);
+  KeyManipulator toKeys(toLayout);
+  IDBClient::IDBClientIterator *iter = from.getIterator();
+  SetOfKeyValuePairs batch;
+  Status s = Status::OK();
+  for (KeyValuePair kvp = iter->first(); !iter->isEnd() && kvp.first.length() > 0; kvp = iter->next()) {
+    auto type = static_cast<EDBKeyType>(fromKeys.extractTypeFromKey(kvp.first));
+    if (type == EDBKeyType::E_DB_KEY_TYPE_BFT_METADATA_KEY || fromLayout == toLayout) {
+      batch[kvp.first] = kvp.second;
+    } else {
+      batch[toKeys.genDbKey(type,
+                            fromKeys.extractKeyFromKeyComposedWithBlockId(kvp.first),
+                            fromKeys.extractBlockIdFromKey(kvp.first))] = kvp.second;
+    }
+    if (batch.size() == kBatchSize) {
+      s = to.multiPut(batch);
+      if (!s.isOK()) {
+        break;
+      }
+      batch.clear();
+    }
+  }
+  if (s.isOK() && !batch.empty()) {
+    s = to.multiPut(batch);
+  }
+  from.freeIterator(iter);
+  return s;
+}
+
 }
 }
 }
@@ -0,0 +1,141 @@
+// Copyright 2019 VMware, all rights reserved
+//
+// Cache of the latest version of the keys read and written.
+
+#include "blockchain/latest_value_cache.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace concord {
+namespace storage {
+namespace blockchain {
+
+constexpr size_t LatestValueCache::kEntryOverhead;
+
+LatestValueCache::LatestValueCache(const LatestValueCacheConfig &config)
+    : shardCapacity_(config.capacityBytes / std::max<size_t>(config.numOfShards, 1)),
+      metrics_("latest_value_cache", {"hits", "misses", "evictions"}, {"keys", "bytes"}) {
+  for (size_t i = 0; i < std::max<size_t>(config.numOfShards, 1); i++) {
+    shards_.emplace_back(new Shard());
+  }
+}
+
+bool LatestValueCache::get(const Key &key, BlockId &outBlock, Value &outValue) {
+  Shard &shard = shardOf(key);
+  std::lock_guard<std::mutex> lock(shard.lock);
+  auto found = shard.keys.find(key);
+  if (found == shard.keys.end()) {
+    misses_++;
+    return false;
+  }
+  shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+  outBlock = found->second->blockId;
+  outValue = found->second->value;
+  hits_++;
+  return true;
+}
+
+void LatestValueCache::put(const Key &key, BlockId blockId, const Value &value) {
+  Shard &shard = shardOf(key);
+  std::lock_guard<std::mutex> lock(shard.lock);
+  insert(shard, key, blockId, value, Replace::Always);
+}
+
+void LatestValueCache::update(const Key &key, BlockId blockId, const Value &value) {
+  Shard &shard = shardOf(key);
+  std::lock_guard<std::mutex> lock(shard.lock);
+  insert(shard, key, blockId, value, Replace::IfOlder);
+}
+
+void LatestValueCache::fill(const Key &key, BlockId blockId, const Value &value, uint64_t epoch) {
+  Shard &shard = shardOf(key);
+  std::lock_guard<std::mutex> lock(shard.lock);
+  // an invalidation after the read may have erased a newer entry
+  if (epoch != epoch_) {
+    return;
+  }
+  insert(shard, key, blockId, value, Replace::IfOlderOrAbsent);
+}
+
+void LatestValueCache::erase(const Key &key) {
+  Shard &shard = shardOf(key);
+  // before taking the lock: the fills of reads started before are dropped
+  epoch_++;
+  std::lock_guard<std::mutex> lock(shard.lock);
+  auto found = shard.keys.find(key);
+  if (found != shard.keys.end()) {
+    remove(shard, found->second);
+  }
+}
+
+void LatestValueCache::clear() {
+  epoch_++;
+  for (auto &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->lock);
+    while (!shard->lru.empty()) {
+      remove(*shard, shard->lru.begin());
+    }
+  }
+}
+
+void LatestValueCache::insert(Shard &shard, const Key &key, BlockId blockId, const Value &value, Replace replace) {
+  auto found = shard.keys.find(key);
+  if (found != shard.keys.end()) {
+    if (replace != Replace::Always && found->second->blockId >= blockId) {
+      shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+      return;
+    }
+    remove(shard, found->second);
+  } else if (replace == Replace::IfOlder) {
+    return;
+  }
+
+  // the key and the value may view memory that is reused, or a whole block
+  Entry entry{Sliver::copy(key.data(), key.length()), blockId, Sliver::copy(value.data(), value.length())};
+  const size_t entryCharge = charge(entry);
+  if (entryCharge > shardCapacity_) {
+    return;
+  }
+  while (shard.bytes + entryCharge > shardCapacity_) {
+    remove(shard, std::prev(shard.lru.end()));
+    evictions_++;
+  }
+  shard.lru.push_front(std::move(entry));
+  shard.keys[shard.lru.front().key] = shard.lru.begin();
+  shard.bytes += entryCharge;
+  bytes_ += entryCharge;
+  numOfKeys_++;
+}
+
+void LatestValueCache::remove(Shard &shard, LruList::iterator it) {
+  const size_t entryCharge = charge(*it);
+  shard.bytes -= entryCharge;
+  bytes_ -= entryCharge;
+  numOfKeys_--;
+  shard.keys.erase(it->key);
+  shard.lru.erase(it);
+}
+
+LatestValueCache::Stats LatestValueCache::stats() const {
+  Stats stats;
+  stats.hits = hits_;
+  stats.misses = misses_;
+  stats.evictions = evictions_;
+  stats.numOfKeys = numOfKeys_;
+  stats.bytes = bytes_;
+  return stats;
+}
+
+void LatestValueCache::setAggregator(std::shared_ptr<concordMetrics::Aggregator> aggregator) {
+  metrics_.setAggregator(aggregator);
+}
+
+void LatestValueCache::updateMetrics() {
+  const Stats current = stats();
+  metrics_.update({current.hits, current.misses, current.evictions}, {current.numOfKeys, current.bytes});
+}
+
+}  // namespace blockchain
+}  // namespace storage
+}  // namespace concord
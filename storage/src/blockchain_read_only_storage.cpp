@@ -0,0 +1,205 @@
+// Copyright 2019 VMware, all rights reserved
+//
+// Read-only storage over a follower of the database of a replica.
+
+#include "blockchain/read_only_storage.h"
+
+#include <chrono>
+
+namespace concord {
+namespace storage {
+namespace blockchain {
+
+// An iteration at a fixed read version, keeping its own position: the one of
+// the adapter is shared by all the iterations.
+class ReadOnlyStorage::Iterator final : public ILocalKeyValueStorageReadOnlyIterator {
+ public:
+  explicit Iterator(const ReadOnlyStorage &storage)
+      : storage_(storage), readVersion_(storage.getLastBlock()), iter_(storage.adapter_.getIterator()) {}
+  ~Iterator() { storage_.adapter_.freeIterator(iter_); }
+
+  KeyValuePair first(BlockId readVersion, BlockId &actualVersion, bool &isEnd) override {
+    std::lock_guard<std::mutex> lock(storage_.iterationLock_);
+    Key key;
+    Value value;
+    return moved(storage_.adapter_.first(iter_, readVersion, actualVersion, isEnd, key, value), key, value, isEnd);
+  }
+  KeyValuePair first() override {
+    BlockId actualVersion = 0;
+    bool isEnd = false;
+    return first(readVersion_, actualVersion, isEnd);
+  }
+
+  KeyValuePair seekAtLeast(BlockId readVersion, const Key &key, BlockId &actualVersion, bool &isEnd) override {
+    std::lock_guard<std::mutex> lock(storage_.iterationLock_);
+    Key actualKey;
+    Value value;
+    return moved(storage_.adapter_.seekAtLeast(iter_, key, readVersion, actualVersion, actualKey, value, isEnd),
+                 actualKey,
+                 value,
+                 isEnd);
+  }
+  KeyValuePair seekAtLeast(const Key &key) override {
+    BlockId actualVersion = 0;
+    bool isEnd = false;
+    return seekAtLeast(readVersion_, key, actualVersion, isEnd);
+  }
+
+  KeyValuePair next(BlockId readVersion, const Key & /* key */, BlockId &actualVersion, bool &isEnd) override {
+    std::lock_guard<std::mutex> lock(storage_.iterationLock_);
+    Key nextKey;
+    Value nextValue;
+    return moved(storage_.adapter_.next(iter_, readVersion, nextKey, nextValue, actualVersion, isEnd),
+                 nextKey,
+                 nextValue,
+                 isEnd);
+  }
+  KeyValuePair next() override {
+    BlockId actualVersion = 0;
+    bool isEnd = false;
+    return next(readVersion_, current_.first, actualVersion, isEnd);
+  }
+
+  KeyValuePair getCurrent() override { return current_; }
+  bool isEnd() override { return isEnd_; }
+
+ private:
+  KeyValuePair moved(const Status &s, const Key &key, const Value &value, bool &isEnd) {
+    if (!s.isOK()) {
+      // not found, or failed: the iteration ends
+      isEnd = true;
+    }
+    isEnd_ = isEnd;
+    current_ = isEnd ? KeyValuePair() : KeyValuePair(key, value);
+    return current_;
+  }
+
+  const ReadOnlyStorage &storage_;
+  const BlockId readVersion_;
+  IDBClient::IDBClientIterator *iter_;
+  KeyValuePair current_;
+  bool isEnd_ = true;
+};
+
+ReadOnlyStorage::ReadOnlyStorage(DBAdapter &adapter, const ReadOnlyStorageConfig &config)
+    : logger_(concordlogger::Log::getLogger("concord.storage.ReadOnlyStorage")), adapter_(adapter), config_(config) {}
+
+void ReadOnlyStorage::start() {
+  std::lock_guard<std::mutex> lock(lock_);
+  if (thread_.joinable()) {
+    return;
+  }
+  stopRequested_ = false;
+  thread_ = std::thread(&ReadOnlyStorage::run, this);
+}
+
+void ReadOnlyStorage::stop() {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    stopRequested_ = true;
+  }
+  stopCond_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+Status ReadOnlyStorage::catchUp() { return adapter_.catchUpWithPrimary(); }
+
+void ReadOnlyStorage::run() {
+  LOG_INFO(logger_, "Following the primary database every " << config_.catchUpIntervalMilli << " ms");
+  while (sleep(config_.catchUpIntervalMilli)) {
+    Status s = catchUp();
+    if (!s.isOK()) {
+      LOG_ERROR(logger_, "Catching up with the primary database failed: " << s);
+    }
+  }
+  LOG_INFO(logger_, "Stopped following the primary database");
+}
+
+bool ReadOnlyStorage::sleep(uint64_t milli) {
+  std::unique_lock<std::mutex> lock(lock_);
+  return !stopCond_.wait_for(lock, std::chrono::milliseconds(milli), [this]() { return stopRequested_; });
+}
+
+Status ReadOnlyStorage::get(const Key &key, Value &outValue) const {
+  BlockId outBlock = 0;
+  return get(getLastBlock(), key, outValue, outBlock);
+}
+
+Status ReadOnlyStorage::get(BlockId readVersion, const Sliver &key, Sliver &outValue, BlockId &outBlock) const {
+  return adapter_.getKeyByReadVersion(readVersion, key, outValue, outBlock);
+}
+
+BlockId ReadOnlyStorage::getLastBlock() const { return adapter_.getLastReachableBlock(); }
+
+Status ReadOnlyStorage::getBlockData(BlockId blockId, SetOfKeyValuePairs &outBlockData) const {
+  BlockView block;
+  Status s = getBlockView(blockId, block);
+  if (s.isOK()) {
+    outBlockData = block.toSet();
+  }
+  return s;
+}
+
+Status ReadOnlyStorage::getBlockView(BlockId blockId, BlockView &outBlock) const {
+  Sliver block;
+  bool found = false;
+  Status s = adapter_.getBlockById(blockId, block, found);
+  if (!s.isOK()) {
+    return s;
+  }
+  if (!found) {
+    return Status::NotFound("No block " + std::to_string(blockId));
+  }
+  outBlock = BlockView(block);
+  return Status::OK();
+}
+
+Status ReadOnlyStorage::mayHaveConflictBetween(const Sliver &key,
+                                               BlockId fromBlock,
+                                               BlockId toBlock,
+                                               bool &outRes) const {
+  // we conservatively assume that we have a conflict
+  outRes = true;
+  Sliver value;
+  BlockId block = 0;
+  Status s = adapter_.getKeyByReadVersion(toBlock, key, value, block);
+  if (s.isOK() && block < fromBlock) {
+    outRes = false;
+  }
+  return s;
+}
+
+Status ReadOnlyStorage::mayHaveConflictBetween(const KeysVector &keys,
+                                               BlockId fromBlock,
+                                               BlockId toBlock,
+                                               std::vector<bool> &outConflicts) const {
+  outConflicts.assign(keys.size(), true);
+  ValuesVector values;
+  std::vector<BlockId> blocks;
+  Status s = adapter_.getKeysByReadVersion(toBlock, keys, values, blocks);
+  if (!s.isOK()) {
+    return s;
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    outConflicts[i] = blocks[i] >= fromBlock;
+  }
+  return Status::OK();
+}
+
+ILocalKeyValueStorageReadOnlyIterator *ReadOnlyStorage::getSnapIterator() const { return new Iterator(*this); }
+
+Status ReadOnlyStorage::freeSnapIterator(ILocalKeyValueStorageReadOnlyIterator *iter) const {
+  if (iter == nullptr) {
+    return Status::InvalidArgument("Invalid iterator");
+  }
+  delete static_cast<Iterator *>(iter);
+  return Status::OK();
+}
+
+void ReadOnlyStorage::monitor() const { adapter_.monitor(); }
+
+}  // namespace blockchain
+}  // namespace storage
+}  // namespace concord
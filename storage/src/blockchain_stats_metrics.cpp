@@ -0,0 +1,50 @@
+// Copyright 2019 VMware, all rights reserved
+
+#include "blockchain/stats_metrics.h"
+
+#include <cassert>
+#include <utility>
+
+namespace concord {
+namespace storage {
+namespace blockchain {
+
+StatsMetrics::StatsMetrics(std::string name, std::vector<std::string> counterNames, std::vector<std::string> gaugeNames)
+    : name_(std::move(name)), counterNames_(std::move(counterNames)), gaugeNames_(std::move(gaugeNames)) {}
+
+StatsMetrics::Registered::Registered(const StatsMetrics &metrics,
+                                     std::shared_ptr<concordMetrics::Aggregator> aggregator)
+    : component(metrics.name_, aggregator) {
+  for (const auto &name : metrics.counterNames_) {
+    counters.push_back(component.RegisterCounter(name));
+  }
+  for (const auto &name : metrics.gaugeNames_) {
+    gauges.push_back(component.RegisterGauge(name, 0));
+  }
+  component.Register();
+}
+
+void StatsMetrics::setAggregator(std::shared_ptr<concordMetrics::Aggregator> aggregator) {
+  std::lock_guard<std::mutex> lock(lock_);
+  registered_.reset(new Registered(*this, aggregator));
+}
+
+void StatsMetrics::update(const std::vector<uint64_t> &counters, const std::vector<uint64_t> &gauges) {
+  assert(counters.size() == counterNames_.size() && gauges.size() == gaugeNames_.size());
+  std::lock_guard<std::mutex> lock(lock_);
+  if (!registered_) {
+    return;
+  }
+  // the totals are counted by the component, the counters only take them
+  for (size_t i = 0; i < counters.size(); ++i) {
+    registered_->counters[i].Get() = concordMetrics::Counter(counters[i]);
+  }
+  for (size_t i = 0; i < gauges.size(); ++i) {
+    registered_->gauges[i].Get().Set(gauges[i]);
+  }
+  registered_->component.UpdateAggregator();
+}
+
+}  // namespace blockchain
+}  // namespace storage
+}  // namespace concord
@@ -39,6 +39,10 @@ void DBMetadataStorage::verifyOperation(uint32_t objectId, uint32_t dataLen, con
   }
 }
 
+Sliver DBMetadataStorage::metadataKey(uint32_t objectId) const {
+  return objectId < metadataKeys_.size() ? metadataKeys_[objectId] : genMetadataKey_(objectId);
+}
+
 bool DBMetadataStorage::isNewStorage() {
   uint32_t outActualObjectSize;
   read(objectsNumParameterId_, sizeof(objectsNum_), (char *) &objectsNum_, outActualObjectSize);
@@ -46,8 +50,12 @@ bool DBMetadataStorage::isNewStorage() {
 }
 
 bool DBMetadataStorage::initMaxSizeOfObjects(ObjectDesc *metadataObjectsArray, uint32_t metadataObjectsArrayLength) {
+  if (metadataKeys_.size() < metadataObjectsArrayLength) {
+    metadataKeys_.resize(metadataObjectsArrayLength);
+  }
   for (uint32_t i = objectsNumParameterId_ + 1; i < metadataObjectsArrayLength; ++i) {
     objectIdToSizeMap_[i] = metadataObjectsArray[i].maxSize;
+    metadataKeys_[i] = genMetadataKey_(i);
     LOG_TRACE(logger_, "initMaxSizeOfObjects i=" << i << " object data: id=" << metadataObjectsArray[i].id
                                                  << ", maxSize=" << metadataObjectsArray[i].maxSize);
   }
@@ -66,7 +74,7 @@ void DBMetadataStorage::read(uint32_t objectId, uint32_t bufferSize, char *outBu
                              uint32_t &outActualObjectSize) {
   verifyOperation(objectId, bufferSize, outBufferForObject, false);
   lock_guard<mutex> lock(ioMutex_);
-  Status status = dbClient_->get(genMetadataKey_(objectId), outBufferForObject, bufferSize, outActualObjectSize);
+  Status status = dbClient_->get(metadataKey(objectId), outBufferForObject, bufferSize, outActualObjectSize);
   if (status.isNotFound()) {
     memset(outBufferForObject, 0, bufferSize);
     outActualObjectSize = 0;
@@ -82,7 +90,7 @@ void DBMetadataStorage::atomicWrite(uint32_t objectId, char *data, uint32_t data
   auto *dataCopy = new uint8_t[dataLength];
   memcpy(dataCopy, data, dataLength);
   lock_guard<mutex> lock(ioMutex_);
-  Status status = dbClient_->put(genMetadataKey_(objectId), Sliver(dataCopy, dataLength));
+  Status status = dbClient_->put(metadataKey(objectId), Sliver(dataCopy, dataLength));
   if (!status.isOK()) {
     throw runtime_error("DBClient put operation failed");
   }
@@ -91,41 +99,41 @@ void DBMetadataStorage::atomicWrite(uint32_t objectId, char *data, uint32_t data
 void DBMetadataStorage::beginAtomicWriteOnlyBatch() {
   lock_guard<mutex> lock(ioMutex_);
   LOG_DEBUG(logger_, "Begin atomic transaction");
-  if (batch_) {
+  if (batchOpen_) {
     LOG_INFO(logger_, "Transaction has been opened before; ignoring");
     return;
   }
-  batch_ = new SetOfKeyValuePairs;
+  batch_->clear();
+  batchOpen_ = true;
 }
 
 void DBMetadataStorage::writeInBatch(uint32_t objectId, char *data, uint32_t dataLength) {
   LOG_TRACE(logger_, "writeInBatch: objectId=" << objectId << ", dataLength=" << dataLength);
   verifyOperation(objectId, dataLength, data, true);
-  auto *dataCopy = new uint8_t[dataLength];
-  memcpy(dataCopy, data, dataLength);
   lock_guard<mutex> lock(ioMutex_);
-  if (!batch_) {
+  if (!batchOpen_) {
     LOG_ERROR(logger_, WRONG_FLOW);
     throw runtime_error(WRONG_FLOW);
   }
-  batch_->insert(KeyValuePair(genMetadataKey_(objectId), Sliver(dataCopy, dataLength)));
+  // the batch copies the data
+  batch_->put(metadataKey(objectId), Sliver(reinterpret_cast<const uint8_t *>(data), dataLength));
 }
 
 void DBMetadataStorage::commitAtomicWriteOnlyBatch() {
   lock_guard<mutex> lock(ioMutex_);
   LOG_DEBUG(logger_, "Begin Commit atomic transaction");
-  if (!batch_) {
+  if (!batchOpen_) {
     LOG_ERROR(logger_, WRONG_FLOW);
     throw runtime_error(WRONG_FLOW);
   }
-  Status status = dbClient_->multiPut(*batch_);
+  Status status = dbClient_->write(*batch_);
   LOG_DEBUG(logger_, "End Commit atomic transaction");
   if (!status.isOK()) {
-    LOG_ERROR(logger_, "DBClient multiPut operation failed");
-    throw runtime_error("DBClient multiPut operation failed");
+    LOG_ERROR(logger_, "DBClient write operation failed");
+    throw runtime_error("DBClient write operation failed");
   }
-  delete batch_;
-  batch_ = nullptr;
+  batch_->clear();
+  batchOpen_ = false;
 }
 
 Status DBMetadataStorage::multiDel(const ObjectIdsVector &objectIds) {
@@ -134,7 +142,7 @@ Status DBMetadataStorage::multiDel(const ObjectIdsVector &objectIds) {
   LOG_TRACE(logger_, "Going to perform multiple delete");
   KeysVector keysVec;
   for (size_t objectId = 0; objectId < objectsNumber; objectId++) {
-    auto key = genMetadataKey_(objectId);
+    auto key = metadataKey(objectId);
     keysVec.push_back(key);
     LOG_INFO(logger_, "Deleted object id=" << objectId << ", key=" << key);
   }
@@ -164,6 +164,32 @@ Status Client::multiDel(const KeysVector &_keysVec) {
   return status;
 }
 
+/**
+ * @brief Applies the operations of a batch, whose keys and values it owns.
+ *
+ * @param _batch A batch of this client.
+ * @return Status OK.
+ */
+Status Client::write(IWriteBatch &_batch) {
+  for (const auto &it : static_cast<WriteBatch &>(_batch).operations()) {
+    if (it.deleted) {
+      map_.erase(it.key);
+    } else {
+      map_[it.key] = it.value;
+    }
+  }
+  return Status::OK();
+}
+
+Status Client::rangeDel(const Sliver& _beginKey, const Sliver& _endKey) {
+  auto begin = map_.lower_bound(_beginKey);
+  auto end = map_.lower_bound(_endKey);
+  if (comp_(_beginKey, _endKey)) {
+    map_.erase(begin, end);
+  }
+  return Status::OK();
+}
+
 /**
  * @brief Moves the iterator to the start of the map.
  *
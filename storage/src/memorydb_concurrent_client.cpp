@@ -0,0 +1,568 @@
+// Copyright 2019 VMware, all rights reserved
+
+#include "memorydb/concurrent_client.h"
+
+#include <cstddef>
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#include "hash_defs.h"
+#include "sliver.hpp"
+
+using concordUtils::Sliver;
+using concordUtils::Status;
+
+namespace concord {
+namespace storage {
+namespace memorydb {
+
+uint8_t *Arena::allocate(size_t size) {
+  // keeps the nodes and their atomics aligned
+  size = (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+  if (size > remaining_) {
+    if (size > kBlockSize / 4) {
+      // a block of its own, so as not to waste the current one
+      blocks_.emplace_back(new uint8_t[size]);
+      memoryUsage_.fetch_add(size, std::memory_order_relaxed);
+      return blocks_.back().get();
+    }
+    blocks_.emplace_back(new uint8_t[kBlockSize]);
+    current_ = blocks_.back().get();
+    remaining_ = kBlockSize;
+    memoryUsage_.fetch_add(kBlockSize, std::memory_order_relaxed);
+  }
+  uint8_t *result = current_;
+  current_ += size;
+  remaining_ -= size;
+  return result;
+}
+
+ConcurrentClient::ConcurrentClient(KeyComparator comp)
+    : logger(concordlogger::Log::getLogger("concord.storage.memorydb")),
+      comp_(comp),
+      arena_(std::make_shared<Arena>()),
+      head_(nullptr) {
+  head_ = newNode(Sliver(), kMaxHeight);
+}
+
+ConcurrentClient::~ConcurrentClient() {
+  for (Node *node = head_->getNext(0); node != nullptr; node = node->getNext(0)) {
+    freeVersions(node->version.load(std::memory_order_relaxed));
+  }
+  ReaderSlot *slot = readers_.load(std::memory_order_relaxed);
+  while (slot != nullptr) {
+    ReaderSlot *next = slot->next;
+    delete slot;
+    slot = next;
+  }
+}
+
+/**
+ * @brief Does nothing.
+ *
+ * Does nothing.
+ * @return Status OK.
+ */
+void ConcurrentClient::init(bool readOnly) {}
+
+ConcurrentClient::Node *ConcurrentClient::newNode(const Sliver &key, int height) {
+  uint8_t *memory = arena_->allocate(sizeof(Node) + (height - 1) * sizeof(std::atomic<Node *>));
+  Node *node = new (memory) Node;
+  uint8_t *keyBytes = nullptr;
+  if (key.length() > 0) {
+    keyBytes = arena_->allocate(key.length());
+    memcpy(keyBytes, key.data(), key.length());
+  }
+  node->key = keyBytes;
+  node->keyLength = static_cast<uint32_t>(key.length());
+  node->version.store(nullptr, std::memory_order_relaxed);
+  node->height = height;
+  for (int i = 0; i < height; i++) {
+    new (&node->next[i]) std::atomic<Node *>(nullptr);
+  }
+  return node;
+}
+
+int ConcurrentClient::randomHeight() {
+  // each level has a quarter of the nodes of the level below
+  int height = 1;
+  while (height < kMaxHeight && random_() % 4 == 0) {
+    height++;
+  }
+  return height;
+}
+
+// The levels often lead to a node already compared at the level above: it is
+// not compared again.
+ConcurrentClient::Node *ConcurrentClient::findGreaterOrEqual(const Sliver &key, Node **prev) const {
+  Node *x = head_;
+  Node *notLess = nullptr;
+  int level = height_.load(std::memory_order_relaxed) - 1;
+  while (true) {
+    Node *next = x->getNext(level);
+    if (next != nullptr && next != notLess && compare(next, key) < 0) {
+      x = next;
+    } else {
+      notLess = next;
+      if (prev != nullptr) {
+        prev[level] = x;
+      }
+      if (level == 0) {
+        return next;
+      }
+      level--;
+    }
+  }
+}
+
+ConcurrentClient::Node *ConcurrentClient::findLessThan(const Sliver &key) const {
+  Node *x = head_;
+  Node *notLess = nullptr;
+  int level = height_.load(std::memory_order_relaxed) - 1;
+  while (true) {
+    Node *next = x->getNext(level);
+    if (next != nullptr && next != notLess && compare(next, key) < 0) {
+      x = next;
+    } else if (level == 0) {
+      return x;
+    } else {
+      notLess = next;
+      level--;
+    }
+  }
+}
+
+ConcurrentClient::Node *ConcurrentClient::findLast() const {
+  Node *x = head_;
+  int level = height_.load(std::memory_order_relaxed) - 1;
+  while (true) {
+    Node *next = x->getNext(level);
+    if (next != nullptr) {
+      x = next;
+    } else if (level == 0) {
+      return x;
+    } else {
+      level--;
+    }
+  }
+}
+
+const ConcurrentClient::Version *ConcurrentClient::visibleVersion(const Node *node, uint64_t sequence) {
+  const Version *version = node->version.load(std::memory_order_acquire);
+  while (version != nullptr && version->sequence > sequence) {
+    version = version->previous.load(std::memory_order_acquire);
+  }
+  return (version != nullptr && !version->deleted) ? version : nullptr;
+}
+
+Sliver ConcurrentClient::keyOf(const Node *node) const {
+  return Sliver(std::shared_ptr<uint8_t>(arena_, const_cast<uint8_t *>(node->key)), node->keyLength);
+}
+
+Sliver ConcurrentClient::valueOf(const Version *version) const {
+  if (version->length == 0) {
+    return Sliver();
+  }
+  return Sliver(version->data, version->length);
+}
+
+ConcurrentClient::ReaderSlot *ConcurrentClient::acquireSlot() const {
+  ReaderSlot *head = readers_.load(std::memory_order_acquire);
+  for (ReaderSlot *slot = head; slot != nullptr; slot = slot->next) {
+    bool inUse = false;
+    if (!slot->inUse.load(std::memory_order_relaxed) &&
+        slot->inUse.compare_exchange_strong(inUse, true, std::memory_order_acquire)) {
+      return slot;
+    }
+  }
+  ReaderSlot *slot = new ReaderSlot();
+  slot->inUse.store(true, std::memory_order_relaxed);
+  slot->next = head;
+  while (!readers_.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_acquire)) {
+  }
+  return slot;
+}
+
+// A writer that publishes a later write after the pin was checked sees the
+// pin when it looks for the oldest one, as all are sequentially consistent.
+uint64_t ConcurrentClient::pin(ReaderSlot *slot) const {
+  uint64_t sequence = lastSequence();
+  while (true) {
+    slot->pinned.store(sequence, std::memory_order_seq_cst);
+    uint64_t last = lastSequence();
+    if (last == sequence) {
+      return sequence;
+    }
+    sequence = last;
+  }
+}
+
+void ConcurrentClient::releaseSlot(ReaderSlot *slot) {
+  slot->pinned.store(kUnpinned, std::memory_order_release);
+  slot->inUse.store(false, std::memory_order_release);
+}
+
+void ConcurrentClient::publish(uint64_t sequence) {
+  sequence_.store(sequence, std::memory_order_seq_cst);
+  reclaim();
+}
+
+void ConcurrentClient::reclaim() {
+  if (retired_.empty()) {
+    return;
+  }
+  uint64_t oldestPinned = kUnpinned;
+  for (ReaderSlot *slot = readers_.load(std::memory_order_acquire); slot != nullptr; slot = slot->next) {
+    oldestPinned = std::min(oldestPinned, slot->pinned.load(std::memory_order_seq_cst));
+  }
+  // the readers as of a write see its versions, or later ones
+  while (!retired_.empty() && retired_.front().first <= oldestPinned) {
+    Version *superseded = retired_.front().second->previous.exchange(nullptr, std::memory_order_acq_rel);
+    retired_.pop_front();
+    freeVersions(superseded);
+  }
+}
+
+void ConcurrentClient::freeVersions(Version *version) {
+  while (version != nullptr) {
+    Version *previous = version->previous.load(std::memory_order_relaxed);
+    valueBytes_.fetch_sub(version->length, std::memory_order_relaxed);
+    delete version;
+    version = previous;
+  }
+}
+
+void ConcurrentClient::write(const Sliver &key, const Sliver *value, uint64_t sequence) {
+  Node *prev[kMaxHeight];
+  Node *node = findGreaterOrEqual(key, prev);
+  if (node == nullptr || compare(node, key) != 0) {
+    if (value == nullptr) {
+      return;
+    }
+    int height = randomHeight();
+    int currentHeight = height_.load(std::memory_order_relaxed);
+    if (height > currentHeight) {
+      for (int i = currentHeight; i < height; i++) {
+        prev[i] = head_;
+      }
+      // readers that see the new height before the new links go down a level
+      height_.store(height, std::memory_order_relaxed);
+    }
+    node = newNode(key, height);
+    for (int i = 0; i < height; i++) {
+      node->next[i].store(prev[i]->next[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+      prev[i]->next[i].store(node, std::memory_order_release);
+    }
+    numOfNodes_.fetch_add(1, std::memory_order_relaxed);
+  }
+  addVersion(node, value, sequence);
+}
+
+void ConcurrentClient::addVersion(Node *node, const Sliver *value, uint64_t sequence) {
+  Version *version = new Version;
+  version->sequence = sequence;
+  Version *previous = node->version.load(std::memory_order_relaxed);
+  version->previous.store(previous, std::memory_order_relaxed);
+  version->length = 0;
+  version->deleted = (value == nullptr);
+  if (value != nullptr && value->length() > 0) {
+    const size_t length = value->length();
+    // the value lives on in the slivers handed out by the reads
+    version->data = std::shared_ptr<uint8_t>(new uint8_t[length], std::default_delete<uint8_t[]>());
+    memcpy(version->data.get(), value->data(), length);
+    version->length = static_cast<uint32_t>(length);
+    valueBytes_.fetch_add(length, std::memory_order_relaxed);
+  }
+  node->version.store(version, std::memory_order_release);
+  if (previous != nullptr) {
+    retired_.emplace_back(sequence, version);
+  }
+}
+
+/**
+ * @brief Services a read request from the In Memory Database.
+ *
+ * Tries to get the value associated with a key, as of the last write.
+ * @param _key Reference to the key being looked up.
+ * @param _outValue Reference to where the value gets stored if the lookup is
+ *                  successful.
+ * @return Status NotFound if no mapping is found, else, Status OK.
+ */
+Status ConcurrentClient::get(const Sliver &_key, OUT Sliver &_outValue) const {
+  ReaderSlot *slot = acquireSlot();
+  uint64_t sequence = pin(slot);
+  const Version *version = nullptr;
+  Node *node = findGreaterOrEqual(_key, nullptr);
+  if (node != nullptr && compare(node, _key) == 0) {
+    version = visibleVersion(node, sequence);
+    if (version != nullptr) {
+      _outValue = valueOf(version);
+    }
+  }
+  releaseSlot(slot);
+  return version != nullptr ? Status::OK() : Status::NotFound("Not found");
+}
+
+// A memory for the output buffer is expected to be allocated by a caller.
+Status ConcurrentClient::get(const Sliver &_key, OUT char *&buf, uint32_t bufSize, OUT uint32_t &_size) const {
+  Sliver value;
+  Status status = get(_key, value);
+  if (!status.isOK()) return status;
+
+  _size = static_cast<uint32_t>(value.length());
+  if (bufSize < _size) {
+    LOG_ERROR(logger, "Object value is bigger than specified buffer bufSize=" << bufSize << ", _realSize=" << _size);
+    return Status::GeneralError("Object value is bigger than specified buffer");
+  }
+  memcpy(buf, value.data(), _size);
+  return Status::OK();
+}
+
+/**
+ * @brief Returns reference to a new object of IDBClientIterator.
+ *
+ * @return A pointer to IDBClientIterator object.
+ */
+IDBClient::IDBClientIterator *ConcurrentClient::getIterator() const { return new ConcurrentClientIterator(this); }
+
+/**
+ * @brief Frees the IDBClientIterator.
+ *
+ * @param _iter Pointer to object of class IDBClientIterator that needs to be
+ *              freed.
+ * @return Status InvalidArgument if iterator is null pointer, else, Status OK.
+ */
+Status ConcurrentClient::freeIterator(IDBClientIterator *_iter) const {
+  if (_iter == NULL) {
+    return Status::InvalidArgument("Invalid iterator");
+  }
+
+  delete (ConcurrentClientIterator *)_iter;
+  return Status::OK();
+}
+
+/**
+ * @brief Services a write request to the In Memory database.
+ *
+ * The key is copied in the arena, and the value on its own. If the key exists,
+ * its new version goes before the others, which are freed once no reader can
+ * see them.
+ *
+ * @param _key Key of the mapping.
+ * @param _value Value of the mapping.
+ * @return Status OK.
+ */
+Status ConcurrentClient::put(const Sliver &_key, const Sliver &_value) {
+  std::lock_guard<std::mutex> lock(writeLock_);
+  uint64_t sequence = sequence_.load(std::memory_order_relaxed) + 1;
+  write(_key, &_value, sequence);
+  publish(sequence);
+  return Status::OK();
+}
+
+/**
+ * @brief Deletes a key, with a version that marks it as deleted.
+ *
+ * @param _key Reference to the key of the mapping.
+ * @return Status OK.
+ */
+Status ConcurrentClient::del(const Sliver &_key) {
+  std::lock_guard<std::mutex> lock(writeLock_);
+  uint64_t sequence = sequence_.load(std::memory_order_relaxed) + 1;
+  write(_key, nullptr, sequence);
+  publish(sequence);
+  return Status::OK();
+}
+
+Status ConcurrentClient::multiGet(const KeysVector &_keysVec, OUT ValuesVector &_valuesVec) {
+  Status status = Status::OK();
+  Sliver sliver;
+  for (auto const &it : _keysVec) {
+    status = get(it, sliver);
+    if (!status.isOK()) return status;
+    _valuesVec.push_back(sliver);
+  }
+  return status;
+}
+
+Status ConcurrentClient::multiPut(const SetOfKeyValuePairs &_keyValueMap) {
+  std::lock_guard<std::mutex> lock(writeLock_);
+  uint64_t sequence = sequence_.load(std::memory_order_relaxed) + 1;
+  for (const auto &it : _keyValueMap) {
+    write(it.first, &it.second, sequence);
+  }
+  publish(sequence);
+  return Status::OK();
+}
+
+Status ConcurrentClient::multiDel(const KeysVector &_keysVec) {
+  std::lock_guard<std::mutex> lock(writeLock_);
+  uint64_t sequence = sequence_.load(std::memory_order_relaxed) + 1;
+  for (const auto &it : _keysVec) {
+    write(it, nullptr, sequence);
+  }
+  publish(sequence);
+  return Status::OK();
+}
+
+Status ConcurrentClient::write(IWriteBatch &_batch) {
+  std::lock_guard<std::mutex> lock(writeLock_);
+  uint64_t sequence = sequence_.load(std::memory_order_relaxed) + 1;
+  for (const auto &it : static_cast<WriteBatch &>(_batch).operations()) {
+    write(it.key, it.deleted ? nullptr : &it.value, sequence);
+  }
+  publish(sequence);
+  return Status::OK();
+}
+
+Status ConcurrentClient::rangeDel(const Sliver &_beginKey, const Sliver &_endKey) {
+  std::lock_guard<std::mutex> lock(writeLock_);
+  uint64_t sequence = sequence_.load(std::memory_order_relaxed) + 1;
+  for (Node *node = findGreaterOrEqual(_beginKey, nullptr); node != nullptr && compare(node, _endKey) < 0;
+       node = node->getNext(0)) {
+    if (visibleVersion(node, sequence) != nullptr) {
+      addVersion(node, nullptr, sequence);
+    }
+  }
+  publish(sequence);
+  return Status::OK();
+}
+
+void ConcurrentClient::monitor() const {
+  LOG_INFO(logger, "Keys: " << numOfNodes_.load(std::memory_order_relaxed)
+                            << ", writes: " << lastSequence() << ", memory: " << memoryUsage());
+}
+
+size_t ConcurrentClient::memoryUsage() const {
+  return arena_->memoryUsage() + valueBytes_.load(std::memory_order_relaxed);
+}
+
+ConcurrentClientIterator::ConcurrentClientIterator(const ConcurrentClient *_parentClient)
+    : logger(concordlogger::Log::getLogger("concord.storage.memorydb")), m_parentClient(_parentClient) {}
+
+ConcurrentClientIterator::~ConcurrentClientIterator() {
+  if (m_slot != nullptr) {
+    ConcurrentClient::releaseSlot(m_slot);
+  }
+}
+
+// Keeps the versions as of the last write until the iterator is moved again,
+// or freed.
+void ConcurrentClientIterator::pinLastWrite() {
+  if (m_slot == nullptr) {
+    m_slot = m_parentClient->acquireSlot();
+  }
+  m_sequence = m_parentClient->pin(m_slot);
+}
+
+/**
+ * @brief Moves the iterator to the first key.
+ *
+ * @return The first key value pair.
+ */
+KeyValuePair ConcurrentClientIterator::first() {
+  pinLastWrite();
+  m_current = m_parentClient->head_->getNext(0);
+  return skipToVisible();
+}
+
+/**
+ * @brief Returns the key value pair of the key which is greater than or equal
+ * to _searchKey.
+ *
+ *  Returns the first key value pair whose key is not considered to go before
+ *  _searchKey. Also, moves the iterator to this position.
+ *
+ *  @param _searchKey Key to search for.
+ *  @return Key value pair of the key which is greater than or equal to
+ *  _searchKey.
+ */
+KeyValuePair ConcurrentClientIterator::seekAtLeast(const Sliver &_searchKey) {
+  pinLastWrite();
+  m_current = m_parentClient->findGreaterOrEqual(_searchKey, nullptr);
+  KeyValuePair p = skipToVisible();
+  if (isEnd()) {
+    LOG_WARN(logger, "Key " << _searchKey << " not found");
+  }
+  return p;
+}
+
+/**
+ * @brief Decrements the iterator.
+ *
+ * Searches the key before the current one, as the nodes have no link to
+ * their previous one.
+ *
+ * @return The previous key value pair.
+ */
+KeyValuePair ConcurrentClientIterator::previous() {
+  if (m_slot == nullptr) {
+    pinLastWrite();
+  }
+  const ConcurrentClient::Node *node = m_current;
+  do {
+    node = node ? m_parentClient->findLessThan(m_parentClient->keyOf(node)) : m_parentClient->findLast();
+  } while (node != m_parentClient->head_ && !ConcurrentClient::visibleVersion(node, m_sequence));
+
+  if (node == m_parentClient->head_) {
+    LOG_WARN(logger, "Iterator already at first key");
+    return KeyValuePair();
+  }
+  m_current = node;
+  return getCurrent();
+}
+
+/**
+ * @brief Increments the iterator.
+ *
+ * Increments the iterator and returns the next key value pair.
+ *
+ * @return The next key value pair.
+ */
+KeyValuePair ConcurrentClientIterator::next() {
+  if (m_current != nullptr) {
+    m_current = m_current->getNext(0);
+  }
+  return skipToVisible();
+}
+
+// Moves forward past the keys that are deleted, or written after m_sequence.
+KeyValuePair ConcurrentClientIterator::skipToVisible() {
+  while (m_current != nullptr && !ConcurrentClient::visibleVersion(m_current, m_sequence)) {
+    m_current = m_current->getNext(0);
+  }
+  return getCurrent();
+}
+
+/**
+ * @brief Returns the key value pair at the current position of the iterator.
+ *
+ * @return Current key value pair.
+ */
+KeyValuePair ConcurrentClientIterator::getCurrent() {
+  if (m_current == nullptr) {
+    return KeyValuePair();
+  }
+
+  return KeyValuePair(m_parentClient->keyOf(m_current),
+                      m_parentClient->valueOf(ConcurrentClient::visibleVersion(m_current, m_sequence)));
+}
+
+/**
+ * @brief Tells whether iterator is at the end of the keys.
+ *
+ * @return True if iterator is at the end of the keys, else False.
+ */
+bool ConcurrentClientIterator::isEnd() { return m_current == nullptr; }
+
+/**
+ * @brief Does nothing.
+ *
+ * @return Status OK.
+ */
+Status ConcurrentClientIterator::getStatus() { return Status::OK(); }
+
+}  // namespace memorydb
+}  // namespace storage
+}  // namespace concord
@@ -17,7 +17,18 @@
 #include "rocksdb/transaction.h"
 #include "Logger.hpp"
 #include "hash_defs.h"
+#include <algorithm>
 #include <atomic>
+#include <rocksdb/filter_policy.h>
+#include <rocksdb/sst_file_writer.h>
+#include <rocksdb/table.h>
+#include <rocksdb/utilities/checkpoint.h>
+#include <rocksdb/version.h>
+
+// secondary instances, and the batched multiGet
+#if ROCKSDB_MAJOR < 6 || (ROCKSDB_MAJOR == 6 && ROCKSDB_MINOR < 4)
+#error "The RocksDB client needs RocksDB 6.4 or later"
+#endif
 
 using concordUtils::Sliver;
 using concordUtils::Status;
@@ -26,8 +37,8 @@ namespace concord {
 namespace storage {
 namespace rocksdb {
 
-// Counter for number of read requests
-static unsigned int g_rocksdb_called_read = 0;
+// Counter for number of read requests, from all the threads
+static std::atomic<unsigned int> g_rocksdb_called_read{0};
 static bool g_rocksdb_print_measurements = false;
 
 /**
@@ -71,10 +82,11 @@ Sliver copyRocksdbSlice(::rocksdb::Slice _s) {
 ITransaction* Client::beginTransaction()
 {
   static std::atomic_uint64_t current_transaction_id (0);
-  ::rocksdb::WriteOptions wo;
   if (!txn_db_)
     throw std::runtime_error("Failed to start transaction, reason: RO mode");
-  return new Transaction(txn_db_->BeginTransaction(wo), ++current_transaction_id);
+  // the commit is a write under the write policy
+  ::rocksdb::WriteOptions wo = writeOptions();
+  return new Transaction(txn_db_->BeginTransaction(wo), ++current_transaction_id, this);
 }
 
 
@@ -92,26 +104,100 @@ bool Client::isNew() {
  * Uses the RocksDBClient object variables m_dbPath and m_dbInstance to
  * establish a connection with RocksDB by creating a RocksDB object.
  *
+ * A new database is created with the configured column families. An existing
+ * one is opened with the column families it has: its single keyspace if it was
+ * created without column families, else the configured ones, which it must
+ * have. A secondary instance opens the database of its primary, which must
+ * exist.
+ *
  *  @throw GeneralError in case of error in connection, else OK.
  */
 void Client::init(bool readOnly) {
   ::rocksdb::DB* db;
-  ::rocksdb::Options options;
+  ::rocksdb::DBOptions options;
   ::rocksdb::TransactionDBOptions txn_options;
   options.create_if_missing = true;
-  options.comparator = m_comparator;
-  ::rocksdb::Status s;
-  if (readOnly) {
-    s = ::rocksdb::DB::OpenForReadOnly(options, m_dbPath, &db);
+  options.create_missing_column_families = true;
+  options.enable_pipelined_write = m_writePolicy.pipelinedWrites;
+
+  std::vector<std::string> existingFamilies;
+  ::rocksdb::Status s = ::rocksdb::DB::ListColumnFamilies(options, m_dbPath, &existingFamilies);
+  bool singleKeyspace = m_columnFamilies.empty() || (s.ok() && existingFamilies.size() == 1);
+  if (singleKeyspace && !m_columnFamilies.empty()) {
+    LOG_INFO(logger, "Database at " << m_dbPath << " was created without column families, not using them");
+  }
+
+  std::vector<::rocksdb::ColumnFamilyDescriptor> families;
+  if (singleKeyspace) {
+    ::rocksdb::ColumnFamilyOptions familyOptions;
+    ::rocksdb::BlockBasedTableOptions tableOptions;
+    tableOptions.filter_policy.reset(::rocksdb::NewBloomFilterPolicy(10, false));
+    familyOptions.table_factory.reset(::rocksdb::NewBlockBasedTableFactory(tableOptions));
+    if (m_prefixExtractor) {
+      familyOptions.prefix_extractor = m_prefixExtractor;
+      familyOptions.memtable_prefix_bloom_size_ratio = 0.1;
+    }
+    families.emplace_back(::rocksdb::kDefaultColumnFamilyName, familyOptions);
+  } else {
+    if (m_columnFamilies[0].name != ::rocksdb::kDefaultColumnFamilyName || m_columnFamilies[0].firstKeyByte != 0)
+      throw std::runtime_error("The first column family must be the default one, from key byte 0");
+    for (size_t i = 0; i < m_columnFamilies.size(); i++) {
+      if (i > 0 && m_columnFamilies[i].firstKeyByte <= m_columnFamilies[i - 1].firstKeyByte)
+        throw std::runtime_error("Column families must be sorted by first key byte");
+      families.emplace_back(m_columnFamilies[i].name, m_columnFamilies[i].options);
+      for (size_t b = m_columnFamilies[i].firstKeyByte; b < m_familyOfKeyByte.size(); b++) {
+        m_familyOfKeyByte[b] = static_cast<uint8_t>(i);
+      }
+    }
+    if (s.ok()) {
+      std::vector<std::string> configuredFamilies;
+      for (const auto &family : families) configuredFamilies.push_back(family.name);
+      std::sort(existingFamilies.begin(), existingFamilies.end());
+      std::sort(configuredFamilies.begin(), configuredFamilies.end());
+      if (existingFamilies != configuredFamilies)
+        throw std::runtime_error("Database at " + m_dbPath + " has other column families than configured");
+    }
+  }
+  for (auto &family : families) {
+    if (m_comparator) {
+      family.options.comparator = m_comparator;
+    }
+    m_columnFamilyNames.push_back(family.name);
+  }
+
+  if (isSecondary()) {
+    // the primary creates the database, and a secondary keeps all its files open
+    options.create_if_missing = false;
+    options.create_missing_column_families = false;
+    options.max_open_files = -1;
+    s = ::rocksdb::DB::OpenAsSecondary(options, m_dbPath, m_secondaryPath, families, &m_columnFamilyHandles, &db);
+    m_dbInstance.reset(db);
+  } else if (readOnly) {
+    s = ::rocksdb::DB::OpenForReadOnly(options, m_dbPath, families, &m_columnFamilyHandles, &db);
     m_dbInstance.reset(db);
   } else {
-    s = ::rocksdb::TransactionDB::Open(options, txn_options, m_dbPath, &txn_db_);
-    m_dbInstance.reset(txn_db_->GetBaseDB());
+    s = ::rocksdb::TransactionDB::Open(options, txn_options, m_dbPath, families, &m_columnFamilyHandles, &txn_db_);
+    if (s.ok()) m_dbInstance.reset(txn_db_->GetBaseDB());
   }
   if (!s.ok())
     throw std::runtime_error("Failed to open rocksdb database at " + m_dbPath + std::string(" reason: ") + s.ToString());
 }
 
+Client::~Client() {
+  // the handles go before their database
+  for (auto handle : m_columnFamilyHandles) {
+    delete handle;
+  }
+}
+
+::rocksdb::ColumnFamilyHandle *Client::columnFamily(const Sliver& _key) const {
+  return m_columnFamilyHandles[columnFamilyIndex(_key)];
+}
+
+size_t Client::columnFamilyIndex(const Sliver& _key) const {
+  return _key.length() > 0 ? m_familyOfKeyByte[_key[0]] : 0;
+}
+
 Status Client::get(const Sliver& _key, OUT std::string &_value) const {
   ++g_rocksdb_called_read;
   if (g_rocksdb_print_measurements) {
@@ -119,7 +205,7 @@ Status Client::get(const Sliver& _key, OUT std::string &_value) const {
                                                << ", key " << _key);
   }
   ::rocksdb::Status s =
-      m_dbInstance->Get(::rocksdb::ReadOptions(), toRocksdbSlice(_key), &_value);
+      m_dbInstance->Get(::rocksdb::ReadOptions(), columnFamily(_key), toRocksdbSlice(_key), &_value);
 
   if (s.IsNotFound()) {
     return Status::NotFound("Not found");
@@ -189,6 +275,16 @@ IDBClient::IDBClientIterator *Client::getIterator() const {
   return new ClientIterator(this);
 }
 
+/**
+ * @brief Returns a RocksDBClientIterator object that stops at the end of the
+ * prefix of its last seek.
+ *
+ * @return RocksDBClientIterator object.
+ */
+IDBClient::IDBClientIterator *Client::getPrefixIterator() const {
+  return new ClientIterator(this, true);
+}
+
 /**
  * @brief Frees the RocksDBClientIterator.
  *
@@ -207,14 +303,21 @@ Status Client::freeIterator(IDBClientIterator *_iter) const {
 }
 
 /**
- * @brief Returns an iterator.
+ * @brief Returns an iterator over a column family.
  *
  * Returns a reference to a new object of RocksDbIterator.
  *
  * @return A pointer to RocksDbIterator object.
  */
-::rocksdb::Iterator *Client::getNewRocksDbIterator() const {
-  return m_dbInstance->NewIterator(::rocksdb::ReadOptions());
+::rocksdb::Iterator *Client::getNewRocksDbIterator(size_t family, bool prefixSameAsStart) const {
+  ::rocksdb::ReadOptions readOptions;
+  if (prefixSameAsStart) {
+    readOptions.prefix_same_as_start = true;
+  } else {
+    // not limited by the prefix bloom filters
+    readOptions.total_order_seek = true;
+  }
+  return m_dbInstance->NewIterator(readOptions, m_columnFamilyHandles[family]);
 }
 
 /**
@@ -226,6 +329,18 @@ void Client::monitor() const {
   if (g_rocksdb_print_measurements) {
     LOG_DEBUG(logger, "No. of times read: " << g_rocksdb_called_read);
   }
+
+  for (size_t i = 0; i < m_columnFamilyHandles.size(); i++) {
+    uint64_t keys = 0, sstBytes = 0, memtableBytes = 0, pendingCompactionBytes = 0;
+    m_dbInstance->GetIntProperty(m_columnFamilyHandles[i], "rocksdb.estimate-num-keys", &keys);
+    m_dbInstance->GetIntProperty(m_columnFamilyHandles[i], "rocksdb.total-sst-files-size", &sstBytes);
+    m_dbInstance->GetIntProperty(m_columnFamilyHandles[i], "rocksdb.cur-size-all-mem-tables", &memtableBytes);
+    m_dbInstance->GetIntProperty(m_columnFamilyHandles[i], "rocksdb.estimate-pending-compaction-bytes",
+                                 &pendingCompactionBytes);
+    LOG_INFO(logger, "Column family " << m_columnFamilyNames[i] << ": ~" << keys << " keys, "
+                                      << sstBytes << " SST bytes, " << memtableBytes << " memtable bytes, "
+                                      << pendingCompactionBytes << " bytes pending compaction");
+  }
 }
 
 /**
@@ -233,11 +348,46 @@ void Client::monitor() const {
  *
  * Calls the getNewRocksDbIterator function.
  */
-ClientIterator::ClientIterator(const Client *_parentClient)
+ClientIterator::ClientIterator(const Client *_parentClient, bool _prefixSameAsStart)
     : logger(concordlogger::Log::getLogger("com.vmware.concord.kvb")),
+      m_iters(_parentClient->numOfColumnFamilies(), nullptr),
+      m_prefixSameAsStart(_prefixSameAsStart),
       m_parentClient(_parentClient),
-      m_status(Status::OK()) {
-  m_iter = m_parentClient->getNewRocksDbIterator();
+      m_status(Status::OK()) {}
+
+ClientIterator::~ClientIterator() {
+  for (auto iter : m_iters) {
+    delete iter;
+  }
+}
+
+::rocksdb::Iterator *ClientIterator::iterator(size_t _family) {
+  if (!m_iters[_family]) {
+    m_iters[_family] = m_parentClient->getNewRocksDbIterator(_family, m_prefixSameAsStart);
+  }
+  return m_iters[_family];
+}
+
+void ClientIterator::skipEmptyFamilies(bool _backward) {
+  while (!iterator(m_family)->Valid()) {
+    if (_backward) {
+      if (m_family == 0) return;
+      iterator(--m_family)->SeekToLast();
+    } else {
+      if (m_family + 1 == m_iters.size()) return;
+      iterator(++m_family)->SeekToFirst();
+    }
+  }
+}
+
+// We have to copy the data out of the iterator, so that we own it. The
+// pointers from the iterator will become invalid if the iterator is moved.
+KeyValuePair ClientIterator::currentKeyValue() {
+  Sliver key = copyRocksdbSlice(iterator(m_family)->key());
+  Sliver value = copyRocksdbSlice(iterator(m_family)->value());
+
+  m_status = Status::OK();
+  return KeyValuePair(key, value);
 }
 
 /**
@@ -250,10 +400,10 @@ ClientIterator::ClientIterator(const Client *_parentClient)
  * @return Status GeneralError if error in Put, else Status OK.
  */
 Status Client::put(const Sliver& _key, const Sliver& _value) {
-  ::rocksdb::WriteOptions woptions = ::rocksdb::WriteOptions();
+  ::rocksdb::WriteOptions woptions = writeOptions();
 
   ::rocksdb::Status s =
-      m_dbInstance->Put(woptions, toRocksdbSlice(_key), toRocksdbSlice(_value));
+      m_dbInstance->Put(woptions, columnFamily(_key), toRocksdbSlice(_key), toRocksdbSlice(_value));
 
   LOG_TRACE(logger, "Rocksdb Put " << _key << " : " << _value);
 
@@ -276,8 +426,8 @@ Status Client::put(const Sliver& _key, const Sliver& _value) {
  *  @return Status GeneralError if error in delete, else Status OK.
  */
 Status Client::del(const Sliver& _key) {
-  ::rocksdb::WriteOptions woptions = ::rocksdb::WriteOptions();
-  ::rocksdb::Status s = m_dbInstance->Delete(woptions, toRocksdbSlice(_key));
+  ::rocksdb::WriteOptions woptions = writeOptions();
+  ::rocksdb::Status s = m_dbInstance->Delete(woptions, columnFamily(_key), toRocksdbSlice(_key));
 
   LOG_TRACE(logger, "Rocksdb delete " << _key);
 
@@ -291,32 +441,111 @@ Status Client::del(const Sliver& _key) {
 
 Status Client::multiGet(const KeysVector &_keysVec,
                                OUT ValuesVector &_valuesVec) {
-  std::vector<std::string> values;
-  std::vector<::rocksdb::Slice> keys;
-  for (auto const &it : _keysVec) keys.push_back(toRocksdbSlice(it));
-
-  std::vector<::rocksdb::Status> statuses =
-      m_dbInstance->MultiGet(::rocksdb::ReadOptions(), keys, &values);
+  ValuesVector values;
+  std::vector<Status> statuses;
+  Status s = multiGet(_keysVec, values, statuses);
+  if (!s.isOK()) return s;
 
   for (size_t i = 0; i < values.size(); i++) {
-    if (statuses[i].IsNotFound()) return Status::NotFound("Not found");
+    if (statuses[i].isNotFound()) return statuses[i];
+    _valuesVec.push_back(values[i]);
+  }
+  return Status::OK();
+}
 
+/**
+ * @brief Reads a batch of keys into pinned RocksDB buffers.
+ *
+ * The values of the batch share the ownership of its buffers, so that no value
+ * is copied. RocksDB before 6.4 has no batched MultiGet with PinnableSlice:
+ * the keys are then read one by one, still without copies.
+ *
+ * @param _keysVec Keys to read.
+ * @param _valuesVec Values of the keys, empty for the missing keys.
+ * @param _statusesVec Statuses of the reads of the keys.
+ * @return Status GeneralError if a read failed, else OK.
+ */
+Status Client::multiGet(const KeysVector &_keysVec,
+                               OUT ValuesVector &_valuesVec,
+                               OUT std::vector<Status> &_statusesVec) {
+  size_t numOfKeys = _keysVec.size();
+  std::vector<::rocksdb::Slice> keys;
+  keys.reserve(numOfKeys);
+  std::vector<::rocksdb::ColumnFamilyHandle *> families;
+  families.reserve(numOfKeys);
+  for (auto const &it : _keysVec) {
+    keys.push_back(toRocksdbSlice(it));
+    families.push_back(columnFamily(it));
+  }
+  auto pinned = std::make_shared<std::vector<::rocksdb::PinnableSlice>>(numOfKeys);
+  std::vector<::rocksdb::Status> statuses(numOfKeys);
+
+  m_dbInstance->MultiGet(::rocksdb::ReadOptions(), numOfKeys, families.data(),
+                         keys.data(), pinned->data(), statuses.data());
+
+  Status ret = Status::OK();
+  _valuesVec.assign(numOfKeys, Sliver());
+  _statusesVec.assign(numOfKeys, Status::OK());
+  for (size_t i = 0; i < numOfKeys; i++) {
+    if (statuses[i].IsNotFound()) {
+      _statusesVec[i] = Status::NotFound("Not found");
+      continue;
+    }
     if (!statuses[i].ok()) {
       LOG_WARN(logger, "Failed to get key " << _keysVec[i] << " due to "
                                                   << statuses[i].ToString());
-      return Status::GeneralError("Failed to read key");
+      _statusesVec[i] = Status::GeneralError("Failed to read key");
+      if (ret.isOK()) ret = _statusesVec[i];
+      continue;
+    }
+    const ::rocksdb::PinnableSlice &value = (*pinned)[i];
+    if (value.size() > 0) {
+      // aliases the value while owning the batch
+      std::shared_ptr<uint8_t> data(pinned, reinterpret_cast<uint8_t *>(const_cast<char *>(value.data())));
+      _valuesVec[i] = Sliver(data, value.size());
     }
-    size_t valueSize = values[i].size();
-    auto valueStr = new uint8_t[valueSize];
-    memcpy(valueStr, values[i].data(), valueSize);
-    _valuesVec.push_back(Sliver(valueStr, valueSize));
+  }
+  return ret;
+}
+
+/**
+ * @brief Returns the options of a write, which syncs the write ahead log if it
+ * is the syncInterval-th one since the last sync.
+ */
+::rocksdb::WriteOptions Client::writeOptions() {
+  ::rocksdb::WriteOptions options;
+  if (m_writePolicy.syncInterval > 0) {
+    options.sync = (m_numOfWrites.fetch_add(1, std::memory_order_relaxed) + 1) % m_writePolicy.syncInterval == 0;
+    if (options.sync) m_numOfSyncedWrites.fetch_add(1, std::memory_order_relaxed);
+  }
+  return options;
+}
+
+/**
+ * @brief Makes a secondary instance see the writes of the primary.
+ *
+ * The secondary replays the log of the primary since the last catch-up, and
+ * picks up the table files of its flushes and compactions. The iterators
+ * created before keep the view they had.
+ *
+ * @return Status IllegalOperation if the client is not a secondary instance,
+ *         GeneralError if the catch-up failed, else OK.
+ */
+Status Client::tryCatchUpWithPrimary() {
+  if (!isSecondary()) {
+    return Status::IllegalOperation("Not a secondary instance");
+  }
+  ::rocksdb::Status s = m_dbInstance->TryCatchUpWithPrimary();
+  if (!s.ok()) {
+    LOG_WARN(logger, "Failed to catch up with the primary at " << m_dbPath << " due to " << s.ToString());
+    return Status::GeneralError("Failed to catch up with the primary");
   }
   return Status::OK();
 }
 
 Status Client::launchBatchJob(::rocksdb::WriteBatch &batch) {
   LOG_DEBUG(logger, "launcBatchJob: batch data size=" << batch.GetDataSize() << " num updates=" << batch.Count());
-  ::rocksdb::WriteOptions wOptions = ::rocksdb::WriteOptions();
+  ::rocksdb::WriteOptions wOptions = writeOptions();
   ::rocksdb::Status status = m_dbInstance->Write(wOptions, &batch);
   if (!status.ok()) {
     LOG_ERROR(logger, "Execution of batch job failed; batch data size=" << batch.GetDataSize() <<
@@ -332,7 +561,7 @@ Status Client::multiPut(const SetOfKeyValuePairs &keyValueMap) {
   ::rocksdb::WriteBatch batch;
   LOG_DEBUG(logger, "multiPut: keyValueMap.size() = " << keyValueMap.size());
   for (const auto &it : keyValueMap) {
-    batch.Put(toRocksdbSlice(it.first), toRocksdbSlice(it.second));
+    batch.Put(columnFamily(it.first), toRocksdbSlice(it.first), toRocksdbSlice(it.second));
     LOG_TRACE(logger, "RocksDB Added entry: key ="
                                 << it.first << ", value= " << it.second
                                 << " to the batch job");
@@ -343,17 +572,177 @@ Status Client::multiPut(const SetOfKeyValuePairs &keyValueMap) {
   return status;
 }
 
+void WriteBatch::put(const Sliver& _key, const Sliver& _value) {
+  m_batch.Put(m_client->columnFamily(_key), toRocksdbSlice(_key), toRocksdbSlice(_value));
+}
+
+void WriteBatch::del(const Sliver& _key) {
+  m_batch.Delete(m_client->columnFamily(_key), toRocksdbSlice(_key));
+}
+
+std::unique_ptr<IDBClient::IWriteBatch> Client::newWriteBatch() const {
+  return std::unique_ptr<IWriteBatch>(new WriteBatch(this));
+}
+
+/**
+ * @brief Writes a batch as it is encoded, without copying it.
+ *
+ * @param _batch A batch of this client.
+ * @return Status GeneralError if the write failed, else OK.
+ */
+Status Client::write(IWriteBatch &_batch) {
+  return launchBatchJob(static_cast<WriteBatch &>(_batch).m_batch);
+}
+
 Status Client::multiDel(const KeysVector &_keysVec) {
   ::rocksdb::WriteBatch batch;
   std::ostringstream keys;
   for (auto const &it : _keysVec) {
-    batch.Delete(toRocksdbSlice(it));
+    batch.Delete(columnFamily(it), toRocksdbSlice(it));
   }
   Status status = launchBatchJob(batch);
   if (status.isOK()) LOG_DEBUG(logger, "Successfully deleted entries");
   return status;
 }
 
+/**
+ * @brief Deletes a range of keys with a range tombstone.
+ *
+ * The keys are dropped by the compactions, rather than deleted one by one.
+ *
+ * @param _beginKey First key of the range.
+ * @param _endKey Key following the range.
+ * @return Status GeneralError if error in DeleteRange, else Status OK.
+ */
+Status Client::rangeDel(const Sliver& _beginKey, const Sliver& _endKey) {
+  ::rocksdb::Status s = m_dbInstance->DeleteRange(writeOptions(), columnFamily(_beginKey),
+                                                  toRocksdbSlice(_beginKey), toRocksdbSlice(_endKey));
+  LOG_TRACE(logger, "Rocksdb delete range " << _beginKey << " - " << _endKey);
+
+  if (!s.ok()) {
+    LOG_ERROR(logger, "Failed to delete range " << _beginKey << " - " << _endKey << " due to " << s.ToString());
+    return Status::GeneralError("Failed to delete range");
+  }
+
+  return Status::OK();
+}
+
+/**
+ * @brief Creates a checkpoint of the database.
+ *
+ * The memtables are flushed, then the table files are hard-linked in the
+ * checkpoint directory, and the other files copied.
+ *
+ * @param _path Directory of the checkpoint, which must not exist.
+ * @return Status GeneralError if error in CreateCheckpoint, else Status OK.
+ */
+Status Client::createCheckpoint(const std::string &_path) const {
+  ::rocksdb::Checkpoint *checkpoint = nullptr;
+  ::rocksdb::Status s = ::rocksdb::Checkpoint::Create(m_dbInstance.get(), &checkpoint);
+  if (s.ok()) {
+    s = checkpoint->CreateCheckpoint(_path);
+    delete checkpoint;
+  }
+
+  if (!s.ok()) {
+    LOG_ERROR(logger, "Failed to create checkpoint " << _path << " due to " << s.ToString());
+    return Status::GeneralError("Failed to create checkpoint");
+  }
+
+  LOG_INFO(logger, "Created checkpoint " << _path);
+  return Status::OK();
+}
+
+/**
+ * @brief Deletes a checkpoint of the database.
+ *
+ * @param _path Directory of the checkpoint.
+ * @return Status GeneralError if error in DestroyDB, else Status OK.
+ */
+Status Client::deleteCheckpoint(const std::string &_path) const {
+  ::rocksdb::Status s = ::rocksdb::DestroyDB(_path, ::rocksdb::Options());
+  if (!s.ok()) {
+    LOG_ERROR(logger, "Failed to delete checkpoint " << _path << " due to " << s.ToString());
+    return Status::GeneralError("Failed to delete checkpoint");
+  }
+
+  return Status::OK();
+}
+
+/**
+ * @brief Loads a checkpoint in the database.
+ *
+ * The checkpoint is opened read-only, with the comparator and the column
+ * families of the database. The keys of each column family are written in
+ * order in a table file, which the column family ingests by moving it.
+ *
+ * @param _path Directory of the checkpoint.
+ * @return Status IllegalOperation if the database is read-only or not empty,
+ *         InvalidArgument if the checkpoint can't be opened or has other
+ *         column families, GeneralError if error in writing or ingesting the
+ *         files, which leaves the database partly loaded, else Status OK.
+ */
+Status Client::ingestCheckpoint(const std::string &_path) {
+  if (!txn_db_) {
+    return Status::IllegalOperation("Can't ingest a checkpoint in RO mode");
+  }
+  for (size_t i = 0; i < m_columnFamilyHandles.size(); i++) {
+    std::unique_ptr<::rocksdb::Iterator> it(getNewRocksDbIterator(i));
+    it->SeekToFirst();
+    if (it->Valid()) {
+      return Status::IllegalOperation("Can't ingest a checkpoint in a database that is not empty");
+    }
+  }
+
+  Client checkpoint(_path, m_comparator, nullptr, m_columnFamilies);
+  checkpoint.m_prefixExtractor = m_prefixExtractor;
+  try {
+    checkpoint.init(true);
+  } catch (std::exception &e) {
+    LOG_ERROR(logger, "Failed to open checkpoint " << _path << " due to " << e.what());
+    return Status::InvalidArgument("Failed to open checkpoint");
+  }
+  if (checkpoint.m_columnFamilyNames != m_columnFamilyNames) {
+    LOG_ERROR(logger, "Checkpoint " << _path << " has other column families than " << m_dbPath);
+    return Status::InvalidArgument("Checkpoint has other column families");
+  }
+
+  for (size_t i = 0; i < m_columnFamilyHandles.size(); i++) {
+    std::unique_ptr<::rocksdb::Iterator> it(checkpoint.getNewRocksDbIterator(i));
+    it->SeekToFirst();
+    if (!it->Valid()) {
+      // a table file can't be empty
+      continue;
+    }
+
+    const std::string file = m_dbPath + "/ingest_" + m_columnFamilyNames[i] + ".sst";
+    ::rocksdb::SstFileWriter writer(::rocksdb::EnvOptions(), m_dbInstance->GetOptions(m_columnFamilyHandles[i]),
+                                    m_columnFamilyHandles[i]);
+    ::rocksdb::Status s = writer.Open(file);
+    uint64_t numOfKeys = 0;
+    for (; s.ok() && it->Valid(); it->Next(), numOfKeys++) {
+      s = writer.Put(it->key(), it->value());
+    }
+    if (s.ok()) s = it->status();
+    if (s.ok()) s = writer.Finish();
+    if (s.ok()) {
+      ::rocksdb::IngestExternalFileOptions ingestOptions;
+      ingestOptions.move_files = true;
+      s = m_dbInstance->IngestExternalFile(m_columnFamilyHandles[i], {file}, ingestOptions);
+    }
+
+    if (!s.ok()) {
+      LOG_ERROR(logger, "Failed to ingest column family " << m_columnFamilyNames[i] << " of checkpoint " << _path
+                                                          << " due to " << s.ToString());
+      return Status::GeneralError("Failed to ingest checkpoint");
+    }
+    LOG_INFO(logger, "Ingested " << numOfKeys << " keys of column family " << m_columnFamilyNames[i]
+                                 << " from checkpoint " << _path);
+  }
+
+  return Status::OK();
+}
+
 /**
  * @brief Returns the KeyValuePair object of the first key in the database.
  *
@@ -366,19 +755,17 @@ KeyValuePair ClientIterator::first() {
   }
 
   // Position at the first key in the database
-  m_iter->SeekToFirst();
+  m_family = 0;
+  iterator(m_family)->SeekToFirst();
+  skipEmptyFamilies(false);
 
-  if (!m_iter->Valid()) {
+  if (isEnd()) {
     LOG_ERROR(logger, "Did not find a first key");
     m_status = Status::NotFound("Empty database");
     return KeyValuePair();
   }
 
-  Sliver key = copyRocksdbSlice(m_iter->key());
-  Sliver value = copyRocksdbSlice(m_iter->value());
-
-  m_status = Status::OK();
-  return KeyValuePair(key, value);
+  return currentKeyValue();
 }
 
 /**
@@ -399,20 +786,18 @@ KeyValuePair ClientIterator::seekAtLeast(const Sliver& _searchKey) {
                                                << ", key " << _searchKey);
   }
 
-  m_iter->Seek(toRocksdbSlice(_searchKey));
-  if (!m_iter->Valid()) {
+  m_family = m_parentClient->columnFamilyIndex(_searchKey);
+  iterator(m_family)->Seek(toRocksdbSlice(_searchKey));
+  if (!m_prefixSameAsStart) {
+    skipEmptyFamilies(false);
+  }
+  if (isEnd()) {
     LOG_WARN(logger, "Did not find search key " << _searchKey);
     // TODO(SG): Status to exception?
     return KeyValuePair();
   }
 
-  // We have to copy the data out of the iterator, so that we own it. The
-  // pointers from the iterator will become invalid if the iterator is moved.
-  Sliver key = copyRocksdbSlice(m_iter->key());
-  Sliver value = copyRocksdbSlice(m_iter->value());
-
-  m_status = Status::OK();
-  return KeyValuePair(key, value);
+  return currentKeyValue();
 }
 
 /**
@@ -423,19 +808,17 @@ KeyValuePair ClientIterator::seekAtLeast(const Sliver& _searchKey) {
  * @return The previous key value pair.
  */
 KeyValuePair ClientIterator::previous() {
-  m_iter->Prev();
+  iterator(m_family)->Prev();
+  if (!m_prefixSameAsStart) {
+    skipEmptyFamilies(true);
+  }
 
-  if (!m_iter->Valid()) {
+  if (isEnd()) {
     LOG_ERROR(logger, "Iterator out of bounds");
     return KeyValuePair();
   }
 
-  Sliver key = copyRocksdbSlice(m_iter->key());
-  Sliver value = copyRocksdbSlice(m_iter->value());
-
-  m_status = Status::OK();
-
-  return KeyValuePair(key, value);
+  return currentKeyValue();
 }
 
 /**
@@ -451,18 +834,17 @@ KeyValuePair ClientIterator::next() {
     LOG_DEBUG(logger, "Reading count = " << g_rocksdb_called_read);
   }
 
-  m_iter->Next();
-  if (!m_iter->Valid()) {
+  iterator(m_family)->Next();
+  if (!m_prefixSameAsStart) {
+    skipEmptyFamilies(false);
+  }
+  if (isEnd()) {
     LOG_ERROR(logger, "No next key");
     m_status = Status::GeneralError("No next key");
     return KeyValuePair();
   }
 
-  Sliver key = copyRocksdbSlice(m_iter->key());
-  Sliver value = copyRocksdbSlice(m_iter->value());
-
-  m_status = Status::OK();
-  return KeyValuePair(key, value);
+  return currentKeyValue();
 }
 
 /**
@@ -471,17 +853,13 @@ KeyValuePair ClientIterator::next() {
  * @return Current key value pair.
  */
 KeyValuePair ClientIterator::getCurrent() {
-  if (!m_iter->Valid()) {
+  if (isEnd()) {
     LOG_ERROR(logger, "Iterator is not pointing at an element");
     m_status = Status::GeneralError("Iterator is not pointing at an element");
     return KeyValuePair();
   }
 
-  Sliver key = copyRocksdbSlice(m_iter->key());
-  Sliver value = copyRocksdbSlice(m_iter->value());
-
-  m_status = Status::OK();
-  return KeyValuePair(key, value);
+  return currentKeyValue();
 }
 
 /**
@@ -490,7 +868,7 @@ KeyValuePair ClientIterator::getCurrent() {
  *
  * @return True if iterator is beyond the bounds, else False.
  */
-bool ClientIterator::isEnd() { return !m_iter->Valid(); }
+bool ClientIterator::isEnd() { return !iterator(m_family)->Valid(); }
 
 /**
  * @brief Returns the Status.
@@ -1,6 +1,6 @@
 // Copyright 2018 VMware, all rights reserved
 //
-// Storage key comparators implementation.
+// Storage key comparators, prefix extractor and column families implementation.
 
 #ifdef USE_ROCKSDB
 
@@ -10,8 +10,11 @@
 #include "hex_tools.h"
 #include "sliver.hpp"
 #include "rocksdb/client.h"
+#include "blockchain/db_types.h"
 
 #include <chrono>
+#include <rocksdb/filter_policy.h>
+#include <rocksdb/table.h>
 
 using concordUtils::Sliver;
 using concordlogger::Logger;
@@ -32,6 +35,92 @@ int KeyComparator::Compare(const ::rocksdb::Slice& _a,
   return ret;
 }
 
+using concord::storage::blockchain::EDBKeyType;
+
+// The escaped key ends at the first 0x00 not followed by the 0xFF escape.
+size_t KeyPrefixExtractor::prefixLength(const ::rocksdb::Slice& _key) {
+  if (_key.empty() || _key[0] != static_cast<char>(EDBKeyType::E_DB_KEY_TYPE_KEY)) {
+    return 0;
+  }
+  for (size_t i = sizeof(EDBKeyType); i + 1 < _key.size(); ++i) {
+    if (_key[i] == 0) {
+      if (_key[i + 1] == 1) {
+        return i + 2;
+      }
+      ++i;  // skip the escape
+    }
+  }
+  return 0;
+}
+
+::rocksdb::Slice KeyPrefixExtractor::Transform(const ::rocksdb::Slice& _key) const {
+  return ::rocksdb::Slice(_key.data(), prefixLength(_key));
+}
+
+bool KeyPrefixExtractor::InDomain(const ::rocksdb::Slice& _key) const {
+  return prefixLength(_key) > 0;
+}
+
+namespace {
+
+ColumnFamily columnFamily(const std::string& name, EDBKeyType firstKeyType, size_t blockSize, bool bloomFilter) {
+  ColumnFamily family;
+  family.name = name;
+  family.firstKeyByte = static_cast<uint8_t>(firstKeyType);
+  ::rocksdb::BlockBasedTableOptions tableOptions;
+  tableOptions.block_size = blockSize;
+  if (bloomFilter) {
+    tableOptions.filter_policy.reset(::rocksdb::NewBloomFilterPolicy(10, false));
+  }
+  family.options.table_factory.reset(::rocksdb::NewBlockBasedTableFactory(tableOptions));
+  return family;
+}
+
+}  // namespace
+
+std::vector<ColumnFamily> blockchainColumnFamilies(blockchain::KeyLayout layout) {
+  std::vector<ColumnFamily> families;
+
+  // nothing is stored below the first key type
+  ColumnFamily other;
+  other.name = ::rocksdb::kDefaultColumnFamilyName;
+  other.firstKeyByte = 0;
+  families.push_back(other);
+
+  // Blocks are written once and read whole, mostly by state transfer: large
+  // blocks of the table compress well, and large memtables keep the number of
+  // files down. The bloom filter serves the lookups of missing blocks.
+  ColumnFamily blocks = columnFamily("blocks", EDBKeyType::E_DB_KEY_TYPE_BLOCK, 64 * 1024, true);
+  blocks.options.write_buffer_size = 128 << 20;
+  blocks.options.compression = ::rocksdb::kLZ4Compression;
+  blocks.options.bottommost_compression = ::rocksdb::kZSTD;
+  families.push_back(blocks);
+
+  ColumnFamily keys = columnFamily("keys", EDBKeyType::E_DB_KEY_TYPE_KEY, 4 * 1024, true);
+  keys.options.write_buffer_size = 64 << 20;
+  keys.options.compression = ::rocksdb::kLZ4Compression;
+  if (layout == blockchain::KeyLayout::Bytewise) {
+    keys.options.prefix_extractor.reset(new KeyPrefixExtractor());
+    keys.options.memtable_prefix_bloom_size_ratio = 0.1;
+  }
+  families.push_back(keys);
+
+  // A few small objects, rewritten at each consensus step: kept uncompressed,
+  // in small memtables flushed early.
+  ColumnFamily metadata = columnFamily("bft_metadata", EDBKeyType::E_DB_KEY_TYPE_BFT_METADATA_KEY, 4 * 1024, true);
+  metadata.options.write_buffer_size = 4 << 20;
+  metadata.options.compression = ::rocksdb::kNoCompression;
+  families.push_back(metadata);
+
+  ColumnFamily latestVersions =
+      columnFamily("latest_versions", EDBKeyType::E_DB_KEY_TYPE_LATEST_VERSION_KEY, 4 * 1024, true);
+  latestVersions.options.write_buffer_size = 64 << 20;
+  latestVersions.options.compression = ::rocksdb::kLZ4Compression;
+  families.push_back(latestVersions);
+
+  return families;
+}
+
 }
 }
 }
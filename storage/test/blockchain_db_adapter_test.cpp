@@ -0,0 +1,864 @@
+// Copyright 2019 VMware, all rights reserved
+/**
+ * Test the key layouts, the last reachable block tracking, the latest version
+ * index and the pruning of DBAdapter, over the in-memory client.
+ */
+
+#include "gtest/gtest.h"
+#include "hash_defs.h"
+#include "memorydb/client.h"
+#include "memorydb/concurrent_client.h"
+#include "memorydb/key_comparator.h"
+#include "blockchain/db_adapter.h"
+#include "blockchain/block_compressor.h"
+#include "blockchain/block_pruner.h"
+#include "blockchain/read_only_storage.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using concordUtils::KeyValuePair;
+using concordUtils::Sliver;
+using concordUtils::Status;
+using concordUtils::SetOfKeyValuePairs;
+using concordUtils::KeysVector;
+using concordUtils::ValuesVector;
+using concord::storage::memorydb::Client;
+using concord::storage::memorydb::ConcurrentClient;
+using concord::storage::memorydb::KeyComparator;
+using concord::storage::blockchain::BlockCache;
+using concord::storage::blockchain::BlockCacheConfig;
+using concord::storage::blockchain::BlockCompression;
+using concord::storage::blockchain::BlockCompressionConfig;
+using concord::storage::blockchain::BlockCompressor;
+using concord::storage::blockchain::BlockEntry;
+using concord::storage::blockchain::BlockHeader;
+using concord::storage::blockchain::BlockId;
+using concord::storage::blockchain::BlockPruner;
+using concord::storage::blockchain::BlockView;
+using concord::storage::blockchain::DBAdapter;
+using concord::storage::blockchain::EDBKeyType;
+using concord::storage::blockchain::KeyLayout;
+using concord::storage::blockchain::KeyManipulator;
+using concord::storage::blockchain::LatestValueCacheConfig;
+using concord::storage::blockchain::migrateKeyLayout;
+using concord::storage::blockchain::PruningConfig;
+using concord::storage::blockchain::ReadOnlyStorage;
+using concord::storage::blockchain::ReadOnlyStorageConfig;
+using concord::storage::blockchain::ILocalKeyValueStorageReadOnlyIterator;
+
+namespace {
+
+Client *newClient(KeyLayout layout = KeyLayout::Composed) {
+  return new Client(KeyComparator(new KeyManipulator(layout)));
+}
+
+// Sliver(std::string) doesn't own the string: the tests use copies.
+Sliver sliverOf(std::string s) {
+  return Sliver::copy(&s[0], s.length());
+}
+
+// A block without key-values, told apart by its id after the header.
+Sliver blockData(BlockId blockId) {
+  return sliverOf(std::string(sizeof(BlockHeader), '\0') + std::to_string(blockId));
+}
+
+// A block of key-values, laid out as the replicas do.
+Sliver blockOf(const SetOfKeyValuePairs &updates) {
+  std::string block(sizeof(BlockHeader) + updates.size() * sizeof(BlockEntry), '\0');
+  reinterpret_cast<BlockHeader *>(&block[0])->numberOfElements = updates.size();
+  size_t i = 0;
+  for (const auto &kv : updates) {
+    BlockEntry entry;
+    entry.keyOffset = block.size();
+    entry.keySize = kv.first.length();
+    block.append((const char *)kv.first.data(), kv.first.length());
+    entry.valOffset = block.size();
+    entry.valSize = kv.second.length();
+    block.append((const char *)kv.second.data(), kv.second.length());
+    memcpy(&block[sizeof(BlockHeader) + i++ * sizeof(BlockEntry)], &entry, sizeof(entry));
+  }
+  return sliverOf(block);
+}
+
+// An adapter over a copy of the database of another, as if it was reopened.
+DBAdapter *reopen(DBAdapter &adapter) {
+  Client *client = newClient();
+  client->getMap() = static_cast<Client *>(adapter.getDb().get())->getMap();
+  return new DBAdapter(client);
+}
+
+TEST(blockchain_db_adapter_test, appended_blocks_are_reachable) {
+  DBAdapter adapter(newClient());
+  ASSERT_EQ(0, adapter.getLastReachableBlock());
+  for (BlockId i = 1; i <= 10; ++i) {
+    ASSERT_TRUE(adapter.addBlock(i, blockData(i)).isOK());
+    ASSERT_EQ(i, adapter.getLastReachableBlock());
+  }
+  ASSERT_EQ(10, adapter.getLatestBlock());
+  std::unique_ptr<DBAdapter> reopened(reopen(adapter));
+  ASSERT_EQ(10, reopened->getLastReachableBlock());
+}
+
+TEST(blockchain_db_adapter_test, gap_closes_when_state_transfer_fills_it) {
+  DBAdapter adapter(newClient());
+  for (BlockId i = 1; i <= 5; ++i) {
+    ASSERT_TRUE(adapter.addBlock(i, blockData(i)).isOK());
+  }
+  // state transfer adds blocks in reverse order
+  for (BlockId i = 20; i > 6; --i) {
+    ASSERT_TRUE(adapter.addBlock(i, blockData(i)).isOK());
+    ASSERT_EQ(5, adapter.getLastReachableBlock());
+  }
+  ASSERT_EQ(20, adapter.getLatestBlock());
+  ASSERT_TRUE(adapter.addBlock(6, blockData(6)).isOK());
+  ASSERT_EQ(20, adapter.getLastReachableBlock());
+
+  std::unique_ptr<DBAdapter> reopened(reopen(adapter));
+  ASSERT_EQ(20, reopened->getLastReachableBlock());
+}
+
+TEST(blockchain_db_adapter_test, deleted_block_lowers_last_reachable) {
+  DBAdapter adapter(newClient());
+  for (BlockId i = 1; i <= 10; ++i) {
+    ASSERT_TRUE(adapter.addBlock(i, blockData(i)).isOK());
+  }
+  adapter.deleteBlockAndItsKeys(10);
+  ASSERT_EQ(9, adapter.getLastReachableBlock());
+  ASSERT_TRUE(adapter.delBlock(5).isOK());
+  ASSERT_EQ(4, adapter.getLastReachableBlock());
+
+  std::unique_ptr<DBAdapter> reopened(reopen(adapter));
+  ASSERT_EQ(4, reopened->getLastReachableBlock());
+}
+
+TEST(blockchain_db_adapter_test, database_without_marker_is_scanned) {
+  DBAdapter adapter(newClient());
+  for (BlockId i = 1; i <= 10; ++i) {
+    ASSERT_TRUE(adapter.addBlock(i, blockData(i)).isOK());
+  }
+  ASSERT_TRUE(adapter.addBlock(12, blockData(12)).isOK());
+  // as written before the marker was kept
+  ASSERT_TRUE(adapter.getDb()->del(KeyManipulator::generateMetadataKey(0xFFFFFFFF)).isOK());
+
+  std::unique_ptr<DBAdapter> reopened(reopen(adapter));
+  ASSERT_EQ(10, reopened->getLastReachableBlock());
+  ASSERT_TRUE(reopened->addBlock(11, blockData(11)).isOK());
+  ASSERT_EQ(12, reopened->getLastReachableBlock());
+}
+
+// Blocks 1..10 each update "key<i % 3>" and "common"; "odd" is updated by the
+// odd blocks only.
+void addVersionedBlocks(DBAdapter &adapter) {
+  for (BlockId i = 1; i <= 10; ++i) {
+    SetOfKeyValuePairs updates;
+    updates[sliverOf(std::string("key") + std::to_string(i % 3))] = sliverOf(std::to_string(i));
+    updates[sliverOf("common")] = sliverOf(std::to_string(i));
+    if (i % 2) {
+      updates[sliverOf("odd")] = sliverOf(std::to_string(i));
+    }
+    ASSERT_TRUE(adapter.addBlockAndUpdateMultiKey(updates, i, blockOf(updates)).isOK());
+  }
+}
+
+// The version of 'key' visible at 'version', as "<block>:<value>".
+std::string readAt(const DBAdapter &adapter, const std::string &key, BlockId version) {
+  Sliver value;
+  BlockId block = 0;
+  EXPECT_TRUE(adapter.getKeyByReadVersion(version, sliverOf(key), value, block).isOK());
+  return std::to_string(block) + ":" + std::string((const char *)value.data(), value.length());
+}
+
+TEST(blockchain_db_adapter_test, reads_latest_and_older_versions) {
+  DBAdapter adapter(newClient());
+  addVersionedBlocks(adapter);
+  ASSERT_EQ("10:10", readAt(adapter, "common", 10));
+  ASSERT_EQ("10:10", readAt(adapter, "common", 100));
+  ASSERT_EQ("4:4", readAt(adapter, "common", 4));
+  ASSERT_EQ("9:9", readAt(adapter, "odd", 10));
+  ASSERT_EQ("7:7", readAt(adapter, "odd", 8));
+  ASSERT_EQ("0:", readAt(adapter, "key0", 2));
+  ASSERT_EQ("9:9", readAt(adapter, "key0", 9));
+  ASSERT_EQ("0:", readAt(adapter, "never written", 10));
+
+  // state transfer writes older versions after newer ones
+  ASSERT_TRUE(adapter.updateKey(sliverOf("odd"), 8, sliverOf("8")).isOK());
+  ASSERT_TRUE(adapter.updateKey(sliverOf("late"), 3, sliverOf("3")).isOK());
+  ASSERT_EQ("9:9", readAt(adapter, "odd", 10));
+  ASSERT_EQ("8:8", readAt(adapter, "odd", 8));
+  ASSERT_EQ("3:3", readAt(adapter, "late", 10));
+  ASSERT_EQ("0:", readAt(adapter, "late", 2));
+}
+
+TEST(blockchain_db_adapter_test, deleted_versions_fall_back_to_older_ones) {
+  DBAdapter adapter(newClient());
+  addVersionedBlocks(adapter);
+  adapter.deleteBlockAndItsKeys(10);
+  ASSERT_EQ("9:9", readAt(adapter, "common", 10));
+  ASSERT_EQ("7:7", readAt(adapter, "key1", 10));
+  ASSERT_TRUE(adapter.delKey(sliverOf("odd"), 9).isOK());
+  ASSERT_EQ("7:7", readAt(adapter, "odd", 10));
+  for (BlockId i = 1; i <= 7; i += 2) {
+    ASSERT_TRUE(adapter.delKey(sliverOf("odd"), i).isOK());
+  }
+  ASSERT_EQ("0:", readAt(adapter, "odd", 10));
+
+  // the index was updated with the deletions, and refers to the versions
+  Sliver marker, entry;
+  ASSERT_TRUE(adapter.getDb()->get(KeyManipulator::generateMetadataKey(0xFFFFFFFE), marker).isOK());
+  ASSERT_TRUE(adapter.getDb()->get(
+      KeyManipulator().genDbKey(EDBKeyType::E_DB_KEY_TYPE_LATEST_VERSION_KEY, sliverOf("common"), 0), entry).isOK());
+  ASSERT_EQ(sizeof(BlockId), entry.length());
+  ASSERT_TRUE(adapter.getDb()->get(
+      KeyManipulator().genDbKey(EDBKeyType::E_DB_KEY_TYPE_LATEST_VERSION_KEY, sliverOf("odd"), 0), entry)
+      .isNotFound());
+
+  std::unique_ptr<DBAdapter> reopened(reopen(adapter));
+  ASSERT_EQ("9:9", readAt(*reopened, "common", 10));
+  ASSERT_EQ("0:", readAt(*reopened, "odd", 10));
+}
+
+TEST(blockchain_db_adapter_test, missing_latest_version_index_is_rebuilt) {
+  DBAdapter adapter(newClient());
+  addVersionedBlocks(adapter);
+  // as in a database written before the index, with an entry from an older format
+  ASSERT_TRUE(adapter.getDb()->del(KeyManipulator::generateMetadataKey(0xFFFFFFFE)).isOK());
+  ASSERT_TRUE(adapter.getDb()->put(
+      KeyManipulator().genDbKey(EDBKeyType::E_DB_KEY_TYPE_LATEST_VERSION_KEY, sliverOf("stale"), 0),
+      sliverOf(std::string(sizeof(BlockId), '\1') + "stale")).isOK());
+
+  std::unique_ptr<DBAdapter> reopened(reopen(adapter));
+  ASSERT_EQ("0:", readAt(*reopened, "stale", 10));
+  for (BlockId version = 1; version <= 10; ++version) {
+    for (const auto &key : {"key0", "key1", "key2", "common", "odd"}) {
+      ASSERT_EQ(readAt(adapter, key, version), readAt(*reopened, key, version));
+    }
+  }
+}
+
+TEST(blockchain_db_adapter_test, pruned_blocks_keep_the_later_reads) {
+  DBAdapter adapter(newClient());
+  addVersionedBlocks(adapter);
+  ASSERT_EQ(1, adapter.getFirstBlock());
+  ASSERT_TRUE(adapter.pruneBlocks(6).isOK());
+  ASSERT_EQ(6, adapter.getFirstBlock());
+  ASSERT_EQ(10, adapter.getLastReachableBlock());
+
+  for (BlockId i = 1; i <= 10; ++i) {
+    Sliver block;
+    bool found = false;
+    ASSERT_TRUE(adapter.getBlockById(i, block, found).isOK());
+    ASSERT_EQ(i >= 6, found);
+  }
+  // the versions visible from block 6 on are kept, the older ones are gone
+  ASSERT_EQ("5:5", readAt(adapter, "odd", 6));
+  ASSERT_EQ("0:", readAt(adapter, "odd", 4));
+  ASSERT_EQ("5:5", readAt(adapter, "key2", 7));
+  ASSERT_EQ("0:", readAt(adapter, "key2", 3));
+  ASSERT_EQ("6:6", readAt(adapter, "common", 6));
+  ASSERT_EQ("10:10", readAt(adapter, "common", 10));
+  ASSERT_EQ("9:9", readAt(adapter, "key0", 10));
+
+  // pruning again, or past the last reachable block, stops at it
+  ASSERT_TRUE(adapter.pruneBlocks(6).isOK());
+  ASSERT_TRUE(adapter.pruneBlocks(100).isOK());
+  ASSERT_EQ(10, adapter.getFirstBlock());
+  ASSERT_EQ("9:9", readAt(adapter, "odd", 10));
+
+  std::unique_ptr<DBAdapter> reopened(reopen(adapter));
+  ASSERT_EQ(10, reopened->getFirstBlock());
+  ASSERT_EQ(10, reopened->getLastReachableBlock());
+  ASSERT_EQ("10:10", readAt(*reopened, "common", 10));
+  ASSERT_TRUE(reopened->addBlock(11, blockData(11)).isOK());
+  ASSERT_EQ(11, reopened->getLastReachableBlock());
+}
+
+TEST(blockchain_db_adapter_test, batched_reads_match_single_reads) {
+  for (bool cached : {false, true}) {
+    DBAdapter adapter(newClient());
+    if (cached) {
+      adapter.enableLatestValueCache(LatestValueCacheConfig());
+    }
+    addVersionedBlocks(adapter);
+    ASSERT_TRUE(adapter.updateKey(sliverOf("late"), 3, sliverOf("3")).isOK());
+    KeysVector keys;
+    for (const auto &key : {"odd", "key2", "never written", "common", "late", "key0", "odd"}) {
+      keys.push_back(sliverOf(key));
+    }
+    for (BlockId version = 0; version <= 11; ++version) {
+      ValuesVector values;
+      std::vector<BlockId> blocks;
+      ASSERT_TRUE(adapter.getKeysByReadVersion(version, keys, values, blocks).isOK());
+      ASSERT_EQ(keys.size(), values.size());
+      ASSERT_EQ(keys.size(), blocks.size());
+      for (size_t i = 0; i < keys.size(); ++i) {
+        ASSERT_EQ(readAt(adapter, std::string((const char *)keys[i].data(), keys[i].length()), version),
+                  std::to_string(blocks[i]) + ":" + std::string((const char *)values[i].data(), values[i].length()));
+      }
+    }
+  }
+}
+
+TEST(blockchain_db_adapter_test, block_cache_evicts_least_recently_used) {
+  BlockCacheConfig config;
+  config.numOfShards = 1;
+  const Sliver block = sliverOf(std::string(1000, 'b'));
+  // room for three blocks, with their overhead
+  config.capacityBytes = 3 * 1100;
+  BlockCache cache(config);
+  for (BlockId i = 1; i <= 3; ++i) {
+    cache.put(i, block);
+  }
+  Sliver read;
+  ASSERT_TRUE(cache.get(1, read));
+  ASSERT_EQ(block, read);
+  cache.put(4, block);
+  ASSERT_FALSE(cache.get(2, read));
+  ASSERT_TRUE(cache.get(1, read));
+  ASSERT_TRUE(cache.get(3, read));
+  ASSERT_TRUE(cache.get(4, read));
+  // too large to be cached
+  cache.put(5, sliverOf(std::string(config.capacityBytes, 'b')));
+  ASSERT_FALSE(cache.get(5, read));
+
+  BlockCache::Stats stats = cache.stats();
+  ASSERT_EQ(4, stats.hits);
+  ASSERT_EQ(2, stats.misses);
+  ASSERT_EQ(1, stats.evictions);
+  ASSERT_EQ(3, stats.numOfBlocks);
+  ASSERT_LE(stats.bytes, config.capacityBytes);
+
+  // the totals are counters, the sizes gauges
+  auto aggregator = std::make_shared<concordMetrics::Aggregator>();
+  cache.setAggregator(aggregator);
+  cache.updateMetrics();
+  ASSERT_EQ(4, aggregator->GetCounter("block_cache", "hits").Get());
+  ASSERT_EQ(1, aggregator->GetCounter("block_cache", "evictions").Get());
+  ASSERT_EQ(3, aggregator->GetGauge("block_cache", "blocks").Get());
+
+  cache.eraseBefore(4);
+  ASSERT_EQ(1, cache.stats().numOfBlocks);
+  cache.clear();
+  ASSERT_EQ(0, cache.stats().bytes);
+}
+
+TEST(blockchain_db_adapter_test, block_cache_follows_deletions) {
+  DBAdapter adapter(newClient());
+  adapter.enableBlockCache(BlockCacheConfig());
+  addVersionedBlocks(adapter);
+  for (BlockId i = 1; i <= 10; ++i) {
+    Sliver block;
+    bool found = false;
+    ASSERT_TRUE(adapter.getBlockById(i, block, found).isOK());
+    ASSERT_TRUE(found);
+  }
+  // the added blocks were written through
+  ASSERT_EQ(10, adapter.blockCache()->stats().hits);
+  ASSERT_EQ(0, adapter.blockCache()->stats().misses);
+
+  ASSERT_TRUE(adapter.pruneBlocks(6).isOK());
+  adapter.deleteBlockAndItsKeys(10);
+  ASSERT_TRUE(adapter.delBlock(9).isOK());
+  for (BlockId i = 1; i <= 10; ++i) {
+    Sliver block;
+    bool found = false;
+    ASSERT_TRUE(adapter.getBlockById(i, block, found).isOK());
+    ASSERT_EQ(i >= 6 && i <= 8, found);
+  }
+  ASSERT_EQ(3, adapter.blockCache()->stats().numOfBlocks);
+}
+
+TEST(blockchain_db_adapter_test, latest_value_cache_follows_writes_and_deletions) {
+  DBAdapter adapter(newClient());
+  adapter.enableLatestValueCache(LatestValueCacheConfig());
+  addVersionedBlocks(adapter);
+  // the added versions were written through
+  ASSERT_EQ("10:10", readAt(adapter, "common", 10));
+  ASSERT_EQ("9:9", readAt(adapter, "odd", 10));
+  ASSERT_EQ(2, adapter.latestValueCache()->stats().hits);
+  ASSERT_EQ(0, adapter.latestValueCache()->stats().misses);
+  auto aggregator = std::make_shared<concordMetrics::Aggregator>();
+  adapter.latestValueCache()->setAggregator(aggregator);
+  adapter.latestValueCache()->updateMetrics();
+  ASSERT_EQ(2, aggregator->GetCounter("latest_value_cache", "hits").Get());
+  ASSERT_LT(0, aggregator->GetGauge("latest_value_cache", "keys").Get());
+  // older versions are read from the database
+  ASSERT_EQ("7:7", readAt(adapter, "odd", 8));
+  ASSERT_EQ("0:", readAt(adapter, "never written", 10));
+
+  // state transfer writes older versions after newer ones
+  ASSERT_TRUE(adapter.updateKey(sliverOf("odd"), 8, sliverOf("8")).isOK());
+  ASSERT_TRUE(adapter.updateKey(sliverOf("late"), 3, sliverOf("3")).isOK());
+  ASSERT_EQ("9:9", readAt(adapter, "odd", 10));
+  ASSERT_EQ("3:3", readAt(adapter, "late", 10));
+
+  adapter.deleteBlockAndItsKeys(10);
+  ASSERT_EQ("9:9", readAt(adapter, "common", 10));
+  ASSERT_EQ("7:7", readAt(adapter, "key1", 10));
+  ASSERT_TRUE(adapter.delKey(sliverOf("odd"), 9).isOK());
+  ASSERT_EQ("8:8", readAt(adapter, "odd", 10));
+
+  ASSERT_TRUE(adapter.pruneBlocks(6).isOK());
+  ASSERT_EQ("9:9", readAt(adapter, "common", 9));
+  ASSERT_EQ("8:8", readAt(adapter, "key2", 9));
+  ASSERT_EQ("5:5", readAt(adapter, "key2", 7));
+
+  // the reads are those of an adapter without the cache
+  std::unique_ptr<DBAdapter> reopened(reopen(adapter));
+  for (BlockId version = 6; version <= 10; ++version) {
+    for (const auto &key : {"key0", "key1", "key2", "common", "odd", "late"}) {
+      ASSERT_EQ(readAt(*reopened, key, version), readAt(adapter, key, version));
+    }
+  }
+  ASSERT_GT(adapter.latestValueCache()->stats().hits, 0);
+}
+
+TEST(blockchain_db_adapter_test, pruner_keeps_the_retained_blocks) {
+  DBAdapter adapter(newClient());
+  addVersionedBlocks(adapter);
+  PruningConfig config;
+  config.retainedBlocks = 3;
+  config.blocksPerBatch = 2;
+  config.maxBlocksPerSecond = 1000;
+  BlockPruner pruner(adapter, config);
+  ASSERT_EQ(8, pruner.retentionPoint());
+  ASSERT_TRUE(pruner.pruneToRetentionPoint().isOK());
+  ASSERT_EQ(8, adapter.getFirstBlock());
+  ASSERT_EQ("7:7", readAt(adapter, "odd", 8));
+  ASSERT_EQ("10:10", readAt(adapter, "common", 10));
+
+  config.retainedBlocks = 20;
+  ASSERT_EQ(0, BlockPruner(adapter, config).retentionPoint());
+}
+
+// Counts the iterators not freed yet
+class CountingClient : public Client {
+ public:
+  CountingClient(std::shared_ptr<std::atomic<int>> liveIterators)
+      : Client(KeyComparator(new KeyManipulator())), liveIterators_(liveIterators) {}
+  IDBClientIterator *getIterator() const override {
+    ++*liveIterators_;
+    return Client::getIterator();
+  }
+  Status freeIterator(IDBClientIterator *iter) const override {
+    --*liveIterators_;
+    return Client::freeIterator(iter);
+  }
+
+ private:
+  std::shared_ptr<std::atomic<int>> liveIterators_;
+};
+
+TEST(blockchain_db_adapter_test, lookup_iterators_are_freed_with_their_thread) {
+  auto liveIterators = std::make_shared<std::atomic<int>>(0);
+  std::unique_ptr<DBAdapter> adapter(new DBAdapter(new CountingClient(liveIterators)));
+  addVersionedBlocks(*adapter);
+  ASSERT_EQ(0, *liveIterators);
+
+  // reading an older version seeks with the iterator of the thread
+  for (int i = 0; i < 20; ++i) {
+    std::thread reader([&adapter] { ASSERT_EQ("4:4", readAt(*adapter, "common", 4)); });
+    reader.join();
+    ASSERT_EQ(0, *liveIterators);
+  }
+
+  ASSERT_EQ("4:4", readAt(*adapter, "common", 4));
+  ASSERT_EQ("4:4", readAt(*adapter, "common", 4));
+  ASSERT_EQ(1, *liveIterators);
+  // the iterator of a thread still alive is freed with the adapter
+  adapter.reset();
+  ASSERT_EQ(0, *liveIterators);
+
+  // and the thread uses a new one with the next adapter
+  adapter.reset(new DBAdapter(new CountingClient(liveIterators)));
+  addVersionedBlocks(*adapter);
+  ASSERT_EQ("4:4", readAt(*adapter, "common", 4));
+  ASSERT_EQ(1, *liveIterators);
+  adapter.reset();
+  ASSERT_EQ(0, *liveIterators);
+}
+
+// The pruning thread and the writer share the adapter
+TEST(blockchain_db_adapter_test, pruner_runs_alongside_the_writer) {
+  DBAdapter adapter(new ConcurrentClient(KeyComparator(new KeyManipulator())));
+  PruningConfig config;
+  config.retainedBlocks = 5;
+  config.blocksPerBatch = 3;
+  config.maxBlocksPerSecond = 0;
+  config.intervalMilli = 1;
+  BlockPruner pruner(adapter, config);
+  pruner.start();
+  for (BlockId i = 1; i <= 200; ++i) {
+    SetOfKeyValuePairs updates;
+    updates[sliverOf("key")] = sliverOf(std::to_string(i));
+    ASSERT_TRUE(adapter.addBlockAndUpdateMultiKey(updates, i, blockOf(updates)).isOK());
+  }
+  pruner.stop();
+  ASSERT_TRUE(pruner.pruneToRetentionPoint().isOK());
+  ASSERT_EQ(196, adapter.getFirstBlock());
+  ASSERT_EQ("200:200", readAt(adapter, "key", 200));
+}
+
+// A follower of the database of another client, as a RocksDB secondary
+// instance is: it sees the writes to it as of its last catch-up.
+class FollowerClient : public Client {
+ public:
+  FollowerClient(Client &primary) : Client(KeyComparator(new KeyManipulator())), primary_(primary) {
+    getMap() = primary_.getMap();
+  }
+  Status tryCatchUpWithPrimary() override {
+    getMap() = primary_.getMap();
+    return Status::OK();
+  }
+
+ private:
+  Client &primary_;
+};
+
+TEST(blockchain_db_adapter_test, read_only_storage_follows_the_primary) {
+  DBAdapter primary(newClient());
+  for (BlockId i = 1; i <= 5; ++i) {
+    SetOfKeyValuePairs updates;
+    updates[sliverOf("key")] = sliverOf(std::to_string(i));
+    ASSERT_TRUE(primary.addBlockAndUpdateMultiKey(updates, i, blockOf(updates)).isOK());
+  }
+  DBAdapter follower(new FollowerClient(*static_cast<Client *>(primary.getDb().get())), true);
+  ReadOnlyStorage storage(follower, ReadOnlyStorageConfig());
+  ASSERT_EQ(5, storage.getLastBlock());
+
+  for (BlockId i = 6; i <= 10; ++i) {
+    SetOfKeyValuePairs updates;
+    updates[sliverOf("key")] = sliverOf(std::to_string(i));
+    updates[sliverOf("new")] = sliverOf(std::to_string(i));
+    ASSERT_TRUE(primary.addBlockAndUpdateMultiKey(updates, i, blockOf(updates)).isOK());
+  }
+  // the follower lags until it catches up
+  Sliver value;
+  ASSERT_TRUE(storage.get(sliverOf("key"), value).isOK());
+  ASSERT_EQ(sliverOf("5"), value);
+  ASSERT_TRUE(storage.catchUp().isOK());
+  ASSERT_EQ(10, storage.getLastBlock());
+  ASSERT_TRUE(storage.get(sliverOf("key"), value).isOK());
+  ASSERT_EQ(sliverOf("10"), value);
+  BlockId block = 0;
+  ASSERT_TRUE(storage.get(7, sliverOf("new"), value, block).isOK());
+  ASSERT_EQ(7, block);
+  SetOfKeyValuePairs blockData;
+  ASSERT_TRUE(storage.getBlockData(8, blockData).isOK());
+  ASSERT_EQ(sliverOf("8"), blockData[sliverOf("new")]);
+  ASSERT_TRUE(storage.getBlockData(11, blockData).isNotFound());
+  std::vector<bool> conflicts;
+  ASSERT_TRUE(storage.mayHaveConflictBetween(KeysVector{sliverOf("key"), sliverOf("none")}, 9, 10, conflicts).isOK());
+  ASSERT_EQ(std::vector<bool>({true, false}), conflicts);
+
+  // the snapshot iterates at the last block as of its creation
+  ILocalKeyValueStorageReadOnlyIterator *snapshot = storage.getSnapIterator();
+  KeyValuePair kv = snapshot->seekAtLeast(sliverOf("k"));
+  ASSERT_FALSE(snapshot->isEnd());
+  ASSERT_EQ(sliverOf("key"), kv.first);
+  ASSERT_EQ(sliverOf("10"), kv.second);
+  kv = snapshot->next();
+  ASSERT_FALSE(snapshot->isEnd());
+  ASSERT_EQ(sliverOf("new"), kv.first);
+  ASSERT_EQ(sliverOf("10"), kv.second);
+  snapshot->next();
+  ASSERT_TRUE(snapshot->isEnd());
+  ASSERT_TRUE(storage.freeSnapIterator(snapshot).isOK());
+
+  // the primary isn't a follower
+  ASSERT_FALSE(primary.catchUpWithPrimary().isOK());
+}
+
+TEST(blockchain_db_adapter_test, block_view_finds_the_entries) {
+  SetOfKeyValuePairs updates;
+  for (int i = 0; i < 50; i++) updates[sliverOf("key" + std::to_string(i))] = sliverOf("value" + std::to_string(i));
+  const int8_t parentDigest[4] = {1, 2, 3, 4};
+  SetOfKeyValuePairs updatesInBlock;
+  BlockView sorted(BlockView::createBlock(updates, parentDigest, sizeof(parentDigest), &updatesInBlock));
+  ASSERT_TRUE(sorted.isValid());
+  ASSERT_TRUE(sorted.isSorted());
+  ASSERT_EQ(updates, updatesInBlock);
+  ASSERT_EQ(sizeof(parentDigest), sorted.header().parentDigestLength);
+  ASSERT_EQ(0, memcmp(parentDigest, sorted.header().parentDigest, sizeof(parentDigest)));
+  for (size_t i = 1; i < sorted.size(); i++) ASSERT_LT(sorted.key(i - 1).compare(sorted.key(i)), 0);
+
+  // Blocks laid out before the entries were sorted are scanned
+  BlockView unsorted(blockOf(updates));
+  ASSERT_TRUE(unsorted.isValid());
+  ASSERT_FALSE(unsorted.isSorted());
+  for (const BlockView *view : {&sorted, &unsorted}) {
+    ASSERT_EQ(updates.size(), view->size());
+    ASSERT_EQ(updates, view->toSet());
+    for (const auto &kv : updates) {
+      Sliver value;
+      ASSERT_TRUE(view->get(kv.first, value));
+      ASSERT_EQ(kv.second, value);
+    }
+    ASSERT_EQ(view->size(), view->find(sliverOf("key")));
+    ASSERT_EQ(view->size(), view->find(sliverOf("key50")));
+  }
+
+  ASSERT_TRUE(BlockView(BlockView::createBlock(SetOfKeyValuePairs(), nullptr, 0)).isValid());
+  ASSERT_FALSE(BlockView().isValid());
+  ASSERT_FALSE(BlockView(sliverOf("short")).isValid());
+  Sliver block = blockOf(updates);
+  BlockView invalid(Sliver(block, 0, block.length() - 1));
+  ASSERT_FALSE(invalid.isValid());
+  ASSERT_EQ(0, invalid.size());
+}
+
+TEST(blockchain_db_adapter_test, block_view_counts_beyond_16_bits) {
+  SetOfKeyValuePairs updates;
+  for (int i = 0; i < 70000; i++) updates[sliverOf(std::to_string(i))] = sliverOf("v");
+  BlockView view(BlockView::createBlock(updates, nullptr, 0));
+  ASSERT_TRUE(view.isValid());
+  ASSERT_EQ(updates.size(), view.size());
+  Sliver value;
+  ASSERT_TRUE(view.get(sliverOf("69999"), value));
+
+  // A header of the former layout: a 32-bit digest length, and no flags
+  std::string block(sizeof(BlockHeader), '\0');
+  const uint32_t oldHeader[2] = {0, sizeof(BlockHeader::parentDigest)};
+  memcpy(&block[0], oldHeader, sizeof(oldHeader));
+  BlockView old(sliverOf(block));
+  ASSERT_TRUE(old.isValid());
+  ASSERT_FALSE(old.isSorted());
+  ASSERT_EQ(sizeof(BlockHeader::parentDigest), old.header().parentDigestLength);
+}
+
+// A block of similar key-values, as the replicas write.
+Sliver repetitiveBlock(int seed, int size = 50) {
+  SetOfKeyValuePairs updates;
+  for (int i = 0; i < size; i++) {
+    updates[sliverOf("account/" + std::to_string(seed * size + i))] =
+        sliverOf("{\"owner\": \"owner" + std::to_string(i % 7) + "\", \"balance\": " + std::to_string(seed + i) + "}");
+  }
+  return BlockView::createBlock(updates, nullptr, 0);
+}
+
+Sliver storedBlock(DBAdapter &adapter, BlockId blockId) {
+  Sliver stored;
+  EXPECT_TRUE(adapter.getDb()->get(KeyManipulator().genBlockDbKey(blockId), stored).isOK());
+  return stored;
+}
+
+// An application block whose bytes happen to look like a header.
+Sliver headerLookAlike() {
+  std::string block(64, '\xFF');
+  return sliverOf(block);
+}
+
+TEST(blockchain_db_adapter_test, compressed_blocks_are_read_as_added) {
+  DBAdapter adapter(newClient());
+  std::vector<Sliver> blocks;
+  uint64_t compressedBlocks = 0;
+  for (BlockCompression compression : {BlockCompression::LZ4, BlockCompression::Zstd}) {
+    BlockCompressionConfig config;
+    config.compression = compression;
+    if (!BlockCompressor::isAvailable(compression)) {
+      ASSERT_FALSE(adapter.enableBlockCompression(config).isOK());
+      continue;
+    }
+    ASSERT_TRUE(adapter.enableBlockCompression(config).isOK());
+    blocks.push_back(repetitiveBlock(blocks.size() + 1));
+    ASSERT_TRUE(adapter.addBlock(blocks.size(), blocks.back()).isOK());
+    Sliver stored = storedBlock(adapter, blocks.size());
+    ASSERT_TRUE(BlockCompressor::isCompressed(stored));
+    ASSERT_LT(stored.length(), blocks.back().length());
+    compressedBlocks++;
+    // short blocks are stored as is, after their format
+    blocks.push_back(blockData(blocks.size() + 1));
+    ASSERT_TRUE(adapter.addBlock(blocks.size(), blocks.back()).isOK());
+    ASSERT_FALSE(BlockCompressor::isCompressed(storedBlock(adapter, blocks.size())));
+    blocks.push_back(headerLookAlike());
+    ASSERT_TRUE(adapter.addBlock(blocks.size(), blocks.back()).isOK());
+  }
+  ASSERT_EQ(compressedBlocks, adapter.blockCompressor().stats().compressedBlocks);
+  ASSERT_LE(adapter.blockCompressor().stats().compressedBytes, adapter.blockCompressor().stats().blockBytes);
+  auto aggregator = std::make_shared<concordMetrics::Aggregator>();
+  adapter.blockCompressor().setAggregator(aggregator);
+  adapter.blockCompressor().updateMetrics();
+  ASSERT_EQ(compressedBlocks, aggregator->GetCounter("block_compression", "compressed_blocks").Get());
+  ASSERT_GE(100, aggregator->GetGauge("block_compression", "ratio_percent").Get());
+
+  // read by an adapter without compression
+  DBAdapter reader(new FollowerClient(*static_cast<Client *>(adapter.getDb().get())), true);
+  for (BlockId i = 1; i <= blocks.size(); i++) {
+    Sliver block;
+    bool found = false;
+    ASSERT_TRUE(reader.getBlockById(i, block, found).isOK());
+    ASSERT_TRUE(found);
+    ASSERT_EQ(blocks[i - 1], block);
+  }
+}
+
+// The blocks of a database without compression are never decoded, whatever
+// their content, and compression can't be enabled on it anymore.
+TEST(blockchain_db_adapter_test, blocks_without_compression_are_stored_as_added) {
+  DBAdapter adapter(newClient());
+  ASSERT_TRUE(adapter.addBlock(1, headerLookAlike()).isOK());
+  ASSERT_EQ(headerLookAlike(), storedBlock(adapter, 1));
+  Sliver block;
+  bool found = false;
+  ASSERT_TRUE(adapter.getBlockById(1, block, found).isOK());
+  ASSERT_EQ(headerLookAlike(), block);
+
+  BlockCompressionConfig config;
+  config.compression = BlockCompression::None;
+  ASSERT_TRUE(adapter.enableBlockCompression(config).isIllegalOperation());
+  ASSERT_TRUE(adapter.addBlock(2, headerLookAlike()).isOK());
+  ASSERT_EQ(headerLookAlike(), storedBlock(adapter, 2));
+
+  // a new database is framed even without compression, so that it can be
+  // compressed later on
+  DBAdapter framed(newClient());
+  ASSERT_TRUE(framed.enableBlockCompression(config).isOK());
+  ASSERT_TRUE(framed.addBlock(1, headerLookAlike()).isOK());
+  ASSERT_EQ(headerLookAlike().length() + 1, storedBlock(framed, 1).length());
+  DBAdapter reopened(new FollowerClient(*static_cast<Client *>(framed.getDb().get())), true);
+  ASSERT_TRUE(reopened.getBlockById(1, block, found).isOK());
+  ASSERT_EQ(headerLookAlike(), block);
+}
+
+TEST(blockchain_db_adapter_test, blocks_compressed_with_a_dictionary_need_it) {
+  // a dictionary pays off on small blocks
+  std::vector<Sliver> samples;
+  for (int i = 0; i < 100; i++) samples.push_back(repetitiveBlock(i, 5));
+  BlockCompressionConfig config;
+  config.compression = BlockCompression::Zstd;
+  if (!BlockCompressor::isAvailable(BlockCompression::Zstd)) {
+    ASSERT_FALSE(BlockCompressor::trainDictionary(samples, 16 * 1024, config.dictionary).isOK());
+    return;
+  }
+  ASSERT_TRUE(BlockCompressor::trainDictionary(samples, 16 * 1024, config.dictionary).isOK());
+  ASSERT_FALSE(config.dictionary.empty());
+
+  DBAdapter adapter(newClient());
+  ASSERT_TRUE(adapter.enableBlockCompression(config).isOK());
+  Sliver block = repetitiveBlock(100, 5);
+  ASSERT_TRUE(adapter.addBlock(1, block).isOK());
+  Sliver read;
+  bool found = false;
+  ASSERT_TRUE(adapter.getBlockById(1, read, found).isOK());
+  ASSERT_EQ(block, read);
+
+  // smaller than without the dictionary
+  DBAdapter withoutDictionary(newClient());
+  config.dictionary.clear();
+  ASSERT_TRUE(withoutDictionary.enableBlockCompression(config).isOK());
+  ASSERT_TRUE(withoutDictionary.addBlock(1, block).isOK());
+  ASSERT_LT(storedBlock(adapter, 1).length(), storedBlock(withoutDictionary, 1).length());
+
+  DBAdapter reader(new FollowerClient(*static_cast<Client *>(adapter.getDb().get())), true);
+  ASSERT_FALSE(reader.getBlockById(1, read, found).isOK());
+  config.dictionary = "not a dictionary";
+  ASSERT_FALSE(reader.enableBlockCompression(config).isOK());
+}
+
+struct ComposedKey {
+  EDBKeyType type;
+  std::string key;
+  BlockId blockId;
+};
+
+// Keys made of few distinct bytes, so that there are many shared prefixes,
+// zero bytes and escape look-alikes.
+std::vector<ComposedKey> randomKeys(size_t count) {
+  const char bytes[] = {'\0', '\1', 'a', '\xFF'};
+  const BlockId blockIds[] = {0, 1, 2, 255, 256, std::numeric_limits<BlockId>::max()};
+  std::mt19937 gen(17);
+  std::vector<ComposedKey> keys;
+  for (size_t i = 0; i < count; ++i) {
+    ComposedKey k;
+    k.type = (gen() % 2) ? EDBKeyType::E_DB_KEY_TYPE_KEY : EDBKeyType::E_DB_KEY_TYPE_BLOCK;
+    if (k.type == EDBKeyType::E_DB_KEY_TYPE_KEY) {
+      size_t length = gen() % 6;
+      for (size_t j = 0; j < length; ++j) {
+        k.key.push_back(bytes[gen() % sizeof(bytes)]);
+      }
+    }
+    k.blockId = (gen() % 2) ? blockIds[gen() % 6] : gen();
+    keys.push_back(k);
+  }
+  return keys;
+}
+
+// The order of 'keys' once encoded with 'keys', as indexes into 'keys'.
+std::vector<size_t> sortedOrder(const std::vector<ComposedKey> &keys, KeyManipulator &manipulator) {
+  std::vector<Sliver> encoded;
+  for (const auto &k : keys) {
+    encoded.push_back(manipulator.genDbKey(k.type, Sliver(k.key), k.blockId));
+  }
+  std::vector<size_t> order(keys.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return manipulator.composedKeyComparison(encoded[a].data(), encoded[a].length(),
+                                             encoded[b].data(), encoded[b].length()) < 0;
+  });
+  return order;
+}
+
+TEST(blockchain_db_adapter_test, bytewise_layout_keeps_composed_order) {
+  KeyManipulator composed(KeyLayout::Composed);
+  KeyManipulator bytewise(KeyLayout::Bytewise);
+  auto keys = randomKeys(5000);
+  ASSERT_EQ(sortedOrder(keys, composed), sortedOrder(keys, bytewise));
+}
+
+TEST(blockchain_db_adapter_test, bytewise_layout_round_trips) {
+  KeyManipulator bytewise(KeyLayout::Bytewise);
+  for (const auto &k : randomKeys(1000)) {
+    Sliver dbKey = bytewise.genDbKey(k.type, Sliver(k.key), k.blockId);
+    ASSERT_EQ((char)k.type, bytewise.extractTypeFromKey(dbKey));
+    ASSERT_EQ(k.blockId, bytewise.extractBlockIdFromKey(dbKey));
+    ASSERT_TRUE(Sliver(k.key) == bytewise.extractKeyFromKeyComposedWithBlockId(dbKey));
+  }
+}
+
+TEST(blockchain_db_adapter_test, migrated_database_reads_the_same) {
+  DBAdapter composed(newClient(KeyLayout::Composed));
+  for (BlockId i = 1; i <= 20; ++i) {
+    SetOfKeyValuePairs updates;
+    updates[sliverOf(std::string("key") + std::to_string(i % 3))] = sliverOf(std::to_string(i));
+    updates[sliverOf(std::string("k\0y", 3))] = sliverOf(std::to_string(i));
+    ASSERT_TRUE(composed.addBlockAndUpdateMultiKey(updates, i, blockData(i)).isOK());
+  }
+
+  Client *client = newClient(KeyLayout::Bytewise);
+  ASSERT_TRUE(migrateKeyLayout(*composed.getDb(), KeyLayout::Composed, *client, KeyLayout::Bytewise).isOK());
+  DBAdapter bytewise(client, false, KeyLayout::Bytewise);
+
+  ASSERT_EQ(20, bytewise.getLatestBlock());
+  ASSERT_EQ(20, bytewise.getLastReachableBlock());
+  for (BlockId version = 1; version <= 20; ++version) {
+    for (const auto &key : {sliverOf("key0"), sliverOf("key1"), sliverOf(std::string("k\0y", 3))}) {
+      Sliver expectedValue, value;
+      BlockId expectedBlock = 0, block = 0;
+      ASSERT_TRUE(composed.getKeyByReadVersion(version, key, expectedValue, expectedBlock).isOK());
+      ASSERT_TRUE(bytewise.getKeyByReadVersion(version, key, value, block).isOK());
+      ASSERT_EQ(expectedBlock, block);
+      ASSERT_TRUE(expectedValue == value);
+    }
+    Sliver blockRaw;
+    bool found = false;
+    ASSERT_TRUE(bytewise.getBlockById(version, blockRaw, found).isOK());
+    ASSERT_TRUE(found);
+    ASSERT_TRUE(blockData(version) == blockRaw);
+  }
+}
+
+}  // end namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,162 @@
+// Copyright 2019 VMware, all rights reserved
+/**
+ * Put and seek throughput of the database key layouts: blocks of key-value
+ * updates are added through DBAdapter, then keys are read at random versions
+ * and at the last block.
+ * With RocksDB, the Composed layout goes through the parsing comparator and the
+ * Bytewise layout through the built-in one. Without RocksDB, the in-memory
+ * client is measured.
+ *
+ * usage: key_layout_benchmark [-n updates] [-b updates per block] [-k key size]
+ *                             [-p database path prefix]
+ */
+
+#include "Logger.hpp"
+#include "hash_defs.h"
+#include "blockchain/db_adapter.h"
+#include "memorydb/client.h"
+#include "memorydb/key_comparator.h"
+
+#ifdef USE_ROCKSDB
+#include "rocksdb/client.h"
+#include "rocksdb/key_comparator.h"
+#endif
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using concordUtils::Sliver;
+using concordUtils::SetOfKeyValuePairs;
+using concord::storage::IDBClient;
+using concord::storage::blockchain::BlockId;
+using concord::storage::blockchain::DBAdapter;
+using concord::storage::blockchain::KeyLayout;
+using concord::storage::blockchain::KeyManipulator;
+
+namespace {
+
+IDBClient *openDb(KeyLayout layout, const std::string &path) {
+#ifdef USE_ROCKSDB
+  ::rocksdb::DestroyDB(path, ::rocksdb::Options());
+  if (layout == KeyLayout::Bytewise) {
+    return new concord::storage::rocksdb::Client(path);
+  }
+  return new concord::storage::rocksdb::Client(
+      path, new concord::storage::rocksdb::KeyComparator(new KeyManipulator(layout)));
+#else
+  (void)path;
+  return new concord::storage::memorydb::Client(
+      concord::storage::memorydb::KeyComparator(new KeyManipulator(layout)));
+#endif
+}
+
+Sliver randomSliver(std::mt19937 &gen, size_t size) {
+  auto *data = new uint8_t[size];
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = static_cast<uint8_t>(gen());
+  }
+  return Sliver(data, size);
+}
+
+void run(const std::string &name,
+         KeyLayout layout,
+         const std::string &path,
+         size_t numOfUpdates,
+         size_t updatesPerBlock,
+         size_t keySize) {
+  DBAdapter adapter(openDb(layout, path), false, layout);
+  std::mt19937 gen(1);
+
+  // every key is updated in 4 blocks on average
+  std::vector<Sliver> keys;
+  for (size_t i = 0; i < numOfUpdates / 4 + 1; ++i) {
+    keys.push_back(randomSliver(gen, keySize));
+  }
+  Sliver value = randomSliver(gen, 100);
+  Sliver block = randomSliver(gen, 1000);
+
+  auto start = std::chrono::steady_clock::now();
+  BlockId lastBlock = 0;
+  for (size_t i = 0; i < numOfUpdates; i += updatesPerBlock) {
+    SetOfKeyValuePairs updates;
+    for (size_t j = 0; j < updatesPerBlock; ++j) {
+      updates[keys[gen() % keys.size()]] = value;
+    }
+    if (!adapter.addBlockAndUpdateMultiKey(updates, ++lastBlock, block).isOK()) {
+      std::cerr << name << ": failed to add block " << lastBlock << std::endl;
+      return;
+    }
+  }
+  double putSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  start = std::chrono::steady_clock::now();
+  size_t found = 0;
+  for (size_t i = 0; i < numOfUpdates; ++i) {
+    Sliver outValue;
+    BlockId outBlock = 0;
+    adapter.getKeyByReadVersion(gen() % lastBlock + 1, keys[gen() % keys.size()], outValue, outBlock);
+    found += (outBlock != 0);
+  }
+  double seekSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // the replicas mostly read at the last block
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < numOfUpdates; ++i) {
+    Sliver outValue;
+    BlockId outBlock = 0;
+    adapter.getKeyByReadVersion(lastBlock, keys[gen() % keys.size()], outValue, outBlock);
+  }
+  double latestSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << std::left << std::setw(10) << name
+            << " puts/sec: " << uint64_t(numOfUpdates / putSeconds)
+            << ", seeks/sec: " << uint64_t(numOfUpdates / seekSeconds)
+            << ", latest reads/sec: " << uint64_t(numOfUpdates / latestSeconds)
+            << ", found: " << found << "/" << numOfUpdates << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  size_t numOfUpdates = 200000;
+  size_t updatesPerBlock = 100;
+  size_t keySize = 32;
+  std::string pathPrefix = "./key_layout_benchmark";
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:b:k:p:")) != -1) {
+    switch (opt) {
+      case 'n':
+        numOfUpdates = std::stoull(optarg);
+        break;
+      case 'b':
+        updatesPerBlock = std::stoull(optarg);
+        break;
+      case 'k':
+        keySize = std::stoull(optarg);
+        break;
+      case 'p':
+        pathPrefix = optarg;
+        break;
+      default:
+        std::cerr << "usage: " << argv[0]
+                  << " [-n updates] [-b updates per block] [-k key size] [-p database path prefix]" << std::endl;
+        return 1;
+    }
+  }
+  if (numOfUpdates == 0 || updatesPerBlock == 0) {
+    std::cerr << "updates and updates per block must be positive" << std::endl;
+    return 1;
+  }
+
+  std::cout << "updates: " << numOfUpdates << ", updates per block: " << updatesPerBlock
+            << ", key size: " << keySize << std::endl;
+  run("Composed", KeyLayout::Composed, pathPrefix + "_composed", numOfUpdates, updatesPerBlock, keySize);
+  run("Bytewise", KeyLayout::Bytewise, pathPrefix + "_bytewise", numOfUpdates, updatesPerBlock, keySize);
+  return 0;
+}
@@ -0,0 +1,267 @@
+// Copyright 2019 VMware, all rights reserved
+/**
+ * Test the concurrent in-memory client: against the map-based one, with
+ * writes during iterations, and with concurrent readers.
+ */
+
+#include "gtest/gtest.h"
+#include "hash_defs.h"
+#include "memorydb/client.h"
+#include "memorydb/concurrent_client.h"
+#include "memorydb/key_comparator.h"
+#include "blockchain/db_adapter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using concordUtils::Sliver;
+using concordUtils::KeyValuePair;
+using concordUtils::KeysVector;
+using concordUtils::SetOfKeyValuePairs;
+using concord::storage::IDBClient;
+using concord::storage::memorydb::Client;
+using concord::storage::memorydb::ConcurrentClient;
+using concord::storage::memorydb::KeyComparator;
+using concord::storage::blockchain::BlockId;
+using concord::storage::blockchain::DBAdapter;
+using concord::storage::blockchain::KeyManipulator;
+
+namespace {
+
+class BytewiseManipulator : public IDBClient::IKeyManipulator {
+ public:
+  int composedKeyComparison(const uint8_t *a_data, size_t a_length, const uint8_t *b_data, size_t b_length) override {
+    int ret = memcmp(a_data, b_data, std::min(a_length, b_length));
+    if (ret != 0) return ret;
+    return (a_length < b_length) ? -1 : (a_length > b_length) ? 1 : 0;
+  }
+};
+
+Sliver sliverOf(std::string s) {
+  auto *data = new uint8_t[s.length()];
+  memcpy(data, s.data(), s.length());
+  return Sliver(data, s.length());
+}
+
+std::string stringOf(const Sliver &s) { return std::string((const char *)s.data(), s.length()); }
+
+// All the keys and values, from a single iteration.
+std::vector<std::pair<std::string, std::string>> contentOf(const IDBClient &client) {
+  std::vector<std::pair<std::string, std::string>> content;
+  auto *iter = client.getIterator();
+  for (KeyValuePair p = iter->first(); !iter->isEnd(); p = iter->next()) {
+    content.emplace_back(stringOf(p.first), stringOf(p.second));
+  }
+  client.freeIterator(iter);
+  return content;
+}
+
+TEST(memorydb_concurrent_client_test, behaves_as_the_map_client) {
+  Client expected(KeyComparator(new BytewiseManipulator()));
+  ConcurrentClient client(KeyComparator(new BytewiseManipulator()));
+  std::mt19937 gen(1);
+  for (int i = 0; i < 20000; ++i) {
+    Sliver key = sliverOf("key" + std::to_string(gen() % 500));
+    switch (gen() % 8) {
+      case 0:
+        ASSERT_TRUE(expected.del(key).isOK());
+        ASSERT_TRUE(client.del(key).isOK());
+        break;
+      case 1: {
+        Sliver end = sliverOf("key" + std::to_string(gen() % 500));
+        ASSERT_TRUE(expected.rangeDel(key, end).isOK());
+        ASSERT_TRUE(client.rangeDel(key, end).isOK());
+        break;
+      }
+      case 2: {
+        SetOfKeyValuePairs updates;
+        updates[key] = sliverOf(std::to_string(i));
+        updates[sliverOf("key" + std::to_string(gen() % 500))] = sliverOf("");
+        ASSERT_TRUE(expected.multiPut(updates).isOK());
+        ASSERT_TRUE(client.multiPut(updates).isOK());
+        break;
+      }
+      case 3: {
+        auto expectedBatch = expected.newWriteBatch();
+        auto batch = client.newWriteBatch();
+        for (auto *b : {expectedBatch.get(), batch.get()}) {
+          // a later operation on the same key wins
+          std::string value = std::to_string(i);
+          b->put(key, Sliver(value));
+          b->del(sliverOf("key" + std::to_string(i % 500)));
+          b->put(sliverOf("key" + std::to_string(i % 250)), Sliver(value));
+          value.clear();
+        }
+        ASSERT_TRUE(expected.write(*expectedBatch).isOK());
+        ASSERT_TRUE(client.write(*batch).isOK());
+        break;
+      }
+      default: {
+        Sliver value = sliverOf(std::to_string(i));
+        ASSERT_TRUE(expected.put(key, value).isOK());
+        ASSERT_TRUE(client.put(key, value).isOK());
+      }
+    }
+
+    Sliver expectedValue, value;
+    ASSERT_EQ(expected.get(key, expectedValue).isOK(), client.get(key, value).isOK());
+    ASSERT_TRUE(expectedValue == value);
+  }
+  auto content = contentOf(client);
+  ASSERT_TRUE(contentOf(expected) == content);
+
+  // backwards, and from a seek
+  auto *iter = client.getIterator();
+  iter->seekAtLeast(sliverOf("key250"));
+  size_t i = std::lower_bound(content.begin(), content.end(), std::make_pair(std::string("key250"), std::string())) -
+             content.begin();
+  ASSERT_EQ(content[i].first, stringOf(iter->getCurrent().first));
+  for (; i > 0; --i) {
+    ASSERT_EQ(content[i - 1].first, stringOf(iter->previous().first));
+  }
+  ASSERT_EQ(0, iter->previous().first.length());
+  client.freeIterator(iter);
+}
+
+TEST(memorydb_concurrent_client_test, iterators_stay_valid_across_writes) {
+  ConcurrentClient client(KeyComparator(new BytewiseManipulator()));
+  for (char c = 'a'; c <= 'e'; ++c) {
+    ASSERT_TRUE(client.put(sliverOf(std::string(1, c)), sliverOf("old")).isOK());
+  }
+  auto *iter = client.getIterator();
+  ASSERT_EQ("b", stringOf(iter->seekAtLeast(sliverOf("b")).first));
+
+  // the moves after the seek read as of the seek
+  ASSERT_TRUE(client.put(sliverOf("bb"), sliverOf("new")).isOK());
+  ASSERT_TRUE(client.put(sliverOf("c"), sliverOf("new")).isOK());
+  ASSERT_TRUE(client.del(sliverOf("d")).isOK());
+  KeyValuePair p = iter->next();
+  ASSERT_EQ("c", stringOf(p.first));
+  ASSERT_EQ("old", stringOf(p.second));
+  ASSERT_EQ("d", stringOf(iter->next().first));
+
+  // the next seek reads the last writes
+  p = iter->seekAtLeast(sliverOf("b"));
+  ASSERT_EQ("bb", stringOf(iter->next().first));
+  p = iter->next();
+  ASSERT_EQ("new", stringOf(p.second));
+  ASSERT_EQ("e", stringOf(iter->next().first));
+  iter->next();
+  ASSERT_TRUE(iter->isEnd());
+  client.freeIterator(iter);
+
+  // values outlive the client
+  Sliver value;
+  {
+    ConcurrentClient shortLived(KeyComparator(new BytewiseManipulator()));
+    ASSERT_TRUE(shortLived.put(sliverOf("key"), sliverOf("value")).isOK());
+    ASSERT_TRUE(shortLived.get(sliverOf("key"), value).isOK());
+  }
+  ASSERT_EQ("value", stringOf(value));
+}
+
+TEST(memorydb_concurrent_client_test, frees_superseded_values) {
+  ConcurrentClient client(KeyComparator(new BytewiseManipulator()));
+  const std::string big(64 * 1024, 'v');
+  for (int k = 0; k < 10; ++k) {
+    ASSERT_TRUE(client.put(sliverOf("key" + std::to_string(k)), sliverOf(big)).isOK());
+  }
+  const size_t usage = client.memoryUsage();
+
+  // overwrites free the values they supersede
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(client.put(sliverOf("key0"), sliverOf(big)).isOK());
+  }
+  ASSERT_EQ(usage, client.memoryUsage());
+
+  // an iterator keeps what it reads until it moves to the last writes
+  auto *iter = client.getIterator();
+  ASSERT_EQ("key0", stringOf(iter->first().first));
+  ASSERT_TRUE(client.put(sliverOf("key1"), sliverOf("new")).isOK());
+  ASSERT_TRUE(client.del(sliverOf("key2")).isOK());
+  ASSERT_LT(usage, client.memoryUsage());
+  KeyValuePair p = iter->next();
+  ASSERT_EQ(big, stringOf(p.second));
+  ASSERT_EQ("key2", stringOf(iter->next().first));
+  iter->first();
+  ASSERT_TRUE(client.put(sliverOf("key3"), sliverOf("new")).isOK());
+  ASSERT_GT(usage, client.memoryUsage());
+  client.freeIterator(iter);
+
+  // so do deletes, and a range delete
+  ASSERT_TRUE(client.rangeDel(sliverOf("key"), sliverOf("key9")).isOK());
+  ASSERT_TRUE(client.del(sliverOf("key9")).isOK());
+  ASSERT_GT(usage - 9 * big.length(), client.memoryUsage());
+  Sliver value;
+  ASSERT_TRUE(client.get(sliverOf("key5"), value).isNotFound());
+}
+
+TEST(memorydb_concurrent_client_test, readers_see_whole_batches) {
+  ConcurrentClient client(KeyComparator(new BytewiseManipulator()));
+  const int numOfKeys = 50;
+  std::atomic<bool> done(false);
+  std::atomic<int> numOfFailures(0);
+
+  // each batch writes the same value to all the keys
+  std::thread writer([&]() {
+    for (int i = 0; i < 2000; ++i) {
+      SetOfKeyValuePairs updates;
+      for (int k = 0; k < numOfKeys; ++k) {
+        updates[sliverOf("key" + std::to_string(k))] = sliverOf(std::to_string(i));
+      }
+      client.multiPut(updates);
+    }
+    done = true;
+  });
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 4; ++r) {
+    readers.emplace_back([&]() {
+      while (!done) {
+        auto content = contentOf(client);
+        for (const auto &keyValue : content) {
+          if (keyValue.second != content.front().second) {
+            numOfFailures++;
+          }
+        }
+        if (!content.empty() && content.size() != numOfKeys) {
+          numOfFailures++;
+        }
+      }
+    });
+  }
+  writer.join();
+  for (auto &reader : readers) {
+    reader.join();
+  }
+  ASSERT_EQ(0, numOfFailures);
+  ASSERT_EQ(numOfKeys, contentOf(client).size());
+}
+
+TEST(memorydb_concurrent_client_test, holds_a_blockchain) {
+  DBAdapter adapter(new ConcurrentClient(KeyComparator(new KeyManipulator())));
+  for (BlockId i = 1; i <= 10; ++i) {
+    SetOfKeyValuePairs updates;
+    updates[sliverOf("key")] = sliverOf(std::to_string(i));
+    ASSERT_TRUE(adapter.addBlockAndUpdateMultiKey(updates, i, sliverOf(std::string(64, '\0'))).isOK());
+  }
+  ASSERT_EQ(10, adapter.getLastReachableBlock());
+  for (BlockId i = 1; i <= 10; ++i) {
+    Sliver value;
+    BlockId block = 0;
+    ASSERT_TRUE(adapter.getKeyByReadVersion(i, sliverOf("key"), value, block).isOK());
+    ASSERT_EQ(i, block);
+    ASSERT_EQ(std::to_string(i), stringOf(value));
+  }
+}
+
+}  // end namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
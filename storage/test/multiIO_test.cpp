@@ -12,6 +12,14 @@
 #include "rocksdb/client.h"
 #include "kv_types.hpp"
 #include "blockchain/db_adapter.h"
+#include "blockchain/db_types.h"
+#include "blockchain/read_only_storage.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
 
 using namespace std;
 
@@ -22,6 +30,11 @@ using concordUtils::KeyValuePair;
 using concordUtils::SetOfKeyValuePairs;
 using concord::storage::rocksdb::Client;
 using concord::storage::rocksdb::KeyComparator;
+using concord::storage::rocksdb::blockchainColumnFamilies;
+using concord::storage::blockchain::BlockId;
+using concord::storage::blockchain::DBAdapter;
+using concord::storage::blockchain::ReadOnlyStorage;
+using concord::storage::blockchain::ReadOnlyStorageConfig;
 using concord::storage::ITransaction;
 using concord::storage::blockchain::KeyManipulator;
 namespace {
@@ -40,6 +53,26 @@ uint8_t *createAndFillBuf(size_t length) {
   return buffer;
 }
 
+Sliver copyOf(const std::string &s) {
+  return Sliver::copy(reinterpret_cast<const uint8_t *>(s.data()), s.length());
+}
+
+// A block updating a single key, laid out as the replicas do.
+Sliver blockOf(const Sliver &key, const Sliver &value) {
+  std::string block(sizeof(concord::storage::blockchain::BlockHeader) +
+                    sizeof(concord::storage::blockchain::BlockEntry), '\0');
+  reinterpret_cast<concord::storage::blockchain::BlockHeader *>(&block[0])->numberOfElements = 1;
+  concord::storage::blockchain::BlockEntry entry;
+  entry.keyOffset = block.size();
+  entry.keySize = key.length();
+  block.append(reinterpret_cast<const char *>(key.data()), key.length());
+  entry.valOffset = block.size();
+  entry.valSize = value.length();
+  block.append(reinterpret_cast<const char *>(value.data()), value.length());
+  memcpy(&block[sizeof(concord::storage::blockchain::BlockHeader)], &entry, sizeof(entry));
+  return copyOf(block);
+}
+
 void verifyMultiGet(KeysVector &keys, Sliver inValues[blocksNum],
                     KeysVector &outValues) {
   ASSERT_TRUE(dbClient->multiGet(keys, outValues) == Status::OK());
@@ -87,6 +120,99 @@ TEST(multiIO_test, multi_put) {
   verifyMultiGet(keys, inValues, outValues);
 }
 
+TEST(multiIO_test, multi_get_with_missing_keys) {
+  KeysVector keys(blocksNum);
+  Sliver inValues[blocksNum];
+  SetOfKeyValuePairs keyValueMap;
+  launchMultiPut(keys, inValues, keyValueMap);
+  KeysVector someKeys;
+  for (int i = 0; i < blocksNum; i++) {
+    someKeys.push_back(keys[i]);
+    someKeys.push_back(Sliver(createAndFillBuf(keyLen + 1), keyLen + 1));
+  }
+
+  KeysVector outValues;
+  std::vector<Status> statuses;
+  ASSERT_TRUE(dbClient->multiGet(someKeys, outValues, statuses).isOK());
+  ASSERT_EQ(someKeys.size(), outValues.size());
+  ASSERT_EQ(someKeys.size(), statuses.size());
+  for (int i = 0; i < blocksNum; i++) {
+    ASSERT_TRUE(statuses[2 * i].isOK());
+    ASSERT_TRUE(inValues[i] == outValues[2 * i]);
+    ASSERT_TRUE(statuses[2 * i + 1].isNotFound());
+    ASSERT_EQ(0, outValues[2 * i + 1].length());
+  }
+
+  // the values outlive the batch and each other
+  Sliver value = outValues[0];
+  outValues.clear();
+  ASSERT_TRUE(inValues[0] == value);
+
+  KeysVector allValues;
+  ASSERT_TRUE(dbClient->multiGet(someKeys, allValues).isNotFound());
+}
+
+TEST(multiIO_test, multi_get_across_column_families) {
+  const string dbPath = "./rocksdb_multi_get_test";
+  ::rocksdb::DestroyDB(dbPath, ::rocksdb::Options());
+  Client client(dbPath, new KeyComparator(new KeyManipulator()), nullptr, blockchainColumnFamilies());
+  client.init();
+
+  KeyManipulator manipulator;
+  SetOfKeyValuePairs keyValueMap;
+  KeysVector keys;
+  for (BlockId block = 1; block <= blocksNum; block++) {
+    keys.push_back(manipulator.genBlockDbKey(block));
+    keys.push_back(manipulator.genDataDbKey(copyOf("key" + std::to_string(block)), block));
+    keys.push_back(KeyManipulator::generateMetadataKey(static_cast<concord::storage::blockchain::ObjectId>(block)));
+  }
+  // createAndFillBuf() returns the same bytes within a second
+  for (size_t i = 0; i < keys.size(); i++) keyValueMap[keys[i]] = copyOf(std::string(valueLen, 'a' + i % 26));
+  ASSERT_TRUE(client.multiPut(keyValueMap).isOK());
+
+  // every family, with keys missing from each
+  KeysVector someKeys;
+  for (size_t i = 0; i < keys.size(); i++) {
+    someKeys.push_back(keys[i]);
+    if (i % 3 == 0) someKeys.push_back(manipulator.genBlockDbKey(blocksNum + 1 + i));
+    if (i % 3 == 1) someKeys.push_back(manipulator.genDataDbKey(copyOf("missing" + std::to_string(i)), 1));
+    if (i % 3 == 2) someKeys.push_back(KeyManipulator::generateMetadataKey(static_cast<concord::storage::blockchain::ObjectId>(blocksNum + 1 + i)));
+  }
+  KeysVector outValues;
+  std::vector<Status> statuses;
+  ASSERT_TRUE(client.multiGet(someKeys, outValues, statuses).isOK());
+  ASSERT_EQ(someKeys.size(), outValues.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_TRUE(statuses[2 * i].isOK());
+    ASSERT_TRUE(keyValueMap[keys[i]] == outValues[2 * i]);
+    ASSERT_TRUE(statuses[2 * i + 1].isNotFound());
+    ASSERT_EQ(0, outValues[2 * i + 1].length());
+  }
+
+  // the values outlive the batch, and the keys being overwritten or deleted
+  KeysVector kept;
+  for (size_t i = 0; i < keys.size(); i++) kept.push_back(outValues[2 * i]);
+  outValues.clear();
+  statuses.clear();
+  SetOfKeyValuePairs overwritten;
+  for (size_t i = 0; i < keys.size(); i += 2) overwritten[keys[i]] = copyOf(std::string(valueLen, 'A' + i % 26));
+  ASSERT_TRUE(client.multiPut(overwritten).isOK());
+  for (size_t i = 1; i < keys.size(); i += 2) ASSERT_TRUE(client.del(keys[i]).isOK());
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_TRUE(keyValueMap[keys[i]] == kept[i]);
+  }
+
+  // and the next batch sees the writes
+  ASSERT_TRUE(client.multiGet(keys, outValues, statuses).isOK());
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (i % 2 == 0) {
+      ASSERT_TRUE(overwritten[keys[i]] == outValues[i]);
+    } else {
+      ASSERT_TRUE(statuses[i].isNotFound());
+    }
+  }
+}
+
 TEST(multiIO_test, multi_del) {
   KeysVector keys(blocksNum);
   Sliver inValues[blocksNum];
@@ -153,6 +279,420 @@ TEST(multiIO_test, no_commit_during_exception)
 
 
 
+TEST(multiIO_test, column_families_iterate_as_one_keyspace) {
+  const string dbPath = "./rocksdb_column_families_test";
+  ::rocksdb::DestroyDB(dbPath, ::rocksdb::Options());
+  KeyManipulator manipulator;
+  KeysVector keys;
+  for (BlockId block = 1; block <= 3; block++) {
+    keys.push_back(manipulator.genBlockDbKey(block));
+    keys.push_back(manipulator.genDataDbKey(Sliver(createAndFillBuf(keyLen), keyLen), block));
+  }
+  keys.push_back(KeyManipulator::generateMetadataKey(1));
+  keys.push_back(KeyManipulator::generateMetadataKey(2));
+  std::sort(keys.begin(), keys.end(), [&](const Sliver &a, const Sliver &b) {
+    return manipulator.composedKeyComparison(a.data(), a.length(), b.data(), b.length()) < 0;
+  });
+
+  for (int pass = 0; pass < 2; pass++) {
+    // written, then reopened
+    std::unique_ptr<Client> client(new Client(dbPath, new KeyComparator(new KeyManipulator()), nullptr,
+                                              blockchainColumnFamilies()));
+    client->init();
+    if (pass == 0) {
+      SetOfKeyValuePairs keyValueMap;
+      for (const auto &key : keys) keyValueMap[key] = key;
+      ASSERT_TRUE(client->multiPut(keyValueMap).isOK());
+    }
+
+    auto *iter = client->getIterator();
+    size_t i = 0;
+    for (KeyValuePair p = iter->first(); !iter->isEnd(); p = iter->next(), i++) {
+      ASSERT_LT(i, keys.size());
+      ASSERT_TRUE(keys[i] == p.first);
+    }
+    ASSERT_EQ(keys.size(), i);
+    for (i = keys.size(); i > 0; i--) {
+      KeyValuePair p = (i == keys.size()) ? iter->seekAtLeast(keys[i - 1]) : iter->previous();
+      ASSERT_TRUE(keys[i - 1] == p.first);
+    }
+    // past the last block: the first versioned key
+    ASSERT_TRUE(keys[3] == iter->seekAtLeast(manipulator.genBlockDbKey(0)).first);
+    client->freeIterator(iter);
+
+    Sliver value;
+    ASSERT_TRUE(client->get(keys[0], value).isOK());
+    ASSERT_TRUE(keys[0] == value);
+  }
+}
+
+TEST(multiIO_test, column_families_migrated_from_single_keyspace) {
+  const string legacyPath = "./rocksdb_single_keyspace_test";
+  const string migratedPath = "./rocksdb_migrated_test";
+  for (const auto &path : {legacyPath, migratedPath}) {
+    ::rocksdb::DestroyDB(path, ::rocksdb::Options());
+  }
+  KeyManipulator manipulator;
+  SetOfKeyValuePairs keyValueMap;
+  for (BlockId block = 1; block <= blocksNum; block++) {
+    keyValueMap[manipulator.genBlockDbKey(block)] = copyOf("block" + std::to_string(block));
+    keyValueMap[manipulator.genDataDbKey(copyOf("key" + std::to_string(block % 7)), block)] =
+        copyOf("value" + std::to_string(block));
+  }
+  keyValueMap[KeyManipulator::generateMetadataKey(1)] = copyOf("metadata");
+
+  auto verify = [&](const Client &client) {
+    auto *iter = client.getIterator();
+    size_t numOfKeys = 0;
+    Sliver previous;
+    for (KeyValuePair p = iter->first(); !iter->isEnd(); p = iter->next(), numOfKeys++) {
+      ASSERT_TRUE(keyValueMap[p.first] == p.second);
+      if (numOfKeys > 0) {
+        ASSERT_LT(manipulator.composedKeyComparison(previous.data(), previous.length(), p.first.data(), p.first.length()), 0);
+      }
+      previous = p.first;
+    }
+    client.freeIterator(iter);
+    ASSERT_EQ(keyValueMap.size(), numOfKeys);
+  };
+  auto familiesOf = [](const string &path) {
+    std::vector<std::string> families;
+    EXPECT_TRUE(::rocksdb::DB::ListColumnFamilies(::rocksdb::DBOptions(), path, &families).ok());
+    std::sort(families.begin(), families.end());
+    return families;
+  };
+
+  {
+    Client legacy(legacyPath, new KeyComparator(new KeyManipulator()));
+    legacy.init();
+    ASSERT_TRUE(legacy.multiPut(keyValueMap).isOK());
+  }
+  {
+    // opened with column families, it keeps its single keyspace
+    Client legacy(legacyPath, new KeyComparator(new KeyManipulator()), nullptr, blockchainColumnFamilies());
+    legacy.init();
+    ASSERT_EQ(1u, legacy.numOfColumnFamilies());
+    verify(legacy);
+    ASSERT_TRUE(legacy.put(manipulator.genBlockDbKey(blocksNum + 1), copyOf("written")).isOK());
+    keyValueMap[manipulator.genBlockDbKey(blocksNum + 1)] = copyOf("written");
+
+    Client migrated(migratedPath, new KeyComparator(new KeyManipulator()), nullptr, blockchainColumnFamilies());
+    migrated.init();
+    ASSERT_EQ(blockchainColumnFamilies().size(), migrated.numOfColumnFamilies());
+    ASSERT_TRUE(concord::storage::blockchain::migrateKeyLayout(legacy, concord::storage::blockchain::KeyLayout::Composed,
+                                                               migrated, concord::storage::blockchain::KeyLayout::Composed).isOK());
+  }
+  ASSERT_EQ(std::vector<std::string>{::rocksdb::kDefaultColumnFamilyName}, familiesOf(legacyPath));
+
+  std::vector<std::string> configured;
+  for (const auto &family : blockchainColumnFamilies()) configured.push_back(family.name);
+  std::sort(configured.begin(), configured.end());
+  ASSERT_EQ(configured, familiesOf(migratedPath));
+  {
+    // reopened with its column families
+    Client migrated(migratedPath, new KeyComparator(new KeyManipulator()), nullptr, blockchainColumnFamilies());
+    migrated.init();
+    verify(migrated);
+    Sliver value;
+    ASSERT_TRUE(migrated.get(KeyManipulator::generateMetadataKey(1), value).isOK());
+    ASSERT_TRUE(copyOf("metadata") == value);
+  }
+
+  // and refused with other ones
+  auto other = blockchainColumnFamilies();
+  other.pop_back();
+  Client refused(migratedPath, new KeyComparator(new KeyManipulator()), nullptr, other);
+  ASSERT_THROW(refused.init(), std::runtime_error);
+}
+
+TEST(multiIO_test, checkpoint_is_ingested) {
+  const string dbPath = "./rocksdb_checkpoint_test";
+  const string checkpointPath = dbPath + "_checkpoint";
+  const string bootstrappedPath = dbPath + "_bootstrapped";
+  for (const auto &path : {dbPath, checkpointPath, bootstrappedPath}) {
+    ::rocksdb::DestroyDB(path, ::rocksdb::Options());
+  }
+  KeyManipulator manipulator;
+  SetOfKeyValuePairs keyValueMap;
+  for (BlockId block = 1; block <= blocksNum; block++) {
+    keyValueMap[manipulator.genBlockDbKey(block)] = Sliver(createAndFillBuf(valueLen), valueLen);
+    keyValueMap[manipulator.genDataDbKey(Sliver(createAndFillBuf(keyLen), keyLen), block)] =
+        Sliver(createAndFillBuf(valueLen), valueLen);
+  }
+
+  Client client(dbPath, new KeyComparator(new KeyManipulator()), nullptr, blockchainColumnFamilies());
+  client.init();
+  ASSERT_TRUE(client.multiPut(keyValueMap).isOK());
+  ASSERT_TRUE(client.createCheckpoint(checkpointPath).isOK());
+  // not in the checkpoint
+  ASSERT_TRUE(client.put(manipulator.genBlockDbKey(blocksNum + 1), Sliver(createAndFillBuf(valueLen), valueLen)).isOK());
+
+  Client bootstrapped(bootstrappedPath, new KeyComparator(new KeyManipulator()), nullptr, blockchainColumnFamilies());
+  bootstrapped.init();
+  ASSERT_TRUE(bootstrapped.ingestCheckpoint(checkpointPath).isOK());
+  auto *iter = bootstrapped.getIterator();
+  size_t numOfKeys = 0;
+  for (KeyValuePair p = iter->first(); !iter->isEnd(); p = iter->next(), numOfKeys++) {
+    ASSERT_TRUE(keyValueMap[p.first] == p.second);
+  }
+  bootstrapped.freeIterator(iter);
+  ASSERT_EQ(keyValueMap.size(), numOfKeys);
+
+  // only an empty database is bootstrapped
+  ASSERT_FALSE(bootstrapped.ingestCheckpoint(checkpointPath).isOK());
+  ASSERT_TRUE(client.deleteCheckpoint(checkpointPath).isOK());
+}
+
+// A checkpoint of a blockchain, ingested in a new database, restores its
+// blocks, the versions of its keys and its last reachable block.
+TEST(multiIO_test, checkpoint_restores_the_blockchain) {
+  const string dbPath = "./rocksdb_restore_test";
+  const string checkpointPath = dbPath + "_checkpoint";
+  const string restoredPath = dbPath + "_restored";
+  for (const auto &path : {dbPath, checkpointPath, restoredPath}) {
+    ::rocksdb::DestroyDB(path, ::rocksdb::Options());
+  }
+  auto newClient = [](const string &path) {
+    return new Client(path, new KeyComparator(new KeyManipulator()), nullptr, blockchainColumnFamilies());
+  };
+  auto keyOf = [](BlockId block) { return copyOf("key" + std::to_string(block % 3)); };
+  auto valueOf = [](BlockId block) { return copyOf("value" + std::to_string(block)); };
+
+  std::vector<Sliver> blocks(blocksNum + 2);
+  {
+    DBAdapter primary(newClient(dbPath));
+    for (BlockId block = 1; block <= blocksNum + 1; block++) {
+      SetOfKeyValuePairs updates;
+      updates[keyOf(block)] = valueOf(block);
+      blocks[block] = blockOf(keyOf(block), valueOf(block));
+      ASSERT_TRUE(primary.addBlockAndUpdateMultiKey(updates, block, blocks[block]).isOK());
+      if (block == blocksNum) {
+        ASSERT_TRUE(primary.getDb()->createCheckpoint(checkpointPath).isOK());
+      }
+    }
+  }
+  {
+    std::unique_ptr<Client> restored(newClient(restoredPath));
+    restored->init();
+    ASSERT_TRUE(restored->ingestCheckpoint(checkpointPath).isOK());
+  }
+
+  DBAdapter restored(newClient(restoredPath));
+  ASSERT_EQ(blocksNum, restored.getLastReachableBlock());
+  ASSERT_EQ(blocksNum, restored.getLatestBlock());
+  for (BlockId block = 1; block <= blocksNum; block++) {
+    Sliver blockRaw;
+    bool found = false;
+    ASSERT_TRUE(restored.getBlockById(block, blockRaw, found).isOK());
+    ASSERT_TRUE(found);
+    ASSERT_TRUE(blocks[block] == blockRaw);
+
+    // the versions of the keys as of the block
+    for (BlockId previous = block; previous > 0 && previous + 3 > block; previous--) {
+      Sliver value;
+      BlockId valueBlock = 0;
+      ASSERT_TRUE(restored.getKeyByReadVersion(block, keyOf(previous), value, valueBlock).isOK());
+      ASSERT_EQ(previous, valueBlock);
+      ASSERT_TRUE(valueOf(previous) == value);
+    }
+  }
+  // the block added after the checkpoint isn't there
+  Sliver blockRaw;
+  bool found = true;
+  ASSERT_TRUE(restored.getBlockById(blocksNum + 1, blockRaw, found).isOK());
+  ASSERT_FALSE(found);
+  Sliver value;
+  BlockId valueBlock = 0;
+  ASSERT_TRUE(restored.getKeyByReadVersion(blocksNum + 1, keyOf(blocksNum + 1), value, valueBlock).isOK());
+  ASSERT_EQ(blocksNum - 2, valueBlock);
+
+  // and the restored chain goes on
+  SetOfKeyValuePairs updates;
+  updates[keyOf(blocksNum + 1)] = valueOf(blocksNum + 1);
+  ASSERT_TRUE(restored.addBlockAndUpdateMultiKey(updates, blocksNum + 1, blocks[blocksNum + 1]).isOK());
+  ASSERT_EQ(blocksNum + 1, restored.getLastReachableBlock());
+  ASSERT_TRUE(restored.getKeyByReadVersion(blocksNum + 1, keyOf(blocksNum + 1), value, valueBlock).isOK());
+  ASSERT_EQ(blocksNum + 1, valueBlock);
+}
+
+TEST(multiIO_test, write_batch_is_reused) {
+  const string dbPath = "./rocksdb_write_batch_test";
+  ::rocksdb::DestroyDB(dbPath, ::rocksdb::Options());
+  Client client(dbPath, new KeyComparator(new KeyManipulator()), nullptr, blockchainColumnFamilies());
+  concord::storage::rocksdb::WritePolicy policy;
+  policy.syncInterval = 2;
+  policy.pipelinedWrites = true;
+  client.setWritePolicy(policy);
+  client.init();
+
+  KeyManipulator manipulator;
+  auto batch = client.newWriteBatch();
+  KeysVector keys;
+  for (BlockId block = 1; block <= blocksNum; block++) {
+    // the batch copies the keys and values of temporary buffers
+    std::vector<uint8_t> key;
+    manipulator.genDbKey(concord::storage::blockchain::EDBKeyType::E_DB_KEY_TYPE_BLOCK, Sliver(), block, key);
+    std::vector<uint8_t> value(valueLen, static_cast<uint8_t>(block));
+    batch->clear();
+    batch->put(Sliver(static_cast<const uint8_t *>(key.data()), key.size()),
+               Sliver(static_cast<const uint8_t *>(value.data()), value.size()));
+    if (block > 1) {
+      batch->del(keys.back());
+    }
+    ASSERT_TRUE(client.write(*batch).isOK());
+    keys.push_back(manipulator.genBlockDbKey(block));
+  }
+  ASSERT_EQ(2u, batch->count());
+
+  // only the last block is left
+  auto *iter = client.getIterator();
+  KeyValuePair p = iter->first();
+  ASSERT_FALSE(iter->isEnd());
+  ASSERT_TRUE(p.first == keys.back());
+  ASSERT_EQ(valueLen, p.second.length());
+  ASSERT_EQ(blocksNum, p.second[0]);
+  iter->next();
+  ASSERT_TRUE(iter->isEnd());
+  client.freeIterator(iter);
+}
+
+// Writes of all kinds from several threads, under the write policy: every
+// syncInterval-th one syncs the log, and all of them are found on reopening.
+TEST(multiIO_test, write_policy_keeps_the_writes) {
+  const string dbPath = "./rocksdb_write_policy_test";
+  const int numOfThreads = 4;
+  const int writesPerThread = 30;
+  KeyManipulator manipulator;
+  auto keyOf = [&](uint32_t syncInterval, int thread, int write) {
+    return manipulator.genDataDbKey(
+        copyOf(std::to_string(syncInterval) + "_" + std::to_string(thread) + "_" + std::to_string(write)), 1);
+  };
+
+  for (uint32_t syncInterval : {1u, 3u}) {
+    ::rocksdb::DestroyDB(dbPath, ::rocksdb::Options());
+    {
+      Client client(dbPath, new KeyComparator(new KeyManipulator()), nullptr, blockchainColumnFamilies());
+      concord::storage::rocksdb::WritePolicy policy;
+      policy.syncInterval = syncInterval;
+      policy.pipelinedWrites = true;
+      client.setWritePolicy(policy);
+      client.init();
+
+      std::vector<std::thread> threads;
+      for (int t = 0; t < numOfThreads; t++) {
+        threads.emplace_back([&, t]() {
+          auto batch = client.newWriteBatch();
+          for (int w = 0; w < writesPerThread; w++) {
+            Sliver key = keyOf(syncInterval, t, w);
+            switch (w % 4) {
+              case 0:
+                ASSERT_TRUE(client.put(key, key).isOK());
+                break;
+              case 1: {
+                SetOfKeyValuePairs keyValueMap;
+                keyValueMap[key] = key;
+                ASSERT_TRUE(client.multiPut(keyValueMap).isOK());
+                break;
+              }
+              case 2:
+                batch->clear();
+                batch->put(key, key);
+                ASSERT_TRUE(client.write(*batch).isOK());
+                break;
+              default: {
+                ITransaction::Guard g(client.beginTransaction());
+                g.txn->put(key, key);
+              }
+            }
+          }
+        });
+      }
+      for (auto &thread : threads) thread.join();
+      ASSERT_EQ(numOfThreads * writesPerThread / syncInterval, client.numOfSyncedWrites());
+    }
+
+    Client reopened(dbPath, new KeyComparator(new KeyManipulator()), nullptr, blockchainColumnFamilies());
+    reopened.init();
+    for (int t = 0; t < numOfThreads; t++) {
+      for (int w = 0; w < writesPerThread; w++) {
+        Sliver key = keyOf(syncInterval, t, w);
+        Sliver value;
+        ASSERT_TRUE(reopened.get(key, value).isOK());
+        ASSERT_TRUE(key == value);
+      }
+    }
+  }
+}
+
+// A read-only storage over a secondary instance follows the primary while it
+// writes: its last block never goes back, and the reads at it see that block.
+TEST(multiIO_test, secondary_follows_the_writing_primary) {
+  const string dbPath = "./rocksdb_primary_test";
+  const string secondaryPath = dbPath + "_secondary";
+  ::rocksdb::DestroyDB(dbPath, ::rocksdb::Options());
+  ::rocksdb::DestroyDB(secondaryPath, ::rocksdb::Options());
+  auto valueOf = [](BlockId block) { return copyOf(std::to_string(block)); };
+  const Sliver key = copyOf("key");
+  const BlockId numOfBlocks = 500;
+
+  DBAdapter primary(new Client(dbPath, new KeyComparator(new KeyManipulator()), nullptr, blockchainColumnFamilies()));
+  auto addBlock = [&](BlockId block) {
+    SetOfKeyValuePairs updates;
+    updates[key] = valueOf(block);
+    return primary.addBlockAndUpdateMultiKey(updates, block, blockOf(key, valueOf(block))).isOK();
+  };
+  ASSERT_TRUE(addBlock(1));
+
+  Client *secondaryClient =
+      new Client(dbPath, new KeyComparator(new KeyManipulator()), nullptr, blockchainColumnFamilies());
+  secondaryClient->setSecondaryPath(secondaryPath);
+  DBAdapter follower(secondaryClient, true);
+  ReadOnlyStorageConfig config;
+  config.catchUpIntervalMilli = 1;
+  ReadOnlyStorage storage(follower, config);
+  ASSERT_EQ(1u, storage.getLastBlock());
+  ASSERT_FALSE(follower.getDb()->put(key, key).isOK());
+
+  std::atomic_bool writing{true};
+  std::thread writer([&]() {
+    for (BlockId block = 2; block <= numOfBlocks; block++) {
+      if (!addBlock(block)) {
+        ADD_FAILURE() << "Failed to add block " << block;
+        break;
+      }
+    }
+    writing = false;
+  });
+  storage.start();
+
+  BlockId lastBlock = 1;
+  size_t numOfReads = 0;
+  for (bool done = false; !done; numOfReads++) {
+    done = !writing;
+    BlockId block = storage.getLastBlock();
+    ASSERT_GE(block, lastBlock);
+    lastBlock = block;
+
+    Sliver value;
+    BlockId valueBlock = 0;
+    ASSERT_TRUE(storage.get(block, key, value, valueBlock).isOK());
+    ASSERT_EQ(block, valueBlock);
+    ASSERT_TRUE(valueOf(block) == value);
+    SetOfKeyValuePairs blockData;
+    ASSERT_TRUE(storage.getBlockData(block, blockData).isOK());
+    ASSERT_TRUE(valueOf(block) == blockData[key]);
+  }
+  writer.join();
+  storage.stop();
+
+  ASSERT_TRUE(storage.catchUp().isOK());
+  ASSERT_EQ(numOfBlocks, storage.getLastBlock());
+  Sliver value;
+  ASSERT_TRUE(storage.get(key, value).isOK());
+  ASSERT_TRUE(valueOf(numOfBlocks) == value);
+  ASSERT_GT(numOfReads, 1u);
+}
+
 }  // end namespace
 
 int main(int argc, char **argv) {
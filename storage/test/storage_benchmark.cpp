@@ -0,0 +1,399 @@
+// Copyright 2019 VMware, all rights reserved
+/**
+ * Throughput and latency of the storage layer, per database client, reported
+ * as JSON to track regressions. The workloads run in order on each client:
+ *  - append: blocks of key-value updates added through DBAdapter
+ *  - latest_reads: keys read at the last block
+ *  - historical_reads: keys read at random versions
+ *  - conflict_probes: the check of ReplicaImp::mayHaveConflictBetween, whether
+ *    a key was updated in a range of recent blocks
+ *  - batched_conflict_probes: the same check for read sets of 16 keys, read
+ *    together
+ *  - iteration: the steps of a scan of the versions of the keys
+ *  - metadata_batches: atomic batches of DBMetadataStorage writes
+ * The latencies are those of single operations: a block for the appends, a
+ * batch for the metadata writes.
+ *
+ * usage: storage_benchmark [-c clients] [-b blocks] [-k keys per block]
+ *                          [-s key size] [-v value size] [-r reads]
+ *                          [-m metadata objects per batch]
+ *                          [-p database path prefix] [-o JSON output file]
+ * clients: comma-separated among rocksdb, memorydb and concurrent_memorydb,
+ * all of them by default. The JSON goes to stdout with '-o -'.
+ */
+
+#include "Logger.hpp"
+#include "hash_defs.h"
+#include "blockchain/db_adapter.h"
+#include "memorydb/client.h"
+#include "memorydb/concurrent_client.h"
+#include "memorydb/key_comparator.h"
+#include "storage/db_metadata_storage.h"
+
+#ifdef USE_ROCKSDB
+#include "rocksdb/client.h"
+#include "rocksdb/key_comparator.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using concordUtils::Sliver;
+using concordUtils::SetOfKeyValuePairs;
+using concordUtils::KeysVector;
+using concordUtils::ValuesVector;
+using concord::storage::IDBClient;
+using concord::storage::DBMetadataStorage;
+using concord::storage::blockchain::BlockId;
+using concord::storage::blockchain::DBAdapter;
+using concord::storage::blockchain::EDBKeyType;
+using concord::storage::blockchain::KeyManipulator;
+
+namespace {
+
+struct Config {
+  std::vector<std::string> clients;
+  size_t numOfBlocks = 20000;
+  size_t keysPerBlock = 10;
+  size_t keySize = 32;
+  size_t valueSize = 100;
+  size_t numOfReads = 200000;
+  size_t objectsPerBatch = 10;
+  std::string pathPrefix = "./storage_benchmark";
+  std::string outputPath = "./storage_benchmark.json";
+};
+
+typedef std::chrono::steady_clock Clock;
+
+// The durations of the operations of a workload.
+class Measurement {
+ public:
+  explicit Measurement(size_t expectedOps) { latencies_.reserve(expectedOps); }
+
+  void start() { start_ = Clock::now(); }
+  void add(Clock::time_point opStart) { latencies_.push_back(Clock::now() - opStart); }
+  void stop() { elapsed_ = Clock::now() - start_; }
+  size_t numOfOps() const { return latencies_.size(); }
+
+  std::string toJson(const std::string &client, const std::string &workload) {
+    std::sort(latencies_.begin(), latencies_.end());
+    double seconds = std::chrono::duration<double>(elapsed_).count();
+    std::ostringstream json;
+    json << "{\"client\": \"" << client << "\", \"workload\": \"" << workload << "\", \"operations\": "
+         << latencies_.size() << ", \"ops_per_sec\": " << uint64_t(seconds > 0 ? latencies_.size() / seconds : 0)
+         << ", \"latency_us\": {\"mean\": " << micros(mean()) << ", \"p50\": " << micros(percentile(0.5))
+         << ", \"p90\": " << micros(percentile(0.9)) << ", \"p99\": " << micros(percentile(0.99))
+         << ", \"p999\": " << micros(percentile(0.999)) << ", \"max\": "
+         << micros(latencies_.empty() ? Clock::duration::zero() : latencies_.back()) << "}}";
+    return json.str();
+  }
+
+ private:
+  Clock::duration percentile(double p) const {
+    if (latencies_.empty()) {
+      return Clock::duration::zero();
+    }
+    return latencies_[std::min(latencies_.size() - 1, size_t(p * latencies_.size()))];
+  }
+
+  Clock::duration mean() const {
+    if (latencies_.empty()) {
+      return Clock::duration::zero();
+    }
+    Clock::duration total = Clock::duration::zero();
+    for (const auto &latency : latencies_) {
+      total += latency;
+    }
+    return total / latencies_.size();
+  }
+
+  static double micros(Clock::duration d) { return std::chrono::duration<double, std::micro>(d).count(); }
+
+  std::vector<Clock::duration> latencies_;
+  Clock::time_point start_;
+  Clock::duration elapsed_ = Clock::duration::zero();
+};
+
+IDBClient *openDb(const std::string &client, const std::string &path) {
+  if (client == "memorydb") {
+    return new concord::storage::memorydb::Client(concord::storage::memorydb::KeyComparator(new KeyManipulator()));
+  }
+  if (client == "concurrent_memorydb") {
+    return new concord::storage::memorydb::ConcurrentClient(
+        concord::storage::memorydb::KeyComparator(new KeyManipulator()));
+  }
+#ifdef USE_ROCKSDB
+  if (client == "rocksdb") {
+    // as the replicas open it
+    ::rocksdb::DestroyDB(path, ::rocksdb::Options());
+    return new concord::storage::rocksdb::Client(path,
+                                                 new concord::storage::rocksdb::KeyComparator(new KeyManipulator()),
+                                                 nullptr,
+                                                 concord::storage::rocksdb::blockchainColumnFamilies());
+  }
+#else
+  (void)path;
+#endif
+  return nullptr;
+}
+
+Sliver randomSliver(std::mt19937 &gen, size_t size) {
+  auto *data = new uint8_t[size];
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = static_cast<uint8_t>(gen());
+  }
+  return Sliver(data, size);
+}
+
+// Runs the workloads on a client, and appends their results to 'results'.
+bool run(const std::string &client, const Config &config, std::vector<std::string> &results) {
+  IDBClient *db = openDb(client, config.pathPrefix + "_" + client);
+  if (!db) {
+    std::cerr << "unknown or unavailable client: " << client << std::endl;
+    return false;
+  }
+  DBAdapter adapter(db);
+  std::mt19937 gen(1);
+
+  // every key is updated in 4 blocks on average
+  std::vector<Sliver> keys;
+  for (size_t i = 0; i < config.numOfBlocks * config.keysPerBlock / 4 + 1; ++i) {
+    keys.push_back(randomSliver(gen, config.keySize));
+  }
+  Sliver value = randomSliver(gen, config.valueSize);
+  Sliver block = randomSliver(gen, 1000);
+
+  Measurement append(config.numOfBlocks);
+  append.start();
+  BlockId lastBlock = 0;
+  for (size_t i = 0; i < config.numOfBlocks; ++i) {
+    SetOfKeyValuePairs updates;
+    for (size_t j = 0; j < config.keysPerBlock; ++j) {
+      updates[keys[gen() % keys.size()]] = value;
+    }
+    auto opStart = Clock::now();
+    if (!adapter.addBlockAndUpdateMultiKey(updates, ++lastBlock, block).isOK()) {
+      std::cerr << client << ": failed to add block " << lastBlock << std::endl;
+      return false;
+    }
+    append.add(opStart);
+  }
+  append.stop();
+  results.push_back(append.toJson(client, "append"));
+
+  Measurement latestReads(config.numOfReads);
+  latestReads.start();
+  for (size_t i = 0; i < config.numOfReads; ++i) {
+    const Sliver &key = keys[gen() % keys.size()];
+    Sliver outValue;
+    BlockId outBlock = 0;
+    auto opStart = Clock::now();
+    adapter.getKeyByReadVersion(lastBlock, key, outValue, outBlock);
+    latestReads.add(opStart);
+  }
+  latestReads.stop();
+  results.push_back(latestReads.toJson(client, "latest_reads"));
+
+  Measurement historicalReads(config.numOfReads);
+  historicalReads.start();
+  for (size_t i = 0; i < config.numOfReads; ++i) {
+    BlockId version = gen() % lastBlock + 1;
+    const Sliver &key = keys[gen() % keys.size()];
+    Sliver outValue;
+    BlockId outBlock = 0;
+    auto opStart = Clock::now();
+    adapter.getKeyByReadVersion(version, key, outValue, outBlock);
+    historicalReads.add(opStart);
+  }
+  historicalReads.stop();
+  results.push_back(historicalReads.toJson(client, "historical_reads"));
+
+  // the read versions of the clients lag the last block by a few blocks
+  Measurement conflictProbes(config.numOfReads);
+  conflictProbes.start();
+  for (size_t i = 0; i < config.numOfReads; ++i) {
+    BlockId fromBlock = lastBlock - std::min<BlockId>(gen() % 100, lastBlock - 1);
+    const Sliver &key = keys[gen() % keys.size()];
+    Sliver outValue;
+    BlockId outBlock = 0;
+    auto opStart = Clock::now();
+    adapter.getKeyByReadVersion(lastBlock, key, outValue, outBlock);
+    volatile bool conflict = outBlock >= fromBlock;
+    (void)conflict;
+    conflictProbes.add(opStart);
+  }
+  conflictProbes.stop();
+  results.push_back(conflictProbes.toJson(client, "conflict_probes"));
+
+  const size_t readSetSize = 16;
+  Measurement batchedConflictProbes(config.numOfReads / readSetSize + 1);
+  batchedConflictProbes.start();
+  for (size_t i = 0; i < config.numOfReads / readSetSize + 1; ++i) {
+    BlockId fromBlock = lastBlock - std::min<BlockId>(gen() % 100, lastBlock - 1);
+    KeysVector readSet;
+    for (size_t j = 0; j < readSetSize; ++j) {
+      readSet.push_back(keys[gen() % keys.size()]);
+    }
+    ValuesVector outValues;
+    std::vector<BlockId> outBlocks;
+    auto opStart = Clock::now();
+    adapter.getKeysByReadVersion(lastBlock, readSet, outValues, outBlocks);
+    volatile bool conflict =
+        std::any_of(outBlocks.begin(), outBlocks.end(), [fromBlock](BlockId b) { return b >= fromBlock; });
+    (void)conflict;
+    batchedConflictProbes.add(opStart);
+  }
+  batchedConflictProbes.stop();
+  results.push_back(batchedConflictProbes.toJson(client, "batched_conflict_probes"));
+
+  // a scan of the versions of the keys, as when the latest version index is
+  // rebuilt
+  KeyManipulator manipulator;
+  Measurement iteration(config.numOfReads);
+  IDBClient::IDBClientIterator *iter = db->getIterator();
+  iteration.start();
+  auto opStart = Clock::now();
+  auto p = iter->seekAtLeast(manipulator.genDataDbKey(Sliver(), std::numeric_limits<BlockId>::max()));
+  iteration.add(opStart);
+  while (!iter->isEnd() && p.first.length() > 0 &&
+         manipulator.extractTypeFromKey(p.first) == (char)EDBKeyType::E_DB_KEY_TYPE_KEY &&
+         iteration.numOfOps() < config.numOfReads) {
+    opStart = Clock::now();
+    p = iter->next();
+    iteration.add(opStart);
+  }
+  iteration.stop();
+  db->freeIterator(iter);
+  results.push_back(iteration.toJson(client, "iteration"));
+
+  // the objects of the metadata are ids 2 and above
+  DBMetadataStorage metadata(db, KeyManipulator::generateMetadataKey);
+  std::vector<DBMetadataStorage::ObjectDesc> objects(config.objectsPerBatch + 2);
+  for (uint32_t i = 0; i < objects.size(); ++i) {
+    objects[i].id = i;
+    objects[i].maxSize = config.valueSize;
+  }
+  metadata.initMaxSizeOfObjects(objects.data(), objects.size());
+  std::vector<char> object(config.valueSize, 'm');
+  size_t numOfBatches = config.numOfReads / config.objectsPerBatch + 1;
+  Measurement metadataBatches(numOfBatches);
+  metadataBatches.start();
+  for (size_t i = 0; i < numOfBatches; ++i) {
+    opStart = Clock::now();
+    metadata.beginAtomicWriteOnlyBatch();
+    for (uint32_t id = 2; id < objects.size(); ++id) {
+      metadata.writeInBatch(id, object.data(), object.size());
+    }
+    metadata.commitAtomicWriteOnlyBatch();
+    metadataBatches.add(opStart);
+  }
+  metadataBatches.stop();
+  results.push_back(metadataBatches.toJson(client, "metadata_batches"));
+  return true;
+}
+
+std::vector<std::string> split(const std::string &s, char delimiter) {
+  std::vector<std::string> tokens;
+  std::istringstream in(s);
+  std::string token;
+  while (std::getline(in, token, delimiter)) {
+    if (!token.empty()) {
+      tokens.push_back(token);
+    }
+  }
+  return tokens;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Config config;
+#ifdef USE_ROCKSDB
+  config.clients = {"rocksdb", "memorydb", "concurrent_memorydb"};
+#else
+  config.clients = {"memorydb", "concurrent_memorydb"};
+#endif
+
+  int opt;
+  while ((opt = getopt(argc, argv, "c:b:k:s:v:r:m:p:o:")) != -1) {
+    switch (opt) {
+      case 'c':
+        config.clients = split(optarg, ',');
+        break;
+      case 'b':
+        config.numOfBlocks = std::stoull(optarg);
+        break;
+      case 'k':
+        config.keysPerBlock = std::stoull(optarg);
+        break;
+      case 's':
+        config.keySize = std::stoull(optarg);
+        break;
+      case 'v':
+        config.valueSize = std::stoull(optarg);
+        break;
+      case 'r':
+        config.numOfReads = std::stoull(optarg);
+        break;
+      case 'm':
+        config.objectsPerBatch = std::stoull(optarg);
+        break;
+      case 'p':
+        config.pathPrefix = optarg;
+        break;
+      case 'o':
+        config.outputPath = optarg;
+        break;
+      default:
+        std::cerr << "usage: " << argv[0]
+                  << " [-c clients] [-b blocks] [-k keys per block] [-s key size] [-v value size] [-r reads]"
+                     " [-m metadata objects per batch] [-p database path prefix] [-o JSON output file]"
+                  << std::endl;
+        return 1;
+    }
+  }
+  if (config.numOfBlocks == 0 || config.keysPerBlock == 0 || config.keySize == 0 || config.valueSize == 0 ||
+      config.objectsPerBatch == 0) {
+    std::cerr << "blocks, keys per block, key and value sizes and objects per batch must be positive" << std::endl;
+    return 1;
+  }
+
+  std::vector<std::string> results;
+  for (const auto &client : config.clients) {
+    if (!run(client, config, results)) {
+      return 1;
+    }
+  }
+
+  std::ostringstream json;
+  json << "{\n  \"config\": {\"blocks\": " << config.numOfBlocks << ", \"keys_per_block\": " << config.keysPerBlock
+       << ", \"key_size\": " << config.keySize << ", \"value_size\": " << config.valueSize
+       << ", \"reads\": " << config.numOfReads << ", \"objects_per_batch\": " << config.objectsPerBatch
+       << "},\n  \"results\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    json << (i ? ",\n    " : "\n    ") << results[i];
+  }
+  json << "\n  ]\n}\n";
+
+  // the logs go to stdout too
+  if (config.outputPath == "-") {
+    std::cout << json.str();
+    return 0;
+  }
+  std::ofstream out(config.outputPath);
+  out << json.str();
+  if (!out) {
+    std::cerr << "failed to write " << config.outputPath << std::endl;
+    return 1;
+  }
+  std::cout << "results written to " << config.outputPath << std::endl;
+  return 0;
+}
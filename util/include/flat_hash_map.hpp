@@ -0,0 +1,359 @@
+// Copyright 2019 VMware, all rights reserved
+
+/**
+ * FlatHashMap -- An open addressing hash map.
+ *
+ * The entries are stored in one array, probed linearly from the slot of their
+ * hash, instead of in a node each as in std::unordered_map: filling a map
+ * costs a few allocations as it grows, or one after reserve(), and a lookup
+ * reads adjacent memory. A byte per slot tells whether it is empty, erased, or
+ * full, with 7 bits of the hash of its key: most of the keys probed are told
+ * apart without being compared.
+ *
+ * The interface is the part of std::unordered_map's that the key-value sets
+ * use. Unlike std::unordered_map, an insertion that grows the map invalidates
+ * the iterators and the references to its entries. Erasing an entry doesn't.
+ * The iteration order depends on the hashes and the history of the map, as
+ * for std::unordered_map: maps filled in the same way iterate in the same
+ * order.
+ */
+
+#ifndef CONCORD_BFT_UTIL_FLAT_HASH_MAP_HPP_
+#define CONCORD_BFT_UTIL_FLAT_HASH_MAP_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace concordUtils {
+
+template <typename K, typename V, typename Hash = std::hash<K>, typename KeyEqual = std::equal_to<K>>
+class FlatHashMap {
+ public:
+  typedef K key_type;
+  typedef V mapped_type;
+  typedef std::pair<const K, V> value_type;
+  typedef size_t size_type;
+  typedef Hash hasher;
+  typedef KeyEqual key_equal;
+
+  template <bool IsConst>
+  class Iterator {
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef typename FlatHashMap::value_type value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef typename std::conditional<IsConst, const value_type*, value_type*>::type pointer;
+    typedef typename std::conditional<IsConst, const value_type&, value_type&>::type reference;
+
+    Iterator() : map_(nullptr), index_(0) {}
+    // an iterator converts to a const_iterator
+    template <bool WasConst, typename = typename std::enable_if<IsConst && !WasConst>::type>
+    Iterator(const Iterator<WasConst>& other) : map_(other.map_), index_(other.index_) {}
+
+    reference operator*() const { return map_->slot(index_); }
+    pointer operator->() const { return &map_->slot(index_); }
+    Iterator& operator++() {
+      index_ = map_->nextFull(index_ + 1);
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator previous = *this;
+      ++*this;
+      return previous;
+    }
+    bool operator==(const Iterator& other) const { return index_ == other.index_ && map_ == other.map_; }
+    bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+   private:
+    typedef typename std::conditional<IsConst, const FlatHashMap*, FlatHashMap*>::type MapPtr;
+
+    Iterator(MapPtr map, size_t index) : map_(map), index_(index) {}
+
+    MapPtr map_;
+    size_t index_;
+
+    friend class FlatHashMap;
+    friend class Iterator<!IsConst>;
+  };
+  typedef Iterator<false> iterator;
+  typedef Iterator<true> const_iterator;
+
+  FlatHashMap() = default;
+  FlatHashMap(std::initializer_list<value_type> entries) {
+    reserve(entries.size());
+    for (const auto& entry : entries) {
+      insert(entry);
+    }
+  }
+  FlatHashMap(const FlatHashMap& other) : hash_(other.hash_), equal_(other.equal_) {
+    reserve(other.size_);
+    for (const auto& entry : other) {
+      insert(entry);
+    }
+  }
+  FlatHashMap(FlatHashMap&& other) noexcept { swap(other); }
+  FlatHashMap& operator=(const FlatHashMap& other) {
+    if (this != &other) {
+      FlatHashMap copy(other);
+      swap(copy);
+    }
+    return *this;
+  }
+  FlatHashMap& operator=(FlatHashMap&& other) noexcept {
+    if (this != &other) {
+      clear();
+      swap(other);
+    }
+    return *this;
+  }
+  ~FlatHashMap() { destroyAll(); }
+
+  void swap(FlatHashMap& other) noexcept {
+    std::swap(ctrl_, other.ctrl_);
+    std::swap(slots_, other.slots_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(size_, other.size_);
+    std::swap(erased_, other.erased_);
+    std::swap(hash_, other.hash_);
+    std::swap(equal_, other.equal_);
+  }
+
+  iterator begin() { return iterator(this, nextFull(0)); }
+  iterator end() { return iterator(this, capacity_); }
+  const_iterator begin() const { return const_iterator(this, nextFull(0)); }
+  const_iterator end() const { return const_iterator(this, capacity_); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Keeps the memory of the map.
+  void clear() {
+    for (size_t i = 0; i < capacity_; ++i) {
+      if (isFull(ctrl_[i])) {
+        slot(i).~value_type();
+      }
+      ctrl_[i] = kEmpty;
+    }
+    size_ = 0;
+    erased_ = 0;
+  }
+
+  // Makes room for 'count' entries without growing.
+  void reserve(size_t count) {
+    size_t capacity = kMinCapacity;
+    while (count > maxLoad(capacity)) {
+      capacity *= 2;
+    }
+    if (capacity > capacity_) {
+      rehash(capacity);
+    }
+  }
+
+  iterator find(const K& key) { return iterator(this, findIndex(key)); }
+  const_iterator find(const K& key) const { return const_iterator(this, findIndex(key)); }
+  size_t count(const K& key) const { return findIndex(key) == capacity_ ? 0 : 1; }
+
+  V& at(const K& key) {
+    size_t index = findIndex(key);
+    if (index == capacity_) {
+      throw std::out_of_range("FlatHashMap::at");
+    }
+    return slot(index).second;
+  }
+  const V& at(const K& key) const {
+    size_t index = findIndex(key);
+    if (index == capacity_) {
+      throw std::out_of_range("FlatHashMap::at");
+    }
+    return slot(index).second;
+  }
+
+  V& operator[](const K& key) { return emplace(key, V()).first->second; }
+
+  std::pair<iterator, bool> insert(const value_type& entry) { return emplace(entry.first, entry.second); }
+  template <typename P, typename = typename std::enable_if<std::is_constructible<value_type, P&&>::value>::type>
+  std::pair<iterator, bool> insert(P&& entry) {
+    return emplace(std::forward<P>(entry).first, std::forward<P>(entry).second);
+  }
+  template <typename InputIt>
+  void insert(InputIt first, InputIt last) {
+    for (; first != last; ++first) {
+      insert(*first);
+    }
+  }
+
+  // Inserts an entry, unless the key is present: 'value' is then unused.
+  template <typename KeyArg, typename ValueArg>
+  std::pair<iterator, bool> emplace(KeyArg&& key, ValueArg&& value) {
+    size_t hash = hash_(key);
+    size_t index = findIndex(key, hash);
+    if (index != capacity_) {
+      return std::make_pair(iterator(this, index), false);
+    }
+    if (size_ + erased_ + 1 > maxLoad(capacity_)) {
+      // erased slots are reclaimed first, without growing
+      rehash(size_ + 1 > maxLoad(capacity_) / 2 ? std::max(capacity_ * 2, kMinCapacity) : capacity_);
+    }
+    index = insertIndex(hash);
+    if (ctrl_[index] == kErased) {
+      --erased_;
+    }
+    new (&slot(index)) value_type(std::forward<KeyArg>(key), std::forward<ValueArg>(value));
+    ctrl_[index] = tag(hash);
+    ++size_;
+    return std::make_pair(iterator(this, index), true);
+  }
+
+  size_t erase(const K& key) {
+    size_t index = findIndex(key);
+    if (index == capacity_) {
+      return 0;
+    }
+    eraseAt(index);
+    return 1;
+  }
+  iterator erase(const_iterator it) {
+    eraseAt(it.index_);
+    return iterator(this, nextFull(it.index_ + 1));
+  }
+
+  bool operator==(const FlatHashMap& other) const {
+    if (size_ != other.size_) {
+      return false;
+    }
+    for (const auto& entry : *this) {
+      auto found = other.find(entry.first);
+      if (found == other.end() || !(found->second == entry.second)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  bool operator!=(const FlatHashMap& other) const { return !(*this == other); }
+
+ private:
+  typedef typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type Slot;
+
+  static constexpr uint8_t kEmpty = 0x80;
+  static constexpr uint8_t kErased = 0xFE;
+  static constexpr size_t kMinCapacity = 8;
+
+  // full slots hold the low 7 bits of their hash
+  static bool isFull(uint8_t ctrl) { return (ctrl & 0x80) == 0; }
+  static uint8_t tag(size_t hash) { return static_cast<uint8_t>(hash & 0x7F); }
+  // a table is at most 7/8 full, counting the erased slots
+  static size_t maxLoad(size_t capacity) { return capacity - capacity / 8; }
+  // the bits of the tag don't select the first slot
+  size_t firstIndex(size_t hash) const { return (hash >> 7) & (capacity_ - 1); }
+
+  value_type& slot(size_t index) { return *reinterpret_cast<value_type*>(&slots_[index]); }
+  const value_type& slot(size_t index) const { return *reinterpret_cast<const value_type*>(&slots_[index]); }
+
+  size_t nextFull(size_t index) const {
+    while (index < capacity_ && !isFull(ctrl_[index])) {
+      ++index;
+    }
+    return index;
+  }
+
+  size_t findIndex(const K& key) const { return capacity_ == 0 ? capacity_ : findIndex(key, hash_(key)); }
+  size_t findIndex(const K& key, size_t hash) const {
+    if (capacity_ == 0) {
+      return capacity_;
+    }
+    const uint8_t keyTag = tag(hash);
+    for (size_t index = firstIndex(hash);; index = (index + 1) & (capacity_ - 1)) {
+      if (ctrl_[index] == kEmpty) {
+        return capacity_;
+      }
+      if (ctrl_[index] == keyTag && equal_(slot(index).first, key)) {
+        return index;
+      }
+    }
+  }
+
+  // The first empty or erased slot on the probe sequence of 'hash'.
+  size_t insertIndex(size_t hash) const {
+    size_t index = firstIndex(hash);
+    while (isFull(ctrl_[index])) {
+      index = (index + 1) & (capacity_ - 1);
+    }
+    return index;
+  }
+
+  void eraseAt(size_t index) {
+    slot(index).~value_type();
+    // an empty slot ends the probes: it can stay empty if its next one is
+    if (ctrl_[(index + 1) & (capacity_ - 1)] == kEmpty) {
+      ctrl_[index] = kEmpty;
+    } else {
+      ctrl_[index] = kErased;
+      ++erased_;
+    }
+    --size_;
+  }
+
+  void rehash(size_t capacity) {
+    std::unique_ptr<uint8_t[]> ctrl(new uint8_t[capacity]);
+    std::unique_ptr<Slot[]> slots(new Slot[capacity]);
+    std::fill(ctrl.get(), ctrl.get() + capacity, kEmpty);
+    std::swap(ctrl, ctrl_);
+    std::swap(slots, slots_);
+    const size_t oldCapacity = capacity_;
+    capacity_ = capacity;
+    size_ = 0;
+    erased_ = 0;
+    for (size_t i = 0; i < oldCapacity; ++i) {
+      if (isFull(ctrl[i])) {
+        value_type& entry = reinterpret_cast<value_type&>(slots[i]);
+        size_t hash = hash_(entry.first);
+        size_t index = insertIndex(hash);
+        // the entry is destroyed right after: its key can be moved
+        new (&slot(index)) value_type(std::move(const_cast<K&>(entry.first)), std::move(entry.second));
+        ctrl_[index] = tag(hash);
+        ++size_;
+        entry.~value_type();
+      }
+    }
+  }
+
+  void destroyAll() {
+    if (!std::is_trivially_destructible<value_type>::value) {
+      for (size_t i = 0; i < capacity_; ++i) {
+        if (isFull(ctrl_[i])) {
+          slot(i).~value_type();
+        }
+      }
+    }
+  }
+
+  std::unique_ptr<uint8_t[]> ctrl_;
+  std::unique_ptr<Slot[]> slots_;
+  size_t capacity_ = 0;
+  size_t size_ = 0;
+  size_t erased_ = 0;
+  Hash hash_;
+  KeyEqual equal_;
+};
+
+template <typename K, typename V, typename H, typename E>
+constexpr uint8_t FlatHashMap<K, V, H, E>::kEmpty;
+template <typename K, typename V, typename H, typename E>
+constexpr uint8_t FlatHashMap<K, V, H, E>::kErased;
+template <typename K, typename V, typename H, typename E>
+constexpr size_t FlatHashMap<K, V, H, E>::kMinCapacity;
+
+}  // namespace concordUtils
+
+#endif  // CONCORD_BFT_UTIL_FLAT_HASH_MAP_HPP_
@@ -6,11 +6,84 @@
 #define CONCORD_BFT_UTIL_HASH_DEFS_H_
 
 #include <stdlib.h>
+#include <cstring>
 #include "sliver.hpp"
 #include "kv_types.hpp"
 
 namespace concordUtils {
 
+namespace detail {
+
+__extension__ typedef unsigned __int128 uint128_t;
+
+// The 128 bits product of a and b, folded to 64 bits
+inline uint64_t hashMix(uint64_t a, uint64_t b) {
+  uint128_t r = static_cast<uint128_t>(a) * b;
+  return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+}
+
+inline uint64_t read64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+}  // namespace detail
+
+// Hashes 8 bytes at a time, after wyhash: inputs of up to 16 bytes, as most
+// keys are, take two or three multiplications. Not a cryptographic hash, nor
+// a stable one: the hashes aren't to be persisted.
+inline size_t hashBytes(const uint8_t *data, const size_t len, uint64_t seed = 0) {
+  using detail::hashMix;
+  using detail::read32;
+  using detail::read64;
+  const uint64_t s0 = 0xa0761d6478bd642full, s1 = 0xe7037ed1a0b428dbull, s2 = 0x8ebc6af09c88c6e3ull,
+                 s3 = 0x589965cc75374cc3ull;
+  const uint8_t *p = data;
+  uint64_t a, b;
+  seed ^= hashMix(seed ^ s0, s1);
+  if (len <= 16) {
+    if (len >= 4) {
+      // two overlapping reads of 4 bytes at each end
+      const size_t shift = (len >> 3) << 2;
+      a = (read32(p) << 32) | read32(p + shift);
+      b = (read32(p + len - 4) << 32) | read32(p + len - 4 - shift);
+    } else if (len > 0) {
+      a = (static_cast<uint64_t>(p[0]) << 16) | (static_cast<uint64_t>(p[len >> 1]) << 8) | p[len - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = hashMix(read64(p) ^ s1, read64(p + 8) ^ seed);
+        see1 = hashMix(read64(p + 16) ^ s2, read64(p + 24) ^ see1);
+        see2 = hashMix(read64(p + 32) ^ s3, read64(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = hashMix(read64(p) ^ s1, read64(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = read64(p + i - 16);
+    b = read64(p + i - 8);
+  }
+  return static_cast<size_t>(hashMix(s1 ^ len, hashMix(a ^ s1, b ^ seed)));
+}
+
 // TODO(GG): do we want this hash function ? See also
 // http://www.cse.yorku.ca/~oz/hash.html
 inline size_t simpleHash(const uint8_t *data, const size_t len) {
@@ -34,7 +107,7 @@ struct hash<concordUtils::Sliver> {
   typedef std::size_t result_type;
 
   result_type operator()(const concordUtils::Sliver &t) const {
-    return concordUtils::simpleHash(t.data(), t.length());
+    return concordUtils::hashBytes(t.data(), t.length());
   }
 };
 
@@ -44,7 +117,7 @@ struct hash<concordUtils::KeyValuePair> {
   typedef std::size_t result_type;
 
   result_type operator()(const concordUtils::KeyValuePair &t) const {
-    size_t keyHash = concordUtils::simpleHash(t.first.data(), t.first.length());
+    size_t keyHash = concordUtils::hashBytes(t.first.data(), t.first.length());
     return keyHash;
   }
 };
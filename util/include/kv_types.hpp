@@ -13,8 +13,8 @@
 #ifndef CONCORD_BFT_UTIL_KV_TYPES_H_
 #define CONCORD_BFT_UTIL_KV_TYPES_H_
 
-#include <unordered_map>
 #include <vector>
+#include "flat_hash_map.hpp"
 #include "sliver.hpp"
 
 namespace concordUtils {
@@ -22,7 +22,7 @@ namespace concordUtils {
 typedef Sliver Key;
 typedef Sliver Value;
 typedef std::pair<Key, Value> KeyValuePair;
-typedef std::unordered_map<Key, Value> SetOfKeyValuePairs;
+typedef FlatHashMap<Key, Value> SetOfKeyValuePairs;
 typedef std::vector<Key> KeysVector;
 typedef KeysVector ValuesVector;
 typedef uint64_t BlockId;
@@ -14,13 +14,26 @@
  * it, and cleaned up once the base sliver and all sub-slivers have finished
  * using it.
  *
- * Intentionally copyable (via default copy constructor and assignment
- * operator). Copying the shared_ptr increases its reference count by one, so
- * that it is not released until both copies go out of scope.
+ * A buffer owned by something else, e.g. a database, can be shared with the
+ * `Sliver(std::shared_ptr<uint8_t> data, size_t length)` constructor: `data`
+ * is then made with the aliasing constructor of std::shared_ptr, pointing
+ * into the buffer while keeping its owner alive.
  *
- * Intentionally movable (via default move constructor and assignment
- * operator). Moving the shared_ptr avoids modifying its reference count, which
- * requires an atomic operation that might be considered expensive.
+ * Short byte strings made with `Sliver::copy` are kept inline, in the sliver
+ * itself, instead of in a shared buffer: they cost no allocation, and their
+ * copies no reference counting. The data of an inline sliver moves with it,
+ * and copies of it don't share their data: don't keep its data() across a
+ * move, or write through it to reach the copies.
+ *
+ * Slivers with a common lifetime, like the keys and values of a batch, can
+ * share the chunks of a `SliverArena` instead of a buffer each.
+ *
+ * Intentionally copyable. Copying the shared_ptr increases its reference
+ * count by one, so that it is not released until both copies go out of scope.
+ *
+ * Intentionally movable. Moving the shared_ptr avoids modifying its reference
+ * count, which requires an atomic operation that might be considered
+ * expensive.
  */
 
 #ifndef CONCORD_BFT_UTIL_SLIVER_HPP_
@@ -33,6 +46,9 @@ namespace concordUtils {
 
 class Sliver {
  public:
+  // The longest data copy() keeps inline
+  static constexpr size_t kInlineCapacity = 31;
+
   Sliver();
   Sliver(uint8_t* data, const size_t length);
   Sliver(char* data, const size_t length);
@@ -40,15 +56,29 @@ class Sliver {
   Sliver(const uint8_t* data, const size_t length);
   Sliver(const char* data, const size_t length);
   Sliver(const std::string& s):Sliver(s.data(), s.length()){}
+  Sliver(std::shared_ptr<uint8_t> data, const size_t length);
   static Sliver copy(uint8_t* data, const size_t length);
   static Sliver copy(char* data, const size_t length);
+  static Sliver copy(const uint8_t* data, const size_t length);
+
+  Sliver(const Sliver& other);
+  Sliver(Sliver&& other) noexcept;
+  Sliver& operator=(const Sliver& other);
+  Sliver& operator=(Sliver&& other) noexcept;
+  ~Sliver();
 
   uint8_t operator[](const size_t offset) const;
 
   Sliver subsliver(const size_t offset, const size_t length) const;
 
-  size_t length() const;
-  uint8_t* data() const;
+  size_t length() const { return m_isInline ? m_inline.length : m_shared.length; }
+  // Remember that the Sliver (or its base) still owns the data, so ensure that
+  // the lifetime of this Sliver (or its base) is at least as long as the
+  // lifetime of the returned pointer.
+  uint8_t* data() const {
+    return m_isInline ? const_cast<uint8_t*>(m_inline.bytes) : m_shared.data.get() + m_shared.offset;
+  }
+  bool isInline() const { return m_isInline; }
 
   std::ostream& operator<<(std::ostream& s) const;
   bool operator==(const Sliver& other) const;
@@ -56,11 +86,28 @@ class Sliver {
   int compare(const Sliver& other) const;
 
  private:
+  struct Shared {
+    std::shared_ptr<uint8_t> data;
+    size_t offset;
+    size_t length;
+  };
+  struct Inline {
+    uint8_t bytes[kInlineCapacity];
+    uint8_t length;
+  };
+
+  void initShared(std::shared_ptr<uint8_t>&& data, const size_t offset, const size_t length);
+  void initFrom(const Sliver& other);
+  void initFrom(Sliver&& other);
+  void destroy();
+
   // these are never modified, but need to be non-const to support copy
   // assignment
-  std::shared_ptr<uint8_t> m_data;
-  size_t m_offset;
-  size_t m_length;
+  union {
+    Shared m_shared;
+    Inline m_inline;
+  };
+  bool m_isInline;
 
   // Delete new and delete, to force the Sliver to be allocated on the stack, so
   // that it is cleaned up properly via RAII scoping.
@@ -72,6 +119,31 @@ class Sliver {
 
 std::ostream& operator<<(std::ostream& s, const Sliver& sliver);
 
+// Copies bytes into chunks shared by the slivers made from them: a sliver
+// costs no allocation of its own, and a chunk is freed with its last sliver.
+// A sliver keeps its whole chunk alive, so the slivers of an arena should go
+// away together. Not thread safe.
+class SliverArena {
+ public:
+  static constexpr size_t kDefaultChunkSize = 64 * 1024;
+
+  explicit SliverArena(const size_t chunkSize = kDefaultChunkSize) : m_chunkSize(chunkSize), m_used(chunkSize) {}
+
+  // Short data is kept inline, and data larger than a quarter of a chunk in
+  // a buffer of its own.
+  Sliver copy(const uint8_t* data, const size_t length);
+  // Starts a new chunk: the slivers of the previous ones stay valid.
+  void reset() {
+    m_chunk = Sliver();
+    m_used = m_chunkSize;
+  }
+
+ private:
+  Sliver m_chunk;
+  const size_t m_chunkSize;
+  size_t m_used;
+};
+
 bool copyToAndAdvance(uint8_t* _buf, size_t* _offset, size_t _maxOffset,
                       uint8_t* _src, size_t _srcSize);
 
@@ -13,15 +13,19 @@
 #include <cstring>
 #include <ios>
 #include <memory>
+#include <new>
 
 #include "hex_tools.h"
 
 namespace concordUtils {
 
+constexpr size_t Sliver::kInlineCapacity;
+constexpr size_t SliverArena::kDefaultChunkSize;
+
 /**
  * Create an empty sliver.
  */
-Sliver::Sliver() : m_data(nullptr), m_offset(0), m_length(0) {}
+Sliver::Sliver() : m_isInline(false) { initShared(nullptr, 0, 0); }
 
 /**
  * Create a new sliver that will own the memory pointed to by `data`, which is
@@ -30,69 +34,164 @@ Sliver::Sliver() : m_data(nullptr), m_offset(0), m_length(0) {}
  * Important: the `data` buffer should have been allocated with `new`, and not
  * `malloc`, because the shared pointer will use `delete` and not `free`.
  */
-Sliver::Sliver(uint8_t* data, const size_t length)
-    : m_data(data, std::default_delete<uint8_t[]>()),
-      m_offset(0),
-      m_length(length) {
+Sliver::Sliver(uint8_t* data, const size_t length) : m_isInline(false) {
+  initShared(std::shared_ptr<uint8_t>(data, std::default_delete<uint8_t[]>()), 0, length);
   // Data must be non-null.
   assert(data);
 }
 
-Sliver::Sliver(char* data, const size_t length)
-    : m_data(reinterpret_cast<uint8_t*>(data),
-             std::default_delete<uint8_t[]>()),
-      m_offset(0),
-      m_length(length) {
+Sliver::Sliver(char* data, const size_t length) : m_isInline(false) {
+  initShared(std::shared_ptr<uint8_t>(reinterpret_cast<uint8_t*>(data), std::default_delete<uint8_t[]>()),
+             0,
+             length);
   // Data must be non-null.
   assert(data);
 }
 /**
  * not owning semantics - empty deleter
  */
-Sliver::Sliver(const uint8_t* data, const size_t length)
-    : m_data(const_cast<uint8_t*>(data), [](uint8_t[]){}),
-      m_offset(0),
-      m_length(length) {
+Sliver::Sliver(const uint8_t* data, const size_t length) : m_isInline(false) {
+  initShared(std::shared_ptr<uint8_t>(const_cast<uint8_t*>(data), [](uint8_t[]) {}), 0, length);
   // Data must be non-null.
   assert(data);
 }
 /**
  * not owning semantics - empty deleter
  */
-Sliver::Sliver(const char* data, const size_t length)
-    : m_data(reinterpret_cast<uint8_t*>(const_cast<char*>(data)),[](uint8_t []){}),
-      m_offset(0),
-      m_length(length) {
+Sliver::Sliver(const char* data, const size_t length) : m_isInline(false) {
+  initShared(std::shared_ptr<uint8_t>(reinterpret_cast<uint8_t*>(const_cast<char*>(data)), [](uint8_t[]) {}),
+             0,
+             length);
   // Data must be non-null.
   assert(data);
 }
 
 /**
- * Create a sub-sliver that references a region of a base sliver.
+ * Create a sliver that shares the ownership of `data`, which is `length` bytes
+ * in size.
+ */
+Sliver::Sliver(std::shared_ptr<uint8_t> data, const size_t length) : m_isInline(false) {
+  initShared(std::move(data), 0, length);
+  // Data must be non-null.
+  assert(m_shared.data);
+}
+
+/**
+ * Create a sub-sliver that references a region of a base sliver. The
+ * sub-slivers of an inline sliver are inline too.
  */
-Sliver::Sliver(const Sliver& base, const size_t offset, const size_t length)
-    : m_data(base.m_data),
-      // This sliver starts offset bytes from the offset of its base.
-      m_offset(base.m_offset + offset),
-      m_length(length) {
+Sliver::Sliver(const Sliver& base, const size_t offset, const size_t length) : m_isInline(base.m_isInline) {
   // This sliver must start no later than the end of the base sliver.
-  assert(offset <= base.m_length);
+  assert(offset <= base.length());
   // This sliver must end no later than the end of the base sliver.
-  assert(length <= base.m_length - offset);
+  assert(length <= base.length() - offset);
+
+  if (m_isInline) {
+    memcpy(m_inline.bytes, base.m_inline.bytes + offset, length);
+    m_inline.length = static_cast<uint8_t>(length);
+  } else {
+    // This sliver starts offset bytes from the offset of its base.
+    initShared(std::shared_ptr<uint8_t>(base.m_shared.data), base.m_shared.offset + offset, length);
+  }
+}
+
+Sliver::Sliver(const Sliver& other) : m_isInline(false) { initFrom(other); }
+
+Sliver::Sliver(Sliver&& other) noexcept : m_isInline(false) { initFrom(std::move(other)); }
+
+Sliver& Sliver::operator=(const Sliver& other) {
+  if (m_isInline && other.m_isInline) {
+    m_inline = other.m_inline;
+  } else if (this != &other) {
+    // other may be owned by the data of this sliver
+    Sliver copy(other);
+    destroy();
+    initFrom(std::move(copy));
+  }
+  return *this;
+}
+
+Sliver& Sliver::operator=(Sliver&& other) noexcept {
+  if (m_isInline && other.m_isInline) {
+    m_inline = other.m_inline;
+  } else if (this != &other) {
+    Sliver moved(std::move(other));
+    destroy();
+    initFrom(std::move(moved));
+  }
+  return *this;
+}
+
+Sliver::~Sliver() { destroy(); }
+
+void Sliver::initShared(std::shared_ptr<uint8_t>&& data, const size_t offset, const size_t length) {
+  new (&m_shared) Shared{std::move(data), offset, length};
+  m_isInline = false;
+}
+
+void Sliver::initFrom(const Sliver& other) {
+  if (other.m_isInline) {
+    m_inline = other.m_inline;
+    m_isInline = true;
+  } else {
+    initShared(std::shared_ptr<uint8_t>(other.m_shared.data), other.m_shared.offset, other.m_shared.length);
+  }
+}
+
+void Sliver::initFrom(Sliver&& other) {
+  if (other.m_isInline) {
+    m_inline = other.m_inline;
+    m_isInline = true;
+  } else {
+    initShared(std::move(other.m_shared.data), other.m_shared.offset, other.m_shared.length);
+  }
+}
+
+void Sliver::destroy() {
+  if (!m_isInline) {
+    m_shared.~Shared();
+  }
 }
 
 /**
  * Create a sliver from a copy of the memory pointed to by `data`, which is
- * `length` bytes in size.
+ * `length` bytes in size. Up to kInlineCapacity bytes are kept inline.
  */
+Sliver Sliver::copy(const uint8_t* data, const size_t length) {
+  if (length > kInlineCapacity) {
+    auto* copy = new uint8_t[length];
+    memcpy(copy, data, length);
+    return Sliver(copy, length);
+  }
+  Sliver copy;
+  copy.destroy();
+  if (length > 0) {
+    memcpy(copy.m_inline.bytes, data, length);
+  }
+  copy.m_inline.length = static_cast<uint8_t>(length);
+  copy.m_isInline = true;
+  return copy;
+}
+
 Sliver Sliver::copy(uint8_t* data, const size_t length) {
-   auto* copy = new uint8_t[length];
-   memcpy(copy, data, length);
-   return Sliver(copy, length);
+  return Sliver::copy(const_cast<const uint8_t*>(data), length);
 }
 
 Sliver Sliver::copy(char* data, const size_t length) {
-  return Sliver::copy(reinterpret_cast<uint8_t*>(data), length);
+  return Sliver::copy(reinterpret_cast<const uint8_t*>(data), length);
+}
+
+Sliver SliverArena::copy(const uint8_t* data, const size_t length) {
+  if (length <= Sliver::kInlineCapacity || length > m_chunkSize / 4) {
+    return Sliver::copy(data, length);
+  }
+  if (m_used + length > m_chunkSize) {
+    m_chunk = Sliver(new uint8_t[m_chunkSize], m_chunkSize);
+    m_used = 0;
+  }
+  memcpy(m_chunk.data() + m_used, data, length);
+  m_used += length;
+  return Sliver(m_chunk, m_used - length, length);
 }
 
 /**
@@ -100,20 +199,13 @@ Sliver Sliver::copy(char* data, const size_t length) {
  */
 uint8_t Sliver::operator[](const size_t offset) const {
   // This offset must be within this sliver.
-  assert(offset < m_length);
+  assert(offset < length());
 
   // The data for the requested offset is that many bytes after the offset from
   // the base sliver.
-  return m_data.get()[m_offset + offset];
+  return data()[offset];
 }
 
-/**
- * Get a direct pointer to the data for this sliver. Remember that the Sliver
- * (or its base) still owns the data, so ensure that the lifetime of this Sliver
- * (or its base) is at least as long as the lifetime of the returned pointer.
- */
-uint8_t* Sliver::data() const { return m_data.get() + m_offset; }
-
 /**
  * Create a subsliver. Syntactic sugar for cases where a function call is more
  * natural than using the sub-sliver constructor directly.
@@ -122,8 +214,6 @@ Sliver Sliver::subsliver(const size_t offset, const size_t length) const {
   return Sliver(*this, offset, length);
 }
 
-size_t Sliver::length() const { return m_length; }
-
 std::ostream& Sliver::operator<<(std::ostream& s) const {
   return hexPrint(s, data(), length());
 }
@@ -0,0 +1,139 @@
+// Copyright 2019 VMware, all rights reserved
+/**
+ * Costs of the hashes of slivers, word at a time and the former byte at a
+ * time, and of FlatHashMap and std::unordered_map filled, iterated and read as
+ * the block write path does. Each measure is run over several rounds and the
+ * fastest one reported.
+ *
+ * usage: flat_hash_map_benchmark [-n keys] [-b updates per block] [-r rounds]
+ */
+
+#include "flat_hash_map.hpp"
+#include "hash_defs.h"
+#include "kv_types.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+
+using concordUtils::KeyValuePair;
+using concordUtils::SetOfKeyValuePairs;
+using concordUtils::Sliver;
+
+namespace {
+
+Sliver sliverOf(std::string s) { return Sliver::copy(&s[0], s.length()); }
+
+void measure(const std::string &name, size_t ops, size_t rounds, const std::function<void()> &run) {
+  double nanos = std::numeric_limits<double>::max();
+  for (size_t round = 0; round < rounds; ++round) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    nanos = std::min(nanos, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+  }
+  std::cout << "  " << std::left << std::setw(46) << name << std::fixed << std::setprecision(1) << nanos / ops
+            << " ns/op" << std::endl;
+}
+
+// Fills a map with each block of updates, then iterates it and finds its keys.
+template <typename Map>
+size_t fillIterateAndFind(const std::vector<Sliver> &keys, const Sliver &value, size_t updatesPerBlock, bool reserve) {
+  size_t found = 0;
+  for (size_t first = 0; first + updatesPerBlock <= keys.size(); first += updatesPerBlock) {
+    Map updates;
+    if (reserve) {
+      updates.reserve(updatesPerBlock);
+    }
+    for (size_t i = first; i < first + updatesPerBlock; i++) {
+      updates.insert(KeyValuePair(keys[i], value));
+    }
+    for (const auto &kv : updates) {
+      found += updates.count(kv.first);
+    }
+  }
+  return found;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  size_t numOfKeys = 100000;
+  size_t updatesPerBlock = 100;
+  size_t rounds = 5;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:b:r:")) != -1) {
+    switch (opt) {
+      case 'n':
+        numOfKeys = std::stoull(optarg);
+        break;
+      case 'b':
+        updatesPerBlock = std::stoull(optarg);
+        break;
+      case 'r':
+        rounds = std::stoull(optarg);
+        break;
+      default:
+        std::cerr << "usage: " << argv[0] << " [-n keys] [-b updates per block] [-r rounds]" << std::endl;
+        return 1;
+    }
+  }
+  if (numOfKeys == 0 || updatesPerBlock == 0 || updatesPerBlock > numOfKeys || rounds == 0) {
+    std::cerr << "keys, updates per block and rounds must be positive, with no more updates per block than keys"
+              << std::endl;
+    return 1;
+  }
+
+  size_t sum = 0;
+  for (size_t length : {size_t(21), size_t(64), size_t(4096)}) {
+    std::string bytes(length, 'k');
+    const size_t hashes = 10000000 / length;
+    std::cout << length << " bytes" << std::endl;
+    measure("byte at a time hash", hashes, rounds, [&]() {
+      for (size_t i = 0; i < hashes; i++) {
+        bytes[0] = static_cast<char>(i);
+        sum += concordUtils::simpleHash(reinterpret_cast<const uint8_t *>(bytes.data()), length);
+      }
+    });
+    measure("word at a time hash", hashes, rounds, [&]() {
+      for (size_t i = 0; i < hashes; i++) {
+        bytes[0] = static_cast<char>(i);
+        sum += concordUtils::hashBytes(reinterpret_cast<const uint8_t *>(bytes.data()), length);
+      }
+    });
+  }
+
+  std::mt19937 gen(1);
+  std::vector<Sliver> keys;
+  for (size_t i = 0; i < numOfKeys; i++) {
+    std::string key(21, '\0');
+    for (auto &c : key) {
+      c = static_cast<char>('a' + gen() % 26);
+    }
+    keys.push_back(sliverOf(key));
+  }
+  const Sliver value = sliverOf(std::string(21, 'v'));
+
+  std::cout << "blocks of " << updatesPerBlock << " updates, per update" << std::endl;
+  measure("unordered_map fill, iterate and find", numOfKeys, rounds, [&]() {
+    sum += fillIterateAndFind<std::unordered_map<Sliver, Sliver>>(keys, value, updatesPerBlock, false);
+  });
+  measure("FlatHashMap fill, iterate and find", numOfKeys, rounds, [&]() {
+    sum += fillIterateAndFind<SetOfKeyValuePairs>(keys, value, updatesPerBlock, false);
+  });
+  measure("FlatHashMap reserved, fill, iterate and find", numOfKeys, rounds, [&]() {
+    sum += fillIterateAndFind<SetOfKeyValuePairs>(keys, value, updatesPerBlock, true);
+  });
+
+  // keeps the measured work from being optimized away
+  std::cout << "checksum: " << sum << std::endl;
+  return 0;
+}
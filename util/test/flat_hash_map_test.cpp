@@ -0,0 +1,128 @@
+// Copyright 2019 VMware, all rights reserved
+/**
+ * Test the FlatHashMap class and the hash of slivers. flat_hash_map_benchmark
+ * compares them to std::unordered_map and to the former byte at a time hash.
+ */
+
+#include "flat_hash_map.hpp"
+#include "hash_defs.h"
+#include "kv_types.hpp"
+#include "gtest/gtest.h"
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+using concordUtils::FlatHashMap;
+using concordUtils::KeyValuePair;
+using concordUtils::SetOfKeyValuePairs;
+using concordUtils::Sliver;
+
+namespace {
+
+Sliver sliverOf(std::string s) { return Sliver::copy(&s[0], s.length()); }
+
+/**
+ * Test that the map behaves as std::unordered_map under random inserts,
+ * lookups and erasures.
+ */
+TEST(flat_hash_map_test, behaves_as_unordered_map) {
+  std::mt19937 gen(7);
+  FlatHashMap<uint64_t, uint64_t> map;
+  std::unordered_map<uint64_t, uint64_t> expected;
+  for (int i = 0; i < 100000; i++) {
+    uint64_t key = gen() % 2000;
+    switch (gen() % 4) {
+      case 0:
+        ASSERT_EQ(expected.insert(std::make_pair(key, i)).second, map.insert(std::make_pair(key, i)).second);
+        break;
+      case 1:
+        expected[key] = i;
+        map[key] = i;
+        break;
+      case 2:
+        ASSERT_EQ(expected.erase(key), map.erase(key));
+        break;
+      default:
+        ASSERT_EQ(expected.count(key), map.count(key));
+        if (expected.count(key)) {
+          ASSERT_EQ(expected.at(key), map.at(key));
+          ASSERT_EQ(expected[key], map.find(key)->second);
+        } else {
+          ASSERT_TRUE(map.find(key) == map.end());
+        }
+    }
+    ASSERT_EQ(expected.size(), map.size());
+  }
+  size_t iterated = 0;
+  for (const auto& kv : map) {
+    ASSERT_EQ(expected.at(kv.first), kv.second);
+    iterated++;
+  }
+  ASSERT_EQ(expected.size(), iterated);
+
+  // erasing while iterating
+  for (auto it = map.begin(); it != map.end();) {
+    it = it->first % 2 ? map.erase(it) : std::next(it);
+  }
+  for (const auto& kv : expected) {
+    ASSERT_EQ(kv.first % 2 ? 0 : 1, map.count(kv.first));
+  }
+  map.clear();
+  ASSERT_TRUE(map.empty());
+  ASSERT_TRUE(map.begin() == map.end());
+}
+
+/**
+ * Test the key-value sets of slivers: copies, moves and comparisons.
+ */
+TEST(flat_hash_map_test, sets_of_key_value_pairs) {
+  SetOfKeyValuePairs updates{{sliverOf("a"), sliverOf("1")}, {sliverOf("b"), sliverOf("2")}};
+  updates.insert(KeyValuePair(sliverOf("c"), sliverOf("3")));
+  updates[sliverOf(std::string(100, 'd'))] = sliverOf(std::string(100, '4'));
+  ASSERT_FALSE(updates.insert(KeyValuePair(sliverOf("a"), sliverOf("5"))).second);
+  ASSERT_EQ(sliverOf("1"), updates.at(sliverOf("a")));
+  ASSERT_THROW(updates.at(sliverOf("e")), std::out_of_range);
+
+  SetOfKeyValuePairs copy(updates);
+  ASSERT_TRUE(copy == updates);
+  copy[sliverOf("a")] = sliverOf("6");
+  ASSERT_TRUE(copy != updates);
+  SetOfKeyValuePairs moved(std::move(copy));
+  ASSERT_EQ(4, moved.size());
+  ASSERT_TRUE(copy.empty());
+  copy = moved;
+  ASSERT_TRUE(copy == moved);
+  ASSERT_EQ(sliverOf("6"), copy.at(sliverOf("a")));
+}
+
+/**
+ * Test that the hash of slivers tells apart inputs differing by one byte, of
+ * all the lengths its code paths handle.
+ */
+TEST(flat_hash_map_test, hash_of_slivers) {
+  std::hash<Sliver> hash;
+  std::unordered_set<size_t> hashes;
+  size_t count = 0;
+  for (size_t length = 0; length < 200; length++) {
+    std::string bytes(length, 'x');
+    ASSERT_EQ(hash(sliverOf(bytes)), hash(sliverOf(bytes)));
+    hashes.insert(hash(sliverOf(bytes)));
+    count++;
+    for (size_t i = 0; i < length; i++) {
+      std::string changed = bytes;
+      changed[i] = 'y';
+      hashes.insert(hash(sliverOf(changed)));
+      count++;
+    }
+  }
+  ASSERT_EQ(count, hashes.size());
+}
+
+}  // end namespace
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,99 @@
+// Copyright 2019 VMware, all rights reserved
+/**
+ * Costs of making, copying and releasing small slivers: in buffers of their
+ * own, inline (Sliver::copy) and from a SliverArena. Each mode is measured
+ * over several rounds, from the same state, and the fastest round reported.
+ *
+ * usage: sliver_benchmark [-n slivers] [-r rounds]
+ */
+
+#include "sliver.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using concordUtils::Sliver;
+using concordUtils::SliverArena;
+
+namespace {
+
+double nanosPerOp(size_t ops, const std::function<void()> &run) {
+  auto start = std::chrono::steady_clock::now();
+  run();
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ops;
+}
+
+void run(const std::string &name,
+         size_t numOfSlivers,
+         size_t rounds,
+         const std::function<Sliver(SliverArena &)> &make) {
+  double makeNanos = std::numeric_limits<double>::max();
+  double copyNanos = makeNanos;
+  double releaseNanos = makeNanos;
+  for (size_t round = 0; round < rounds; ++round) {
+    std::vector<Sliver> slivers;
+    slivers.reserve(numOfSlivers);
+    SliverArena arena;
+    makeNanos = std::min(makeNanos, nanosPerOp(numOfSlivers, [&]() {
+      for (size_t i = 0; i < numOfSlivers; ++i) {
+        slivers.push_back(make(arena));
+      }
+    }));
+    copyNanos = std::min(copyNanos, nanosPerOp(numOfSlivers, [&]() { std::vector<Sliver> copies(slivers); }));
+    releaseNanos = std::min(releaseNanos, nanosPerOp(numOfSlivers, [&]() { slivers = std::vector<Sliver>(); }));
+  }
+  std::cout << "  " << std::left << std::setw(8) << name << std::fixed << std::setprecision(1)
+            << " make: " << makeNanos << " ns, copy and release: " << copyNanos
+            << " ns, release: " << releaseNanos << " ns" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  size_t numOfSlivers = 200000;
+  size_t rounds = 5;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+    switch (opt) {
+      case 'n':
+        numOfSlivers = std::stoull(optarg);
+        break;
+      case 'r':
+        rounds = std::stoull(optarg);
+        break;
+      default:
+        std::cerr << "usage: " << argv[0] << " [-n slivers] [-r rounds]" << std::endl;
+        return 1;
+    }
+  }
+  if (numOfSlivers == 0 || rounds == 0) {
+    std::cerr << "slivers and rounds must be positive" << std::endl;
+    return 1;
+  }
+
+  uint8_t key[256];
+  for (size_t i = 0; i < sizeof(key); ++i) {
+    key[i] = static_cast<uint8_t>(i);
+  }
+  std::cout << "slivers: " << numOfSlivers << ", rounds: " << rounds << ", per sliver:" << std::endl;
+  for (size_t length : {size_t(21), size_t(64), size_t(200)}) {
+    std::cout << length << " bytes" << std::endl;
+    run("shared", numOfSlivers, rounds, [&](SliverArena &) {
+      auto *data = new uint8_t[length];
+      memcpy(data, key, length);
+      return Sliver(data, length);
+    });
+    run("copy()", numOfSlivers, rounds, [&](SliverArena &) { return Sliver::copy(key, length); });
+    run("arena", numOfSlivers, rounds, [&](SliverArena &arena) { return arena.copy(key, length); });
+  }
+  return 0;
+}
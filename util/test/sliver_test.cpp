@@ -10,6 +10,7 @@
 #include "sliver.hpp"
 #include "gtest/gtest.h"
 #include <iostream>
+#include <vector>
 
 using namespace std;
 using concordUtils::Sliver;
@@ -173,6 +174,67 @@ TEST(sliver_test, copying) {
   delete[] expected;
 }
 
+/**
+ * Test that short copies are inline, and behave as the shared ones.
+ */
+TEST(sliver_test, inline_copy) {
+  const size_t test_size = Sliver::kInlineCapacity;
+  uint8_t* expected = new_test_memory(test_size + 1);
+
+  Sliver actual = Sliver::copy(expected, test_size);
+  ASSERT_TRUE(actual.isInline());
+  ASSERT_TRUE(is_match(expected, test_size, actual));
+  ASSERT_FALSE(Sliver::copy(expected, test_size + 1).isInline());
+  ASSERT_EQ(Sliver::copy(expected, test_size + 1).subsliver(0, test_size), actual);
+
+  Sliver copy = actual;
+  ASSERT_TRUE(copy.isInline());
+  ASSERT_NE(actual.data(), copy.data());
+  ASSERT_EQ(actual, copy);
+
+  Sliver sub = actual.subsliver(3, 10);
+  ASSERT_TRUE(sub.isInline());
+  ASSERT_TRUE(is_match(expected + 3, 10, sub));
+
+  // assigned its own sub-sliver, inline or not
+  actual = actual.subsliver(1, 5);
+  ASSERT_TRUE(is_match(expected + 1, 5, actual));
+  Sliver shared(new_test_memory(test_size * 2), test_size * 2);
+  shared = shared.subsliver(4, 40);
+  ASSERT_TRUE(is_match(expected + 4, 20, shared.subsliver(0, 20)));
+  shared = actual;
+  ASSERT_TRUE(shared.isInline());
+  ASSERT_EQ(0, Sliver::copy(expected, 0).length());
+
+  delete[] expected;
+}
+
+/**
+ * Test that the slivers of an arena outlive it.
+ */
+TEST(sliver_test, arena_copy) {
+  const size_t test_size = 200;
+  uint8_t* expected = new_test_memory(test_size);
+
+  std::vector<Sliver> slivers;
+  {
+    concordUtils::SliverArena arena(1024);
+    for (size_t length = 1; length < test_size; length += 13) {
+      slivers.push_back(arena.copy(expected, length));
+      if (length == 92) {
+        arena.reset();
+      }
+    }
+  }
+  size_t length = 1;
+  for (const auto& sliver : slivers) {
+    ASSERT_TRUE(is_match(expected, length, sliver));
+    length += 13;
+  }
+
+  delete[] expected;
+}
+
 }  // end namespace
 
 int main(int argc, char** argv) {